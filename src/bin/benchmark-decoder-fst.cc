@@ -0,0 +1,190 @@
+// bin/benchmark-decoder-fst.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/decoder-fst.h"
+#include "decoder/lattice-faster-decoder.h"
+#include "base/timer.h"
+
+namespace kaldi {
+
+// Decodes all the utterances in 'loglikes' with the decoding graph 'fst',
+// and outputs the cost of the best path of each.  Returns the time taken by
+// the decoding (not counting getting the best paths).
+template <typename FST>
+double DecodeAllWithFst(const FST &fst,
+                        const LatticeFasterDecoderConfig &config,
+                        const TransitionModel &trans_model,
+                        BaseFloat acoustic_scale,
+                        const std::vector<Matrix<BaseFloat> > &loglikes,
+                        std::vector<double> *costs) {
+  LatticeFasterDecoderTpl<FST> decoder(fst, config);
+  costs->resize(loglikes.size());
+  double elapsed = 0.0;
+  for (size_t i = 0; i < loglikes.size(); i++) {
+    DecodableMatrixScaledMapped decodable(trans_model, loglikes[i],
+                                          acoustic_scale);
+    Timer timer;
+    decoder.Decode(&decodable);
+    elapsed += timer.Elapsed();
+    Lattice best_path;
+    decoder.GetBestPath(&best_path);
+    std::vector<int32> alignment, words;
+    LatticeWeight weight;
+    fst::GetLinearSymbolSequence(best_path, &alignment, &words, &weight);
+    (*costs)[i] = weight.Value1() + weight.Value2();
+  }
+  return elapsed;
+}
+
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::Fst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Compares the speed of decoding with a decoding graph stored as\n"
+        "ConstFst and converted to DecoderFst (see decoder/decoder-fst.h).\n"
+        "Reads the graph, converts it to both types (timing the conversions),\n"
+        "then decodes all the utterances with each, --num-repeats times,\n"
+        "alternating between the two, and prints the total decoding time and\n"
+        "real-time factor for each.  The decoding is as in\n"
+        "latgen-faster-mapped (with the same decoder options), but no\n"
+        "lattices are output; it checks that the best paths have the same\n"
+        "costs.  All the log-likelihoods are read into memory first, so\n"
+        "reading them is not timed.\n"
+        "\n"
+        "Usage: benchmark-decoder-fst [options] trans-model-in fst-in "
+        "loglikes-rspecifier\n"
+        " e.g.: benchmark-decoder-fst --acoustic-scale=1.0 final.mdl HCLG.fst "
+        "ark:loglikes.ark\n";
+    ParseOptions po(usage);
+    BaseFloat acoustic_scale = 0.1;
+    BaseFloat frame_shift = 0.01;
+    int32 num_repeats = 1;
+    LatticeFasterDecoderConfig config;
+
+    config.Register(&po);
+    po.Register("acoustic-scale", &acoustic_scale,
+                "Scaling factor for acoustic likelihoods");
+    po.Register("frame-shift", &frame_shift, "Frame shift in seconds of the "
+                "log-likelihoods, for the real-time factor (e.g. 0.03 for "
+                "chain models)");
+    po.Register("num-repeats", &num_repeats, "Number of times to decode all "
+                "the utterances with each graph");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_in_filename = po.GetArg(2),
+        loglikes_rspecifier = po.GetArg(3);
+
+    TransitionModel trans_model;
+    ReadKaldiObject(model_in_filename, &trans_model);
+
+    std::vector<Matrix<BaseFloat> > loglikes;
+    int64 num_frames = 0;
+    for (SequentialBaseFloatMatrixReader loglikes_reader(loglikes_rspecifier);
+         !loglikes_reader.Done(); loglikes_reader.Next()) {
+      if (loglikes_reader.Value().NumRows() == 0) {
+        KALDI_WARN << "Skipping zero-length utterance "
+                   << loglikes_reader.Key();
+        continue;
+      }
+      loglikes.push_back(loglikes_reader.Value());
+      num_frames += loglikes.back().NumRows();
+    }
+    if (loglikes.empty())
+      KALDI_ERR << "No utterances to decode.";
+
+    Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_filename);
+    Timer timer;
+    fst::ConstFst<StdArc> const_fst(*decode_fst);
+    double const_fst_time = timer.Elapsed();
+    timer.Reset();
+    fst::DecoderFst decoder_fst(*decode_fst);
+    double decoder_fst_time = timer.Elapsed();
+    delete decode_fst;
+    KALDI_LOG << "Converted decoding graph with " << const_fst.NumStates()
+              << " states to ConstFst in " << const_fst_time
+              << " seconds and to DecoderFst (" << decoder_fst.NumStates()
+              << " states, " << decoder_fst.NumArcs() << " arcs) in "
+              << decoder_fst_time << " seconds.";
+
+    double tot_const_fst_time = 0.0, tot_decoder_fst_time = 0.0;
+    int32 num_differ = 0;
+    for (int32 n = 0; n < num_repeats; n++) {
+      std::vector<double> const_fst_costs, decoder_fst_costs;
+      // We alternate which graph goes first, so that neither is always the
+      // one that runs with a cold cache.
+      for (int32 i = 0; i < 2; i++) {
+        if ((i + n) % 2 == 0)
+          tot_const_fst_time += DecodeAllWithFst(
+              const_fst, config, trans_model, acoustic_scale, loglikes,
+              &const_fst_costs);
+        else
+          tot_decoder_fst_time += DecodeAllWithFst(
+              decoder_fst, config, trans_model, acoustic_scale, loglikes,
+              &decoder_fst_costs);
+      }
+      if (n == 0) {
+        for (size_t u = 0; u < loglikes.size(); u++) {
+          // The words may differ where there are ties, so we only compare
+          // the costs.
+          if (!ApproxEqual(const_fst_costs[u], decoder_fst_costs[u])) {
+            KALDI_WARN << "Utterance " << u << " decoded differently with "
+                       << "ConstFst (cost " << const_fst_costs[u]
+                       << ") and DecoderFst (cost " << decoder_fst_costs[u]
+                       << ").";
+            num_differ++;
+          }
+        }
+      }
+    }
+
+    double audio_time = num_frames * frame_shift * num_repeats;
+    KALDI_LOG << "Decoded " << loglikes.size() << " utterances ("
+              << num_frames << " frames) " << num_repeats << " times.";
+    KALDI_LOG << "ConstFst: decoding took " << tot_const_fst_time
+              << " seconds, real-time factor "
+              << (tot_const_fst_time / audio_time);
+    KALDI_LOG << "DecoderFst: decoding took " << tot_decoder_fst_time
+              << " seconds, real-time factor "
+              << (tot_decoder_fst_time / audio_time) << " (speedup "
+              << (tot_const_fst_time / tot_decoder_fst_time) << ").";
+    if (num_differ != 0)
+      KALDI_WARN << num_differ << " utterances were decoded differently.";
+    return (num_differ == 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
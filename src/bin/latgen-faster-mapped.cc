@@ -29,6 +29,55 @@
 #include "decoder/decodable-matrix.h"
 #include "base/timer.h"
 
+namespace kaldi {
+
+// Decodes all the utterances in 'loglike_reader' with the single decoding
+// graph 'decode_fst'.  This is templated so that it can be used either with
+// the graph as read or with its DecoderFst version.
+template <typename FST>
+void DecodeUtterancesWithFst(const FST &decode_fst,
+                             const LatticeFasterDecoderConfig &config,
+                             const TransitionModel &trans_model,
+                             BaseFloat acoustic_scale,
+                             bool allow_partial,
+                             const fst::SymbolTable *word_syms,
+                             SequentialBaseFloatMatrixReader *loglike_reader,
+                             Int32VectorWriter *alignment_writer,
+                             Int32VectorWriter *words_writer,
+                             CompactLatticeWriter *compact_lattice_writer,
+                             LatticeWriter *lattice_writer,
+                             double *tot_like,
+                             int64 *frame_count,
+                             int *num_success,
+                             int *num_fail) {
+  LatticeFasterDecoderTpl<FST> decoder(decode_fst, config);
+
+  for (; !loglike_reader->Done(); loglike_reader->Next()) {
+    std::string utt = loglike_reader->Key();
+    Matrix<BaseFloat> loglikes (loglike_reader->Value());
+    loglike_reader->FreeCurrent();
+    if (loglikes.NumRows() == 0) {
+      KALDI_WARN << "Zero-length utterance: " << utt;
+      (*num_fail)++;
+      continue;
+    }
+
+    DecodableMatrixScaledMapped decodable(trans_model, loglikes, acoustic_scale);
+
+    double like;
+    if (DecodeUtteranceLatticeFaster(
+            decoder, decodable, trans_model, word_syms, utt,
+            acoustic_scale, config.determinize_lattice, allow_partial,
+            alignment_writer, words_writer, compact_lattice_writer,
+            lattice_writer, &like)) {
+      *tot_like += like;
+      *frame_count += loglikes.NumRows();
+      (*num_success)++;
+    } else (*num_fail)++;
+  }
+}
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -46,6 +95,7 @@ int main(int argc, char *argv[]) {
     ParseOptions po(usage);
     Timer timer;
     bool allow_partial = false;
+    bool use_decoder_fst = false;
     BaseFloat acoustic_scale = 0.1;
     LatticeFasterDecoderConfig config;
 
@@ -55,6 +105,11 @@ int main(int argc, char *argv[]) {
 
     po.Register("word-symbol-table", &word_syms_filename, "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial, "If true, produce output even if end state was not reached.");
+    po.Register("use-decoder-fst", &use_decoder_fst, "If true, convert the "
+                "decoding graph to the DecoderFst layout (see "
+                "decoder/decoder-fst.h) after reading it, which makes decoding "
+                "faster at the cost of the conversion time.  Only applies if "
+                "a single FST is given.");
 
     po.Read(argc, argv);
 
@@ -99,36 +154,31 @@ int main(int argc, char *argv[]) {
       SequentialBaseFloatMatrixReader loglike_reader(feature_rspecifier);
       // Input FST is just one FST, not a table of FSTs.
       Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_str);
-      timer.Reset();
-
-      {
-        LatticeFasterDecoder decoder(*decode_fst, config);
-
-        for (; !loglike_reader.Done(); loglike_reader.Next()) {
-          std::string utt = loglike_reader.Key();
-          Matrix<BaseFloat> loglikes (loglike_reader.Value());
-          loglike_reader.FreeCurrent();
-          if (loglikes.NumRows() == 0) {
-            KALDI_WARN << "Zero-length utterance: " << utt;
-            num_fail++;
-            continue;
-          }
-
-          DecodableMatrixScaledMapped decodable(trans_model, loglikes, acoustic_scale);
-
-          double like;
-          if (DecodeUtteranceLatticeFaster(
-                  decoder, decodable, trans_model, word_syms, utt,
-                  acoustic_scale, determinize, allow_partial, &alignment_writer,
-                  &words_writer, &compact_lattice_writer, &lattice_writer,
-                  &like)) {
-            tot_like += like;
-            frame_count += loglikes.NumRows();
-            num_success++;
-          } else num_fail++;
-        }
+      if (use_decoder_fst) {
+        Timer conversion_timer;
+        fst::DecoderFst decoder_fst(*decode_fst);
+        delete decode_fst;
+        KALDI_LOG << "Converted decoding graph to DecoderFst with "
+                  << decoder_fst.NumStates() << " states and "
+                  << decoder_fst.NumArcs() << " arcs in "
+                  << conversion_timer.Elapsed() << " seconds.";
+        timer.Reset();
+        DecodeUtterancesWithFst(decoder_fst, config, trans_model,
+                                acoustic_scale, allow_partial, word_syms,
+                                &loglike_reader, &alignment_writer,
+                                &words_writer, &compact_lattice_writer,
+                                &lattice_writer, &tot_like, &frame_count,
+                                &num_success, &num_fail);
+      } else {
+        timer.Reset();
+        DecodeUtterancesWithFst(*decode_fst, config, trans_model,
+                                acoustic_scale, allow_partial, word_syms,
+                                &loglike_reader, &alignment_writer,
+                                &words_writer, &compact_lattice_writer,
+                                &lattice_writer, &tot_like, &frame_count,
+                                &num_success, &num_fail);
+        delete decode_fst;
       }
-      delete decode_fst; // delete this only after decoder goes out of scope.
     } else { // We have different FSTs for different utterances.
       SequentialTableReader<fst::VectorFstHolder> fst_reader(fst_in_str);
       RandomAccessBaseFloatMatrixReader loglike_reader(feature_rspecifier);
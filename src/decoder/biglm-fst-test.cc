@@ -0,0 +1,100 @@
+// decoder/biglm-fst-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/biglm-fst.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/decoder-test-utils.h"
+#include "decoder/lattice-biglm-faster-decoder.h"
+#include "decoder/lattice-faster-decoder.h"
+
+namespace kaldi {
+
+// Creates a random deterministic acceptor over words 1 ... num_words with an
+// arc for each word from each state, to stand in for the LM difference.  The
+// costs may be negative, as they would be for a real LM difference.
+static void RandLmDiff(int32 num_states, int32 num_words,
+                       fst::VectorFst<fst::StdArc> *fst) {
+  typedef fst::StdArc Arc;
+  fst->DeleteStates();
+  for (int32 s = 0; s < num_states; s++)
+    fst->AddState();
+  fst->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    for (int32 w = 1; w <= num_words; w++)
+      fst->AddArc(s, Arc(w, w, RandUniform() - 0.5,
+                         RandInt(0, num_states - 1)));
+    fst->SetFinal(s, RandUniform() - 0.5);
+  }
+}
+
+// Checks that LatticeFasterDecoderTpl<fst::BiglmFst> gives the same best path
+// as LatticeBiglmFasterDecoder.
+void TestBiglmFst() {
+  int32 num_pdfs = RandInt(10, 100), num_words = RandInt(1, 50),
+      num_frames = RandInt(20, 100);
+  fst::VectorFst<fst::StdArc> graph, lm_diff;
+  RandDecodingGraph(RandInt(10, 1000), num_pdfs, num_words, &graph);
+  RandLmDiff(RandInt(1, 20), num_words, &lm_diff);
+
+  Matrix<BaseFloat> loglikes(num_frames, num_pdfs);
+  loglikes.SetRandn();
+  DecodableMatrixScaled decodable(loglikes, 1.0);
+  LatticeFasterDecoderConfig config;
+  config.beam = 1000.0;
+  config.max_active = std::numeric_limits<int32>::max();
+
+  std::vector<int32> alignment, words, alignment2, words2;
+  LatticeWeight weight = LatticeWeight::Zero(),
+      weight2 = LatticeWeight::Zero();
+  bool ans, ans2;
+  {
+    fst::BackoffDeterministicOnDemandFst<fst::StdArc> lm_diff_dfst(lm_diff);
+    LatticeBiglmFasterDecoder decoder(graph, config, &lm_diff_dfst);
+    decoder.Decode(&decodable);
+    Lattice best_path;
+    ans = decoder.GetBestPath(&best_path);
+    if (ans)
+      fst::GetLinearSymbolSequence(best_path, &alignment, &words, &weight);
+  }
+  {
+    fst::BackoffDeterministicOnDemandFst<fst::StdArc> lm_diff_dfst(lm_diff);
+    fst::CacheDeterministicOnDemandFst<fst::StdArc> cache_dfst(&lm_diff_dfst);
+    fst::BiglmFst biglm_fst(graph, &cache_dfst);
+    LatticeFasterDecoderTpl<fst::BiglmFst> decoder(biglm_fst, config);
+    decoder.Decode(&decodable);
+    Lattice best_path;
+    ans2 = decoder.GetBestPath(&best_path);
+    if (ans2)
+      fst::GetLinearSymbolSequence(best_path, &alignment2, &words2, &weight2);
+  }
+  KALDI_ASSERT(ans == ans2);
+  if (!ans)
+    return;
+  KALDI_ASSERT(ApproxEqual(weight.Value1() + weight.Value2(),
+                           weight2.Value1() + weight2.Value2()));
+  if (alignment != alignment2 || words != words2)
+    KALDI_WARN << "Best paths differ (there may be a tie).";
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (kaldi::int32 i = 0; i < 20; i++)
+    kaldi::TestBiglmFst();
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -0,0 +1,216 @@
+// decoder/biglm-fst.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_BIGLM_FST_H_
+#define KALDI_DECODER_BIGLM_FST_H_
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "fst/fstlib.h"
+#include "fstext/deterministic-fst.h"
+
+namespace fst {
+
+/// The arc type of BiglmFstTpl.  It is the same as StdArc except that the
+/// state-ids are 64-bit, because each state of a BiglmFstTpl is a pair of
+/// states.
+struct BiglmArc {
+  typedef StdArc::Label Label;
+  typedef StdArc::Weight Weight;
+  typedef kaldi::int64 StateId;
+
+  BiglmArc() { }
+  BiglmArc(Label ilabel, Label olabel, Weight weight, StateId nextstate):
+      ilabel(ilabel), olabel(olabel), weight(weight), nextstate(nextstate) { }
+
+  Label ilabel;
+  Label olabel;
+  Weight weight;
+  StateId nextstate;
+};
+
+
+template <class FST> class BiglmFstTpl;
+
+// Declare that we'll be overriding class ArcIterator for class BiglmFstTpl.
+// As with GrammarFst, this works because BiglmFstTpl doesn't inherit from
+// class Fst.
+template <class FST> class ArcIterator<BiglmFstTpl<FST> >;
+
+
+/**
+   BiglmFstTpl is the on-the-fly composition of a decoding graph (e.g. HCLG)
+   with a "difference language model": a DeterministicOnDemandFst that gives,
+   for each word, the difference between the cost from the LM you want and the
+   cost from the LM you compiled the graph with.  This is the same thing that
+   LatticeBiglmFasterDecoder does, but done as an FST type that
+   LatticeFasterDecoderTpl, LatticeFasterOnlineDecoderTpl and
+   SingleUtteranceNnet3DecoderTpl are instantiated for, so you can decode with
+   a big LM in a single pass, online, with all the features of those
+   decoders.
+
+   A state is a pair (graph state, LM state).  As in LatticeBiglmFasterDecoder
+   the pair is packed into the 64-bit state-id (graph state in the low 32
+   bits), so no table of pairs is needed; the decoder's token hash is keyed on
+   the packed pair.  Arcs without a word on them leave the LM state unchanged;
+   arcs with a word get the cost and next LM state from the LM-difference FST.
+
+   The LM-difference FST builds up state as it is used and is not thread-safe,
+   so you would normally create one, and one BiglmFstTpl, per utterance (or
+   per decoding session).  It's best to wrap it in a
+   CacheDeterministicOnDemandFst, which caches the arcs; the final-costs of LM
+   states are cached here, because the decoders compute final-costs for all
+   active tokens (e.g. when checking for endpoints).
+
+   FST must have 32-bit state-ids (e.g. fst::Fst<StdArc> or DecoderFst; not
+   GrammarFst).
+ */
+template <class FST>
+class BiglmFstTpl {
+ public:
+  typedef BiglmArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Label Label;
+  typedef Arc::Weight Weight;
+
+  KALDI_COMPILE_TIME_ASSERT(sizeof(typename FST::Arc::StateId) == 4);
+
+  /// Constructor.  Does not take ownership of 'fst' or 'lm_diff_fst', which
+  /// must outlive this object.
+  BiglmFstTpl(const FST &fst, DeterministicOnDemandFst<StdArc> *lm_diff_fst):
+      fst_(fst), lm_diff_fst_(lm_diff_fst), warned_noarc_(false) { }
+
+  StateId Start() const {
+    StdArc::StateId start = fst_.Start();
+    if (start == kNoStateId)
+      return kNoStateId;
+    return ConstructPair(start, lm_diff_fst_->Start());
+  }
+
+  Weight Final(StateId s) const {
+    return Times(fst_.Final(PairToState(s)),
+                 Weight(LmFinalCost(PairToLmState(s))));
+  }
+
+  size_t NumInputEpsilons(StateId s) const {
+    return fst_.NumInputEpsilons(PairToState(s));
+  }
+
+  std::string Type() const { return "biglm"; }
+
+ private:
+  friend class ArcIterator<BiglmFstTpl<FST> >;
+
+  static inline StateId ConstructPair(StdArc::StateId fst_state,
+                                      StdArc::StateId lm_state) {
+    return static_cast<StateId>(static_cast<kaldi::uint64>(fst_state) +
+                                (static_cast<kaldi::uint64>(lm_state) << 32));
+  }
+  static inline StdArc::StateId PairToState(StateId s) {
+    return static_cast<StdArc::StateId>(static_cast<kaldi::uint32>(s));
+  }
+  static inline StdArc::StateId PairToLmState(StateId s) {
+    return static_cast<StdArc::StateId>(
+        static_cast<kaldi::uint32>(static_cast<kaldi::uint64>(s) >> 32));
+  }
+
+  float LmFinalCost(StdArc::StateId lm_state) const {
+    if (static_cast<size_t>(lm_state) >= lm_final_costs_.size())
+      lm_final_costs_.resize(lm_state + 1,
+                             std::numeric_limits<float>::quiet_NaN());
+    float &cost = lm_final_costs_[lm_state];
+    if (KALDI_ISNAN(cost))
+      cost = lm_diff_fst_->Final(lm_state).Value();
+    return cost;
+  }
+
+  // Sets *oarc to the arc of this FST that corresponds to the arc 'arc' of
+  // fst_, leaving a state whose LM state is 'lm_state'.
+  inline void MapArc(const StdArc &arc, StdArc::StateId lm_state,
+                     Arc *oarc) const {
+    oarc->ilabel = arc.ilabel;
+    oarc->olabel = arc.olabel;
+    if (arc.olabel == 0) {  // No word, so no change in LM state.
+      oarc->weight = arc.weight;
+      oarc->nextstate = ConstructPair(arc.nextstate, lm_state);
+      return;
+    }
+    StdArc lm_arc;
+    if (lm_diff_fst_->GetArc(lm_state, arc.olabel, &lm_arc)) {
+      oarc->weight = Times(arc.weight, lm_arc.weight);
+      oarc->nextstate = ConstructPair(arc.nextstate, lm_arc.nextstate);
+    } else {
+      // This case is unexpected for statistical LMs.  The arc will be pruned,
+      // so it doesn't really matter what the next state is.
+      if (!warned_noarc_) {
+        warned_noarc_ = true;
+        KALDI_WARN << "No arc available in LM (unlikely to be correct "
+            "if a statistical language model); will not warn again";
+      }
+      oarc->weight = Weight::Zero();
+      oarc->nextstate = ConstructPair(arc.nextstate, lm_state);
+    }
+  }
+
+  const FST &fst_;
+  DeterministicOnDemandFst<StdArc> *lm_diff_fst_;
+  // Final-costs of LM states, indexed by LM state; NaN if not known yet.
+  mutable std::vector<float> lm_final_costs_;
+  mutable bool warned_noarc_;
+};
+
+typedef BiglmFstTpl<Fst<StdArc> > BiglmFst;
+
+
+/**
+   This is the overridden template for class ArcIterator for BiglmFstTpl.  It
+   is only used in the decoder, so it only supports Done(), Next() and
+   Value().
+ */
+template <class FST>
+class ArcIterator<BiglmFstTpl<FST> > {
+ public:
+  typedef BiglmArc Arc;
+  typedef Arc::StateId StateId;
+
+  inline ArcIterator(const BiglmFstTpl<FST> &fst, StateId s):
+      fst_(fst), aiter_(fst.fst_, BiglmFstTpl<FST>::PairToState(s)),
+      lm_state_(BiglmFstTpl<FST>::PairToLmState(s)) { }
+
+  inline bool Done() const { return aiter_.Done(); }
+
+  inline void Next() { aiter_.Next(); }
+
+  inline const Arc &Value() const {
+    fst_.MapArc(aiter_.Value(), lm_state_, &arc_);
+    return arc_;
+  }
+
+ private:
+  const BiglmFstTpl<FST> &fst_;
+  ArcIterator<FST> aiter_;
+  StdArc::StateId lm_state_;
+  mutable Arc arc_;
+};
+
+
+}  // namespace fst
+
+#endif  // KALDI_DECODER_BIGLM_FST_H_
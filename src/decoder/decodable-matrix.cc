@@ -64,6 +64,14 @@ BaseFloat DecodableMatrixMapped::LogLikelihood(int32 frame, int32 tid) {
 #endif
 }
 
+const BaseFloat *DecodableMatrixMapped::LogLikelihoodRow(int32 frame) {
+  const BaseFloat *row = row_.Get(frame);
+  if (row != NULL) return row;
+  KALDI_PARANOID_ASSERT(frame >= frame_offset_ &&
+                        frame < frame_offset_ + likes_->NumRows());
+  return row_.Set(frame, tid_to_pdf_, raw_data_ + frame * stride_, 1.0);
+}
+
 int32 DecodableMatrixMapped::NumFramesReady() const {
   return frame_offset_ + likes_->NumRows();
 }
@@ -103,6 +111,7 @@ void DecodableMatrixMappedOffset::AcceptLoglikes(
     loglikes_.Swap(&new_loglikes);
   }
   frame_offset_ += frames_to_discard;
+  row_.Invalidate();
   stride_ = loglikes_.Stride();
   raw_data_ = loglikes_.Data() - (frame_offset_ * stride_);
 }
@@ -72,6 +72,12 @@ class DecodableMatrixScaledMapped: public DecodableInterface {
     return scale_ * (*likes_)(frame, tid_to_pdf_[tid]);
   }
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame) {
+    const BaseFloat *row = row_.Get(frame);
+    if (row != NULL) return row;
+    return row_.Set(frame, tid_to_pdf_, likes_->RowData(frame), scale_);
+  }
+
   // Indices are one-based!  This is for compatibility with OpenFst.
   virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
 
@@ -84,6 +90,7 @@ class DecodableMatrixScaledMapped: public DecodableInterface {
   const std::vector<int32> &tid_to_pdf_;
   BaseFloat scale_;
   bool delete_likes_;
+  MappedLogLikelihoodRow row_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableMatrixScaledMapped);
 };
 
@@ -120,6 +127,8 @@ class DecodableMatrixMapped: public DecodableInterface {
 
   virtual BaseFloat LogLikelihood(int32 frame, int32 tid);
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame);
+
   // Note: these indices are 1-based.
   virtual int32 NumIndices() const;
 
@@ -137,6 +146,8 @@ class DecodableMatrixMapped: public DecodableInterface {
   const BaseFloat *raw_data_;
   int32 stride_;
 
+  MappedLogLikelihoodRow row_;
+
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableMatrixMapped);
 };
 
@@ -194,6 +205,13 @@ class DecodableMatrixMappedOffset: public DecodableInterface {
 #endif
   }
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame) {
+    const BaseFloat *row = row_.Get(frame);
+    if (row != NULL) return row;
+    return row_.Set(frame, tid_to_pdf_,
+                    loglikes_.RowData(frame - frame_offset_), 1.0);
+  }
+
   virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
 
   // nothing special to do in destructor.
@@ -213,6 +231,8 @@ class DecodableMatrixMappedOffset: public DecodableInterface {
   BaseFloat *raw_data_;
   int32 stride_;
 
+  MappedLogLikelihoodRow row_;
+
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableMatrixMappedOffset);
 };
 
@@ -240,12 +260,19 @@ class DecodableMatrixScaled: public DecodableInterface {
     return scale_ * likes_(frame, index - 1);
   }
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame) {
+    const BaseFloat *row = row_.Get(frame);
+    if (row != NULL) return row;
+    return row_.Set(frame, likes_.NumCols(), likes_.RowData(frame), scale_);
+  }
+
   // Indices are one-based!  This is for compatibility with OpenFst.
   virtual int32 NumIndices() const { return likes_.NumCols(); }
 
  private:
   const Matrix<BaseFloat> &likes_;
   BaseFloat scale_;
+  MappedLogLikelihoodRow row_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableMatrixScaled);
 };
 }  // namespace kaldi
@@ -0,0 +1,90 @@
+// decoder/decoder-fst-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/decodable-matrix.h"
+#include "decoder/decoder-test-utils.h"
+#include "decoder/decoder-fst.h"
+#include "decoder/lattice-faster-decoder.h"
+
+namespace kaldi {
+
+template <typename FST>
+static void DecodeAndGetBestPath(const FST &fst,
+                                 const LatticeFasterDecoderConfig &config,
+                                 DecodableInterface *decodable,
+                                 std::vector<int32> *alignment,
+                                 std::vector<int32> *words,
+                                 LatticeWeight *weight) {
+  LatticeFasterDecoderTpl<FST> decoder(fst, config);
+  decoder.Decode(decodable);
+  Lattice best_path;
+  decoder.GetBestPath(&best_path);
+  fst::GetLinearSymbolSequence(best_path, alignment, words, weight);
+}
+
+// Checks that decoding with DecoderFst gives the same best path as decoding
+// with the ConstFst it was converted from.
+void TestDecoderFst(int32 num_states) {
+  KALDI_ASSERT(fst::DecoderFst().NumStates() == 0);
+  int32 num_pdfs = RandInt(10, 200), num_frames = RandInt(20, 100);
+  fst::VectorFst<fst::StdArc> vector_fst;
+  RandDecodingGraph(num_states, num_pdfs, 100, &vector_fst);
+  fst::ConstFst<fst::StdArc> const_fst(vector_fst);
+  fst::DecoderFst decoder_fst(const_fst);
+  KALDI_ASSERT(decoder_fst.NumStates() <= num_states);
+  for (int32 s = 0; s < decoder_fst.NumStates(); s++) {
+    // The input-epsilon arcs come first, then the emitting arcs in order.
+    int32 i = 0, prev_ilabel = 0;
+    for (fst::ArcIterator<fst::DecoderFst> aiter(decoder_fst, s);
+         !aiter.Done(); aiter.Next(), i++) {
+      const fst::StdArc &arc = aiter.Value();
+      KALDI_ASSERT((arc.ilabel == 0) ==
+                   (i < static_cast<int32>(decoder_fst.NumInputEpsilons(s))));
+      KALDI_ASSERT(arc.ilabel >= prev_ilabel);
+      prev_ilabel = arc.ilabel;
+    }
+    KALDI_ASSERT(i == static_cast<int32>(decoder_fst.NumArcs(s)));
+  }
+
+  Matrix<BaseFloat> loglikes(num_frames, num_pdfs);
+  loglikes.SetRandn();
+  DecodableMatrixScaled decodable(loglikes, 1.0);
+  LatticeFasterDecoderConfig config;
+  config.beam = 10.0;
+  config.max_active = 100000;
+
+  std::vector<int32> alignment, words, alignment2, words2;
+  LatticeWeight weight = LatticeWeight::Zero(),
+      weight2 = LatticeWeight::Zero();
+  DecodeAndGetBestPath(const_fst, config, &decodable,
+                       &alignment, &words, &weight);
+  DecodeAndGetBestPath(decoder_fst, config, &decodable,
+                       &alignment2, &words2, &weight2);
+  KALDI_ASSERT(alignment == alignment2 && words == words2);
+  KALDI_ASSERT(ApproxEqual(weight.Value1() + weight.Value2(),
+                           weight2.Value1() + weight2.Value2()));
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    TestDecoderFst(RandInt(10, 1000));
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -0,0 +1,98 @@
+// decoder/decoder-fst.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+
+#include "decoder/decoder-fst.h"
+
+namespace fst {
+
+// Orders the arcs of a state: input-epsilon arcs first, then the emitting
+// arcs in order of ilabel.
+struct DecoderFstArcLess {
+  bool operator () (const StdArc &a, const StdArc &b) const {
+    return a.ilabel < b.ilabel;
+  }
+};
+
+void DecoderFst::Init(const Fst<StdArc> &fst) {
+  using kaldi::uint32;
+  states_.clear();
+  arcs_.clear();
+  start_ = kNoStateId;
+  StateId old_start = fst.Start();
+  if (old_start == kNoStateId)
+    return;
+
+  // Number the states in breadth-first order from the start state.  The
+  // states are numbered as they are first seen, so 'queue' (the old state-ids
+  // in order of their new state-ids) doubles as the BFS queue.
+  std::vector<StateId> state_map;  // old state-id -> new state-id.
+  if (fst.Properties(kExpanded, false))
+    state_map.resize(CountStates(fst), kNoStateId);
+  std::vector<StateId> queue;
+  size_t num_arcs = 0;
+  queue.push_back(old_start);
+  if (state_map.size() <= static_cast<size_t>(old_start))
+    state_map.resize(old_start + 1, kNoStateId);
+  state_map[old_start] = 0;
+  for (size_t i = 0; i < queue.size(); i++) {
+    StateId s = queue[i];
+    for (ArcIterator<Fst<StdArc> > aiter(fst, s); !aiter.Done();
+         aiter.Next()) {
+      StateId t = aiter.Value().nextstate;
+      if (state_map.size() <= static_cast<size_t>(t))
+        state_map.resize(t + 1, kNoStateId);
+      if (state_map[t] == kNoStateId) {
+        state_map[t] = queue.size();
+        queue.push_back(t);
+      }
+      num_arcs++;
+    }
+  }
+  if (num_arcs >= static_cast<size_t>(std::numeric_limits<uint32>::max()))
+    KALDI_ERR << "FST has too many arcs for DecoderFst: " << num_arcs;
+
+  StateId num_states = queue.size();
+  start_ = 0;
+  states_.resize(num_states + 1);
+  arcs_.reserve(num_arcs);
+  for (StateId s = 0; s < num_states; s++) {
+    StateId old_s = queue[s];
+    StateInfo &info = states_[s];
+    info.final_cost = fst.Final(old_s).Value();
+    info.first_arc = arcs_.size();
+    info.num_input_epsilons = 0;
+    for (ArcIterator<Fst<StdArc> > aiter(fst, old_s); !aiter.Done();
+         aiter.Next()) {
+      StdArc arc = aiter.Value();
+      arc.nextstate = state_map[arc.nextstate];
+      if (arc.ilabel == 0)
+        info.num_input_epsilons++;
+      arcs_.push_back(arc);
+    }
+    // A stable sort keeps the original order of arcs with the same ilabel.
+    std::stable_sort(arcs_.begin() + info.first_arc, arcs_.end(),
+                     DecoderFstArcLess());
+  }
+  states_[num_states].final_cost = Weight::Zero().Value();
+  states_[num_states].first_arc = arcs_.size();
+  states_[num_states].num_input_epsilons = 0;
+}
+
+}  // namespace fst
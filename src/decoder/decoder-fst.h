@@ -0,0 +1,139 @@
+// decoder/decoder-fst.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_DECODER_FST_H_
+#define KALDI_DECODER_DECODER_FST_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "fst/fstlib.h"
+
+namespace fst {
+
+class DecoderFst;
+
+// Declare that we'll be overriding class ArcIterator for class DecoderFst.
+// As with GrammarFst, this works because DecoderFst doesn't inherit from
+// class Fst.
+template <> class ArcIterator<DecoderFst>;
+
+
+/**
+   DecoderFst is an immutable copy of a decoding graph (e.g. HCLG) in a layout
+   designed for the decoders' access pattern.  Like GrammarFst, it does not
+   inherit from fst::Fst and only supports the parts of the interface that the
+   decoder needs; the decoder is templated on it, so there are no virtual calls
+   when iterating over arcs.
+
+   Compared with ConstFst<StdArc>:
+     - The states are renumbered in breadth-first order from the start state,
+       so states that are active at the same time tend to be close together
+       in memory.  (States not reachable from the start state are removed.)
+     - The arcs of each state are split into two ranges: the input-epsilon
+       arcs come first, then the emitting arcs, sorted by ilabel (so that the
+       lookups of acoustic scores for a state are in increasing order).
+       NumInputEpsilons() is therefore just a lookup.
+     - The final-cost, arc range and number of input epsilons of a state are
+       stored together, so the decoder's per-state queries touch one small
+       record, and the arcs are stored contiguously as StdArc (16 bytes).
+
+   To measure the speedup over ConstFst on a given graph, use
+   benchmark-decoder-fst (in bin/); decoder-fst-test only checks correctness.
+ */
+class DecoderFst {
+ public:
+  typedef StdArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Label Label;
+  typedef Arc::Weight Weight;
+
+  DecoderFst(): start_(kNoStateId) { }
+
+  /// Converts 'fst' into this format.
+  explicit DecoderFst(const Fst<StdArc> &fst) { Init(fst); }
+
+  /// Converts 'fst' into this format.
+  void Init(const Fst<StdArc> &fst);
+
+  StateId Start() const { return start_; }
+
+  Weight Final(StateId s) const { return Weight(states_[s].final_cost); }
+
+  size_t NumInputEpsilons(StateId s) const {
+    return states_[s].num_input_epsilons;
+  }
+
+  size_t NumArcs(StateId s) const {
+    return states_[s + 1].first_arc - states_[s].first_arc;
+  }
+
+  StateId NumStates() const {
+    return states_.empty() ? 0 : static_cast<StateId>(states_.size()) - 1;
+  }
+
+  size_t NumArcs() const { return arcs_.size(); }
+
+  std::string Type() const { return "decoder"; }
+
+ private:
+  friend class ArcIterator<DecoderFst>;
+
+  struct StateInfo {
+    float final_cost;
+    // The arcs of state s are arcs_[first_arc] ... arcs_[next first_arc - 1].
+    kaldi::uint32 first_arc;
+    kaldi::uint32 num_input_epsilons;
+  };
+
+  StateId start_;
+  // states_ has dimension NumStates() + 1 (or is empty if this object was
+  // default-constructed); the last element is only used for its 'first_arc'.
+  std::vector<StateInfo> states_;
+  std::vector<StdArc> arcs_;
+};
+
+
+/**
+   This is the overridden template for class ArcIterator for DecoderFst.  It is
+   only used in the decoder, so it only supports Done(), Next() and Value().
+ */
+template <>
+class ArcIterator<DecoderFst> {
+ public:
+  typedef StdArc Arc;
+  typedef Arc::StateId StateId;
+
+  inline ArcIterator(const DecoderFst &fst, StateId s):
+      arc_(fst.arcs_.data() + fst.states_[s].first_arc),
+      end_(fst.arcs_.data() + fst.states_[s + 1].first_arc) { }
+
+  inline bool Done() const { return arc_ == end_; }
+
+  inline void Next() { ++arc_; }
+
+  inline const Arc &Value() const { return *arc_; }
+
+ private:
+  const Arc *arc_;
+  const Arc *end_;
+};
+
+
+}  // namespace fst
+
+#endif  // KALDI_DECODER_DECODER_FST_H_
@@ -0,0 +1,46 @@
+// decoder/decoder-test-utils.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/decoder-test-utils.h"
+
+namespace kaldi {
+
+void RandDecodingGraph(int32 num_states, int32 num_pdfs, int32 num_words,
+                       fst::VectorFst<fst::StdArc> *fst) {
+  typedef fst::StdArc Arc;
+  fst->DeleteStates();
+  for (int32 s = 0; s < num_states; s++)
+    fst->AddState();
+  fst->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    int32 num_arcs = RandInt(1, 4);
+    for (int32 i = 0; i < num_arcs; i++) {
+      int32 olabel = (RandInt(0, 3) == 0 ? RandInt(1, num_words) : 0);
+      int32 nextstate = (RandInt(0, 9) == 0 ? RandInt(0, num_states - 1) :
+                         std::min(num_states - 1, s + RandInt(0, 3)));
+      fst->AddArc(s, Arc(RandInt(1, num_pdfs), olabel, RandUniform() * 2.0,
+                         nextstate));
+    }
+    if (RandInt(0, 4) == 0)
+      fst->AddArc(s, Arc(0, RandInt(0, num_words), 1.0 + RandUniform(),
+                         RandInt(0, num_states - 1)));
+    if (RandInt(0, 9) == 0)
+      fst->SetFinal(s, RandUniform());
+  }
+}
+
+}  // namespace kaldi
@@ -0,0 +1,39 @@
+// decoder/decoder-test-utils.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_DECODER_TEST_UTILS_H_
+#define KALDI_DECODER_DECODER_TEST_UTILS_H_
+
+#include "base/kaldi-common.h"
+#include "fst/fstlib.h"
+
+namespace kaldi {
+
+// Convenience functions for the decoder test code.
+
+/// Creates a random graph that looks a bit like HCLG, for testing decoders:
+/// each state has a few emitting arcs (ilabels are 1 ... num_pdfs, i.e.
+/// pdf-ids plus one, as expected by DecodableMatrixScaled) and sometimes an
+/// input-epsilon arc, and words 1 ... num_words appear on some of the arcs.
+/// Most arcs go to nearby states, so that the decoder keeps a reasonable
+/// number of paths alive.
+void RandDecodingGraph(int32 num_states, int32 num_pdfs, int32 num_words,
+                       fst::VectorFst<fst::StdArc> *fst);
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_DECODER_TEST_UTILS_H_
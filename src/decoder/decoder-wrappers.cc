@@ -17,6 +17,9 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <atomic>
+#include <iomanip>
+
 #include "decoder/decoder-wrappers.h"
 #include "decoder/faster-decoder.h"
 #include "decoder/lattice-faster-decoder.h"
@@ -29,8 +32,9 @@ namespace kaldi {
 
 
 
-DecodeUtteranceLatticeFasterClass::DecodeUtteranceLatticeFasterClass(
-    LatticeFasterDecoder *decoder,
+template <typename FST>
+DecodeUtteranceLatticeFasterClassTpl<FST>::DecodeUtteranceLatticeFasterClassTpl(
+    LatticeFasterDecoderTpl<FST> *decoder,
     DecodableInterface *decodable,
     const TransitionInformation &trans_model,
     const fst::SymbolTable *word_syms,
@@ -61,7 +65,8 @@ DecodeUtteranceLatticeFasterClass::DecodeUtteranceLatticeFasterClass(
     clat_(NULL), lat_(NULL) { }
 
 
-void DecodeUtteranceLatticeFasterClass::operator () () {
+template <typename FST>
+void DecodeUtteranceLatticeFasterClassTpl<FST>::operator () () {
   // Decoding and lattice determinization happens here.
   computed_ = true; // Just means this function was called-- a check on the
   // calling code.
@@ -113,7 +118,8 @@ void DecodeUtteranceLatticeFasterClass::operator () () {
   }
 }
 
-DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
+template <typename FST>
+DecodeUtteranceLatticeFasterClassTpl<FST>::~DecodeUtteranceLatticeFasterClassTpl() {
   if (!computed_)
     KALDI_ERR << "Destructor called without operator (), error in calling code.";
 
@@ -195,6 +201,10 @@ DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
   delete decodable_;
 }
 
+// Instantiate the template above for the required FST types.
+template class DecodeUtteranceLatticeFasterClassTpl<fst::StdFst>;
+template class DecodeUtteranceLatticeFasterClassTpl<fst::ConstGrammarFst>;
+
 template <typename FST>
 bool DecodeUtteranceLatticeIncremental(
     LatticeIncrementalDecoderTpl<FST> &decoder, // not const but is really an input.
@@ -282,6 +292,174 @@ bool DecodeUtteranceLatticeIncremental(
 }
 
 
+// Used by DecodeUtteranceLatticeFasterSegmented(): appends the best path
+// through the raw lattice segment 'lat' (which starts at frame 'start_frame')
+// to 'alignment' and 'words', adds its cost to 'weight', and writes the
+// segment (determinized if requested) with a key of the form
+// <utt>-<start-frame>-<end-frame>.
+static void OutputLatticeSegment(const TransitionInformation &trans_model,
+                                 const LatticeFasterDecoderConfig &config,
+                                 const std::string &utt,
+                                 int32 start_frame,
+                                 double acoustic_scale,
+                                 bool determinize,
+                                 Lattice *lat,
+                                 CompactLatticeWriter *compact_lattice_writer,
+                                 LatticeWriter *lattice_writer,
+                                 std::vector<int32> *alignment,
+                                 std::vector<int32> *words,
+                                 LatticeWeight *weight) {
+  if (lat->NumStates() == 0)
+    KALDI_ERR << "Unexpected problem getting lattice for utterance " << utt
+              << " starting at frame " << start_frame;
+  Lattice best_path;
+  fst::ShortestPath(*lat, &best_path);
+  std::vector<int32> seg_alignment, seg_words;
+  LatticeWeight seg_weight;
+  GetLinearSymbolSequence(best_path, &seg_alignment, &seg_words, &seg_weight);
+  alignment->insert(alignment->end(), seg_alignment.begin(),
+                    seg_alignment.end());
+  words->insert(words->end(), seg_words.begin(), seg_words.end());
+  *weight = fst::Times(*weight, seg_weight);
+
+  std::ostringstream key;
+  key << utt << '-' << std::setfill('0') << std::setw(7) << start_frame
+      << '-' << std::setw(7) << (start_frame + seg_alignment.size());
+  if (determinize) {
+    CompactLattice clat;
+    if (!DeterminizeLatticePhonePrunedWrapper(trans_model, lat,
+                                              config.lattice_beam, &clat,
+                                              config.det_opts))
+      KALDI_WARN << "Determinization finished earlier than the beam for "
+                 << "lattice segment " << key.str();
+    if (acoustic_scale != 0.0)
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale), &clat);
+    compact_lattice_writer->Write(key.str(), clat);
+  } else {
+    if (acoustic_scale != 0.0)
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale), lat);
+    lattice_writer->Write(key.str(), *lat);
+  }
+}
+
+
+// This is as DecodeUtteranceLatticeFaster(), but for when
+// --lattice-segment-lookback is set: it writes the lattice in segments while
+// decoding (see LatticeFasterDecoderTpl::GetRawLatticePrefix()), so the
+// decoder's memory use doesn't grow with the length of the utterance.  The
+// words and alignment are the concatenation of the best paths through the
+// segments, which is the overall best path unless a cut had to be forced.
+// Forced cuts discard paths, so we warn about them, with the total number over
+// all utterances so far (across threads) in tot_forced_cuts.
+static std::atomic<int64> tot_forced_cuts(0);
+
+template <typename FST>
+static bool DecodeUtteranceLatticeFasterSegmented(
+    LatticeFasterDecoderTpl<FST> &decoder,
+    DecodableInterface &decodable,
+    const TransitionInformation &trans_model,
+    const fst::SymbolTable *word_syms,
+    std::string utt,
+    double acoustic_scale,
+    bool determinize,
+    bool allow_partial,
+    Int32VectorWriter *alignment_writer,
+    Int32VectorWriter *words_writer,
+    CompactLatticeWriter *compact_lattice_writer,
+    LatticeWriter *lattice_writer,
+    double *like_ptr) {
+  const LatticeFasterDecoderConfig &config = decoder.GetOptions();
+  int32 lookback = config.lattice_segment_lookback;
+  KALDI_ASSERT(lookback > 0);
+
+  std::vector<int32> alignment, words;
+  LatticeWeight weight = LatticeWeight::One();
+  int32 num_segments = 0;
+  Lattice lat;
+
+  decoder.InitDecoding();
+  while (!decodable.IsLastFrame(decoder.NumFramesDecoded() - 1)) {
+    int32 num_frames_decoded = decoder.NumFramesDecoded();
+    decoder.AdvanceDecoding(&decodable, lookback);
+    if (decoder.NumFramesDecoded() == num_frames_decoded)
+      break;  // No progress; shouldn't happen with offline decodables.
+    // We only output frames at least 'lookback' frames behind the decoding
+    // front, where the paths have usually merged.  If they still haven't
+    // merged after a further 'lookback' frames, we force a cut so that memory
+    // use stays bounded.
+    int32 start_frame = decoder.FirstFrame(),
+        max_frame = decoder.NumFramesDecoded() - lookback;
+    bool force = (max_frame - start_frame >= lookback);
+    if (decoder.GetRawLatticePrefix(max_frame, force, &lat) > 0) {
+      OutputLatticeSegment(trans_model, config, utt, start_frame,
+                           acoustic_scale, determinize, &lat,
+                           compact_lattice_writer, lattice_writer,
+                           &alignment, &words, &weight);
+      num_segments++;
+    }
+  }
+  decoder.FinalizeDecoding();
+  if (decoder.NumFramesDecoded() == 0) {
+    KALDI_WARN << "Failed to decode utterance with id " << utt;
+    return false;
+  }
+  if (!decoder.ReachedFinal()) {
+    if (allow_partial) {
+      KALDI_WARN << "Outputting partial output for utterance " << utt
+                 << " since no final-state reached\n";
+    } else {
+      // Note: the earlier segments of this utterance have already been
+      // written.
+      KALDI_WARN << "Not producing output for the rest of utterance " << utt
+                 << " since no final-state reached and "
+                 << "--allow-partial=false.\n";
+      return false;
+    }
+  }
+  int32 start_frame = decoder.FirstFrame();
+  decoder.GetRawLattice(&lat);
+  OutputLatticeSegment(trans_model, config, utt, start_frame,
+                       acoustic_scale, determinize, &lat,
+                       compact_lattice_writer, lattice_writer,
+                       &alignment, &words, &weight);
+  num_segments++;
+
+  int32 num_frames = alignment.size();
+  if (words_writer->IsOpen())
+    words_writer->Write(utt, words);
+  if (alignment_writer->IsOpen())
+    alignment_writer->Write(utt, alignment);
+  if (word_syms != NULL) {
+    std::cerr << utt << ' ';
+    for (size_t i = 0; i < words.size(); i++) {
+      std::string s = word_syms->Find(words[i]);
+      if (s == "")
+        KALDI_ERR << "Word-id " << words[i] << " not in symbol table.";
+      std::cerr << s << ' ';
+    }
+    std::cerr << '\n';
+  }
+  int32 num_forced_cuts = decoder.NumForcedCuts();
+  if (num_forced_cuts > 0) {
+    int64 tot = (tot_forced_cuts += num_forced_cuts);
+    KALDI_WARN << "Forced " << num_forced_cuts << " lattice cut(s) in "
+               << "utterance " << utt << ", discarding the paths not through "
+               << "the best token at the cut (" << tot << " forced cuts in "
+               << "total so far); consider increasing "
+               << "--lattice-segment-lookback.";
+  }
+  double likelihood = -(weight.Value1() + weight.Value2());
+  KALDI_LOG << "Log-like per frame for utterance " << utt << " is "
+            << (likelihood / num_frames) << " over "
+            << num_frames << " frames, in " << num_segments
+            << " lattice segments (" << num_forced_cuts << " forced cuts).";
+  KALDI_VLOG(2) << "Cost for utterance " << utt << " is "
+                << weight.Value1() << " + " << weight.Value2();
+  *like_ptr = likelihood;
+  return true;
+}
+
+
 // Takes care of output.  Returns true on success.
 template <typename FST>
 bool DecodeUtteranceLatticeFaster(
@@ -300,6 +478,12 @@ bool DecodeUtteranceLatticeFaster(
     double *like_ptr) { // puts utterance's like in like_ptr on success.
   using fst::VectorFst;
 
+  if (decoder.GetOptions().lattice_segment_lookback > 0)
+    return DecodeUtteranceLatticeFasterSegmented(
+        decoder, decodable, trans_model, word_syms, utt, acoustic_scale,
+        determinize, allow_partial, alignment_writer, words_writer,
+        compact_lattice_writer, lattice_writer, like_ptr);
+
   if (!decoder.Decode(&decodable)) {
     KALDI_WARN << "Failed to decode utterance with id " << utt;
     return false;
@@ -442,6 +626,21 @@ template bool DecodeUtteranceLatticeFaster(
     LatticeWriter *lattice_writer,
     double *like_ptr);
 
+template bool DecodeUtteranceLatticeFaster(
+    LatticeFasterDecoderTpl<fst::DecoderFst > &decoder,
+    DecodableInterface &decodable,
+    const TransitionInformation &trans_model,
+    const fst::SymbolTable *word_syms,
+    std::string utt,
+    double acoustic_scale,
+    bool determinize,
+    bool allow_partial,
+    Int32VectorWriter *alignment_writer,
+    Int32VectorWriter *words_writer,
+    CompactLatticeWriter *compact_lattice_writer,
+    LatticeWriter *lattice_writer,
+    double *like_ptr);
+
 
 // Takes care of output.  Returns true on success.
 bool DecodeUtteranceLatticeSimple(
@@ -114,9 +114,9 @@ bool DecodeUtteranceLatticeIncremental(
 /// lattice_writer, else to compact_lattice_writer.  The writers for
 /// alignments and words will only be written to if they are open.
 ///
-/// Caution: this will only link correctly if FST is either fst::Fst<fst::StdArc>,
-/// or fst::GrammarFst, as the template function is defined in the .cc file and
-/// only instantiated for those two types.
+/// Caution: this will only link correctly if FST is fst::Fst<fst::StdArc>,
+/// fst::GrammarFst or fst::DecoderFst, as the template function is defined in
+/// the .cc file and only instantiated for those types.
 template <typename FST>
 bool DecodeUtteranceLatticeFaster(
     LatticeFasterDecoderTpl<FST> &decoder, // not const but is really an input.
@@ -139,13 +139,17 @@ bool DecodeUtteranceLatticeFaster(
 /// to build a multi-threaded command line program more easily.
 /// The main computation takes place in operator (), and the output
 /// happens in the destructor.
-class DecodeUtteranceLatticeFasterClass {
+///
+/// Caution: this will only link correctly if FST is fst::Fst<fst::StdArc> or
+/// fst::GrammarFst, as the class is only instantiated for those types.
+template <typename FST>
+class DecodeUtteranceLatticeFasterClassTpl {
  public:
   // Initializer sets various variables.
   // NOTE: we "take ownership" of "decoder" and "decodable".  These
   // are deleted by the destructor.  On error, "num_err" is incremented.
-  DecodeUtteranceLatticeFasterClass(
-      LatticeFasterDecoder *decoder,
+  DecodeUtteranceLatticeFasterClassTpl(
+      LatticeFasterDecoderTpl<FST> *decoder,
       DecodableInterface *decodable,
       const TransitionInformation &trans_model,
       const fst::SymbolTable *word_syms,
@@ -163,10 +167,10 @@ class DecodeUtteranceLatticeFasterClass {
       int32 *num_err,  // on failure, increments this.
       int32 *num_partial);  // If partial decode (final-state not reached), increments this.
   void operator () (); // The decoding happens here.
-  ~DecodeUtteranceLatticeFasterClass(); // Output happens here.
+  ~DecodeUtteranceLatticeFasterClassTpl(); // Output happens here.
  private:
   // The following variables correspond to inputs:
-  LatticeFasterDecoder *decoder_;
+  LatticeFasterDecoderTpl<FST> *decoder_;
   DecodableInterface *decodable_;
   const TransitionInformation *trans_model_;
   const fst::SymbolTable *word_syms_;
@@ -192,6 +196,9 @@ class DecodeUtteranceLatticeFasterClass {
   Lattice *lat_; // Stored output, if determinize_ == false.
 };
 
+typedef DecodeUtteranceLatticeFasterClassTpl<fst::StdFst>
+    DecodeUtteranceLatticeFasterClass;
+
 // This function DecodeUtteranceLatticeSimple is used in several decoders, and
 // we have moved it here.  Note: this is really "binary-level" code as it
 // involves table readers and writers; we've just put it here as there is no
@@ -234,6 +234,10 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
   // on the next frame.
   double next_weight_cutoff = std::numeric_limits<double>::infinity();
 
+  // If the decodable object supports it, we get the frame's log-likelihoods
+  // as an array, which saves a virtual call per arc.
+  const BaseFloat *loglikes = decodable->LogLikelihoodRow(frame);
+
   // First process the best token to get a hopefully
   // reasonably tight bound on the next cutoff.
   if (best_elem) {
@@ -244,7 +248,8 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
          aiter.Next()) {
       const Arc &arc = aiter.Value();
       if (arc.ilabel != 0) {  // we'd propagate..
-        BaseFloat ac_cost = - decodable->LogLikelihood(frame, arc.ilabel);
+        BaseFloat ac_cost = - (loglikes != NULL ? loglikes[arc.ilabel] :
+                               decodable->LogLikelihood(frame, arc.ilabel));
         double new_weight = arc.weight.Value() + tok->cost_ + ac_cost;
         if (new_weight + adaptive_beam < next_weight_cutoff)
           next_weight_cutoff = new_weight + adaptive_beam;
@@ -270,7 +275,8 @@ double FasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
            aiter.Next()) {
         Arc arc = aiter.Value();
         if (arc.ilabel != 0) {  // propagate..
-          BaseFloat ac_cost =  - decodable->LogLikelihood(frame, arc.ilabel);
+          BaseFloat ac_cost = - (loglikes != NULL ? loglikes[arc.ilabel] :
+                                 decodable->LogLikelihood(frame, arc.ilabel));
           double new_weight = arc.weight.Value() + tok->cost_ + ac_cost;
           if (new_weight < next_weight_cutoff) {  // not pruned..
             Token *new_tok = new Token(arc, ac_cost, tok);
@@ -0,0 +1,225 @@
+// decoder/grammar-fst-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <list>
+
+#include "decoder/decodable-matrix.h"
+#include "decoder/grammar-fst.h"
+#include "decoder/lattice-faster-decoder.h"
+
+namespace kaldi {
+
+using fst::StdArc;
+using fst::StdVectorFst;
+
+// The value of --nonterm-phones-offset we use: phones 1 to 4 are real phones,
+// and the nonterminal symbols are numbered from 5.
+static const int32 kNontermPhonesOffset = 5;
+
+// Returns the ilabel for nonterminal symbol kNontermPhonesOffset + 'n' with
+// left-context phone 'phone' (see grammar-context-fst.h).
+static int32 NontermLabel(int32 n, int32 phone) {
+  return static_cast<int32>(fst::kNontermBigNumber) +
+      (kNontermPhonesOffset + n) *
+      fst::GetEncodingMultiple(kNontermPhonesOffset) + phone;
+}
+
+// Creates the top-level FST of our grammar: word 1, then the nonterminals
+// 'first' and 'second', then word 2.  Words 1 and 2 are one frame each, with
+// transition-id 1.  The left-context phone is 1 when entering 'first' and 2
+// after that.  Both 'first' and 'second' are offsets from
+// kNontermPhonesOffset, e.g. fst::kNontermUserDefined.
+static std::shared_ptr<StdVectorFst> CreateTopFst(int32 first,
+                                                  int32 second) {
+  std::shared_ptr<StdVectorFst> ans(new StdVectorFst());
+  for (int32 s = 0; s < 7; s++)
+    ans->AddState();
+  ans->SetStart(0);
+  ans->AddArc(0, StdArc(1, 1, 0.0, 1));
+  ans->AddArc(1, StdArc(NontermLabel(first, 1), 0, 0.0, 2));
+  ans->AddArc(2, StdArc(NontermLabel(fst::kNontermReenter, 2), 0, 0.0, 3));
+  ans->AddArc(3, StdArc(NontermLabel(second, 2), 0, 0.0, 4));
+  ans->AddArc(4, StdArc(NontermLabel(fst::kNontermReenter, 2), 0, 0.0, 5));
+  ans->AddArc(5, StdArc(1, 2, 0.0, 6));
+  ans->SetFinal(6, StdArc::Weight::One());
+  fst::PrepareForGrammarFst(kNontermPhonesOffset, ans.get());
+  return ans;
+}
+
+// Creates the FST for a nonterminal, entered with left-context phone
+// 'entry_phone', which is the single word 'word' on one frame with
+// transition-id 'transition_id', and is left with left-context phone 2.
+static std::shared_ptr<StdVectorFst> CreateNonterminalFst(
+    int32 entry_phone, int32 transition_id, int32 word) {
+  std::shared_ptr<StdVectorFst> ans(new StdVectorFst());
+  for (int32 s = 0; s < 4; s++)
+    ans->AddState();
+  ans->SetStart(0);
+  ans->AddArc(0, StdArc(NontermLabel(fst::kNontermBegin, entry_phone), 0,
+                        0.0, 1));
+  ans->AddArc(1, StdArc(transition_id, word, 0.0, 2));
+  ans->AddArc(2, StdArc(NontermLabel(fst::kNontermEnd, 2), 0, 0.0, 3));
+  ans->SetFinal(3, StdArc::Weight::One());
+  fst::PrepareForGrammarFst(kNontermPhonesOffset, ans.get());
+  return ans;
+}
+
+// Decodes four frames (the length of every path through our grammar) with
+// random likelihoods for transition-ids 1 to 3, and returns the words on the
+// best path.
+static std::vector<int32> DecodeWords(
+    const fst::VectorGrammarFst &grammar_fst) {
+  Matrix<BaseFloat> loglikes(4, 3);
+  loglikes.SetRandn();
+  DecodableMatrixScaled decodable(loglikes, 1.0);
+  LatticeFasterDecoderTpl<fst::VectorGrammarFst> decoder(
+      grammar_fst, LatticeFasterDecoderConfig());
+  KALDI_ASSERT(decoder.Decode(&decodable) && decoder.ReachedFinal());
+  Lattice best_path;
+  decoder.GetBestPath(&best_path);
+  std::vector<int32> alignment, words;
+  LatticeWeight weight;
+  fst::GetLinearSymbolSequence(best_path, &alignment, &words, &weight);
+  KALDI_ASSERT(alignment.size() == 4);
+  return words;
+}
+
+// Checks that a GrammarFst created from another one with overrides decodes
+// with the FST given for the overridden nonterminal, and with the other
+// one's FSTs for the rest, without changing the other GrammarFst; and that
+// GrammarFstOverrideCache evicts the least recently used entry.
+void TestGrammarFstOverride() {
+  typedef fst::GrammarFstOverrideCache<StdVectorFst> OverrideCache;
+  int32 contact = fst::kNontermUserDefined,
+      other = fst::kNontermUserDefined + 1;
+  std::vector<std::pair<int32, std::shared_ptr<StdVectorFst> > > ifsts;
+  ifsts.push_back(std::make_pair(kNontermPhonesOffset + contact,
+                                 CreateNonterminalFst(1, 2, 100)));
+  ifsts.push_back(std::make_pair(kNontermPhonesOffset + other,
+                                 CreateNonterminalFst(2, 2, 300)));
+  fst::VectorGrammarFst base(kNontermPhonesOffset,
+                             CreateTopFst(contact, other), ifsts);
+
+  // The overrides for three speakers, with the contact names 201, 202 and 203.
+  std::vector<std::shared_ptr<const OverrideCache::OverrideList> > overrides;
+  for (int32 i = 1; i <= 3; i++) {
+    OverrideCache::OverrideList *override_list =
+        new OverrideCache::OverrideList;
+    override_list->push_back(std::make_pair(kNontermPhonesOffset + contact,
+                                            CreateNonterminalFst(1, 3,
+                                                                 200 + i)));
+    overrides.push_back(
+        std::shared_ptr<const OverrideCache::OverrideList>(override_list));
+  }
+
+  // The capacity is as given by --speaker-grammar-cache-size in
+  // online2-wav-nnet3-latgen-grammar.
+  OverrideCache cache(2);
+  cache.Insert("a", overrides[0]);
+  cache.Insert("b", overrides[1]);
+  KALDI_ASSERT(cache.Find("a") == overrides[0]);
+  // Now "b" is the least recently used.
+  cache.Insert("c", overrides[2]);
+  KALDI_ASSERT(cache.Find("b") == NULL);
+  KALDI_ASSERT(cache.Find("a") == overrides[0] &&
+               cache.Find("c") == overrides[2]);
+  // Now "a" is the least recently used.
+  cache.Insert("b", overrides[1]);
+  KALDI_ASSERT(cache.Find("a") == NULL);
+  KALDI_ASSERT(cache.Find("c") == overrides[2] &&
+               cache.Find("b") == overrides[1]);
+  cache.Erase("c");
+  KALDI_ASSERT(cache.Find("c") == NULL && cache.Find("b") == overrides[1]);
+
+  std::vector<int32> base_words;
+  base_words.push_back(1);
+  base_words.push_back(100);
+  base_words.push_back(300);
+  base_words.push_back(2);
+  for (int32 i = 0; i < 3; i++) {
+    // overrides[0] was evicted from the cache, but we still hold it, so it
+    // can still be used.
+    fst::VectorGrammarFst speaker_fst(base, *overrides[i]);
+    std::vector<int32> words = DecodeWords(speaker_fst);
+    std::vector<int32> speaker_words(base_words);
+    speaker_words[1] = 201 + i;
+    KALDI_ASSERT(words == speaker_words);
+    KALDI_ASSERT(speaker_fst.NumInstances() == 3);
+    // 'base' is shared, not changed.
+    KALDI_ASSERT(base.NumInstances() == 1 && base.NumExpandedStates() == 0);
+  }
+  KALDI_ASSERT(DecodeWords(base) == base_words);
+  // Decoding with 'base' doesn't affect a GrammarFst created from it.
+  fst::VectorGrammarFst speaker_fst(base, *overrides[1]);
+  KALDI_ASSERT(DecodeWords(speaker_fst)[1] == 202 &&
+               DecodeWords(base) == base_words);
+}
+
+// Checks GrammarFstOverrideCache against a simple implementation of an LRU
+// cache, with random operations.
+void TestGrammarFstOverrideCacheRandom() {
+  typedef fst::GrammarFstOverrideCache<StdVectorFst> OverrideCache;
+  int32 capacity = RandInt(1, 4), num_keys = RandInt(1, 6);
+  OverrideCache cache(capacity);
+  std::vector<std::shared_ptr<const OverrideCache::OverrideList> > values;
+  for (int32 i = 0; i < 10; i++)
+    values.push_back(std::shared_ptr<const OverrideCache::OverrideList>(
+        new OverrideCache::OverrideList));
+  // The keys and values in 'cache', most recently used first.
+  std::list<std::pair<std::string,
+                      std::shared_ptr<const OverrideCache::OverrideList> > >
+      ref;
+  for (int32 n = 0; n < 200; n++) {
+    std::string key = std::to_string(RandInt(0, num_keys - 1));
+    std::shared_ptr<const OverrideCache::OverrideList> ref_value;
+    for (auto iter = ref.begin(); iter != ref.end(); ++iter) {
+      if (iter->first == key) {
+        ref_value = iter->second;
+        ref.erase(iter);
+        break;
+      }
+    }
+    int32 op = RandInt(0, 2);
+    if (op == 0) {
+      KALDI_ASSERT(cache.Find(key) == ref_value);
+      if (ref_value != NULL)
+        ref.push_front(std::make_pair(key, ref_value));
+    } else if (op == 1) {
+      ref_value = values[RandInt(0, values.size() - 1)];
+      cache.Insert(key, ref_value);
+      ref.push_front(std::make_pair(key, ref_value));
+      if (ref.size() > static_cast<size_t>(capacity))
+        ref.pop_back();
+    } else {
+      cache.Erase(key);
+    }
+  }
+  for (auto iter = ref.begin(); iter != ref.end(); ++iter)
+    KALDI_ASSERT(cache.Find(iter->first) == iter->second);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++) {
+    TestGrammarFstOverride();
+    TestGrammarFstOverrideCacheRandom();
+  }
+  std::cout << "Test OK.\n";
+  return 0;
+}
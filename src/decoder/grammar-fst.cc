@@ -17,6 +17,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include "base/timer.h"
 #include "decoder/grammar-fst.h"
 #include "fstext/grammar-context-fst.h"
 
@@ -30,10 +31,56 @@ GrammarFstTpl<FST>::GrammarFstTpl(
     const std::vector<std::pair<Label, std::shared_ptr<FST > > > &ifsts):
     nonterm_phones_offset_(nonterm_phones_offset),
     top_fst_(top_fst),
-    ifsts_(ifsts) {
+    ifsts_(ifsts), num_instances_(0), expanded_table_(NULL) {
   Init();
 }
 
+template <typename FST>
+GrammarFstTpl<FST>::GrammarFstTpl(const GrammarFstTpl<FST> &other):
+    nonterm_phones_offset_(other.nonterm_phones_offset_),
+    top_fst_(other.top_fst_),
+    ifsts_(other.ifsts_), num_instances_(0), expanded_table_(NULL) {
+  Init();
+}
+
+template <typename FST>
+GrammarFstTpl<FST>::GrammarFstTpl(
+    const GrammarFstTpl<FST> &other,
+    const std::vector<std::pair<Label, std::shared_ptr<FST > > > &overrides):
+    nonterm_phones_offset_(other.nonterm_phones_offset_),
+    top_fst_(other.top_fst_),
+    ifsts_(other.ifsts_), num_instances_(0), expanded_table_(NULL) {
+  std::vector<int32> override_indexes(overrides.size());
+  for (size_t i = 0; i < overrides.size(); i++) {
+    int32 nonterminal = overrides[i].first;
+    KALDI_ASSERT(overrides[i].second != NULL);
+    std::unordered_map<int32, int32>::const_iterator iter =
+        other.nonterminal_map_.find(nonterminal);
+    if (iter != other.nonterminal_map_.end()) {
+      override_indexes[i] = iter->second;
+      ifsts_[iter->second].second = overrides[i].second;
+    } else {
+      // InitNonterminalMap(), called from Init(), will detect it if the same
+      // new nonterminal appears twice in 'overrides'.
+      override_indexes[i] = ifsts_.size();
+      ifsts_.push_back(overrides[i]);
+    }
+  }
+  Init();
+  // Check the new FSTs now rather than when they are first entered while
+  // decoding, so that problems are detected sooner.
+  for (size_t i = 0; i < override_indexes.size(); i++)
+    if (entry_arcs_[override_indexes[i]].empty())
+      InitEntryArcs(override_indexes[i]);
+}
+
+template <typename FST>
+GrammarFstTpl<FST>::GrammarFstTpl():
+    nonterm_phones_offset_(-1), num_instances_(0), expanded_table_(NULL) {
+  for (int32 b = 0; b < kMaxInstanceBlocks; b++)
+    instance_blocks_[b].store(NULL, std::memory_order_relaxed);
+}
+
 template <typename FST>
 void GrammarFstTpl<FST>::Init() {
   KALDI_ASSERT(nonterm_phones_offset_ > 1);
@@ -62,7 +109,17 @@ void GrammarFstTpl<FST>::Destroy() {
   ifsts_.clear();
   nonterminal_map_.clear();
   entry_arcs_.clear();
-  instances_.clear();
+  for (int32 b = 0; b < kMaxInstanceBlocks; b++) {
+    delete [] instance_blocks_[b].load(std::memory_order_relaxed);
+    instance_blocks_[b].store(NULL, std::memory_order_relaxed);
+  }
+  num_instances_ = 0;
+  delete expanded_table_.load(std::memory_order_relaxed);
+  expanded_table_.store(NULL, std::memory_order_relaxed);
+  for (size_t i = 0; i < retired_tables_.size(); i++)
+    delete retired_tables_[i];
+  retired_tables_.clear();
+  expanded_states_.clear();
 }
 
 template <typename FST>
@@ -118,12 +175,121 @@ bool GrammarFstTpl<FST>::InitEntryArcs(int32 i) {
 
 template <typename FST>
 void GrammarFstTpl<FST>::InitInstances() {
-  KALDI_ASSERT(instances_.empty());
-  instances_.resize(1);
-  instances_[0].ifst_index = -1;
-  instances_[0].fst = top_fst_.get();
-  instances_[0].parent_instance = -1;
-  instances_[0].parent_state = -1;
+  for (int32 b = 0; b < kMaxInstanceBlocks; b++)
+    instance_blocks_[b].store(NULL, std::memory_order_relaxed);
+  num_instances_ = 0;
+  NewInstance();  // Creates instance 0.
+  FstInstance &instance = GetMutableInstance(0);
+  instance.ifst_index = -1;
+  instance.fst = top_fst_.get();
+  instance.parent_instance = -1;
+  instance.parent_state = -1;
+
+  KALDI_ASSERT(retired_tables_.empty() && expanded_states_.empty());
+  expanded_table_.store(new ExpandedStateTable(10), std::memory_order_release);
+  num_expanded_arcs_ = 0;
+  expand_time_ = 0.0;
+  num_expanded_by_other_thread_ = 0;
+}
+
+template <typename FST>
+int32 GrammarFstTpl<FST>::NewInstance() {
+  int32 instance_id = num_instances_,
+      block = instance_id >> kInstanceBlockShift;
+  if (block >= kMaxInstanceBlocks)
+    KALDI_ERR << "Too many FST instances were created (" << instance_id
+              << "); does the grammar have unbounded recursion?";
+  if (instance_blocks_[block].load(std::memory_order_relaxed) == NULL)
+    instance_blocks_[block].store(new FstInstance[kInstanceBlockSize],
+                                  std::memory_order_release);
+  num_instances_++;
+  return instance_id;
+}
+
+template <typename FST>
+void GrammarFstTpl<FST>::InsertExpandedState(StateId s,
+                                             const ExpandedState *e) {
+  ExpandedStateTable *table = expanded_table_.load(std::memory_order_relaxed);
+  size_t num_buckets = table->keys.size();
+  if (2 * (expanded_states_.size() + 1) > num_buckets) {
+    // Copy the entries to a table twice the size.  Other threads may still be
+    // doing lookups in the old table, so we keep it until we are destroyed.
+    int32 log_num_buckets = 64 - table->shift + 1;
+    ExpandedStateTable *new_table = new ExpandedStateTable(log_num_buckets);
+    size_t new_mask = new_table->keys.size() - 1;
+    for (size_t b = 0; b < num_buckets; b++) {
+      const ExpandedState *value =
+          table->values[b].load(std::memory_order_relaxed);
+      if (value == NULL)
+        continue;
+      StateId key = table->keys[b];
+      size_t new_b = new_table->Bucket(key);
+      while (new_table->values[new_b].load(std::memory_order_relaxed) != NULL)
+        new_b = (new_b + 1) & new_mask;
+      new_table->keys[new_b] = key;
+      new_table->values[new_b].store(value, std::memory_order_relaxed);
+    }
+    // The release ordering makes the contents of the new table visible to
+    // threads that see the new pointer.
+    expanded_table_.store(new_table, std::memory_order_release);
+    retired_tables_.push_back(table);
+    table = new_table;
+  }
+  size_t mask = table->keys.size() - 1, b = table->Bucket(s);
+  while (table->values[b].load(std::memory_order_relaxed) != NULL) {
+    KALDI_ASSERT(table->keys[b] != s);
+    b = (b + 1) & mask;
+  }
+  table->keys[b] = s;
+  // The key must be written before the value is published; see
+  // ExpandedStateTable.
+  table->values[b].store(e, std::memory_order_release);
+}
+
+template <typename FST>
+const typename GrammarFstTpl<FST>::ExpandedState*
+GrammarFstTpl<FST>::ExpandAndCacheState(int32 instance_id,
+                                        BaseStateId state_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  StateId s = (static_cast<StateId>(instance_id) << 32) | state_id;
+  // Another thread may have expanded this state while we were waiting for
+  // the lock.
+  const ExpandedState *ans = FindExpandedState(s);
+  if (ans != NULL) {
+    num_expanded_by_other_thread_++;
+    return ans;
+  }
+  kaldi::Timer timer;
+  std::shared_ptr<ExpandedState> expanded_state =
+      ExpandState(instance_id, state_id);
+  InsertExpandedState(s, expanded_state.get());
+  expanded_states_.push_back(expanded_state);
+  num_expanded_arcs_ += expanded_state->arcs.size();
+  expand_time_ += timer.Elapsed();
+  return expanded_state.get();
+}
+
+template <typename FST>
+void GrammarFstTpl<FST>::PrintStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  KALDI_LOG << "GrammarFst has " << num_instances_ << " FST instances and "
+            << expanded_states_.size() << " expanded states with "
+            << num_expanded_arcs_ << " arcs; expanding states took "
+            << expand_time_ << " seconds.  Threads waited for another "
+            << "thread's expansion of the same state "
+            << num_expanded_by_other_thread_ << " times.";
+}
+
+template <typename FST>
+int32 GrammarFstTpl<FST>::NumInstances() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_instances_;
+}
+
+template <typename FST>
+size_t GrammarFstTpl<FST>::NumExpandedStates() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return expanded_states_.size();
 }
 
 template <typename FST>
@@ -169,7 +335,7 @@ template <typename FST>
 std::shared_ptr<typename GrammarFstTpl<FST>::ExpandedState> GrammarFstTpl<FST>::ExpandState(
     int32 instance_id, BaseStateId state_id) {
   int32 big_number = kNontermBigNumber;
-  FST &fst = *(instances_[instance_id].fst);
+  FST &fst = *(GetInstance(instance_id).fst);
   ArcIterator<FST> aiter(fst, state_id);
   KALDI_ASSERT(!aiter.Done() && aiter.Value().ilabel > big_number &&
                "Something is not right; did you call PrepareForGrammarFst()?");
@@ -221,10 +387,10 @@ std::shared_ptr<typename GrammarFstTpl<FST>::ExpandedState> GrammarFstTpl<FST>::
     int32 instance_id, BaseStateId state_id) {
   if (instance_id == 0)
     KALDI_ERR << "Did not expect #nonterm_end symbol in FST-instance 0.";
-  const FstInstance &instance = instances_[instance_id];
+  const FstInstance &instance = GetInstance(instance_id);
   int32 parent_instance_id = instance.parent_instance;
   FST &fst = *(instance.fst);
-  const FstInstance &parent_instance = instances_[parent_instance_id];
+  const FstInstance &parent_instance = GetInstance(parent_instance_id);
   FST &parent_fst = *(parent_instance.fst);
 
   std::shared_ptr<ExpandedState> ans = std::make_shared<ExpandedState>();
@@ -237,7 +403,7 @@ std::shared_ptr<typename GrammarFstTpl<FST>::ExpandedState> GrammarFstTpl<FST>::
                                               instance.parent_state);
 
   // for explanation of cost_correction, see documentation for CombineArcs().
-  float num_reentry_arcs = instances_[instance_id].parent_reentry_arcs.size(),
+  float num_reentry_arcs = instance.parent_reentry_arcs.size(),
       cost_correction = -log(num_reentry_arcs);
 
   ArcIterator<FST > aiter(fst, state_id);
@@ -251,8 +417,8 @@ std::shared_ptr<typename GrammarFstTpl<FST>::ExpandedState> GrammarFstTpl<FST>::
                  ">1 nonterminals from a state; did you use "
                  "PrepareForGrammarFst()?");
     std::unordered_map<int32, int32>::const_iterator reentry_iter =
-        instances_[instance_id].parent_reentry_arcs.find(left_context_phone),
-        reentry_end = instances_[instance_id].parent_reentry_arcs.end();
+        instance.parent_reentry_arcs.find(left_context_phone),
+        reentry_end = instance.parent_reentry_arcs.end();
     if (reentry_iter == reentry_end) {
       KALDI_ERR << "FST with index " << instance.ifst_index
                 << " ends with left-context-phone " << left_context_phone
@@ -285,11 +451,11 @@ int32 GrammarFstTpl<FST>::GetChildInstanceId(int32 instance_id, int32 nontermina
   // 'new_instance_id' is the instance-id we'd assign if we had to create a new one.
   // We try to add it at once, to avoid having to do an extra map lookup in case
   // it wasn't there and we did need to add it.
-  int32 child_instance_id = instances_.size();
+  int32 child_instance_id = num_instances_;
   {
     std::pair<int64, int32> p(encoded_pair, child_instance_id);
     std::pair<std::unordered_map<int64, int32>::const_iterator, bool> ans =
-        instances_[instance_id].child_instances.insert(p);
+        GetMutableInstance(instance_id).child_instances.insert(p);
     if (!ans.second) {
       // The pair was not inserted, which means the key 'encoded_pair' did exist in the
       // map.  Return the value in the map.
@@ -300,9 +466,9 @@ int32 GrammarFstTpl<FST>::GetChildInstanceId(int32 instance_id, int32 nontermina
   // If we reached this point, we did successfully insert 'child_instance_id' into
   // the map, because the key didn't exist.  That means we have to actually create
   // the instance.
-  instances_.resize(child_instance_id + 1);
-  const FstInstance &parent_instance = instances_[instance_id];
-  FstInstance &child_instance = instances_[child_instance_id];
+  NewInstance();  // Creates the instance numbered child_instance_id.
+  const FstInstance &parent_instance = GetInstance(instance_id);
+  FstInstance &child_instance = GetMutableInstance(child_instance_id);
 
   // Work out the ifst_index for this nonterminal.
   std::unordered_map<int32, int32>::const_iterator iter =
@@ -325,7 +491,7 @@ int32 GrammarFstTpl<FST>::GetChildInstanceId(int32 instance_id, int32 nontermina
 template <typename FST>
 std::shared_ptr<typename GrammarFstTpl<FST>::ExpandedState> GrammarFstTpl<FST>::ExpandStateUserDefined(
     int32 instance_id, BaseStateId state_id) {
-  FST &fst = *(instances_[instance_id].fst);
+  FST &fst = *(GetInstance(instance_id).fst);
   ArcIterator<FST > aiter(fst, state_id);
 
   std::shared_ptr<ExpandedState> ans = std::make_shared<ExpandedState>();
@@ -346,7 +512,7 @@ std::shared_ptr<typename GrammarFstTpl<FST>::ExpandedState> GrammarFstTpl<FST>::
       KALDI_ERR << "Same state leaves to different FST instances "
           "(Did you use PrepareForGrammarFst()?)";
     }
-    const FstInstance &child_instance = instances_[child_instance_id];
+    const FstInstance &child_instance = GetInstance(child_instance_id);
     FST &child_fst = *(child_instance.fst);
     int32 child_ifst_index = child_instance.ifst_index;
     std::unordered_map<int32, int32> &entry_arcs = entry_arcs_[child_ifst_index];
@@ -381,6 +547,68 @@ std::shared_ptr<typename GrammarFstTpl<FST>::ExpandedState> GrammarFstTpl<FST>::
   return ans;
 }
 
+template <typename FST>
+GrammarFstOverrideCache<FST>::GrammarFstOverrideCache(int32 capacity):
+    capacity_(capacity), num_hits_(0), num_misses_(0) {
+  KALDI_ASSERT(capacity > 0);
+}
+
+template <typename FST>
+std::shared_ptr<const typename GrammarFstOverrideCache<FST>::OverrideList>
+GrammarFstOverrideCache<FST>::Find(const std::string &key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  typename std::unordered_map<std::string,
+      typename LruList::iterator>::iterator iter = map_.find(key);
+  if (iter == map_.end()) {
+    num_misses_++;
+    return NULL;
+  }
+  num_hits_++;
+  // Move the entry to the front of the list; this doesn't invalidate
+  // iterators.
+  lru_list_.splice(lru_list_.begin(), lru_list_, iter->second);
+  return iter->second->second;
+}
+
+template <typename FST>
+void GrammarFstOverrideCache<FST>::Insert(
+    const std::string &key,
+    std::shared_ptr<const OverrideList> overrides) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  typename std::unordered_map<std::string,
+      typename LruList::iterator>::iterator iter = map_.find(key);
+  if (iter != map_.end()) {
+    iter->second->second = overrides;
+    lru_list_.splice(lru_list_.begin(), lru_list_, iter->second);
+    return;
+  }
+  lru_list_.push_front(std::make_pair(key, overrides));
+  map_[key] = lru_list_.begin();
+  if (static_cast<int32>(lru_list_.size()) > capacity_) {
+    map_.erase(lru_list_.back().first);
+    lru_list_.pop_back();
+  }
+}
+
+template <typename FST>
+void GrammarFstOverrideCache<FST>::Erase(const std::string &key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  typename std::unordered_map<std::string,
+      typename LruList::iterator>::iterator iter = map_.find(key);
+  if (iter != map_.end()) {
+    lru_list_.erase(iter->second);
+    map_.erase(iter);
+  }
+}
+
+template <typename FST>
+void GrammarFstOverrideCache<FST>::PrintStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  KALDI_LOG << "Grammar override cache has " << lru_list_.size()
+            << " entries (capacity " << capacity_ << "); " << num_hits_
+            << " lookups were hits and " << num_misses_ << " were misses.";
+}
+
 template <typename FST>
 void GrammarFstTpl<FST>::Write(std::ostream &os, bool binary) const {
   using namespace kaldi;
@@ -1041,6 +1269,9 @@ void CopyToVectorFst(GrammarFstTpl<FST> *grammar_fst,
 template class GrammarFstTpl<const ConstFst<StdArc> >;
 template class GrammarFstTpl<StdVectorFst>;
 
+template class GrammarFstOverrideCache<const ConstFst<StdArc> >;
+template class GrammarFstOverrideCache<StdVectorFst>;
+
 template class ArcIterator<GrammarFstTpl<const ConstFst<StdArc> > >;
 template class ArcIterator<GrammarFstTpl<StdVectorFst> >;
 
@@ -31,6 +31,10 @@
  */
 
 
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
 
 #include "fst/fstlib.h"
 #include "fstext/grammar-context-fst.h"
@@ -92,10 +96,11 @@ template <typename instance_FST> class ArcIterator<GrammarFstTpl<instance_FST> >
    points whenever we invoke a nonterminal.  For more information
    see \ref grammar (i.e. ../doc/grammar.dox).
 
-   THREAD SAFETY: you can't use this object from multiple threads; you should
-   create lightweight copies of this object using the copy constructor,
-   e.g. `new GrammarFst(this_grammar_fst)`, if you want to decode from multiple
-   threads using the same GrammarFst.
+   THREAD SAFETY: a single GrammarFst may be used by any number of decoder
+   threads at once.  States are expanded on demand the first time any thread
+   reaches them, and the expansions are shared between threads: looking up an
+   already-expanded state (the usual case, once decoding is under way) does not
+   take a lock, while expanding a new state is done while holding a mutex.
 */
 template <typename FST>
 class GrammarFstTpl {
@@ -150,13 +155,34 @@ class GrammarFstTpl {
       std::shared_ptr<FST> top_fst,
       const std::vector<std::pair<int32, std::shared_ptr<FST> > > &ifsts);
 
-  /// Copy constructor.  Useful because this object is not thread safe so cannot
-  /// be used by multiple parallel decoder threads, but it is lightweight and
-  /// can copy it without causing the stored FSTs to be copied.
-  GrammarFstTpl(const GrammarFstTpl<FST> &other) = default;
+  /// Copy constructor.  This shares the stored FSTs with 'other' (they are
+  /// not copied), but starts with no expanded states.  There is no need to
+  /// make copies for use by multiple threads, as this object is thread safe.
+  GrammarFstTpl(const GrammarFstTpl<FST> &other);
+
+  /**
+     This constructor is for binding nonterminals to different FSTs per decode
+     session (e.g. a user's contact names as the FST for #nonterm:contact),
+     without rebuilding the rest of the grammar.  It shares the top-level FST
+     and the FSTs for other nonterminals with 'other', and like the copy
+     constructor it starts with no expanded states.  It is fast: it does not
+     copy any FSTs, and its only work proportional to the size of an FST is
+     to check the arcs leaving the start state of each FST in 'overrides'.
+
+     @param [in] other  The GrammarFst to share the FSTs with.
+     @param [in] overrides  A list of pairs (nonterminal-symbol, FST) as for
+              the 'ifsts' argument of the main constructor.  If 'other' has an
+              FST for the nonterminal it is replaced by the one given here;
+              otherwise the nonterminal is added.  The FSTs must have been
+              prepared with PrepareForGrammarFst(), using the same
+              nonterm_phones_offset as the other FSTs.
+   */
+  GrammarFstTpl(
+      const GrammarFstTpl<FST> &other,
+      const std::vector<std::pair<int32, std::shared_ptr<FST> > > &overrides);
 
   ///  This constructor should only be used prior to calling Read().
-  GrammarFstTpl() { }
+  GrammarFstTpl();
 
   // This Write function allows you to dump a GrammarFst to disk as a single
   // object.  It only supports binary mode, but the option is allowed for
@@ -196,7 +222,7 @@ class GrammarFstTpl {
     // Compare with the constructor of ArcIterator.
     int32 instance_id = s >> 32;
     BaseStateId base_state = static_cast<int32>(s);
-    const GrammarFstTpl::FstInstance &instance = instances_[instance_id];
+    const GrammarFstTpl::FstInstance &instance = GetInstance(instance_id);
     FST *base_fst = instance.fst;
     if (base_fst->Final(base_state).Value() != KALDI_GRAMMAR_FST_SPECIAL_WEIGHT) {
       return base_fst->NumInputEpsilons(base_state);
@@ -207,6 +233,17 @@ class GrammarFstTpl {
 
   std::string Type() const { return "grammar"; }
 
+  /// Prints (via KALDI_LOG) statistics on the expansion of states so far:
+  /// the number of FST instances and expanded states, the time spent
+  /// expanding states, and how often threads had to wait for each other.
+  void PrintStats() const;
+
+  /// Returns the number of FST instances created so far.
+  int32 NumInstances() const;
+
+  /// Returns the number of states expanded so far.
+  size_t NumExpandedStates() const;
+
   ~GrammarFstTpl();
 
   /**
@@ -237,6 +274,9 @@ class GrammarFstTpl {
   // An FstInstance is a copy of an FST.  The instance numbered zero is for
   // top_fst_, and (to state it approximately) whenever any FST instance invokes
   // another FST a new instance will be generated on demand.
+  // Once an instance has been created, only the maps 'child_instances' and
+  // 'parent_reentry_arcs' are accessed by the expansion code, which holds
+  // mutex_ while doing so; the other members are never changed.
   struct FstInstance {
     // ifst_index is the index into the ifsts_ vector that corresponds to this
     // FST instance, or -1 if this is the top-level instance.
@@ -246,13 +286,6 @@ class GrammarFstTpl {
     // if ifst_index == -1, or ifsts_[ifst_index].second otherwise.
     FST *fst;
 
-    // 'expanded_states', which will be populated on demand as states in this
-    // FST instance are accessed, will only contain entries for states in this
-    // FST that the final-prob's value equal to
-    // KALDI_GRAMMAR_FST_SPECIAL_WEIGHT.  (That final-prob value is used as a
-    // kind of signal to this code that the state needs expansion).
-    std::unordered_map<BaseStateId, std::shared_ptr<ExpandedState> > expanded_states;
-
     // 'child_instances', which is populated on demand as states in this FST
     // instance are accessed, is logically a map from pair (nonterminal_index,
     // return_state) to instance_id.  When we encounter an arc in our FST with a
@@ -294,11 +327,6 @@ class GrammarFstTpl {
     std::unordered_map<int32, int32> parent_reentry_arcs;
   };
 
-  // The FST instances.  Initially it is a vector with just one element
-  // representing top_fst_, and it will be populated with more elements on
-  // demand.  An instance_id refers to an index into this vector.
-  std::vector<FstInstance> instances_;
-
   // The integer id of the symbol #nonterm_bos in phones.txt.
   int32 nonterm_phones_offset_;
 
@@ -329,6 +357,120 @@ class GrammarFstTpl {
  private:
   friend class ArcIterator<GrammarFstTpl<FST> >;
 
+  // The FST instances are stored in blocks of kInstanceBlockSize, which are
+  // allocated as needed and never moved, so that decoder threads can look up
+  // instances without locking while other threads are adding instances.
+  static const int32 kInstanceBlockShift = 10;
+  static const int32 kInstanceBlockSize = 1 << kInstanceBlockShift;
+  // This limits the number of FST instances to about 4 million, which is far
+  // more than any sensible grammar needs.
+  static const int32 kMaxInstanceBlocks = 4096;
+
+  /**
+     ExpandedStateTable is a hash table from the StateId of an expanded state
+     (which encodes the instance-id and the state in that instance) to the
+     ExpandedState, using open addressing with linear probing.  It is
+     insert-only.  Lookups are done without locking: an entry is written by
+     first setting the key and then setting the value with release semantics,
+     and a lookup stops at the first bucket whose value is NULL.  Inserts are
+     done while holding mutex_; when the table gets half full we copy it to a
+     table twice the size, but we keep the old table (in retired_tables_)
+     because other threads may still be doing lookups in it.
+  */
+  struct ExpandedStateTable {
+    explicit ExpandedStateTable(int32 log_num_buckets):
+        shift(64 - log_num_buckets), keys(1 << log_num_buckets),
+        values(1 << log_num_buckets) { }
+    // 'shift' is 64 minus the log of the number of buckets; see Bucket().
+    int32 shift;
+    std::vector<StateId> keys;
+    std::vector<std::atomic<const ExpandedState*> > values;
+
+    // Returns the first bucket to look in for state s.
+    inline size_t Bucket(StateId s) const {
+      // Multiplicative (Fibonacci) hashing: the top bits of the product are
+      // well mixed.
+      return static_cast<size_t>(
+          (static_cast<uint64>(s) * 11400714819323198485ULL) >> shift);
+    }
+  };
+
+  // Returns the FST instance with this instance-id, which must already exist.
+  // Does not lock.
+  inline const FstInstance &GetInstance(int32 instance_id) const {
+    return instance_blocks_[instance_id >> kInstanceBlockShift].load(
+        std::memory_order_acquire)[instance_id & (kInstanceBlockSize - 1)];
+  }
+
+  // As GetInstance(), but non-const.  Only to be called while holding mutex_
+  // (or while initializing).
+  inline FstInstance &GetMutableInstance(int32 instance_id) {
+    return instance_blocks_[instance_id >> kInstanceBlockShift].load(
+        std::memory_order_relaxed)[instance_id & (kInstanceBlockSize - 1)];
+  }
+
+  // Creates a new FST instance, with uninitialized members, and returns its
+  // instance-id.  Only to be called while holding mutex_ (or while
+  // initializing).
+  int32 NewInstance();
+
+  // Looks up the expanded state for state s (which includes the instance-id)
+  // and returns it, or NULL if it has not been expanded yet.  Does not lock.
+  inline const ExpandedState *FindExpandedState(StateId s) const {
+    const ExpandedStateTable *table =
+        expanded_table_.load(std::memory_order_acquire);
+    size_t mask = table->keys.size() - 1;
+    for (size_t b = table->Bucket(s); ; b = (b + 1) & mask) {
+      const ExpandedState *ans =
+          table->values[b].load(std::memory_order_acquire);
+      if (ans == NULL || table->keys[b] == s)
+        return ans;
+    }
+  }
+
+  // Adds the expanded state 'e' for state s to expanded_table_, enlarging the
+  // table if needed.  Only to be called while holding mutex_.
+  void InsertExpandedState(StateId s, const ExpandedState *e);
+
+  // Called from GetExpandedState() when the state was not found in
+  // expanded_table_: this locks mutex_, and expands the state and adds it to
+  // the table (unless another thread did so first).
+  const ExpandedState *ExpandAndCacheState(int32 instance_id,
+                                           BaseStateId state_id);
+
+  // instance_blocks_[b] points to the array of FST instances with instance-ids
+  // b * kInstanceBlockSize through (b + 1) * kInstanceBlockSize - 1, or is
+  // NULL if none of them exists yet.
+  std::atomic<FstInstance*> instance_blocks_[kMaxInstanceBlocks];
+
+  // The number of FST instances.  Initially 1 (the instance representing
+  // top_fst_), and incremented as instances are created on demand.  Only
+  // accessed while holding mutex_ (or while initializing).
+  int32 num_instances_;
+
+  // The table used to look up expanded states; see ExpandedStateTable.
+  std::atomic<ExpandedStateTable*> expanded_table_;
+
+  // The following are only accessed while holding mutex_.
+  // Tables that have been replaced by larger ones; see ExpandedStateTable.
+  std::vector<ExpandedStateTable*> retired_tables_;
+  // All the expanded states, which are owned here; expanded_table_ holds
+  // pointers to them.  They will only contain entries for states whose
+  // final-prob's value equals KALDI_GRAMMAR_FST_SPECIAL_WEIGHT.  (That
+  // final-prob value is used as a kind of signal to this code that the state
+  // needs expansion).
+  std::vector<std::shared_ptr<ExpandedState> > expanded_states_;
+  // Statistics for PrintStats(): the total number of arcs in the expanded
+  // states, the time spent expanding states, and the number of times a
+  // thread that was about to expand a state found that another thread had
+  // already done so while it was waiting for the lock.
+  size_t num_expanded_arcs_;
+  double expand_time_;
+  int64 num_expanded_by_other_thread_;
+
+  // Guards the expansion of states; see THREAD SAFETY in the class comment.
+  mutable std::mutex mutex_;
+
   // sets up nonterminal_map_.
   void InitNonterminalMap();
 
@@ -342,14 +484,15 @@ class GrammarFstTpl {
   // entry_arcs_[i]; and false if it left it empty because
   bool InitEntryArcs(int32 i);
 
-  // sets up instances_ with the top-level instance.
+  // sets up the FST instances with just the top-level instance, and
+  // expanded_table_ with no expanded states.
   void InitInstances();
 
   // Does the initialization tasks after nonterm_phones_offset_,
   // top_fsts_ and ifsts_ have been set up
   void Init();
 
-  // clears everything.
+  // clears everything, and frees the FST instances and expanded states.
   void Destroy();
 
   /*
@@ -408,7 +551,8 @@ class GrammarFstTpl {
   // particular state-id in the FstInstance for this instance_id.  It is called
   // when we have determined that an ExpandedState needs to be created and that
   // it is not currently present.  It creates and returns it; the calling code
-  // needs to add it to the expanded_states map for its FST instance.
+  // needs to add it to expanded_states_ and expanded_table_.  This and the
+  // functions it calls must only be called while holding mutex_.
   std::shared_ptr<ExpandedState> ExpandState(int32 instance_id, BaseStateId state_id);
 
   // Called from ExpandState() when the nonterminal type on the arcs is
@@ -421,7 +565,7 @@ class GrammarFstTpl {
 
   // Called from ExpandStateUserDefined(), this function attempts to look up the
   // pair (nonterminal, state) in the map
-  // instances_[instance_id].child_instances.  If it exists (because this
+  // GetInstance(instance_id).child_instances.  If it exists (because this
   // return-state has been expanded before), it returns the value it found;
   // otherwise it creates the child-instance and returns its newly created
   // instance-id.
@@ -465,27 +609,19 @@ class GrammarFstTpl {
                                  StdArc *arc);
 
   /** Called from the ArcIterator constructor when we encounter an FST state with
-      nonzero final-prob, this function first looks up this state_id in
-      'expanded_states' member of the corresponding FstInstance, and returns it
-      if already present; otherwise it populates the 'expanded_states' map with
-      something for this state_id and returns the value.
+      nonzero final-prob, this function first looks up this state in
+      expanded_table_, and returns it if already present; otherwise it expands
+      the state, adds it to the table and returns it.  The returned pointer
+      remains valid until this object is destroyed.
   */
-  inline std::shared_ptr<ExpandedState> GetExpandedState(int32 instance_id,
-                                         BaseStateId state_id) {
-    std::unordered_map<BaseStateId, std::shared_ptr<ExpandedState> > &expanded_states =
-        instances_[instance_id].expanded_states;
-
-    typename std::unordered_map<BaseStateId, std::shared_ptr<ExpandedState> >::iterator iter =
-        expanded_states.find(state_id);
-    if (iter != expanded_states.end()) {
-      return iter->second;
-    } else {
-      std::shared_ptr<ExpandedState> ans = ExpandState(instance_id, state_id);
-      // Don't use the reference 'expanded_states'; it could have been
-      // invalidated.
-      instances_[instance_id].expanded_states[state_id] = ans;
+  inline const ExpandedState *GetExpandedState(int32 instance_id,
+                                               BaseStateId state_id) {
+    StateId s = (static_cast<StateId>(instance_id) << 32) | state_id;
+    const ExpandedState *ans = FindExpandedState(s);
+    if (ans != NULL)
       return ans;
-    }
+    else
+      return ExpandAndCacheState(instance_id, state_id);
   }
 };
 
@@ -515,7 +651,8 @@ class ArcIterator<GrammarFstTpl<instance_FST > > {
     // explicitly say int32 below, not BaseStateId == int, which might on some
     // compilers be a 64-bit type.
     BaseStateId base_state = static_cast<int32>(s);
-    const typename GrammarFstTpl<instance_FST >::FstInstance &instance = fst.instances_[instance_id];
+    const typename GrammarFstTpl<instance_FST >::FstInstance &instance =
+        fst.GetInstance(instance_id);
     instance_FST *base_fst = instance.fst;
     if (base_fst->Final(base_state).Value() != KALDI_GRAMMAR_FST_SPECIAL_WEIGHT) {
       // A normal state
@@ -524,8 +661,8 @@ class ArcIterator<GrammarFstTpl<instance_FST > > {
       i_ = 0;
     } else {
       // A special state
-      std::shared_ptr<ExpandedState> expanded_state = fst.GetExpandedState(instance_id,
-                                                           base_state);
+      const ExpandedState *expanded_state = fst.GetExpandedState(instance_id,
+                                                                 base_state);
       dest_instance_ = expanded_state->dest_fst_instance;
       // it's ok to leave the other members of data_ uninitialized, as they will
       // never be interrogated.
@@ -643,6 +780,57 @@ void CopyToVectorFst(GrammarFstTpl<FST> *grammar_fst,
 void PrepareForGrammarFst(int32 nonterm_phones_offset,
                           VectorFst<StdArc> *fst);
 
+
+/**
+   GrammarFstOverrideCache is a small LRU cache of sets of nonterminal FSTs,
+   for servers that decode with per-user grammars: the key would identify a
+   user (or a version of a user's grammar) and the value is the list of pairs
+   (nonterminal-symbol, FST) to give to the GrammarFst constructor that
+   overrides nonterminals.  This saves reading and converting the user's
+   FSTs again when the same user makes several requests.  Evicting an entry
+   doesn't free its FSTs while any GrammarFst is still using them, as they
+   are held by shared_ptr.  This class is thread safe.
+*/
+template <typename FST>
+class GrammarFstOverrideCache {
+ public:
+  typedef std::vector<std::pair<int32, std::shared_ptr<FST> > > OverrideList;
+
+  /// 'capacity' is the maximum number of entries kept; must be > 0.
+  explicit GrammarFstOverrideCache(int32 capacity);
+
+  /// Returns the entry for 'key' and makes it the most recently used one, or
+  /// returns NULL if there is no entry for 'key'.
+  std::shared_ptr<const OverrideList> Find(const std::string &key);
+
+  /// Adds (or replaces) the entry for 'key', making it the most recently used
+  /// one.  If that makes the number of entries exceed the capacity, removes
+  /// the least recently used entry.
+  void Insert(const std::string &key,
+              std::shared_ptr<const OverrideList> overrides);
+
+  /// Removes the entry for 'key', if there is one; e.g. call this when a
+  /// user's grammar has changed.
+  void Erase(const std::string &key);
+
+  /// Prints (via KALDI_LOG) the number of entries, hits and misses.
+  void PrintStats() const;
+
+ private:
+  typedef std::list<std::pair<std::string,
+                              std::shared_ptr<const OverrideList> > > LruList;
+
+  int32 capacity_;
+  // The entries, most recently used first.
+  LruList lru_list_;
+  // Maps from the key to the entry in lru_list_.
+  std::unordered_map<std::string, typename LruList::iterator> map_;
+  int64 num_hits_;
+  int64 num_misses_;
+  mutable std::mutex mutex_;
+};
+
+
 // Template aliases
 using ConstGrammarFst = GrammarFstTpl<const ConstFst<StdArc> >;
 using VectorGrammarFst =  GrammarFstTpl<StdVectorFst>;
@@ -43,6 +43,10 @@ typedef LatticeFasterDecoderConfig LatticeBiglmFasterDecoderConfig;
     DeterministicOnDemandFst follows through the epsilons in G for you
     (assuming G is a standard backoff language model) and makes it look
     like a determinized FST.
+
+    See also fst::BiglmFst in biglm-fst.h, which does the same composition as an
+    FST type that LatticeFasterDecoderTpl and the online decoders can be
+    instantiated with.
 */
 
 class LatticeBiglmFasterDecoder {
@@ -0,0 +1,212 @@
+// decoder/lattice-faster-decoder-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+
+#include "decoder/decodable-matrix.h"
+#include "decoder/decoder-test-utils.h"
+#include "decoder/decoder-wrappers.h"
+#include "decoder/lattice-faster-decoder.h"
+#include "hmm/hmm-test-utils.h"
+
+namespace kaldi {
+
+// Checks that 'lat' has a path from the start state to a final state, and
+// returns the number of frames on its best path.
+static int32 CheckConnectedAndGetNumFrames(const Lattice &lat) {
+  Lattice connected(lat);
+  fst::Connect(&connected);
+  KALDI_ASSERT(connected.NumStates() > 0);
+  Lattice best_path;
+  fst::ShortestPath(connected, &best_path);
+  std::vector<int32> alignment, words;
+  LatticeWeight weight;
+  fst::GetLinearSymbolSequence(best_path, &alignment, &words, &weight);
+  return alignment.size();
+}
+
+// Decodes with GetRawLatticePrefix() called after every few frames, with
+// small lattice segments and 'force' mostly true, so that cuts are often
+// forced, and checks that each segment and the final lattice are connected
+// and that together they cover all the frames.
+void TestGetRawLatticePrefix() {
+  int32 num_pdfs = RandInt(10, 100), num_words = RandInt(1, 50);
+  fst::VectorFst<fst::StdArc> graph;
+  RandDecodingGraph(RandInt(10, 1000), num_pdfs, num_words, &graph);
+  LatticeFasterDecoderConfig config;
+  config.beam = RandInt(10, 20);
+  config.lattice_beam = RandInt(5, 10);
+  config.prune_interval = RandInt(1, 25);
+  LatticeFasterDecoder decoder(graph, config);
+
+  Matrix<BaseFloat> loglikes(RandInt(1, 200), num_pdfs);
+  loglikes.SetRandn();
+  DecodableMatrixScaled decodable(loglikes, 1.0);
+  decoder.InitDecoding();
+  int32 num_frames_output = 0, num_forcing_calls = 0;
+  while (decoder.NumFramesDecoded() < loglikes.NumRows()) {
+    decoder.AdvanceDecoding(&decodable, RandInt(1, 10));
+    int32 max_frame = decoder.NumFramesDecoded() - RandInt(0, 3);
+    bool force = (RandInt(0, 3) != 0);
+    if (force)
+      num_forcing_calls++;
+    Lattice lat;
+    int32 num_frames = decoder.GetRawLatticePrefix(max_frame, force, &lat);
+    if (num_frames == 0)
+      continue;
+    KALDI_ASSERT(CheckConnectedAndGetNumFrames(lat) == num_frames);
+    num_frames_output += num_frames;
+    KALDI_ASSERT(decoder.FirstFrame() == num_frames_output);
+  }
+  KALDI_ASSERT(decoder.NumForcedCuts() <= num_forcing_calls);
+  decoder.FinalizeDecoding();
+  Lattice lat;
+  KALDI_ASSERT(decoder.GetRawLattice(&lat));
+  num_frames_output += CheckConnectedAndGetNumFrames(lat);
+  KALDI_ASSERT(num_frames_output == loglikes.NumRows());
+}
+
+// Checks that DecodeUtteranceLatticeFaster() with --lattice-segment-lookback
+// set (which forces a cut whenever the paths haven't merged in time) writes
+// non-empty, connected lattice segments covering the whole utterance.
+void TestDecodeUtteranceLatticeFasterSegmented() {
+  TransitionModel *trans_model = GenRandTransitionModel(NULL);
+  int32 num_pdfs = RandInt(10, 100), num_words = RandInt(1, 50);
+  fst::VectorFst<fst::StdArc> graph;
+  RandDecodingGraph(RandInt(10, 1000), num_pdfs, num_words, &graph);
+  LatticeFasterDecoderConfig config;
+  config.beam = RandInt(10, 20);
+  config.lattice_beam = RandInt(5, 10);
+  config.lattice_segment_lookback = RandInt(1, 5);
+  LatticeFasterDecoder decoder(graph, config);
+
+  Matrix<BaseFloat> loglikes(RandInt(1, 200), num_pdfs);
+  loglikes.SetRandn();
+  DecodableMatrixScaled decodable(loglikes, 1.0);
+  {
+    Int32VectorWriter alignment_writer("ark:tmpf.ali"), words_writer("");
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer("ark:tmpf.lat");
+    double like;
+    bool determinize = false, allow_partial = true;
+    KALDI_ASSERT(DecodeUtteranceLatticeFaster(
+        decoder, decodable, *trans_model, NULL, "utt", 1.0, determinize,
+        allow_partial, &alignment_writer, &words_writer,
+        &compact_lattice_writer, &lattice_writer, &like));
+  }
+  int32 num_frames = 0;
+  for (SequentialLatticeReader lattice_reader("ark:tmpf.lat");
+       !lattice_reader.Done(); lattice_reader.Next())
+    num_frames += CheckConnectedAndGetNumFrames(lattice_reader.Value());
+  KALDI_ASSERT(num_frames == loglikes.NumRows());
+  SequentialInt32VectorReader alignment_reader("ark:tmpf.ali");
+  KALDI_ASSERT(!alignment_reader.Done() &&
+               alignment_reader.Value().size() == loglikes.NumRows());
+  unlink("tmpf.lat");
+  unlink("tmpf.ali");
+  delete trans_model;
+}
+
+// Feeds synthetic frame times to UpdateDecoderSpeedControl(): first too slow
+// for the budget, then within it but not by much, then much faster; and checks
+// that the beam and max-active narrow down to their minimums, stay put, and
+// widen back to the configured values, and that the degraded frames are
+// counted.
+void TestUpdateDecoderSpeedControl() {
+  LatticeFasterDecoderConfig config;
+  config.beam = RandInt(10, 20);
+  config.min_beam = RandInt(2, 9);
+  config.max_active = (RandInt(0, 1) == 0 ? 10000 :
+                       std::numeric_limits<int32>::max());
+  config.min_max_active = RandInt(1000, 2000);
+  config.min_active = 200;
+  config.rtf_target = 0.5;
+  config.rtf_frame_shift = 0.03;
+  double budget = config.rtf_target * config.rtf_frame_shift;
+  int32 num_active = 5000;
+
+  DecoderSpeedControlState state(config);
+  int32 num_degraded_frames = 0;
+
+  // Too slow: the beam and max-active go down, and stop at their minimums.
+  for (int32 t = 0; t < 50; t++) {
+    BaseFloat beam = state.beam;
+    int32 max_active = state.max_active;
+    if (beam < config.beam || max_active < config.max_active)
+      num_degraded_frames++;
+    UpdateDecoderSpeedControl(config, 20.0 * budget, num_active, &state);
+    KALDI_ASSERT(state.num_degraded_frames == num_degraded_frames);
+    KALDI_ASSERT(state.beam <= beam && state.max_active <= max_active);
+    KALDI_ASSERT(state.beam >= config.min_beam &&
+                 state.max_active >= config.min_max_active);
+    if (t == 0) {
+      // The first frame over budget moves max-active below the number of
+      // active tokens, even if it was unlimited.
+      KALDI_ASSERT(state.beam < config.beam &&
+                   state.max_active == static_cast<int32>(0.9 * num_active));
+    }
+    num_active = state.max_active;
+  }
+  KALDI_ASSERT(state.beam == config.min_beam &&
+               state.max_active == config.min_max_active);
+
+  // Between 80% and 100% of the budget: nothing changes, once the average
+  // has converged.
+  for (int32 t = 0; t < 200; t++)
+    UpdateDecoderSpeedControl(config, 0.9 * budget, num_active, &state);
+  KALDI_ASSERT(state.beam == config.min_beam &&
+               state.max_active == config.min_max_active);
+  num_degraded_frames += 200;
+  KALDI_ASSERT(state.num_degraded_frames == num_degraded_frames);
+
+  // Fast: the beam and max-active go back up to the configured values, and
+  // after that the frames are not counted as degraded.
+  for (int32 t = 0; t < 100; t++) {
+    BaseFloat beam = state.beam;
+    int32 max_active = state.max_active;
+    if (beam < config.beam || max_active < config.max_active)
+      num_degraded_frames++;
+    UpdateDecoderSpeedControl(config, 0.0, num_active, &state);
+    KALDI_ASSERT(state.num_degraded_frames == num_degraded_frames);
+    KALDI_ASSERT(state.beam >= beam && state.max_active >= max_active);
+    KALDI_ASSERT(state.beam <= config.beam &&
+                 state.max_active <= config.max_active);
+  }
+  KALDI_ASSERT(state.beam == config.beam &&
+               state.max_active == config.max_active);
+
+  // With --min-beam larger than --beam, the beam is never changed.
+  config.min_beam = config.beam + 1.0;
+  state.Reset(config);
+  for (int32 t = 0; t < 20; t++)
+    UpdateDecoderSpeedControl(config, 20.0 * budget, num_active, &state);
+  KALDI_ASSERT(state.beam == config.beam &&
+               state.max_active == config.min_max_active);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 20; i++) {
+    TestGetRawLatticePrefix();
+    TestDecodeUtteranceLatticeFasterSegmented();
+    TestUpdateDecoderSpeedControl();
+  }
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -20,11 +20,45 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include "base/timer.h"
 #include "decoder/lattice-faster-decoder.h"
 #include "lat/lattice-functions.h"
 
 namespace kaldi {
 
+void UpdateDecoderSpeedControl(const LatticeFasterDecoderConfig &config,
+                               double frame_time, int32 num_active,
+                               DecoderSpeedControlState *state) {
+  // The frame we just decoded used the current settings.
+  if (state->beam < config.beam || state->max_active < config.max_active)
+    state->num_degraded_frames++;
+  // We react to a moving average over roughly the last 10 frames, not to
+  // single slow frames (e.g. ones where the neural net was evaluated).
+  state->frame_time_avg = 0.9 * state->frame_time_avg + 0.1 * frame_time;
+  double budget = config.rtf_target * config.rtf_frame_shift;
+  BaseFloat min_beam = std::min(config.min_beam, config.beam),
+      beam_step = (config.beam - min_beam) / 10.0;
+  // max-active must not go below min-active; see GetCutoff().
+  int32 min_max_active = std::min(config.max_active,
+                                  std::max(config.min_max_active,
+                                           config.min_active));
+  if (state->frame_time_avg > budget) {
+    state->beam = std::max(min_beam, state->beam - beam_step);
+    // Set max-active below the number of tokens now active, so that it takes
+    // effect at once even if it was very large.
+    int32 below_num_active = static_cast<int32>(0.9 * num_active);
+    state->max_active = std::max(min_max_active,
+                                 std::min(state->max_active, below_num_active));
+  } else if (state->frame_time_avg < 0.8 * budget) {
+    // Comfortably within budget, so widen back towards the configured values.
+    state->beam = std::min(config.beam, state->beam + beam_step);
+    if (state->max_active > config.max_active / 1.25)
+      state->max_active = config.max_active;
+    else
+      state->max_active = static_cast<int32>(state->max_active * 1.25);
+  }
+}
+
 // instantiate this class once for each thing you have to decode.
 template <typename FST, typename Token>
 LatticeFasterDecoderTpl<FST, Token>::LatticeFasterDecoderTpl(
@@ -33,9 +67,15 @@ LatticeFasterDecoderTpl<FST, Token>::LatticeFasterDecoderTpl(
       delete_fst_(false),
       config_(config),
       num_toks_(0),
-      token_pool_(config.memory_pool_tokens_block_size),
-      forward_link_pool_(config.memory_pool_links_block_size) {
+      speed_state_(config),
+      own_token_pool_(config.memory_pool_tokens_block_size),
+      own_forward_link_pool_(config.memory_pool_links_block_size),
+      token_pool_(&own_token_pool_),
+      forward_link_pool_(&own_forward_link_pool_) {
   config.Check();
+  first_frame_ = 0;
+  num_forced_cuts_ = 0;
+  decoding_id_ = 0;
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
 
@@ -46,9 +86,15 @@ LatticeFasterDecoderTpl<FST, Token>::LatticeFasterDecoderTpl(
       delete_fst_(true),
       config_(config),
       num_toks_(0),
-      token_pool_(config.memory_pool_tokens_block_size),
-      forward_link_pool_(config.memory_pool_links_block_size) {
+      speed_state_(config),
+      own_token_pool_(config.memory_pool_tokens_block_size),
+      own_forward_link_pool_(config.memory_pool_links_block_size),
+      token_pool_(&own_token_pool_),
+      forward_link_pool_(&own_forward_link_pool_) {
   config.Check();
+  first_frame_ = 0;
+  num_forced_cuts_ = 0;
+  decoding_id_ = 0;
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
 
@@ -65,19 +111,34 @@ void LatticeFasterDecoderTpl<FST, Token>::InitDecoding() {
   DeleteElems(toks_.Clear());
   cost_offsets_.clear();
   ClearActiveTokens();
+  first_frame_ = 0;
+  num_forced_cuts_ = 0;
+  decoding_id_++;
   warned_ = false;
   num_toks_ = 0;
   decoding_finalized_ = false;
   final_costs_.clear();
+  speed_state_.Reset(config_);
   StateId start_state = fst_->Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   active_toks_.resize(1);
   Token *start_tok =
-      new (token_pool_.Allocate()) Token(0.0, 0.0, NULL, NULL, NULL);
+      new (token_pool_->Allocate()) Token(0.0, 0.0, NULL, NULL, NULL);
   active_toks_[0].toks = start_tok;
   toks_.Insert(start_state, start_tok);
   num_toks_++;
-  ProcessNonemitting(config_.beam);
+  ProcessNonemitting(speed_state_.beam);
+}
+
+template <typename FST, typename Token>
+void LatticeFasterDecoderTpl<FST, Token>::SetMemoryPools(
+    fst::MemoryPool<Token> *token_pool,
+    fst::MemoryPool<ForwardLinkT> *forward_link_pool) {
+  // Tokens must be freed to the pool they were allocated from.
+  KALDI_ASSERT(active_toks_.empty() && toks_.GetList() == NULL &&
+               token_pool != NULL && forward_link_pool != NULL);
+  token_pool_ = token_pool;
+  forward_link_pool_ = forward_link_pool;
 }
 
 // Returns true if any kind of traceback is available (not necessarily from
@@ -98,6 +159,215 @@ bool LatticeFasterDecoderTpl<FST, Token>::Decode(DecodableInterface *decodable)
 }
 
 
+template <typename FST, typename Token>
+int32 LatticeFasterDecoderTpl<FST, Token>::GetRawLatticePrefix(
+    int32 max_frame, bool force, Lattice *ofst) {
+  typedef LatticeArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Weight Weight;
+  if (!std::is_same<Token, decoder::StdToken>::value)
+    KALDI_ERR << "GetRawLatticePrefix() is not supported with "
+              << "BackpointerToken: the backpointers would be invalidated.";
+  KALDI_ASSERT(!decoding_finalized_ &&
+               "You cannot call GetRawLatticePrefix() after FinalizeDecoding()");
+  ofst->DeleteStates();
+  // We never cut on the last frame decoded: its tokens are in the hash toks_,
+  // and we haven't pruned them.
+  max_frame = std::min(max_frame, NumFramesDecoded() - 1);
+  if (max_frame <= first_frame_)
+    return 0;
+  // Make sure the pruning is up to date, so we don't see tokens that would be
+  // pruned away anyway.
+  PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
+
+  int32 cut_frame = -1;
+  for (int32 f = max_frame; f > first_frame_; f--) {
+    Token *toks = active_toks_[f].toks;
+    if (toks != NULL && toks->next == NULL) {
+      cut_frame = f;
+      break;
+    }
+  }
+  if (cut_frame == -1) {
+    if (!force)
+      return 0;
+    cut_frame = max_frame;
+    KeepOnlyBestToken(cut_frame);
+    num_forced_cuts_++;
+    KALDI_VLOG(2) << "Forced a lattice cut at frame " << cut_frame;
+  }
+
+  // Create the states, in topological order.
+  unordered_map<Token*, StateId> tok_map;
+  std::vector<Token*> token_list;
+  for (int32 f = first_frame_; f <= cut_frame; f++) {
+    TopSortTokens(active_toks_[f].toks, &token_list);
+    for (size_t i = 0; i < token_list.size(); i++)
+      if (token_list[i] != NULL)
+        tok_map[token_list[i]] = ofst->AddState();
+  }
+  // There is a single token on first_frame_ (unless it's zero, in which case
+  // the start token comes first in topological order).
+  ofst->SetStart(0);
+  for (int32 f = first_frame_; f < cut_frame; f++) {
+    for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
+      StateId cur_state = tok_map[tok];
+      for (ForwardLinkT *l = tok->links; l != NULL; l = l->next) {
+        typename unordered_map<Token*, StateId>::const_iterator
+            iter = tok_map.find(l->next_tok);
+        KALDI_ASSERT(iter != tok_map.end());
+        BaseFloat cost_offset = (l->ilabel != 0 ? cost_offsets_[f] : 0.0);
+        ofst->AddArc(cur_state,
+                     Arc(l->ilabel, l->olabel,
+                         Weight(l->graph_cost, l->acoustic_cost - cost_offset),
+                         iter->second));
+      }
+    }
+  }
+  ofst->SetFinal(tok_map[active_toks_[cut_frame].toks], Weight::One());
+  Connect(ofst);  // a forced cut may leave some tokens unreachable.
+
+  // Free the tokens before the cut.
+  for (int32 f = first_frame_; f < cut_frame; f++) {
+    for (Token *tok = active_toks_[f].toks; tok != NULL; ) {
+      DeleteForwardLinks(tok);
+      Token *next_tok = tok->next;
+      token_pool_->Free(tok);
+      num_toks_--;
+      tok = next_tok;
+    }
+    active_toks_[f].toks = NULL;
+    active_toks_[f].must_prune_forward_links = false;
+    active_toks_[f].must_prune_tokens = false;
+  }
+  int32 num_frames = cut_frame - first_frame_;
+  first_frame_ = cut_frame;
+  return num_frames;
+}
+
+template <typename FST, typename Token>
+void LatticeFasterDecoderTpl<FST, Token>::KeepOnlyBestToken(
+    int32 frame_plus_one) {
+  KALDI_ASSERT(frame_plus_one > first_frame_ &&
+               frame_plus_one < NumFramesDecoded());
+  Token *&toks = active_toks_[frame_plus_one].toks;
+  KALDI_ASSERT(toks != NULL);
+  Token *best_tok = toks;
+  for (Token *tok = toks; tok != NULL; tok = tok->next)
+    if (tok->extra_cost < best_tok->extra_cost)
+      best_tok = tok;
+  // Remove the links into the other tokens, from the previous frame and (via
+  // epsilon links) from this frame.
+  for (int32 f = frame_plus_one - 1; f <= frame_plus_one; f++) {
+    for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
+      ForwardLinkT *prev_link = NULL, *next_link;
+      for (ForwardLinkT *link = tok->links; link != NULL; link = next_link) {
+        next_link = link->next;
+        // Emitting links from the previous frame and epsilon links from this
+        // frame end on this frame.
+        bool into_this_frame = ((f == frame_plus_one) == (link->ilabel == 0));
+        if (into_this_frame && link->next_tok != best_tok) {
+          if (prev_link != NULL) prev_link->next = next_link;
+          else tok->links = next_link;
+          forward_link_pool_->Free(link);
+        } else {
+          prev_link = link;
+        }
+      }
+    }
+  }
+  for (Token *tok = toks, *next_tok; tok != NULL; tok = next_tok) {
+    next_tok = tok->next;
+    if (tok != best_tok) {
+      DeleteForwardLinks(tok);
+      token_pool_->Free(tok);
+      num_toks_--;
+    }
+  }
+  toks = best_tok;
+  best_tok->next = NULL;
+  RemoveUnreachableTokens(frame_plus_one);
+}
+
+template <typename FST, typename Token>
+void LatticeFasterDecoderTpl<FST, Token>::RemoveUnreachableTokens(
+    int32 frame_plus_one) {
+  Token *start_tok = active_toks_[frame_plus_one].toks;
+  KALDI_ASSERT(start_tok != NULL && start_tok->next == NULL);
+  const BaseFloat infinity = std::numeric_limits<BaseFloat>::infinity();
+  int32 last_frame_plus_one = NumFramesDecoded();
+  // Recompute the forward costs of the later tokens, starting from start_tok;
+  // the ones that stay infinite can't be reached from it.  As in the search
+  // itself, on each frame we first follow the epsilon links within the frame,
+  // then the emitting links into the next frame.
+  for (int32 f = frame_plus_one + 1; f <= last_frame_plus_one; f++)
+    for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next)
+      tok->tot_cost = infinity;
+  std::vector<Token*> queue;
+  for (int32 f = frame_plus_one; f <= last_frame_plus_one; f++) {
+    for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next)
+      if (tok->tot_cost != infinity)
+        queue.push_back(tok);
+    while (!queue.empty()) {
+      Token *tok = queue.back();
+      queue.pop_back();
+      for (ForwardLinkT *link = tok->links; link != NULL; link = link->next) {
+        if (link->ilabel != 0)
+          continue;
+        BaseFloat tot_cost = tok->tot_cost + link->graph_cost;
+        if (tot_cost < link->next_tok->tot_cost) {
+          link->next_tok->tot_cost = tot_cost;
+          queue.push_back(link->next_tok);
+        }
+      }
+    }
+    for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
+      if (tok->tot_cost == infinity)
+        continue;
+      for (ForwardLinkT *link = tok->links; link != NULL; link = link->next) {
+        if (link->ilabel == 0)
+          continue;
+        BaseFloat tot_cost = tok->tot_cost + link->graph_cost +
+            link->acoustic_cost;
+        if (tot_cost < link->next_tok->tot_cost)
+          link->next_tok->tot_cost = tot_cost;
+      }
+    }
+  }
+
+  // The tokens on the last frame are also in the hash toks_; remove the
+  // unreachable ones from it before we free them.
+  Elem *list = toks_.Clear();
+  for (Elem *e = list, *e_tail; e != NULL; e = e_tail) {
+    e_tail = e->tail;
+    if (e->val->tot_cost != infinity)
+      toks_.Insert(e->key, e->val);
+    toks_.Delete(e);
+  }
+
+  for (int32 f = frame_plus_one + 1; f <= last_frame_plus_one; f++) {
+    Token *prev_tok = NULL;
+    for (Token *tok = active_toks_[f].toks, *next_tok; tok != NULL;
+         tok = next_tok) {
+      next_tok = tok->next;
+      if (tok->tot_cost == infinity) {
+        // Any links into this token are from other unreachable tokens.
+        DeleteForwardLinks(tok);
+        if (prev_tok != NULL) prev_tok->next = next_tok;
+        else active_toks_[f].toks = next_tok;
+        token_pool_->Free(tok);
+        num_toks_--;
+      } else {
+        prev_tok = tok;
+      }
+    }
+    // The extra_costs must be recomputed, as some paths have gone.
+    active_toks_[f - 1].must_prune_forward_links = true;
+    active_toks_[f].must_prune_tokens = true;
+  }
+}
+
+
 // Outputs an FST corresponding to the single best path through the lattice.
 template <typename FST, typename Token>
 bool LatticeFasterDecoderTpl<FST, Token>::GetBestPath(Lattice *olat,
@@ -142,7 +412,7 @@ bool LatticeFasterDecoderTpl<FST, Token>::GetRawLattice(
   unordered_map<Token*, StateId> tok_map(bucket_count);
   // First create all states.
   std::vector<Token*> token_list;
-  for (int32 f = 0; f <= num_frames; f++) {
+  for (int32 f = first_frame_; f <= num_frames; f++) {
     if (active_toks_[f].toks == NULL) {
       KALDI_WARN << "GetRawLattice: no tokens active on frame " << f
                  << ": not producing lattice.\n";
@@ -161,7 +431,7 @@ bool LatticeFasterDecoderTpl<FST, Token>::GetRawLattice(
                 << tok_map.bucket_count() << " load:" << tok_map.load_factor()
                 << " max:" << tok_map.max_load_factor();
   // Now create all arcs.
-  for (int32 f = 0; f <= num_frames; f++) {
+  for (int32 f = first_frame_; f <= num_frames; f++) {
     for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
       StateId cur_state = tok_map[tok];
       for (ForwardLinkT *l = tok->links;
@@ -271,7 +541,7 @@ LatticeFasterDecoderTpl<FST, Token>::FindOrAddToken(
     // tokens on the currently final frame have zero extra_cost
     // as any of them could end up
     // on the winning path.
-    Token *new_tok = new (token_pool_.Allocate())
+    Token *new_tok = new (token_pool_->Allocate())
         Token(tot_cost, extra_cost, NULL, toks, backpointer);
     // NULL: no forward links yet
     toks = new_tok;
@@ -349,7 +619,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneForwardLinks(
           ForwardLinkT *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          forward_link_pool_.Free(link);
+          forward_link_pool_->Free(link);
           link = next_link;  // advance link but leave prev_link the same.
           *links_pruned = true;
         } else {   // keep the link and update the tok_extra_cost if needed.
@@ -437,7 +707,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneForwardLinksFinal() {
           ForwardLinkT *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          forward_link_pool_.Free(link);
+          forward_link_pool_->Free(link);
           link = next_link; // advance link but leave prev_link the same.
         } else { // keep the link and update the tok_extra_cost if needed.
           if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -498,7 +768,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneTokensForFrame(int32 frame_plus_o
       // excise tok from list and delete tok.
       if (prev_tok != NULL) prev_tok->next = tok->next;
       else toks = tok->next;
-      token_pool_.Free(tok);
+      token_pool_->Free(tok);
       num_toks_--;
     } else {  // fetch next Token
       prev_tok = tok;
@@ -517,7 +787,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneActiveTokens(BaseFloat delta) {
   int32 num_toks_begin = num_toks_;
   // The index "f" below represents a "frame plus one", i.e. you'd have to subtract
   // one to get the corresponding index for the decodable object.
-  for (int32 f = cur_frame_plus_one - 1; f >= 0; f--) {
+  for (int32 f = cur_frame_plus_one - 1; f >= first_frame_; f--) {
     // Reason why we need to prune forward links in this situation:
     // (1) we have never pruned them (new TokenList)
     // (2) we have not yet pruned the forward links to the next f,
@@ -525,7 +795,7 @@ void LatticeFasterDecoderTpl<FST, Token>::PruneActiveTokens(BaseFloat delta) {
     if (active_toks_[f].must_prune_forward_links) {
       bool extra_costs_changed = false, links_pruned = false;
       PruneForwardLinks(f, &extra_costs_changed, &links_pruned, delta);
-      if (extra_costs_changed && f > 0) // any token has changed extra_cost
+      if (extra_costs_changed && f > first_frame_) // any token has changed extra_cost
         active_toks_[f-1].must_prune_forward_links = true;
       if (links_pruned) // any link was pruned
         active_toks_[f].must_prune_tokens = true;
@@ -622,11 +892,28 @@ void LatticeFasterDecoderTpl<FST, Token>::AdvanceDecoding(DecodableInterface *de
     if (NumFramesDecoded() % config_.prune_interval == 0) {
       PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
     }
-    BaseFloat cost_cutoff = ProcessEmitting(decodable);
-    ProcessNonemitting(cost_cutoff);
+    if (config_.rtf_target > 0.0) {
+      // Only time the frames if speed control is on.
+      Timer timer;
+      BaseFloat cost_cutoff = ProcessEmitting(decodable);
+      ProcessNonemitting(cost_cutoff);
+      UpdateSpeedControl(timer.Elapsed());
+    } else {
+      BaseFloat cost_cutoff = ProcessEmitting(decodable);
+      ProcessNonemitting(cost_cutoff);
+    }
   }
 }
 
+template <typename FST, typename Token>
+void LatticeFasterDecoderTpl<FST, Token>::UpdateSpeedControl(
+    double frame_time) {
+  int32 num_active = 0;
+  for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail)
+    num_active++;
+  UpdateDecoderSpeedControl(config_, frame_time, num_active, &speed_state_);
+}
+
 // FinalizeDecoding() is a version of PruneActiveTokens that we call
 // (optionally) on the final frame.  Takes into account the final-prob of
 // tokens.  This function used to be called PruneActiveTokensFinal().
@@ -637,15 +924,19 @@ void LatticeFasterDecoderTpl<FST, Token>::FinalizeDecoding() {
   // PruneForwardLinksFinal() prunes final frame (with final-probs), and
   // sets decoding_finalized_.
   PruneForwardLinksFinal();
-  for (int32 f = final_frame_plus_one - 1; f >= 0; f--) {
+  for (int32 f = final_frame_plus_one - 1; f >= first_frame_; f--) {
     bool b1, b2; // values not used.
     BaseFloat dontcare = 0.0; // delta of zero means we must always update
     PruneForwardLinks(f, &b1, &b2, dontcare);
     PruneTokensForFrame(f + 1);
   }
-  PruneTokensForFrame(0);
+  PruneTokensForFrame(first_frame_);
   KALDI_VLOG(4) << "pruned tokens from " << num_toks_begin
                 << " to " << num_toks_;
+  if (speed_state_.num_degraded_frames > 0)
+    KALDI_VLOG(1) << "Speed control (--rtf-target) reduced the beam or "
+                  << "max-active on " << speed_state_.num_degraded_frames
+                  << " out of " << final_frame_plus_one << " frames.";
 }
 
 /// Gets the weight cutoff.  Also counts the active tokens.
@@ -655,7 +946,7 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t
   BaseFloat best_weight = std::numeric_limits<BaseFloat>::infinity();
   // positive == high cost == bad.
   size_t count = 0;
-  if (config_.max_active == std::numeric_limits<int32>::max() &&
+  if (speed_state_.max_active == std::numeric_limits<int32>::max() &&
       config_.min_active == 0) {
     for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
       BaseFloat w = static_cast<BaseFloat>(e->val->tot_cost);
@@ -665,8 +956,8 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t
       }
     }
     if (tok_count != NULL) *tok_count = count;
-    if (adaptive_beam != NULL) *adaptive_beam = config_.beam;
-    return best_weight + config_.beam;
+    if (adaptive_beam != NULL) *adaptive_beam = speed_state_.beam;
+    return best_weight + speed_state_.beam;
   } else {
     tmp_array_.clear();
     for (Elem *e = list_head; e != NULL; e = e->tail, count++) {
@@ -679,18 +970,18 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t
     }
     if (tok_count != NULL) *tok_count = count;
 
-    BaseFloat beam_cutoff = best_weight + config_.beam,
+    BaseFloat beam_cutoff = best_weight + speed_state_.beam,
         min_active_cutoff = std::numeric_limits<BaseFloat>::infinity(),
         max_active_cutoff = std::numeric_limits<BaseFloat>::infinity();
 
     KALDI_VLOG(6) << "Number of tokens active on frame " << NumFramesDecoded()
                   << " is " << tmp_array_.size();
 
-    if (tmp_array_.size() > static_cast<size_t>(config_.max_active)) {
+    if (tmp_array_.size() > static_cast<size_t>(speed_state_.max_active)) {
       std::nth_element(tmp_array_.begin(),
-                       tmp_array_.begin() + config_.max_active,
+                       tmp_array_.begin() + speed_state_.max_active,
                        tmp_array_.end());
-      max_active_cutoff = tmp_array_[config_.max_active];
+      max_active_cutoff = tmp_array_[speed_state_.max_active];
     }
     if (max_active_cutoff < beam_cutoff) { // max_active is tighter than beam.
       if (adaptive_beam)
@@ -702,8 +993,9 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t
       else {
         std::nth_element(tmp_array_.begin(),
                          tmp_array_.begin() + config_.min_active,
-                         tmp_array_.size() > static_cast<size_t>(config_.max_active) ?
-                         tmp_array_.begin() + config_.max_active :
+                         tmp_array_.size() >
+                         static_cast<size_t>(speed_state_.max_active) ?
+                         tmp_array_.begin() + speed_state_.max_active :
                          tmp_array_.end());
         min_active_cutoff = tmp_array_[config_.min_active];
       }
@@ -713,7 +1005,7 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::GetCutoff(Elem *list_head, size_t
         *adaptive_beam = min_active_cutoff - best_weight + config_.beam_delta;
       return min_active_cutoff;
     } else {
-      *adaptive_beam = config_.beam;
+      *adaptive_beam = speed_state_.beam;
       return beam_cutoff;
     }
   }
@@ -746,6 +1038,9 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
   BaseFloat cost_offset = 0.0; // Used to keep probabilities in a good
                                // dynamic range.
 
+  // If the decodable object supports it, we get the frame's log-likelihoods
+  // as an array, which saves a virtual call per arc.
+  const BaseFloat *loglikes = decodable->LogLikelihoodRow(frame);
 
   // First process the best token to get a hopefully
   // reasonably tight bound on the next cutoff.  The only
@@ -760,7 +1055,8 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
       const Arc &arc = aiter.Value();
       if (arc.ilabel != 0) {  // propagate..
         BaseFloat new_weight = arc.weight.Value() + cost_offset -
-            decodable->LogLikelihood(frame, arc.ilabel) + tok->tot_cost;
+            (loglikes != NULL ? loglikes[arc.ilabel] :
+             decodable->LogLikelihood(frame, arc.ilabel)) + tok->tot_cost;
         if (new_weight + adaptive_beam < next_cutoff)
           next_cutoff = new_weight + adaptive_beam;
       }
@@ -787,7 +1083,8 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
         const Arc &arc = aiter.Value();
         if (arc.ilabel != 0) {  // propagate..
           BaseFloat ac_cost = cost_offset -
-              decodable->LogLikelihood(frame, arc.ilabel),
+              (loglikes != NULL ? loglikes[arc.ilabel] :
+               decodable->LogLikelihood(frame, arc.ilabel)),
               graph_cost = arc.weight.Value(),
               cur_cost = tok->tot_cost,
               tot_cost = cur_cost + ac_cost + graph_cost;
@@ -801,7 +1098,7 @@ BaseFloat LatticeFasterDecoderTpl<FST, Token>::ProcessEmitting(
           // NULL: no change indicator needed
 
           // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-          tok->links = new (forward_link_pool_.Allocate())
+          tok->links = new (forward_link_pool_->Allocate())
               ForwardLinkT(e_next->val, arc.ilabel, arc.olabel, graph_cost,
                            ac_cost, tok->links);
         }
@@ -819,7 +1116,7 @@ void LatticeFasterDecoderTpl<FST, Token>::DeleteForwardLinks(Token *tok) {
   ForwardLinkT *l = tok->links, *m;
   while (l != NULL) {
     m = l->next;
-    forward_link_pool_.Free(l);
+    forward_link_pool_->Free(l);
     l = m;
   }
   tok->links = NULL;
@@ -883,7 +1180,7 @@ void LatticeFasterDecoderTpl<FST, Token>::ProcessNonemitting(BaseFloat cutoff) {
           Elem *e_new = FindOrAddToken(arc.nextstate, frame + 1, tot_cost,
                                           tok, &changed);
 
-          tok->links = new (forward_link_pool_.Allocate()) ForwardLinkT(
+          tok->links = new (forward_link_pool_->Allocate()) ForwardLinkT(
               e_new->val, 0, arc.olabel, graph_cost, 0, tok->links);
 
           // "changed" tells us whether the new token has a different
@@ -913,7 +1210,7 @@ void LatticeFasterDecoderTpl<FST, Token>::ClearActiveTokens() { // a cleanup rou
     for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
       DeleteForwardLinks(tok);
       Token *next_tok = tok->next;
-      token_pool_.Free(tok);
+      token_pool_->Free(tok);
       num_toks_--;
       tok = next_tok;
     }
@@ -1009,12 +1306,18 @@ template class LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>, decoder::StdT
 
 template class LatticeFasterDecoderTpl<fst::ConstGrammarFst, decoder::StdToken>;
 template class LatticeFasterDecoderTpl<fst::VectorGrammarFst, decoder::StdToken>;
+template class LatticeFasterDecoderTpl<fst::DecoderFst, decoder::StdToken>;
+template class LatticeFasterDecoderTpl<fst::SharedLookaheadFst, decoder::StdToken>;
+template class LatticeFasterDecoderTpl<fst::BiglmFst, decoder::StdToken>;
 
 template class LatticeFasterDecoderTpl<fst::Fst<fst::StdArc> , decoder::BackpointerToken>;
 template class LatticeFasterDecoderTpl<fst::VectorFst<fst::StdArc>, decoder::BackpointerToken >;
 template class LatticeFasterDecoderTpl<fst::ConstFst<fst::StdArc>, decoder::BackpointerToken >;
 template class LatticeFasterDecoderTpl<fst::ConstGrammarFst, decoder::BackpointerToken>;
 template class LatticeFasterDecoderTpl<fst::VectorGrammarFst, decoder::BackpointerToken>;
+template class LatticeFasterDecoderTpl<fst::DecoderFst, decoder::BackpointerToken>;
+template class LatticeFasterDecoderTpl<fst::SharedLookaheadFst, decoder::BackpointerToken>;
+template class LatticeFasterDecoderTpl<fst::BiglmFst, decoder::BackpointerToken>;
 
 
 } // end namespace kaldi.
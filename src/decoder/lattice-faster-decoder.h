@@ -23,7 +23,10 @@
 #ifndef KALDI_DECODER_LATTICE_FASTER_DECODER_H_
 #define KALDI_DECODER_LATTICE_FASTER_DECODER_H_
 
+#include "decoder/biglm-fst.h"
+#include "decoder/decoder-fst.h"
 #include "decoder/grammar-fst.h"
+#include "decoder/shared-lookahead-fst.h"
 #include "fst/fstlib.h"
 #include "fst/memory.h"
 #include "fstext/fstext-lib.h"
@@ -41,6 +44,7 @@ struct LatticeFasterDecoderConfig {
   int32 min_active;
   BaseFloat lattice_beam;
   int32 prune_interval;
+  int32 lattice_segment_lookback;
   bool determinize_lattice; // not inspected by this class... used in
                             // command-line program.
   BaseFloat beam_delta;
@@ -50,6 +54,14 @@ struct LatticeFasterDecoderConfig {
   // tokens as we go.
   BaseFloat prune_scale;
 
+  // Options for speed control (see rtf_target below).  The decoder adjusts the
+  // beam and max-active it uses between beam/max_active and
+  // min_beam/min_max_active.
+  BaseFloat rtf_target;
+  BaseFloat rtf_frame_shift;
+  BaseFloat min_beam;
+  int32 min_max_active;
+
   // Number of elements in the block for Token and ForwardLink memory
   // pool allocation.
   int32 memory_pool_tokens_block_size;
@@ -66,10 +78,15 @@ struct LatticeFasterDecoderConfig {
         min_active(200),
         lattice_beam(10.0),
         prune_interval(25),
+        lattice_segment_lookback(0),
         determinize_lattice(true),
         beam_delta(0.5),
         hash_ratio(2.0),
         prune_scale(0.1),
+        rtf_target(0.0),
+        rtf_frame_shift(0.01),
+        min_beam(8.0),
+        min_max_active(1000),
         memory_pool_tokens_block_size(1 << 8),
         memory_pool_links_block_size(1 << 8) {}
   void Register(OptionsItf *opts) {
@@ -82,6 +99,19 @@ struct LatticeFasterDecoderConfig {
                    "and deeper lattices");
     opts->Register("prune-interval", &prune_interval, "Interval (in frames) at "
                    "which to prune tokens");
+    opts->Register("lattice-segment-lookback", &lattice_segment_lookback,
+                   "If > 0, the lattice is output in segments while decoding, "
+                   "so that memory use doesn't grow with the utterance "
+                   "length: segments end at frames at least this many frames "
+                   "before the decoding front (see GetRawLatticePrefix()).  "
+                   "The segments are written with keys "
+                   "<utt>-<start-frame>-<end-frame>.  If the paths have not "
+                   "merged into a single token after a further this-many "
+                   "frames, a cut is forced by keeping only the best token, "
+                   "which discards the other paths (such cuts are counted and "
+                   "warned about).  The per-frame bookkeeping (a few bytes "
+                   "per frame) still grows with the utterance length.  Only "
+                   "used by some programs.");
     opts->Register("determinize-lattice", &determinize_lattice, "If true, "
                    "determinize the lattice (lattice-determinization, keeping only "
                    "best pdf-sequence for each word-sequence).");
@@ -90,6 +120,24 @@ struct LatticeFasterDecoderConfig {
                    "max-active constraint is applied.  Larger is more accurate.");
     opts->Register("hash-ratio", &hash_ratio, "Setting used in decoder to "
                    "control hash behavior");
+    opts->Register("rtf-target", &rtf_target, "If >0, the decoder times each "
+                   "frame and, when decoding takes longer than rtf-target "
+                   "times --rtf-frame-shift per frame, narrows the beam and "
+                   "max-active (down to --min-beam and --min-max-active) "
+                   "until it is within budget again, widening them back when "
+                   "there is time to spare.  Bounds decoding time under "
+                   "load, at the expense of accuracy on the frames affected.  "
+                   "The time includes computing the likelihoods, if the "
+                   "decodable object does that on demand.");
+    opts->Register("rtf-frame-shift", &rtf_frame_shift, "The duration in "
+                   "seconds of a frame as seen by the decoder, for "
+                   "--rtf-target (e.g. 0.03 for chain models with "
+                   "frame-subsampling-factor=3).");
+    opts->Register("min-beam", &min_beam, "The smallest beam speed control "
+                   "(see --rtf-target) may reduce the beam to.");
+    opts->Register("min-max-active", &min_max_active, "The smallest value "
+                   "speed control (see --rtf-target) may reduce max-active "
+                   "to.");
     opts->Register("memory-pool-tokens-block-size", &memory_pool_tokens_block_size,
                    "Memory pool block size suggestion for storing tokens (in elements). "
                    "Smaller uses less memory but increases cache misses.");
@@ -100,11 +148,47 @@ struct LatticeFasterDecoderConfig {
   void Check() const {
     KALDI_ASSERT(beam > 0.0 && max_active > 1 && lattice_beam > 0.0
                  && min_active <= max_active
-                 && prune_interval > 0 && beam_delta > 0.0 && hash_ratio >= 1.0
-                 && prune_scale > 0.0 && prune_scale < 1.0);
+                 && prune_interval > 0 && lattice_segment_lookback >= 0
+                 && beam_delta > 0.0 && hash_ratio >= 1.0
+                 && prune_scale > 0.0 && prune_scale < 1.0
+                 && rtf_target >= 0.0 && rtf_frame_shift > 0.0
+                 && min_beam > 0.0 && min_max_active > 1);
+  }
+};
+
+/// The state of the speed control of LatticeFasterDecoderTpl (see
+/// --rtf-target).
+struct DecoderSpeedControlState {
+  // The beam and max-active currently in use; these are config.beam and
+  // config.max_active unless speed control has reduced them.
+  BaseFloat beam;
+  int32 max_active;
+  // A moving average of the time taken per frame.
+  double frame_time_avg;
+  // The number of frames decoded with 'beam' or 'max_active' reduced.
+  int32 num_degraded_frames;
+
+  explicit DecoderSpeedControlState(const LatticeFasterDecoderConfig &config) {
+    Reset(config);
+  }
+  void Reset(const LatticeFasterDecoderConfig &config) {
+    beam = config.beam;
+    max_active = config.max_active;
+    frame_time_avg = 0.0;
+    num_degraded_frames = 0;
   }
 };
 
+/// Updates the speed-control state 'state' after a frame that took
+/// 'frame_time' seconds to decode (with state->beam and state->max_active),
+/// leaving 'num_active' tokens active.  Narrows the beam and max-active while
+/// the average frame time exceeds config.rtf_target * config.rtf_frame_shift,
+/// down to config.min_beam and config.min_max_active, and widens them back
+/// towards config.beam and config.max_active when it is below 80% of that.
+void UpdateDecoderSpeedControl(const LatticeFasterDecoderConfig &config,
+                               double frame_time, int32 num_active,
+                               DecoderSpeedControlState *state);
+
 namespace decoder {
 // We will template the decoder on the token type as well as the FST type; this
 // is a mechanism so that we can use the same underlying decoder code for
@@ -233,7 +317,9 @@ struct BackpointerToken {
    quick lookup of the current best path (see lattice-faster-online-decoder.h)
 
    The FST you invoke this decoder which is expected to equal
-   Fst::Fst<fst::StdArc>, a.k.a. StdFst, or GrammarFst.  If you invoke it with
+   Fst::Fst<fst::StdArc>, a.k.a. StdFst, or GrammarFst, DecoderFst,
+   SharedLookaheadFst or BiglmFst (for decoding with on-the-fly composition with
+   a difference LM; see biglm-fst.h).  If you invoke it with
    FST == StdFst and it notices that the actual FST type is
    fst::VectorFst<fst::StdArc> or fst::ConstFst<fst::StdArc>, the decoder object
    will internally cast itself to one that is templated on those more specific
@@ -304,6 +390,37 @@ class LatticeFasterDecoderTpl {
   /// We could put that here in future needed.
   bool GetRawLattice(Lattice *ofst, bool use_final_probs = true) const;
 
+  /// This function is for outputting the lattice of a long utterance in
+  /// pieces while decoding, so that memory use doesn't grow with the length of
+  /// the utterance.  It outputs to 'ofst' the raw lattice from the start of
+  /// the utterance (or the end of the previous piece) up to a "cut" frame
+  /// where only one token is left after pruning, so that all paths pass
+  /// through it; that token becomes the only final state of 'ofst', with
+  /// final-prob One(), and the start state of the next piece.  The tokens
+  /// before the cut are then freed, and GetRawLattice() and GetBestPath() will
+  /// only cover the frames after the cut.
+  ///
+  /// We choose the latest such frame that is no later than 'max_frame'
+  /// (numbered as in NumFramesDecoded(), i.e. the cut token is on the frame
+  /// after the frames in 'ofst').  If there is no such frame and 'force' is
+  /// true, we cut at 'max_frame' anyway, keeping only the best token on that
+  /// frame (and, on later frames, only the tokens reachable from it); this
+  /// discards paths that would otherwise be in the lattice.
+  /// Returns the number of frames in 'ofst', or zero if it produced nothing.
+  ///
+  /// This is not supported with the BackpointerToken type (i.e. in
+  /// LatticeFasterOnlineDecoderTpl).
+  int32 GetRawLatticePrefix(int32 max_frame, bool force, Lattice *ofst);
+
+  /// Returns the frame where the lattice currently starts, i.e. the sum of
+  /// the number of frames in the outputs of GetRawLatticePrefix() since
+  /// InitDecoding().
+  int32 FirstFrame() const { return first_frame_; }
+
+  /// Returns the number of cuts that GetRawLatticePrefix() had to force
+  /// (discarding paths) since InitDecoding().
+  int32 NumForcedCuts() const { return num_forced_cuts_; }
+
 
 
   /// [Deprecated, users should now use GetRawLattice and determinize it
@@ -322,6 +439,14 @@ class LatticeFasterDecoderTpl {
   /// utterance and want to start with a new utterance.
   void InitDecoding();
 
+  /// Makes the decoder allocate tokens and forward links from the given memory
+  /// pools instead of its own, so that several decoders (e.g. the streams of
+  /// LatticeFasterMultiStreamDecoderTpl) can share their storage.  The pools
+  /// are not owned and must outlive this object.  Must be called before
+  /// InitDecoding(), while the decoder holds no tokens.
+  void SetMemoryPools(fst::MemoryPool<Token> *token_pool,
+                      fst::MemoryPool<ForwardLinkT> *forward_link_pool);
+
   /// This will decode until there are no more frames ready in the decodable
   /// object.  You can keep calling it each time more frames become available.
   /// If max_num_frames is specified, it specifies the maximum number of frames
@@ -353,6 +478,10 @@ class LatticeFasterDecoderTpl {
   // whenever we call ProcessEmitting().
   inline int32 NumFramesDecoded() const { return active_toks_.size() - 1; }
 
+  /// Returns the number of frames since InitDecoding() that were decoded with
+  /// a beam or max-active reduced by speed control (see --rtf-target).
+  int32 NumDegradedFrames() const { return speed_state_.num_degraded_frames; }
+
  protected:
   // we make things protected instead of private, as code in
   // LatticeFasterOnlineDecoderTpl, which inherits from this, also uses the
@@ -361,6 +490,17 @@ class LatticeFasterDecoderTpl {
   // Deletes the elements of the singly linked list tok->links.
   void DeleteForwardLinks(Token *tok);
 
+  // Called from GetRawLatticePrefix() if it has to force a cut: deletes all
+  // tokens on this frame except the best one, and the links into them.
+  void KeepOnlyBestToken(int32 frame_plus_one);
+
+  // Called from KeepOnlyBestToken(): deletes the tokens (and their links) on
+  // the frames after 'frame_plus_one', including the current frame in toks_,
+  // that can't be reached from the only token left on 'frame_plus_one', and
+  // recomputes the tot_cost of the others, so that the search continues only
+  // from paths that go through it.
+  void RemoveUnreachableTokens(int32 frame_plus_one);
+
   // head of per-frame list of Tokens (list is in topological order),
   // and something saying whether we ever pruned it using PruneForwardLinks.
   struct TokenList {
@@ -463,6 +603,10 @@ class LatticeFasterDecoderTpl {
   /// preceding ProcessEmitting().
   void ProcessNonemitting(BaseFloat cost_cutoff);
 
+  /// Called after each frame if config_.rtf_target > 0, with the time taken to
+  /// decode it; adjusts speed_state_ (see UpdateDecoderSpeedControl()).
+  void UpdateSpeedControl(double frame_time);
+
   // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
   // more than one list (e.g. for current and previous frames), but only one of
   // them at a time can be indexed by StateId.  It is indexed by frame-index
@@ -475,6 +619,13 @@ class LatticeFasterDecoderTpl {
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
+  int32 first_frame_;  // The tokens on frames (plus one) before this have been
+                       // freed by GetRawLatticePrefix(); it's normally zero.
+  int32 num_forced_cuts_;  // The number of cuts GetRawLatticePrefix() had to
+                           // force, since InitDecoding().
+  int32 decoding_id_;  // Incremented by InitDecoding(), so that child classes
+                       // that keep pointers to tokens can tell when they
+                       // have been freed.
   std::vector<const Elem* > queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
 
@@ -492,6 +643,11 @@ class LatticeFasterDecoderTpl {
   int32 num_toks_; // current total #toks allocated...
   bool warned_;
 
+  // The beam and max-active currently in use (speed_state_.beam and
+  // speed_state_.max_active); these are config_.beam and config_.max_active
+  // unless speed control has reduced them (see UpdateSpeedControl()).
+  DecoderSpeedControlState speed_state_;
+
   /// decoding_finalized_ is true if someone called FinalizeDecoding().  [note,
   /// calling this is optional].  If true, it's forbidden to decode more.  Also,
   /// if this is set, then the output of ComputeFinalCosts() is in the next
@@ -509,9 +665,13 @@ class LatticeFasterDecoderTpl {
   // Memory pools for storing tokens and forward links.
   // We use it to decrease the work put on allocator and to move some of data
   // together. Too small block sizes will result in more work to allocator but
-  // bigger ones increase the memory usage.
-  fst::MemoryPool<Token> token_pool_;
-  fst::MemoryPool<ForwardLinkT> forward_link_pool_;
+  // bigger ones increase the memory usage.  token_pool_ and forward_link_pool_
+  // point to the pools actually used: our own ones unless SetMemoryPools() was
+  // called.
+  fst::MemoryPool<Token> own_token_pool_;
+  fst::MemoryPool<ForwardLinkT> own_forward_link_pool_;
+  fst::MemoryPool<Token> *token_pool_;
+  fst::MemoryPool<ForwardLinkT> *forward_link_pool_;
 
   // There are various cleanup tasks... the toks_ structure contains
   // singly linked lists of Token pointers, where Elem is the list type.
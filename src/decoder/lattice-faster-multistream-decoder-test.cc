@@ -0,0 +1,137 @@
+// decoder/lattice-faster-multistream-decoder-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/decodable-matrix.h"
+#include "decoder/decoder-test-utils.h"
+#include "decoder/lattice-faster-multistream-decoder.h"
+
+namespace kaldi {
+
+// A decodable object for which only the first few frames of the matrix are
+// ready, as if they were arriving in chunks.
+class PartialDecodable: public DecodableMatrixScaled {
+ public:
+  explicit PartialDecodable(const Matrix<BaseFloat> &likes):
+      DecodableMatrixScaled(likes, 1.0), num_frames_(likes.NumRows()),
+      num_frames_ready_(0) { }
+
+  virtual int32 NumFramesReady() const { return num_frames_ready_; }
+
+  void AddFrames(int32 n) {
+    num_frames_ready_ = std::min(num_frames_, num_frames_ready_ + n);
+  }
+
+ private:
+  int32 num_frames_;
+  int32 num_frames_ready_;
+};
+
+static void CheckSameLattice(const Lattice &lat1, const Lattice &lat2) {
+  KALDI_ASSERT(lat1.NumStates() == lat2.NumStates());
+  for (int32 s = 0; s < lat1.NumStates(); s++) {
+    KALDI_ASSERT(lat1.NumArcs(s) == lat2.NumArcs(s) &&
+                 lat1.Final(s) == lat2.Final(s));
+    fst::ArcIterator<Lattice> aiter1(lat1, s), aiter2(lat2, s);
+    for (; !aiter1.Done(); aiter1.Next(), aiter2.Next()) {
+      const LatticeArc &arc1 = aiter1.Value(), &arc2 = aiter2.Value();
+      KALDI_ASSERT(arc1.ilabel == arc2.ilabel && arc1.olabel == arc2.olabel &&
+                   arc1.weight == arc2.weight &&
+                   arc1.nextstate == arc2.nextstate);
+    }
+  }
+}
+
+// Checks that decoding utterances as the streams of a
+// LatticeFasterMultiStreamDecoder, in chunks and with streams starting and
+// finishing at different times, gives the same lattices as decoding them one
+// by one with LatticeFasterDecoder.
+void TestMultiStreamDecoder() {
+  int32 num_pdfs = RandInt(10, 100), num_words = RandInt(1, 50),
+      num_utts = RandInt(1, 10);
+  fst::VectorFst<fst::StdArc> graph;
+  RandDecodingGraph(RandInt(10, 1000), num_pdfs, num_words, &graph);
+  LatticeFasterDecoderConfig config;
+  config.beam = RandInt(5, 15);
+  config.max_active = RandInt(50, 500);
+
+  std::vector<Matrix<BaseFloat> > loglikes(num_utts);
+  std::vector<Lattice> ref_lats(num_utts);
+  for (int32 u = 0; u < num_utts; u++) {
+    loglikes[u].Resize(RandInt(1, 100), num_pdfs);
+    loglikes[u].SetRandn();
+    DecodableMatrixScaled decodable(loglikes[u], 1.0);
+    LatticeFasterDecoder decoder(graph, config);
+    decoder.Decode(&decodable);
+    decoder.GetRawLattice(&(ref_lats[u]));
+  }
+
+  LatticeFasterMultiStreamDecoder decoder(graph, config);
+  int32 max_streams = RandInt(1, 4), next_utt = 0, num_done = 0;
+  // For each stream number: the utterance it's decoding, and its decodable.
+  std::vector<int32> stream_utt;
+  std::vector<PartialDecodable*> stream_decodables;
+  while (num_done < num_utts) {
+    while (decoder.NumStreams() < max_streams && next_utt < num_utts) {
+      int32 stream = decoder.AddStream();
+      if (stream >= static_cast<int32>(stream_utt.size())) {
+        stream_utt.resize(stream + 1, -1);
+        stream_decodables.resize(stream + 1, NULL);
+      }
+      stream_utt[stream] = next_utt;
+      stream_decodables[stream] = new PartialDecodable(loglikes[next_utt]);
+      next_utt++;
+    }
+    // Make some more frames of some of the streams ready, and decode them.
+    std::vector<DecodableInterface*> decodables(decoder.NumSlots(), NULL);
+    for (int32 stream = 0; stream < decoder.NumSlots(); stream++) {
+      if (!decoder.IsActive(stream) || RandInt(0, 2) == 0)
+        continue;
+      stream_decodables[stream]->AddFrames(RandInt(1, 20));
+      decodables[stream] = stream_decodables[stream];
+    }
+    decoder.AdvanceDecoding(decodables);
+
+    for (int32 stream = 0; stream < decoder.NumSlots(); stream++) {
+      if (!decoder.IsActive(stream))
+        continue;
+      int32 utt = stream_utt[stream];
+      if (stream_decodables[stream]->NumFramesReady() <
+          loglikes[utt].NumRows())
+        continue;
+      KALDI_ASSERT(decoder.NumFramesDecoded(stream) ==
+                   loglikes[utt].NumRows());
+      decoder.FinalizeDecoding(stream);
+      Lattice lat;
+      decoder.GetRawLattice(stream, &lat);
+      CheckSameLattice(ref_lats[utt], lat);
+      decoder.RemoveStream(stream);
+      delete stream_decodables[stream];
+      stream_decodables[stream] = NULL;
+      num_done++;
+    }
+  }
+  KALDI_ASSERT(decoder.NumStreams() == 0 && decoder.NumSlots() == 0);
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (kaldi::int32 i = 0; i < 20; i++)
+    kaldi::TestMultiStreamDecoder();
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -0,0 +1,93 @@
+// decoder/lattice-faster-multistream-decoder.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/lattice-faster-multistream-decoder.h"
+
+namespace kaldi {
+
+template <typename FST, typename Token>
+LatticeFasterMultiStreamDecoderTpl<FST, Token>::LatticeFasterMultiStreamDecoderTpl(
+    const FST &fst, const LatticeFasterDecoderConfig &config):
+    fst_(fst), config_(config),
+    token_pool_(config.memory_pool_tokens_block_size),
+    forward_link_pool_(config.memory_pool_links_block_size),
+    num_streams_(0) {
+  config.Check();
+}
+
+template <typename FST, typename Token>
+LatticeFasterMultiStreamDecoderTpl<FST, Token>::~LatticeFasterMultiStreamDecoderTpl() {
+  for (size_t i = 0; i < decoders_.size(); i++)
+    delete decoders_[i];
+}
+
+template <typename FST, typename Token>
+int32 LatticeFasterMultiStreamDecoderTpl<FST, Token>::AddStream() {
+  int32 stream = 0;
+  while (stream < NumSlots() && decoders_[stream] != NULL)
+    stream++;
+  if (stream == NumSlots())
+    decoders_.push_back(NULL);
+  Decoder *decoder = new Decoder(fst_, config_);
+  decoder->SetMemoryPools(&token_pool_, &forward_link_pool_);
+  decoder->InitDecoding();
+  decoders_[stream] = decoder;
+  num_streams_++;
+  return stream;
+}
+
+template <typename FST, typename Token>
+void LatticeFasterMultiStreamDecoderTpl<FST, Token>::RemoveStream(
+    int32 stream) {
+  KALDI_ASSERT(IsActive(stream));
+  // This returns the stream's tokens and links to the shared pools.
+  delete decoders_[stream];
+  decoders_[stream] = NULL;
+  num_streams_--;
+  while (!decoders_.empty() && decoders_.back() == NULL)
+    decoders_.pop_back();
+}
+
+template <typename FST, typename Token>
+void LatticeFasterMultiStreamDecoderTpl<FST, Token>::AdvanceDecoding(
+    const std::vector<DecodableInterface*> &decodables) {
+  KALDI_ASSERT(static_cast<int32>(decodables.size()) == NumSlots());
+  bool any_advanced = true;
+  while (any_advanced) {
+    any_advanced = false;
+    for (int32 stream = 0; stream < NumSlots(); stream++) {
+      DecodableInterface *decodable = decodables[stream];
+      if (decodable == NULL)
+        continue;
+      Decoder &decoder = GetDecoder(stream);
+      if (decodable->NumFramesReady() > decoder.NumFramesDecoded()) {
+        decoder.AdvanceDecoding(decodable, 1);
+        any_advanced = true;
+      }
+    }
+  }
+}
+
+// Instantiate the template for the FST types that we'll need.
+template class LatticeFasterMultiStreamDecoderTpl<fst::Fst<fst::StdArc>,
+                                                  decoder::StdToken>;
+template class LatticeFasterMultiStreamDecoderTpl<fst::Fst<fst::StdArc>,
+                                                  decoder::BackpointerToken>;
+template class LatticeFasterMultiStreamDecoderTpl<fst::SharedLookaheadFst,
+                                                  decoder::StdToken>;
+
+}  // end namespace kaldi.
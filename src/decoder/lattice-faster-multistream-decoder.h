@@ -0,0 +1,161 @@
+// decoder/lattice-faster-multistream-decoder.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_LATTICE_FASTER_MULTISTREAM_DECODER_H_
+#define KALDI_DECODER_LATTICE_FASTER_MULTISTREAM_DECODER_H_
+
+#include <vector>
+
+#include "decoder/lattice-faster-decoder.h"
+
+namespace kaldi {
+
+/**
+   LatticeFasterMultiStreamDecoderTpl decodes several independent utterances
+   ("streams") in one thread.  Each stream is decoded by its own
+   LatticeFasterDecoderTpl, so the results are exactly the same as decoding
+   the utterances one by one; what is different is that:
+
+     - All the streams allocate their tokens and forward links from the same
+       memory pools (see LatticeFasterDecoderTpl::SetMemoryPools()), so memory
+       freed by one stream is reused by the others and the total memory held
+       by the pools is that of the peak total number of tokens, not the sum of
+       each decoder's peak.
+
+     - The version of AdvanceDecoding() that takes a decodable object per
+       stream advances the streams frame-synchronously, one frame of each
+       stream in turn.  The streams are all searching the same graph, and
+       utterances that are in similar places (e.g. silence, or common words)
+       visit the same graph states, so the graph states and arcs the previous
+       stream touched are often still in cache.
+
+   This is intended for programs that decode many utterances with a small
+   number of threads, e.g. nnet3-latgen-faster-batch (see its
+   --num-streams option), or a server where each thread serves several
+   connections.
+
+   Streams are numbered from zero; the number of a removed stream is reused by
+   the next call to AddStream().  This class is not thread-safe.
+ */
+template <typename FST, typename Token = decoder::StdToken>
+class LatticeFasterMultiStreamDecoderTpl {
+ public:
+  typedef LatticeFasterDecoderTpl<FST, Token> Decoder;
+  using ForwardLinkT = decoder::ForwardLink<Token>;
+
+  /// Does not take ownership of 'fst', which must outlive this object.
+  LatticeFasterMultiStreamDecoderTpl(const FST &fst,
+                                     const LatticeFasterDecoderConfig &config);
+
+  ~LatticeFasterMultiStreamDecoderTpl();
+
+  /// Starts decoding a new utterance (calls InitDecoding() on its decoder),
+  /// and returns the number of its stream.
+  int32 AddStream();
+
+  /// Frees the decoder of this stream; its number may be reused by the next
+  /// call to AddStream().  Get its output before calling this.
+  void RemoveStream(int32 stream);
+
+  /// Returns the number of streams currently being decoded.
+  int32 NumStreams() const { return num_streams_; }
+
+  /// Returns an upper bound on the stream numbers in use, plus one; this is
+  /// the size expected for the vector given to AdvanceDecoding().
+  int32 NumSlots() const { return static_cast<int32>(decoders_.size()); }
+
+  /// Returns true if 'stream' is the number of a stream that has been added
+  /// and not removed.
+  bool IsActive(int32 stream) const {
+    return stream >= 0 && stream < NumSlots() && decoders_[stream] != NULL;
+  }
+
+  /// Advances the decoding of a single stream, as
+  /// LatticeFasterDecoderTpl::AdvanceDecoding().
+  void AdvanceDecoding(int32 stream, DecodableInterface *decodable,
+                       int32 max_num_frames = -1) {
+    GetDecoder(stream).AdvanceDecoding(decodable, max_num_frames);
+  }
+
+  /// Advances the decoding of all streams for which decodables[stream] is
+  /// non-NULL, one frame of each stream at a time, until none of them has any
+  /// more frames ready.  decodables.size() must be NumSlots(); the entries for
+  /// unused stream numbers must be NULL.  Note: this does not block waiting
+  /// for frames, so for decodables that block in IsLastFrame() or
+  /// NumFramesReady() you should make sure the frames are ready first.
+  void AdvanceDecoding(const std::vector<DecodableInterface*> &decodables);
+
+  /// As LatticeFasterDecoderTpl::FinalizeDecoding(), for one stream.
+  void FinalizeDecoding(int32 stream) {
+    GetDecoder(stream).FinalizeDecoding();
+  }
+
+  /// As LatticeFasterDecoderTpl::ReachedFinal(), for one stream.
+  bool ReachedFinal(int32 stream) const {
+    return GetDecoder(stream).ReachedFinal();
+  }
+
+  /// As LatticeFasterDecoderTpl::NumFramesDecoded(), for one stream.
+  int32 NumFramesDecoded(int32 stream) const {
+    return GetDecoder(stream).NumFramesDecoded();
+  }
+
+  /// As LatticeFasterDecoderTpl::GetRawLattice(), for one stream.
+  bool GetRawLattice(int32 stream, Lattice *ofst,
+                     bool use_final_probs = true) const {
+    return GetDecoder(stream).GetRawLattice(ofst, use_final_probs);
+  }
+
+  /// As LatticeFasterDecoderTpl::GetBestPath(), for one stream.
+  bool GetBestPath(int32 stream, Lattice *ofst,
+                   bool use_final_probs = true) const {
+    return GetDecoder(stream).GetBestPath(ofst, use_final_probs);
+  }
+
+  /// Gives access to the decoder of a stream, for anything not covered by the
+  /// functions above.  Don't call InitDecoding() on it or destroy it.
+  Decoder &GetDecoder(int32 stream) {
+    KALDI_ASSERT(IsActive(stream));
+    return *(decoders_[stream]);
+  }
+  const Decoder &GetDecoder(int32 stream) const {
+    KALDI_ASSERT(IsActive(stream));
+    return *(decoders_[stream]);
+  }
+
+ private:
+  const FST &fst_;
+  LatticeFasterDecoderConfig config_;
+
+  // The memory pools shared by all the decoders.  They are declared before
+  // decoders_ and so are destroyed after them.
+  fst::MemoryPool<Token> token_pool_;
+  fst::MemoryPool<ForwardLinkT> forward_link_pool_;
+
+  // The decoders, indexed by stream; NULL for stream numbers not in use.
+  std::vector<Decoder*> decoders_;
+  int32 num_streams_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeFasterMultiStreamDecoderTpl);
+};
+
+typedef LatticeFasterMultiStreamDecoderTpl<fst::StdFst, decoder::StdToken>
+    LatticeFasterMultiStreamDecoder;
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_LATTICE_FASTER_MULTISTREAM_DECODER_H_
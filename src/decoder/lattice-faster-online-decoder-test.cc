@@ -0,0 +1,101 @@
+// decoder/lattice-faster-online-decoder-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/decodable-matrix.h"
+#include "decoder/decoder-test-utils.h"
+#include "decoder/lattice-faster-online-decoder.h"
+
+namespace kaldi {
+
+// Checks that GetPartialBestPath() gives the same path as GetBestPath(), and
+// puts its alignment in 'alignment'.
+static void CheckPartialBestPath(LatticeFasterOnlineDecoder *decoder,
+                                 bool use_final_probs,
+                                 std::vector<int32> *alignment,
+                                 int32 *num_stable_frames) {
+  Lattice best_path, partial_best_path;
+  bool ans = decoder->GetBestPath(&best_path, use_final_probs),
+      ans2 = decoder->GetPartialBestPath(&partial_best_path, num_stable_frames,
+                                         use_final_probs);
+  KALDI_ASSERT(ans == ans2);
+  if (!ans)
+    return;
+  std::vector<int32> words, words2, alignment2;
+  LatticeWeight weight, weight2;
+  fst::GetLinearSymbolSequence(best_path, alignment, &words, &weight);
+  fst::GetLinearSymbolSequence(partial_best_path, &alignment2, &words2,
+                               &weight2);
+  KALDI_ASSERT(*alignment == alignment2 && words == words2 &&
+               ApproxEqual(weight, weight2));
+  KALDI_ASSERT(*num_stable_frames >= 0 &&
+               *num_stable_frames <= decoder->NumFramesDecoded());
+}
+
+// Decodes a few utterances frame by frame, checking the output of
+// GetPartialBestPath() on each frame, and that the frames it says are stable
+// don't change.
+void TestGetPartialBestPath() {
+  int32 num_pdfs = RandInt(10, 100), num_words = RandInt(1, 50);
+  fst::VectorFst<fst::StdArc> graph;
+  RandDecodingGraph(RandInt(10, 1000), num_pdfs, num_words, &graph);
+  LatticeFasterDecoderConfig config;
+  config.beam = RandInt(5, 15);
+  config.lattice_beam = RandInt(2, 8);
+  config.prune_interval = RandInt(1, 25);
+  LatticeFasterOnlineDecoder decoder(graph, config);
+
+  for (int32 utt = 0; utt < 3; utt++) {
+    Matrix<BaseFloat> loglikes(RandInt(1, 200), num_pdfs);
+    loglikes.SetRandn();
+    DecodableMatrixScaled decodable(loglikes, 1.0);
+    // Re-initializing through the base class must also discard the stored
+    // best-path prefix of the previous utterance.
+    LatticeFasterDecoderTpl<fst::StdFst, decoder::BackpointerToken>
+        &base_decoder = decoder;
+    base_decoder.InitDecoding();
+    std::vector<int32> stable_alignment;
+    while (decoder.NumFramesDecoded() < loglikes.NumRows()) {
+      decoder.AdvanceDecoding(&decodable, RandInt(1, 5));
+      if (RandInt(0, 2) == 0)
+        continue;
+      std::vector<int32> alignment;
+      int32 num_stable_frames;
+      CheckPartialBestPath(&decoder, false, &alignment, &num_stable_frames);
+      KALDI_ASSERT(num_stable_frames >=
+                   static_cast<int32>(stable_alignment.size()));
+      KALDI_ASSERT(std::equal(stable_alignment.begin(), stable_alignment.end(),
+                              alignment.begin()));
+      stable_alignment.assign(alignment.begin(),
+                              alignment.begin() + num_stable_frames);
+    }
+    decoder.FinalizeDecoding();
+    std::vector<int32> alignment;
+    int32 num_stable_frames;
+    CheckPartialBestPath(&decoder, true, &alignment, &num_stable_frames);
+    KALDI_ASSERT(std::equal(stable_alignment.begin(), stable_alignment.end(),
+                            alignment.begin()));
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (kaldi::int32 i = 0; i < 20; i++)
+    kaldi::TestGetPartialBestPath();
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -74,6 +74,89 @@ bool LatticeFasterOnlineDecoderTpl<FST>::GetBestPath(Lattice *olat,
   return true;
 }
 
+template <typename FST>
+bool LatticeFasterOnlineDecoderTpl<FST>::GetPartialBestPath(
+    Lattice *olat, int32 *num_stable_frames, bool use_final_probs) {
+  olat->DeleteStates();
+  if (stable_decoding_id_ != this->decoding_id_ ||
+      num_stable_frames_ > this->NumFramesDecoded())
+    ResetStablePrefix();  // The decoder was re-initialized.
+  BaseFloat final_graph_cost;
+  BestPathIterator iter = BestPathEnd(use_final_probs, &final_graph_cost);
+  if (iter.Done())
+    return false;  // would have printed warning.
+
+  // Trace back the best path as far as stable_tok_.  tail_arcs[i] is the arc
+  // into tail_toks[i], from tail_toks[i+1] (or from stable_tok_).
+  std::vector<Token*> tail_toks;
+  std::vector<LatticeArc> tail_arcs;
+  unordered_map<Token*, size_t> tail_index;
+  while (!iter.Done() && iter.tok != stable_tok_) {
+    Token *tok = static_cast<Token*>(iter.tok);
+    tail_index[tok] = tail_toks.size();
+    tail_toks.push_back(tok);
+    LatticeArc arc;
+    iter = TraceBackBestPath(iter, &arc);
+    tail_arcs.push_back(arc);
+  }
+  if (iter.tok != stable_tok_)
+    KALDI_ERR << "Stable prefix is not on the best path (code error?)";
+
+  // Find the latest token on the best path that all tokens on the last frame
+  // descend from: tail_toks[common], or stable_tok_ if common ==
+  // tail_toks.size().  We trace back each token until we reach the best path
+  // or a token traced back from an earlier one, so each token is visited
+  // once.
+  size_t common = 0;
+  unordered_set<Token*> seen;
+  for (Token *tok = this->active_toks_.back().toks;
+       tok != NULL && common < tail_toks.size(); tok = tok->next) {
+    for (Token *t = tok; ; t = t->backpointer) {
+      if (t == stable_tok_ || t == NULL) {
+        common = tail_toks.size();
+        break;
+      }
+      typename unordered_map<Token*, size_t>::const_iterator it =
+          tail_index.find(t);
+      if (it != tail_index.end()) {
+        common = std::max(common, it->second);
+        break;
+      }
+      if (!seen.insert(t).second)
+        break;
+    }
+  }
+  // Move the part of the path up to tail_toks[common] into the stable prefix.
+  if (common < tail_toks.size()) {
+    for (size_t i = tail_arcs.size(); i > common; i--) {
+      stable_arcs_.push_back(tail_arcs[i - 1]);
+      if (tail_arcs[i - 1].ilabel != 0)
+        num_stable_frames_++;
+    }
+    stable_tok_ = tail_toks[common];
+    tail_arcs.resize(common);
+  }
+
+  StateId state = olat->AddState();
+  olat->SetStart(state);
+  for (size_t i = 0; i < stable_arcs_.size(); i++) {
+    LatticeArc arc = stable_arcs_[i];
+    arc.nextstate = olat->AddState();
+    olat->AddArc(state, arc);
+    state = arc.nextstate;
+  }
+  for (size_t i = tail_arcs.size(); i > 0; i--) {
+    LatticeArc arc = tail_arcs[i - 1];
+    arc.nextstate = olat->AddState();
+    olat->AddArc(state, arc);
+    state = arc.nextstate;
+  }
+  olat->SetFinal(state, LatticeWeight(final_graph_cost, 0.0));
+  if (num_stable_frames != NULL)
+    *num_stable_frames = num_stable_frames_;
+  return true;
+}
+
 template <typename FST>
 typename LatticeFasterOnlineDecoderTpl<FST>::BestPathIterator LatticeFasterOnlineDecoderTpl<FST>::BestPathEnd(
     bool use_final_probs,
@@ -280,6 +363,9 @@ template class LatticeFasterOnlineDecoderTpl<fst::VectorFst<fst::StdArc> >;
 template class LatticeFasterOnlineDecoderTpl<fst::ConstFst<fst::StdArc> >;
 template class LatticeFasterOnlineDecoderTpl<fst::ConstGrammarFst >;
 template class LatticeFasterOnlineDecoderTpl<fst::VectorGrammarFst >;
+template class LatticeFasterOnlineDecoderTpl<fst::DecoderFst >;
+template class LatticeFasterOnlineDecoderTpl<fst::SharedLookaheadFst >;
+template class LatticeFasterOnlineDecoderTpl<fst::BiglmFst >;
 
 
 } // end namespace kaldi.
@@ -66,14 +66,15 @@ class LatticeFasterOnlineDecoderTpl:
   // 'fst'.
   LatticeFasterOnlineDecoderTpl(const FST &fst,
                                 const LatticeFasterDecoderConfig &config):
-      LatticeFasterDecoderTpl<FST, Token>(fst, config) { }
+      LatticeFasterDecoderTpl<FST, Token>(fst, config),
+      stable_tok_(NULL), num_stable_frames_(0), stable_decoding_id_(-1) { }
 
   // This version of the initializer takes ownership of 'fst', and will delete
   // it when this object is destroyed.
   LatticeFasterOnlineDecoderTpl(const LatticeFasterDecoderConfig &config,
                                 FST *fst):
-      LatticeFasterDecoderTpl<FST, Token>(config, fst) { }
-
+      LatticeFasterDecoderTpl<FST, Token>(config, fst),
+      stable_tok_(NULL), num_stable_frames_(0), stable_decoding_id_(-1) { }
 
   struct BestPathIterator {
     void *tok;
@@ -100,6 +101,22 @@ class LatticeFasterOnlineDecoderTpl:
                    bool use_final_probs = true) const;
 
 
+  /// This is as GetBestPath(), but is meant for getting partial results
+  /// repeatedly while decoding.  GetBestPath() traces back through the whole
+  /// utterance every time; this function remembers the part of the best path
+  /// that can no longer change, i.e. the part up to the most recent token that
+  /// all the tokens on the last frame descend from (via their backpointers),
+  /// and only traces back the part after that.  The output is the same as
+  /// that of GetBestPath().  If num_stable_frames is non-NULL, it is set to
+  /// the number of frames at the start of the best path that will not change
+  /// as decoding continues, so that a client can commit the words on them.
+  /// The tokens traced back on each call are those that descend from the
+  /// last stable token, so the cost is bounded by how far back the
+  /// alternatives that are still active diverge, not by the utterance length.
+  bool GetPartialBestPath(Lattice *ofst,
+                          int32 *num_stable_frames = NULL,
+                          bool use_final_probs = true);
+
   /// This function does a self-test of GetBestPath().  Returns true on
   /// success; returns false and prints a warning on failure.
   bool TestGetBestPath(bool use_final_probs = true) const;
@@ -137,6 +154,28 @@ class LatticeFasterOnlineDecoderTpl:
                            BaseFloat beam) const;
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeFasterOnlineDecoderTpl);
+
+ private:
+  void ResetStablePrefix() {
+    stable_tok_ = NULL;
+    stable_arcs_.clear();
+    num_stable_frames_ = 0;
+    stable_decoding_id_ = this->decoding_id_;
+  }
+
+  // The best-path prefix that can no longer change, for GetPartialBestPath():
+  // stable_arcs_ are the arcs of the best path up to and including the arc
+  // into stable_tok_ (NULL if there is no such prefix yet), and
+  // num_stable_frames_ is the number of them that have nonzero ilabel, which
+  // is also the index (frame plus one) in active_toks_ of stable_tok_.
+  // stable_tok_ is an ancestor of every token after it, so it's never pruned.
+  // stable_decoding_id_ is the value of decoding_id_ when the prefix was
+  // stored: if InitDecoding() has been called since then (by whatever route),
+  // stable_tok_ has been freed and the prefix is discarded.
+  Token *stable_tok_;
+  std::vector<LatticeArc> stable_arcs_;
+  int32 num_stable_frames_;
+  int32 stable_decoding_id_;
 };
 
 typedef LatticeFasterOnlineDecoderTpl<fst::StdFst> LatticeFasterOnlineDecoder;
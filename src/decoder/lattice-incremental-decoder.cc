@@ -32,7 +32,8 @@ LatticeIncrementalDecoderTpl<FST, Token>::LatticeIncrementalDecoderTpl(
       delete_fst_(false),
       num_toks_(0),
       config_(config),
-      determinizer_(trans_model, config) {
+      determinizer_(trans_model, config),
+      determinize_secs_per_frame_(0.0) {
   config.Check();
   toks_.SetSize(1000); // just so on the first frame we do something reasonable.
 }
@@ -45,7 +46,8 @@ LatticeIncrementalDecoderTpl<FST, Token>::LatticeIncrementalDecoderTpl(
       delete_fst_(true),
       num_toks_(0),
       config_(config),
-      determinizer_(trans_model, config) {
+      determinizer_(trans_model, config),
+      determinize_secs_per_frame_(0.0) {
   config.Check();
   toks_.SetSize(1000); // just so on the first frame we do something reasonable.
 }
@@ -84,35 +86,66 @@ void LatticeIncrementalDecoderTpl<FST, Token>::InitDecoding() {
 
 template <typename FST, typename Token>
 void LatticeIncrementalDecoderTpl<FST, Token>::UpdateLatticeDeterminization() {
-  if (NumFramesDecoded() - num_frames_in_lattice_ <
-      config_.determinize_max_delay)
-    return;
+  bool have_budget = (config_.determinize_max_secs > 0.0);
+  Timer timer;
+  for (int32 num_chunks = 0; ; num_chunks++) {
+    /* max_chunk_size is the largest number of frames we expect to be able to
+       determinize in the time left of the budget, if there is one. */
+    int32 max_chunk_size = std::numeric_limits<int32>::max();
+    if (have_budget && determinize_secs_per_frame_ > 0.0) {
+      double frames_left = (config_.determinize_max_secs - timer.Elapsed()) /
+          determinize_secs_per_frame_;
+      if (frames_left < config_.determinize_min_chunk_size) {
+        if (num_chunks > 0)
+          return;  // Leave the rest for the next call.
+        max_chunk_size = config_.determinize_min_chunk_size;
+      } else if (frames_left < max_chunk_size) {
+        max_chunk_size = static_cast<int32>(frames_left);
+      }
+    }
+    int32 num_frames_pending = NumFramesDecoded() - num_frames_in_lattice_;
+    if (num_frames_pending <
+        std::min(config_.determinize_max_delay, max_chunk_size))
+      return;
 
+    /* Make sure the token-pruning is active.  Note: PruneActiveTokens() has
+       internal logic that prevents it from doing unnecessary work if you
+       call it and then immediately call it again. */
+    PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
 
-  /* Make sure the token-pruning is active.  Note: PruneActiveTokens() has
-     internal logic that prevents it from doing unnecessary work if you
-     call it and then immediately call it again. */
-  PruneActiveTokens(config_.lattice_beam * config_.prune_scale);
-
-  int32 first = num_frames_in_lattice_ + config_.determinize_min_chunk_size,
-      last = NumFramesDecoded(),
-      fewest_tokens = std::numeric_limits<int32>::max(),
-      best_frame = -1;
-  for (int32 t = last; t >= first; t--) {
-    /* Make sure PruneActiveTokens() has computed num_toks for all these
-       frames... */
-    KALDI_ASSERT(active_toks_[t].num_toks != -1);
-    if (active_toks_[t].num_toks < fewest_tokens) {
-      //  <= because we want the latest one in case of ties.
-      fewest_tokens = active_toks_[t].num_toks;
-      best_frame = t;
+    int32 first = num_frames_in_lattice_ + config_.determinize_min_chunk_size,
+        last = num_frames_in_lattice_ +
+            std::min(num_frames_pending, max_chunk_size),
+        fewest_tokens = std::numeric_limits<int32>::max(),
+        best_frame = -1;
+    for (int32 t = last; t >= first; t--) {
+      /* Make sure PruneActiveTokens() has computed num_toks for all these
+         frames... */
+      KALDI_ASSERT(active_toks_[t].num_toks != -1);
+      if (active_toks_[t].num_toks < fewest_tokens) {
+        //  <= because we want the latest one in case of ties.
+        fewest_tokens = active_toks_[t].num_toks;
+        best_frame = t;
+      }
     }
+    /* OK, determinize the chunk that spans from num_frames_in_lattice_ to
+       best_frame. */
+    bool use_final_probs = false;
+    int32 chunk_size = best_frame - num_frames_in_lattice_;
+    double start_time = timer.Elapsed();
+    GetLattice(best_frame, use_final_probs);
+    double chunk_secs = timer.Elapsed() - start_time;
+    if (determinize_secs_per_frame_ == 0.0)
+      determinize_secs_per_frame_ = chunk_secs / chunk_size;
+    else
+      determinize_secs_per_frame_ = 0.8 * determinize_secs_per_frame_ +
+          0.2 * chunk_secs / chunk_size;
+    KALDI_VLOG(3) << "Determinized a chunk of " << chunk_size
+                  << " frames, up to frame " << num_frames_in_lattice_
+                  << ", in " << chunk_secs << " seconds.";
+    if (!have_budget)
+      return;
   }
-  /* OK, determinize the chunk that spans from num_frames_in_lattice_ to
-     best_frame. */
-  bool use_final_probs = false;
-  GetLattice(best_frame, use_final_probs);
-  return;
 }
 // Returns true if any kind of traceback is available (not necessarily from
 // a final state).  It should only very rarely return false; this indicates
@@ -698,6 +731,10 @@ BaseFloat LatticeIncrementalDecoderTpl<FST, Token>::ProcessEmitting(
   BaseFloat cost_offset = 0.0; // Used to keep probabilities in a good
                                // dynamic range.
 
+  // If the decodable object supports it, we get the frame's log-likelihoods
+  // as an array, which saves a virtual call per arc.
+  const BaseFloat *loglikes = decodable->LogLikelihoodRow(frame);
+
   // First process the best token to get a hopefully
   // reasonably tight bound on the next cutoff.  The only
   // products of the next block are "next_cutoff" and "cost_offset".
@@ -709,7 +746,8 @@ BaseFloat LatticeIncrementalDecoderTpl<FST, Token>::ProcessEmitting(
       const Arc &arc = aiter.Value();
       if (arc.ilabel != 0) { // propagate..
         BaseFloat new_weight = arc.weight.Value() + cost_offset -
-                               decodable->LogLikelihood(frame, arc.ilabel) +
+                               (loglikes != NULL ? loglikes[arc.ilabel] :
+                                decodable->LogLikelihood(frame, arc.ilabel)) +
                                tok->tot_cost;
         if (new_weight + adaptive_beam < next_cutoff)
           next_cutoff = new_weight + adaptive_beam;
@@ -735,7 +773,9 @@ BaseFloat LatticeIncrementalDecoderTpl<FST, Token>::ProcessEmitting(
         const Arc &arc = aiter.Value();
         if (arc.ilabel != 0) { // propagate..
           BaseFloat ac_cost =
-                        cost_offset - decodable->LogLikelihood(frame, arc.ilabel),
+                        cost_offset -
+                        (loglikes != NULL ? loglikes[arc.ilabel] :
+                         decodable->LogLikelihood(frame, arc.ilabel)),
                     graph_cost = arc.weight.Value(), cur_cost = tok->tot_cost,
                     tot_cost = cur_cost + ac_cost + graph_cost;
           if (tot_cost >= next_cutoff)
@@ -128,6 +128,7 @@ struct LatticeIncrementalDecoderConfig {
   // If you call
   int32 determinize_max_delay;
   int32 determinize_min_chunk_size;
+  BaseFloat determinize_max_secs;
 
 
   LatticeIncrementalDecoderConfig()
@@ -140,7 +141,8 @@ struct LatticeIncrementalDecoderConfig {
         hash_ratio(2.0),
         prune_scale(0.01),
         determinize_max_delay(60),
-        determinize_min_chunk_size(20) {
+        determinize_min_chunk_size(20),
+        determinize_max_secs(0.0) {
     det_opts.minimize = false;
   }
   void Register(OptionsItf *opts) {
@@ -168,6 +170,15 @@ struct LatticeIncrementalDecoderConfig {
                    "determinizing it");
     opts->Register("determinize-min-chunk-size", &determinize_min_chunk_size,
                    "Minimum chunk size used in determinization");
+    opts->Register("determinize-max-secs", &determinize_max_secs,
+                   "If >0, a soft limit on the time in seconds spent "
+                   "determinizing the lattice in each call to AdvanceDecoding(). "
+                   "Chunks are made smaller (but not smaller than "
+                   "--determinize-min-chunk-size) and determinized earlier so "
+                   "the work is spread out; if decoding gets ahead of the "
+                   "determinization, the delay may exceed "
+                   "--determinize-max-delay, and the remaining work is done "
+                   "over subsequent calls or at the end of the utterance.");
 
   }
   void Check() const {
@@ -176,7 +187,7 @@ struct LatticeIncrementalDecoderConfig {
           beam_delta > 0.0 && hash_ratio >= 1.0 &&
           prune_scale > 0.0 && prune_scale < 1.0 &&
           determinize_max_delay > determinize_min_chunk_size &&
-          determinize_min_chunk_size > 0))
+          determinize_min_chunk_size > 0 && determinize_max_secs >= 0.0))
         KALDI_ERR << "Invalid options given to decoder";
     /* Minimization of the chunks is not compatible withour algorithm (or at
        least, would require additional complexity to implement.) */
@@ -671,6 +682,12 @@ class LatticeIncrementalDecoderTpl {
       for any prior call to GetLattice(). */
   int32 num_frames_in_lattice_;
 
+  // A moving average of the time in seconds that GetLattice() took per frame
+  // of the chunks determinized by UpdateLatticeDeterminization(); zero if no
+  // chunk has been determinized yet.  Used with config_.determinize_max_secs
+  // to decide the chunk sizes.  Not reset by InitDecoding().
+  double determinize_secs_per_frame_;
+
   // A map from Token to its token_label.  Will contain an entry for
   // each Token in active_toks_[num_frames_in_lattice_].
   unordered_map<Token*, Label> token2label_map_;
@@ -713,6 +730,11 @@ class LatticeIncrementalDecoderTpl {
      GetLattice().  You can safely call this as often as you want (e.g.  after
      each time you call AdvanceDecoding(); it won't do subtantially more work if
      it is called frequently.
+
+     If config_.determinize_max_secs > 0, it may determinize several chunks
+     in one call, as long as their estimated time fits within that budget, and
+     it limits the chunk sizes so that the work per call stays within it; what
+     is left over is done by later calls.
   */
   void UpdateLatticeDeterminization();
 
@@ -0,0 +1,150 @@
+// decoder/shared-lookahead-fst-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <thread>
+
+#include "decoder/shared-lookahead-fst.h"
+
+namespace fst {
+
+using kaldi::int32;
+using kaldi::RandInt;
+using kaldi::RandUniform;
+
+// Creates a random FST with the given numbers of states and labels (label 0
+// is epsilon).
+static void RandFst(int32 num_states, int32 num_ilabels, int32 num_olabels,
+                    VectorFst<StdArc> *fst) {
+  fst->DeleteStates();
+  for (int32 s = 0; s < num_states; s++)
+    fst->AddState();
+  fst->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    int32 num_arcs = RandInt(1, 4);
+    for (int32 i = 0; i < num_arcs; i++)
+      fst->AddArc(s, StdArc(RandInt(0, num_ilabels), RandInt(0, num_olabels),
+                            RandUniform(), RandInt(0, num_states - 1)));
+    if (RandInt(0, 3) == 0)
+      fst->SetFinal(s, RandUniform());
+  }
+}
+
+typedef std::vector<std::pair<float, std::vector<StdArc> > > ExpandedStates;
+
+// Expands the states of 'fst' reachable from the start state (in
+// breadth-first order) into 'expanded', indexed by state-id.
+template <class FST>
+static void ExpandAll(const FST &fst, ExpandedStates *expanded) {
+  expanded->clear();
+  std::vector<StdArc::StateId> queue(1, fst.Start());
+  std::vector<bool> seen(fst.Start() + 1, false);
+  seen[fst.Start()] = true;
+  for (size_t i = 0; i < queue.size(); i++) {
+    StdArc::StateId s = queue[i];
+    if (expanded->size() <= static_cast<size_t>(s))
+      expanded->resize(s + 1);
+    (*expanded)[s].first = fst.Final(s).Value();
+    for (ArcIterator<FST> aiter(fst, s); !aiter.Done(); aiter.Next()) {
+      const StdArc &arc = aiter.Value();
+      (*expanded)[s].second.push_back(arc);
+      if (seen.size() <= static_cast<size_t>(arc.nextstate))
+        seen.resize(arc.nextstate + 1, false);
+      if (!seen[arc.nextstate]) {
+        seen[arc.nextstate] = true;
+        queue.push_back(arc.nextstate);
+      }
+    }
+  }
+}
+
+static void CheckExpansion(const SharedLookaheadFst *fst,
+                           const ExpandedStates *ref) {
+  ExpandedStates expanded;
+  ExpandAll(*fst, &expanded);
+  KALDI_ASSERT(expanded.size() == ref->size());
+  for (size_t s = 0; s < ref->size(); s++) {
+    const std::vector<StdArc> &arcs = expanded[s].second,
+        &ref_arcs = (*ref)[s].second;
+    KALDI_ASSERT(expanded[s].first == (*ref)[s].first &&
+                 arcs.size() == ref_arcs.size());
+    size_t num_input_epsilons = 0;
+    for (size_t i = 0; i < arcs.size(); i++) {
+      KALDI_ASSERT(arcs[i].ilabel == ref_arcs[i].ilabel &&
+                   arcs[i].olabel == ref_arcs[i].olabel &&
+                   arcs[i].weight == ref_arcs[i].weight &&
+                   arcs[i].nextstate == ref_arcs[i].nextstate);
+      if (arcs[i].ilabel == 0)
+        num_input_epsilons++;
+    }
+    KALDI_ASSERT(fst->NumInputEpsilons(s) == num_input_epsilons);
+  }
+}
+
+// Checks that several threads expanding a SharedLookaheadFst at the same time
+// all see the same FST as LookaheadComposeFst() gives.
+void TestSharedLookaheadFst() {
+  int32 num_phones = RandInt(1, 10), num_words = RandInt(1, 20),
+      num_disambig = RandInt(0, 2);
+  VectorFst<StdArc> hcl, g;
+  RandFst(RandInt(1, 50), num_phones + num_disambig, num_words, &hcl);
+  RandFst(RandInt(1, 50), num_words, num_words, &g);
+  ArcSort(&hcl, OLabelCompare<StdArc>());
+  ArcSort(&g, ILabelCompare<StdArc>());
+  std::vector<int32> disambig_syms;
+  for (int32 i = 1; i <= num_disambig; i++)
+    disambig_syms.push_back(num_phones + i);
+
+  ExpandedStates ref;
+  {
+    std::unique_ptr<LookaheadFst<StdArc, int32> > ref_fst(
+        LookaheadComposeFst(hcl, g, disambig_syms));
+    if (ref_fst->Start() == kNoStateId)
+      return;
+    ExpandAll(*ref_fst, &ref);
+  }
+
+  SharedLookaheadFst fst(hcl, g, disambig_syms);
+  int32 num_threads = RandInt(1, 8);
+  std::vector<std::thread> threads;
+  for (int32 t = 0; t < num_threads; t++)
+    threads.push_back(std::thread(CheckExpansion, &fst, &ref));
+  for (int32 t = 0; t < num_threads; t++)
+    threads[t].join();
+  KALDI_ASSERT(fst.NumExpandedStates() <= ref.size());
+
+  // Once the current FST has expanded more than max_states states, the
+  // provider starts a new one; the old one stays usable.
+  SharedLookaheadFstConfig config;
+  config.max_states = 1;
+  SharedLookaheadFstProvider provider(config, hcl, g, disambig_syms);
+  std::shared_ptr<const SharedLookaheadFst> fst1 = provider.GetFst();
+  KALDI_ASSERT(provider.GetFst() == fst1);
+  CheckExpansion(fst1.get(), &ref);
+  std::shared_ptr<const SharedLookaheadFst> fst2 = provider.GetFst();
+  KALDI_ASSERT((fst2 == fst1) == (fst1->NumExpandedStates() <= 1));
+  CheckExpansion(fst2.get(), &ref);
+  CheckExpansion(fst1.get(), &ref);
+}
+
+}  // namespace fst
+
+int main() {
+  for (kaldi::int32 i = 0; i < 50; i++)
+    fst::TestSharedLookaheadFst();
+  std::cout << "Test OK.\n";
+  return 0;
+}
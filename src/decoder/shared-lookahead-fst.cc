@@ -0,0 +1,133 @@
+// decoder/shared-lookahead-fst.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/timer.h"
+#include "decoder/shared-lookahead-fst.h"
+
+namespace fst {
+
+SharedLookaheadFst::SharedLookaheadFst(
+    const Fst<StdArc> &hcl, const Fst<StdArc> &g,
+    const std::vector<int32> &disambig_syms):
+    fst_(LookaheadComposeFst(hcl, g, disambig_syms)),
+    num_expanded_states_(0), num_expanded_arcs_(0), expand_time_(0.0),
+    num_expanded_by_other_thread_(0) {
+  for (int32 b = 0; b < kMaxBlocks; b++)
+    blocks_[b].store(NULL, std::memory_order_relaxed);
+  start_ = fst_->Start();
+}
+
+SharedLookaheadFst::~SharedLookaheadFst() {
+  for (int32 b = 0; b < kMaxBlocks; b++) {
+    std::atomic<const ExpandedState*> *block =
+        blocks_[b].load(std::memory_order_relaxed);
+    if (block == NULL)
+      continue;
+    for (int32 i = 0; i < kBlockSize; i++)
+      delete block[i].load(std::memory_order_relaxed);
+    delete [] block;
+  }
+}
+
+const SharedLookaheadFst::ExpandedState* SharedLookaheadFst::ExpandState(
+    StateId s) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (s < 0 || (s >> kBlockShift) >= kMaxBlocks)
+    KALDI_ERR << "State-id " << s << " is out of range for "
+              << "SharedLookaheadFst (the composed FST has too many states; "
+              << "try a smaller --lookahead-max-states).";
+  std::atomic<const ExpandedState*> *block =
+      blocks_[s >> kBlockShift].load(std::memory_order_relaxed);
+  if (block == NULL) {
+    // The trailing () zero-initializes the pointers.
+    block = new std::atomic<const ExpandedState*>[kBlockSize]();
+    blocks_[s >> kBlockShift].store(block, std::memory_order_release);
+  }
+  std::atomic<const ExpandedState*> &entry = block[s & (kBlockSize - 1)];
+  const ExpandedState *existing = entry.load(std::memory_order_relaxed);
+  if (existing != NULL) {
+    num_expanded_by_other_thread_++;
+    return existing;
+  }
+
+  kaldi::Timer timer;
+  ExpandedState *ans = new ExpandedState;
+  ans->final_cost = fst_->Final(s).Value();
+  ans->num_input_epsilons = 0;
+  ans->arcs.reserve(fst_->NumArcs(s));
+  for (ArcIterator<ComposedFst> aiter(*fst_, s); !aiter.Done(); aiter.Next()) {
+    const StdArc &arc = aiter.Value();
+    if (arc.ilabel == 0)
+      ans->num_input_epsilons++;
+    ans->arcs.push_back(arc);
+  }
+  entry.store(ans, std::memory_order_release);
+  num_expanded_states_++;
+  num_expanded_arcs_ += ans->arcs.size();
+  expand_time_ += timer.Elapsed();
+  return ans;
+}
+
+size_t SharedLookaheadFst::NumExpandedStates() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_expanded_states_;
+}
+
+void SharedLookaheadFst::PrintStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  KALDI_LOG << "SharedLookaheadFst has " << num_expanded_states_
+            << " expanded states with " << num_expanded_arcs_
+            << " arcs; expanding states took " << expand_time_
+            << " seconds.  Threads waited for another thread's expansion "
+            << "of the same state " << num_expanded_by_other_thread_
+            << " times.";
+}
+
+
+SharedLookaheadFstProvider::SharedLookaheadFstProvider(
+    const SharedLookaheadFstConfig &config,
+    const Fst<StdArc> &hcl, const Fst<StdArc> &g,
+    const std::vector<int32> &disambig_syms):
+    config_(config), hcl_(hcl.Copy()), g_(g.Copy()),
+    disambig_syms_(disambig_syms), num_generations_(0) {
+  KALDI_ASSERT(config_.max_states > 0);
+}
+
+std::shared_ptr<const SharedLookaheadFst> SharedLookaheadFstProvider::GetFst() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (fst_ == nullptr ||
+      fst_->NumExpandedStates() > static_cast<size_t>(config_.max_states)) {
+    if (fst_ != nullptr)
+      KALDI_VLOG(1) << "Shared lookahead FST has expanded "
+                    << fst_->NumExpandedStates() << " states; starting a new "
+                    << "one for new decoding sessions.";
+    fst_ = std::make_shared<const SharedLookaheadFst>(*hcl_, *g_,
+                                                      disambig_syms_);
+    num_generations_++;
+  }
+  return fst_;
+}
+
+void SharedLookaheadFstProvider::PrintStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  KALDI_LOG << "Created " << num_generations_
+            << " generation(s) of the shared lookahead FST.";
+  if (fst_ != nullptr)
+    fst_->PrintStats();
+}
+
+}  // namespace fst
@@ -0,0 +1,252 @@
+// decoder/shared-lookahead-fst.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_SHARED_LOOKAHEAD_FST_H_
+#define KALDI_DECODER_SHARED_LOOKAHEAD_FST_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "fst/fstlib.h"
+#include "fstext/fstext-utils.h"
+#include "itf/options-itf.h"
+
+namespace fst {
+
+class SharedLookaheadFst;
+
+// Declare that we'll be overriding class ArcIterator for class
+// SharedLookaheadFst.  As with GrammarFst, this works because
+// SharedLookaheadFst doesn't inherit from class Fst.
+template <> class ArcIterator<SharedLookaheadFst>;
+
+
+/**
+   SharedLookaheadFst is the lookahead composition HCL o G (as returned by
+   LookaheadComposeFst(), see nnet3-latgen-faster-lookahead), wrapped so that
+   one copy can be used by many decoders in different threads at once, e.g. by
+   all the connections of an online decoding server.
+
+   OpenFst's ComposeFst is expanded on demand and caches what it expands, but
+   it isn't safe to use from more than one thread.  Here the ComposeFst is
+   only accessed while holding a mutex, and each state is copied, the first
+   time any thread asks for it, into an immutable record (final-cost, arcs and
+   number of input epsilons) that is published in a table indexed by
+   state-id.  Looking up a state that's already been expanded takes no lock,
+   so once the states that are commonly visited have been expanded the
+   decoders hardly ever contend for the mutex.  The ComposeFst's own cache is
+   garbage-collected as usual, since every state it expands is copied out.
+
+   Like GrammarFst and DecoderFst, this does not inherit from fst::Fst and
+   only supports the parts of the interface the decoders need; the decoders
+   are instantiated for it.
+
+   The expanded states are never freed while the object exists, so the memory
+   used grows with the number of distinct states that decoding has visited;
+   see SharedLookaheadFstProvider for how to bound it.
+ */
+class SharedLookaheadFst {
+ public:
+  typedef StdArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Label Label;
+  typedef Arc::Weight Weight;
+
+  /// Constructor.  'hcl' would normally be of type olabel_lookahead, and
+  /// 'disambig_syms' are the disambiguation symbols to remove from the input
+  /// side of the composed FST, as for LookaheadComposeFst().  'hcl' and 'g'
+  /// are copied (shallowly, in the OpenFst sense), so they don't need to
+  /// outlive this object.
+  SharedLookaheadFst(const Fst<StdArc> &hcl, const Fst<StdArc> &g,
+                     const std::vector<int32> &disambig_syms);
+
+  ~SharedLookaheadFst();
+
+  StateId Start() const { return start_; }
+
+  Weight Final(StateId s) const {
+    return Weight(GetExpandedState(s)->final_cost);
+  }
+
+  size_t NumInputEpsilons(StateId s) const {
+    return GetExpandedState(s)->num_input_epsilons;
+  }
+
+  std::string Type() const { return "shared-lookahead"; }
+
+  /// Returns the number of states expanded so far (by all threads).
+  size_t NumExpandedStates() const;
+
+  /// Prints (via KALDI_LOG) the number of states and arcs expanded so far
+  /// and how much time was spent expanding them.
+  void PrintStats() const;
+
+ private:
+  friend class ArcIterator<SharedLookaheadFst>;
+
+  struct ExpandedState {
+    float final_cost;
+    int32 num_input_epsilons;
+    std::vector<StdArc> arcs;
+  };
+
+  // The table of expanded states is two-level: blocks_[s >> kBlockShift] is
+  // NULL or points to an array of kBlockSize pointers, the
+  // (s & (kBlockSize - 1))'th of which is NULL or points to the expanded
+  // state s.  Blocks and states are created under mutex_ and published with
+  // release semantics; the lookup in GetExpandedState() uses acquire
+  // semantics and doesn't lock.  The state-ids of a ComposeFst are dense
+  // (they're assigned in the order the states are first seen), so few blocks
+  // are wasted.
+  static const int32 kBlockShift = 12;
+  static const int32 kBlockSize = 1 << kBlockShift;
+  static const int32 kMaxBlocks = 1 << 16;
+
+  inline const ExpandedState *GetExpandedState(StateId s) const {
+    if (static_cast<kaldi::uint32>(s >> kBlockShift) <
+        static_cast<kaldi::uint32>(kMaxBlocks)) {
+      const std::atomic<const ExpandedState*> *block =
+          blocks_[s >> kBlockShift].load(std::memory_order_acquire);
+      if (block != NULL) {
+        const ExpandedState *ans =
+            block[s & (kBlockSize - 1)].load(std::memory_order_acquire);
+        if (ans != NULL)
+          return ans;
+      }
+    }
+    return ExpandState(s);
+  }
+
+  // Expands state s of fst_ (if no other thread has done so already) and
+  // returns it.  Locks mutex_.
+  const ExpandedState *ExpandState(StateId s) const;
+
+  typedef LookaheadFst<StdArc, int32> ComposedFst;
+  // The composed FST; only accessed while holding mutex_ (apart from in the
+  // constructor).
+  std::unique_ptr<ComposedFst> fst_;
+  StateId start_;
+
+  mutable std::atomic<std::atomic<const ExpandedState*>*> blocks_[kMaxBlocks];
+
+  // The following are only accessed while holding mutex_.
+  mutable size_t num_expanded_states_;
+  mutable size_t num_expanded_arcs_;
+  mutable double expand_time_;
+  // The number of times a thread found, after acquiring the mutex, that
+  // another thread had expanded the state it wanted in the meantime.
+  mutable size_t num_expanded_by_other_thread_;
+  mutable std::mutex mutex_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SharedLookaheadFst);
+};
+
+
+/**
+   This is the overridden template for class ArcIterator for
+   SharedLookaheadFst.  It is only used in the decoder, so it only supports
+   Done(), Next() and Value().
+ */
+template <>
+class ArcIterator<SharedLookaheadFst> {
+ public:
+  typedef StdArc Arc;
+  typedef Arc::StateId StateId;
+
+  inline ArcIterator(const SharedLookaheadFst &fst, StateId s) {
+    const std::vector<StdArc> &arcs = fst.GetExpandedState(s)->arcs;
+    arc_ = arcs.data();
+    end_ = arc_ + arcs.size();
+  }
+
+  inline bool Done() const { return arc_ == end_; }
+
+  inline void Next() { ++arc_; }
+
+  inline const Arc &Value() const { return *arc_; }
+
+ private:
+  const Arc *arc_;
+  const Arc *end_;
+};
+
+
+struct SharedLookaheadFstConfig {
+  int32 max_states;
+
+  SharedLookaheadFstConfig(): max_states(1000000) { }
+
+  void Register(kaldi::OptionsItf *opts) {
+    opts->Register("lookahead-max-states", &max_states, "Once the shared "
+                   "lookahead-composed graph has expanded more than this many "
+                   "states, new decoding sessions are given a freshly "
+                   "composed graph, and the old one is freed when the "
+                   "sessions using it have finished.  Limits memory use.");
+  }
+};
+
+
+/**
+   SharedLookaheadFstProvider hands out the SharedLookaheadFst that new
+   decoding sessions should use.  All sessions share the same
+   SharedLookaheadFst until it has expanded more than config.max_states
+   states; after that, GetFst() composes a new one (a "generation") for the
+   sessions that start from then on.  Each session holds a shared_ptr to the
+   generation it started with, so a generation is freed as soon as the last
+   session using it has finished.  This bounds the memory used by the
+   expanded states (to roughly twice max_states, plus whatever the sessions
+   still running on older generations expand) without ever changing the
+   graph under a running decoder.
+
+   It's safe to call GetFst() from multiple threads.
+ */
+class SharedLookaheadFstProvider {
+ public:
+  /// See the constructor of SharedLookaheadFst for the meanings of the
+  /// arguments; 'hcl' and 'g' are copied (shallowly).
+  SharedLookaheadFstProvider(const SharedLookaheadFstConfig &config,
+                             const Fst<StdArc> &hcl, const Fst<StdArc> &g,
+                             const std::vector<int32> &disambig_syms);
+
+  /// Returns the SharedLookaheadFst to use for a new decoding session.  The
+  /// caller should keep the shared_ptr until it has finished decoding with
+  /// it.
+  std::shared_ptr<const SharedLookaheadFst> GetFst();
+
+  /// Prints the number of generations created, and the stats of the current
+  /// one.
+  void PrintStats() const;
+
+ private:
+  SharedLookaheadFstConfig config_;
+  std::unique_ptr<const Fst<StdArc> > hcl_;
+  std::unique_ptr<const Fst<StdArc> > g_;
+  std::vector<int32> disambig_syms_;
+
+  std::shared_ptr<const SharedLookaheadFst> fst_;
+  int32 num_generations_;
+  mutable std::mutex mutex_;
+};
+
+
+}  // namespace fst
+
+#endif  // KALDI_DECODER_SHARED_LOOKAHEAD_FST_H_
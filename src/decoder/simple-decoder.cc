@@ -169,6 +169,9 @@ void SimpleDecoder::ProcessEmitting(DecodableInterface *decodable) {
   // Processes emitting arcs for one frame.  Propagates from
   // prev_toks_ to cur_toks_.
   double cutoff = std::numeric_limits<BaseFloat>::infinity();
+  // If the decodable object supports it, we get the frame's log-likelihoods
+  // as an array, which saves a virtual call per arc.
+  const BaseFloat *loglikes = decodable->LogLikelihoodRow(frame);
   for (unordered_map<StateId, Token*>::iterator iter = prev_toks_.begin();
        iter != prev_toks_.end();
        ++iter) {
@@ -180,7 +183,9 @@ void SimpleDecoder::ProcessEmitting(DecodableInterface *decodable) {
          aiter.Next()) {
       const StdArc &arc = aiter.Value();
       if (arc.ilabel != 0) {  // propagate..
-        BaseFloat acoustic_cost = -decodable->LogLikelihood(frame, arc.ilabel);
+        BaseFloat acoustic_cost = -(loglikes != NULL ? loglikes[arc.ilabel] :
+                                    decodable->LogLikelihood(frame,
+                                                             arc.ilabel));
         double total_cost = tok->cost_ + arc.weight.Value() + acoustic_cost;
 
         if (total_cost >= cutoff) continue;
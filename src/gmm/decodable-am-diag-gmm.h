@@ -126,7 +126,7 @@ class DecodableAmDiagGmmScaled: public DecodableAmDiagGmmUnmapped {
                            BaseFloat scale,
                            BaseFloat log_sum_exp_prune = -1.0):
       DecodableAmDiagGmmUnmapped(am, feats, log_sum_exp_prune), trans_model_(tm),
-      scale_(scale), delete_feats_(NULL) {}
+      scale_(scale), delete_feats_(NULL), row_access_(false) {}
 
   // This version of the initializer takes ownership of the pointer
   // "feats" and will delete it when this class is destroyed.
@@ -136,13 +136,32 @@ class DecodableAmDiagGmmScaled: public DecodableAmDiagGmmUnmapped {
                            BaseFloat log_sum_exp_prune,
                            Matrix<BaseFloat> *feats):
       DecodableAmDiagGmmUnmapped(am, *feats, log_sum_exp_prune),
-      trans_model_(tm),  scale_(scale), delete_feats_(feats) {}
+      trans_model_(tm),  scale_(scale), delete_feats_(feats),
+      row_access_(false) {}
 
   // Note, frames are numbered from zero but transition-ids from one.
   virtual BaseFloat LogLikelihood(int32 frame, int32 tid) {
     return scale_*LogLikelihoodZeroBased(frame,
                                          trans_model_.TransitionIdToPdf(tid));
   }
+
+  /// If you call this with true, LogLikelihoodRow() will be supported.  It
+  /// evaluates all the pdfs on each frame, so it's only worthwhile if the
+  /// decoder's beam is wide enough that most of them are active anyway.
+  void SetRowAccess(bool row_access) { row_access_ = row_access; }
+
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame) {
+    if (!row_access_) return NULL;
+    const BaseFloat *row = row_.Get(frame);
+    if (row != NULL) return row;
+    int32 num_pdfs = acoustic_model_.NumPdfs();
+    pdf_loglikes_.resize(num_pdfs);
+    for (int32 pdf_id = 0; pdf_id < num_pdfs; pdf_id++)
+      pdf_loglikes_[pdf_id] = LogLikelihoodZeroBased(frame, pdf_id);
+    return row_.Set(frame, trans_model_.TransitionIdToPdfArray(),
+                    pdf_loglikes_.data(), scale_);
+  }
+
   // Indices are one-based!  This is for compatibility with OpenFst.
   virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
 
@@ -156,6 +175,9 @@ class DecodableAmDiagGmmScaled: public DecodableAmDiagGmmUnmapped {
   const TransitionModel &trans_model_;  // for transition-id to pdf mapping
   BaseFloat scale_;
   Matrix<BaseFloat> *delete_feats_;
+  bool row_access_;
+  std::vector<BaseFloat> pdf_loglikes_;
+  MappedLogLikelihoodRow row_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmDiagGmmScaled);
 };
 
@@ -21,6 +21,7 @@
 
 #ifndef KALDI_ITF_DECODABLE_ITF_H_
 #define KALDI_ITF_DECODABLE_ITF_H_ 1
+#include <vector>
 #include "base/kaldi-common.h"
 
 namespace kaldi {
@@ -114,8 +115,78 @@ class DecodableInterface {
   /// this is for compatibility with OpenFst).
   virtual int32 NumIndices() const = 0;
 
+  /// This is an optional fast path for the decoders, which otherwise call
+  /// LogLikelihood() once for each arc they expand.  If the decodable object
+  /// can supply all the log-likelihoods of a frame at once, it returns a
+  /// pointer to an array of NumIndices() + 1 elements, where element i (for 1
+  /// <= i <= NumIndices()) equals LogLikelihood(frame, i); element 0 is not
+  /// used.  Otherwise it returns NULL, and the decoder should call
+  /// LogLikelihood().  The pointer is only valid until the next call to a
+  /// non-const function of this object.  Objects that have to compute the
+  /// log-likelihoods on demand (e.g. GMMs) should only do this if asked to,
+  /// since the decoder typically needs only a small fraction of them.
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame) { return NULL; }
+
   virtual ~DecodableInterface() {}
 };
+
+
+/**
+   MappedLogLikelihoodRow is a helper for implementing
+   DecodableInterface::LogLikelihoodRow() in decodable objects that look up
+   their log-likelihoods in a row of (pdf-indexed) acoustic scores; it holds
+   the row of the most recent frame, mapped to the indexes of the decodable
+   object (normally transition-ids) and scaled.
+*/
+class MappedLogLikelihoodRow {
+ public:
+  MappedLogLikelihoodRow(): frame_(-1) { }
+
+  /// Returns the row for frame 'frame' if it's the one that was last set,
+  /// else NULL.
+  const BaseFloat *Get(int32 frame) const {
+    return (frame == frame_ ? row_.data() : NULL);
+  }
+
+  /// Sets and returns the row for frame 'frame', with row[i] =
+  /// scale * pdf_loglikes[index_to_pdf[i]] for 1 <= i < index_to_pdf.size().
+  /// (Note: TransitionInformation::TransitionIdToPdfArray() has the right
+  /// format for 'index_to_pdf').
+  const BaseFloat *Set(int32 frame, const std::vector<int32> &index_to_pdf,
+                       const BaseFloat *pdf_loglikes, BaseFloat scale) {
+    size_t size = index_to_pdf.size();
+    row_.resize(size);
+    if (size != 0) row_[0] = 0.0;
+    const int32 *pdfs = index_to_pdf.data();
+    BaseFloat *row = row_.data();
+    for (size_t i = 1; i < size; i++)
+      row[i] = scale * pdf_loglikes[pdfs[i]];
+    frame_ = frame;
+    return row;
+  }
+
+  /// Sets and returns the row for frame 'frame' in the case where the indexes
+  /// are the pdf-ids plus one, so row[i] = scale * pdf_loglikes[i - 1] for
+  /// 1 <= i <= num_pdfs.
+  const BaseFloat *Set(int32 frame, int32 num_pdfs,
+                       const BaseFloat *pdf_loglikes, BaseFloat scale) {
+    row_.resize(num_pdfs + 1);
+    row_[0] = 0.0;
+    BaseFloat *row = row_.data();
+    for (int32 i = 0; i < num_pdfs; i++)
+      row[i + 1] = scale * pdf_loglikes[i];
+    frame_ = frame;
+    return row;
+  }
+
+  /// Forgets the stored row; call this if the underlying scores may have
+  /// changed.
+  void Invalidate() { frame_ = -1; }
+
+ private:
+  int32 frame_;
+  std::vector<BaseFloat> row_;
+};
 /// @}
 }  // namespace Kaldi
 
@@ -23,6 +23,8 @@
 #include "fstext/fst-test-utils.h"
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
+#include "hmm/hmm-test-utils.h"
+#include "hmm/transition-model.h"
 
 namespace fst {
 // Caution: these tests are not as generic as you might think from all the
@@ -137,11 +139,76 @@ template<class Arc> void TestDeterminizeLatticePruned2() {
 }
 
 
+// test that DeterminizeLatticePhonePrunedWrapper() gives equivalent output
+// when it splits the lattice into pieces and determinizes them in parallel.
+// The lattices are concatenations of random acyclic FSTs, so the start
+// states of the pieces are states that all paths pass through.
+void TestDeterminizeLatticeSegmented() {
+  using kaldi::LatticeArc;
+  using kaldi::CompactLatticeArc;
+  kaldi::TransitionModel *trans_model = kaldi::GenRandTransitionModel(NULL);
+  RandFstOptions opts;
+  opts.n_states = 5;
+  opts.n_arcs = 6;
+  opts.n_final = 2;
+  opts.allow_empty = false;
+  opts.weight_multiplier = 0.5;
+  opts.acyclic = true;
+  for (int i = 0; i < 100; i++) {
+    VectorFst<LatticeArc> *fst = RandPairFst<LatticeArc>(opts);
+    int num_pieces = kaldi::RandInt(1, 8);
+    for (int j = 1; j < num_pieces; j++) {
+      VectorFst<LatticeArc> *piece = RandPairFst<LatticeArc>(opts);
+      Concat(fst, *piece);
+      delete piece;
+    }
+    DeterminizeLatticePhonePrunedOptions det_opts;
+    det_opts.phone_determinize = (i % 2 == 0);
+    if (det_opts.phone_determinize) {
+      // The input labels have to be valid transition-ids.
+      int32 num_tids = trans_model->NumTransitionIds();
+      for (StateIterator<VectorFst<LatticeArc> > siter(*fst); !siter.Done();
+           siter.Next()) {
+        for (MutableArcIterator<VectorFst<LatticeArc> > aiter(
+                 fst, siter.Value()); !aiter.Done(); aiter.Next()) {
+          LatticeArc arc = aiter.Value();
+          if (arc.ilabel != 0)
+            arc.ilabel = 1 + (arc.ilabel - 1) % num_tids;
+          aiter.SetValue(arc);
+        }
+      }
+    }
+    double beam = kaldi::RandInt(4, 10);
+    VectorFst<LatticeArc> fst_copy(*fst);
+    VectorFst<CompactLatticeArc> ref_det_fst, det_fst;
+    bool ref_ans = DeterminizeLatticePhonePrunedWrapper(
+        *trans_model, &fst_copy, beam, &ref_det_fst, det_opts);
+    det_opts.num_threads = kaldi::RandInt(2, 3);
+    det_opts.segment_size = kaldi::RandInt(1, 4);
+    fst_copy = *fst;
+    bool ans = DeterminizeLatticePhonePrunedWrapper(
+        *trans_model, &fst_copy, beam, &det_fst, det_opts);
+    KALDI_ASSERT(ans == ref_ans);
+    KALDI_ASSERT(det_fst.Properties(kIDeterministic, true) & kIDeterministic);
+    // The pruning in the determinizer may leave some paths that are a little
+    // outside the beam, so we compare with the reference pruned to exactly
+    // 'beam' (the joined output of the pieces is pruned in that way).
+    if (ref_det_fst.NumStates() != 0)
+      kaldi::PruneLattice(beam, &ref_det_fst);
+    KALDI_ASSERT(RandEquivalent(det_fst, ref_det_fst, 5/*paths*/,
+                                0.01/*delta*/, kaldi::Rand()/*seed*/,
+                                100/*path length, max*/));
+    delete fst;
+  }
+  delete trans_model;
+}
+
 } // end namespace fst
 
 int main() {
   using namespace fst;
   TestDeterminizeLatticePruned<kaldi::LatticeArc>();
   TestDeterminizeLatticePruned2<kaldi::LatticeArc>();
+  TestDeterminizeLatticeSegmented();
   std::cout << "Tests succeeded\n";
 }
@@ -27,6 +27,7 @@
 #include "lat/minimize-lattice.h"   // for minimization
 #include "lat/push-lattice.h"       // for minimization
 #include "lat/determinize-lattice-pruned.h"
+#include "util/kaldi-thread.h"
 
 namespace fst {
 
@@ -1481,6 +1482,245 @@ bool DeterminizeLatticePhonePruned(
                                        beam, ofst, opts);
 }
 
+// Outputs the "cut" states of 'fst', which must be connected and have its
+// states numbered in topological order (with the start state 0): these are the
+// states (other than the start state) that all successful paths pass through.
+// Because of the topological order, state s is a cut state if no arc goes from
+// a state before s to a state after s, and no state before s is final.
+static void GetLatticeCutStates(const ExpandedFst<kaldi::LatticeArc> &fst,
+                                std::vector<int32> *cut_states) {
+  typedef kaldi::LatticeArc::StateId StateId;
+  cut_states->clear();
+  StateId num_states = fst.NumStates(),
+      max_dest = 0;  // The largest destination of arcs from states before s.
+  for (StateId s = 0; s < num_states; s++) {
+    if (s > 0 && max_dest <= s)
+      cut_states->push_back(s);
+    if (fst.Final(s) != kaldi::LatticeWeight::Zero())
+      break;  // No later state can be a cut state.
+    for (ArcIterator<ExpandedFst<kaldi::LatticeArc> > aiter(fst, s);
+         !aiter.Done(); aiter.Next())
+      max_dest = std::max(max_dest, aiter.Value().nextstate);
+  }
+}
+
+// Copies the part of 'ifst' (as in GetLatticeCutStates()) between states
+// 'begin' and 'end' to 'segment'.  If 'is_last' is false, 'end' is a cut state
+// and it becomes the only final state of 'segment', with unit weight;
+// otherwise 'end' must be the last state.
+static void ExtractLatticeSegment(const ExpandedFst<kaldi::LatticeArc> &ifst,
+                                  int32 begin, int32 end, bool is_last,
+                                  kaldi::Lattice *segment) {
+  typedef kaldi::LatticeArc Arc;
+  segment->DeleteStates();
+  for (int32 s = begin; s <= end; s++)
+    segment->AddState();
+  segment->SetStart(0);
+  for (int32 s = begin; s <= end; s++) {
+    if (s == end && !is_last) {
+      segment->SetFinal(s - begin, kaldi::LatticeWeight::One());
+      break;
+    }
+    segment->SetFinal(s - begin, ifst.Final(s));
+    for (ArcIterator<ExpandedFst<Arc> > aiter(ifst, s); !aiter.Done();
+         aiter.Next()) {
+      Arc arc = aiter.Value();
+      KALDI_ASSERT(arc.nextstate > s && arc.nextstate <= end);
+      arc.nextstate -= begin;
+      segment->AddArc(s - begin, arc);
+    }
+  }
+}
+
+// Returns true if the determinized lattice segment 'clat' can be joined
+// deterministically to the following segment: i.e. if its start state is not
+// final, and none of its final states has arcs leaving it (so that no word
+// sequence it accepts is a prefix of another).
+static bool CanJoinLatticeSegment(const kaldi::CompactLattice &clat) {
+  typedef kaldi::CompactLatticeArc::StateId StateId;
+  if (clat.Start() == kNoStateId ||
+      clat.Final(clat.Start()) != kaldi::CompactLatticeWeight::Zero())
+    return false;
+  for (StateId s = 0; s < clat.NumStates(); s++)
+    if (clat.Final(s) != kaldi::CompactLatticeWeight::Zero() &&
+        clat.NumArcs(s) != 0)
+      return false;
+  return true;
+}
+
+// This class is used in DeterminizeLatticePhonePrunedSegmented() to
+// determinize lattice segments in parallel.
+class DeterminizeLatticeSegmentsClass: public kaldi::MultiThreadable {
+ public:
+  DeterminizeLatticeSegmentsClass(
+      const kaldi::TransitionInformation &trans_model,
+      double beam,
+      const DeterminizeLatticePhonePrunedOptions &opts,
+      const std::vector<int32> &todo,
+      std::vector<kaldi::Lattice> *segments,
+      std::vector<kaldi::CompactLattice> *det_segments,
+      std::vector<char> *ok):
+      trans_model_(trans_model), beam_(beam), opts_(opts), todo_(todo),
+      segments_(segments), det_segments_(det_segments), ok_(ok) { }
+
+  void operator () () {
+    for (size_t i = thread_id_; i < todo_.size(); i += num_threads_) {
+      int32 n = todo_[i];
+      (*ok_)[n] = DeterminizeLatticePhonePruned<kaldi::LatticeWeight,
+                                                kaldi::int32>(
+          trans_model_, &((*segments_)[n]), beam_, &((*det_segments_)[n]),
+          opts_);
+      Connect(&((*det_segments_)[n]));
+    }
+  }
+ private:
+  const kaldi::TransitionInformation &trans_model_;
+  double beam_;
+  const DeterminizeLatticePhonePrunedOptions &opts_;
+  const std::vector<int32> &todo_;
+  std::vector<kaldi::Lattice> *segments_;
+  std::vector<kaldi::CompactLattice> *det_segments_;
+  std::vector<char> *ok_;
+};
+
+// This does the work of DeterminizeLatticePhonePrunedWrapper() if
+// opts.num_threads > 1: see the documentation in the header.  'ifst' must be
+// topologically sorted, with words on the input side.
+static bool DeterminizeLatticePhonePrunedSegmented(
+    const kaldi::TransitionInformation &trans_model,
+    MutableFst<kaldi::LatticeArc> *ifst,
+    double beam,
+    MutableFst<kaldi::CompactLatticeArc> *ofst,
+    const DeterminizeLatticePhonePrunedOptions &opts) {
+  typedef kaldi::CompactLatticeArc CompactArc;
+  typedef CompactArc::StateId StateId;
+  // Connect() keeps the states in topological order.
+  Connect(ifst);
+  int32 num_states = ifst->NumStates();
+  std::vector<int32> cut_states;
+  if (num_states > 0)
+    GetLatticeCutStates(*ifst, &cut_states);
+
+  // Segment i is the states from boundaries[i] to boundaries[i+1].
+  std::vector<int32> boundaries(1, 0);
+  for (size_t i = 0; i < cut_states.size(); i++) {
+    int32 c = cut_states[i];
+    if (c - boundaries.back() >= opts.segment_size &&
+        num_states - c >= opts.segment_size)
+      boundaries.push_back(c);
+  }
+  if (boundaries.size() == 1) {
+    return DeterminizeLatticePhonePruned<kaldi::LatticeWeight, kaldi::int32>(
+        trans_model, ifst, beam, ofst, opts);
+  }
+  boundaries.push_back(num_states - 1);
+
+  std::vector<kaldi::Lattice> segments;
+  std::vector<kaldi::CompactLattice> det_segments;
+  std::vector<char> ok;
+  // The segments that need to be (re-)determinized.
+  std::vector<int32> todo;
+  for (size_t i = 0; i + 1 < boundaries.size(); i++)
+    todo.push_back(i);
+  int32 num_merged = 0;
+  while (true) {
+    int32 num_segments = boundaries.size() - 1;
+    segments.resize(num_segments);
+    det_segments.resize(num_segments);
+    ok.resize(num_segments, 1);
+    for (size_t i = 0; i < todo.size(); i++) {
+      int32 n = todo[i];
+      ExtractLatticeSegment(*ifst, boundaries[n], boundaries[n + 1],
+                            n + 1 == num_segments, &(segments[n]));
+    }
+    {
+      DeterminizeLatticeSegmentsClass c(trans_model, beam, opts, todo,
+                                        &segments, &det_segments, &ok);
+      kaldi::MultiThreader<DeterminizeLatticeSegmentsClass> m(
+          std::min<int32>(opts.num_threads, todo.size()), c);
+    }
+    // Merge any segments that can't be joined to the following one, and
+    // determinize the merged segments again.
+    std::vector<int32> new_boundaries(1, 0);
+    std::vector<kaldi::CompactLattice> new_det_segments;
+    std::vector<char> new_ok;
+    todo.clear();
+    for (int32 n = 0; n < num_segments; ) {
+      int32 m = n;  // The merged segment will be from n to m.
+      while (m + 1 < num_segments && !CanJoinLatticeSegment(det_segments[m]))
+        m++;
+      new_boundaries.push_back(boundaries[m + 1]);
+      new_det_segments.resize(new_det_segments.size() + 1);
+      if (m == n) {
+        // VectorFst copies share their implementation, so this is cheap.
+        new_det_segments.back() = det_segments[n];
+        new_ok.push_back(ok[n]);
+      } else {
+        todo.push_back(new_boundaries.size() - 2);
+        new_ok.push_back(1);
+        num_merged += m - n;
+      }
+      n = m + 1;
+    }
+    boundaries.swap(new_boundaries);
+    det_segments.swap(new_det_segments);
+    ok.swap(new_ok);
+    segments.clear();
+    if (todo.empty())
+      break;
+  }
+  KALDI_VLOG(2) << "Determinized lattice with " << num_states
+                << " states in " << det_segments.size() << " segments ("
+                << num_merged << " segments had to be merged).";
+
+  // Now join the determinized segments: arcs entering the final states of
+  // each segment are redirected to the start state of the next one.
+  bool ans = true;
+  int32 num_segments = det_segments.size();
+  std::vector<StateId> offsets(num_segments);
+  for (int32 n = 0; n < num_segments; n++) {
+    if (det_segments[n].Start() == kNoStateId) {
+      ofst->DeleteStates();
+      return false;  // Empty output.
+    }
+  }
+  kaldi::CompactLattice joined;
+  for (int32 n = 0; n < num_segments; n++) {
+    ans = ans && ok[n];
+    offsets[n] = joined.NumStates();
+    for (StateId s = 0; s < det_segments[n].NumStates(); s++)
+      joined.AddState();
+  }
+  joined.SetStart(offsets[0] + det_segments[0].Start());
+  for (int32 n = 0; n < num_segments; n++) {
+    const kaldi::CompactLattice &clat = det_segments[n];
+    bool is_last = (n + 1 == num_segments);
+    for (StateId s = 0; s < clat.NumStates(); s++) {
+      if (is_last)
+        joined.SetFinal(offsets[n] + s, clat.Final(s));
+      for (ArcIterator<kaldi::CompactLattice> aiter(clat, s); !aiter.Done();
+           aiter.Next()) {
+        CompactArc arc = aiter.Value();
+        kaldi::CompactLatticeWeight final_weight = clat.Final(arc.nextstate);
+        if (!is_last && final_weight != kaldi::CompactLatticeWeight::Zero()) {
+          arc.weight = Times(arc.weight, final_weight);
+          arc.nextstate = offsets[n + 1] + det_segments[n + 1].Start();
+        } else {
+          arc.nextstate += offsets[n];
+        }
+        joined.AddArc(offsets[n] + s, arc);
+      }
+    }
+  }
+  // Each segment was pruned relative to its own best path, so paths that are
+  // within 'beam' inside every segment but not overall may have survived;
+  // prune them away so the output has the same paths as when the lattice is
+  // determinized in one piece.
+  ans = kaldi::PruneLattice(beam, &joined) && ans;
+  *ofst = joined;
+  return ans;
+}
+
 bool DeterminizeLatticePhonePrunedWrapper(
     const kaldi::TransitionInformation &trans_model,
     MutableFst<kaldi::LatticeArc> *ifst,
@@ -1499,8 +1739,12 @@ bool DeterminizeLatticePhonePrunedWrapper(
   }
   ILabelCompare<kaldi::LatticeArc> ilabel_comp;
   ArcSort(ifst, ilabel_comp);
-  ans = DeterminizeLatticePhonePruned<kaldi::LatticeWeight, kaldi::int32>(
-      trans_model, ifst, beam, ofst, opts);
+  if (opts.num_threads > 1 && ifst->NumStates() >= 2 * opts.segment_size)
+    ans = DeterminizeLatticePhonePrunedSegmented(trans_model, ifst, beam,
+                                                 ofst, opts);
+  else
+    ans = DeterminizeLatticePhonePruned<kaldi::LatticeWeight, kaldi::int32>(
+        trans_model, ifst, beam, ofst, opts);
   Connect(ofst);
   return ans;
 }
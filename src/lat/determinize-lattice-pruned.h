@@ -155,11 +155,20 @@ struct DeterminizeLatticePhonePrunedOptions {
   bool word_determinize;
   // minimize: if true, push and minimize after determinization.
   bool minimize;
+  // num_threads: if > 1, DeterminizeLatticePhonePrunedWrapper() splits long
+  // lattices at states that all paths pass through, and determinizes the
+  // pieces in parallel.
+  int num_threads;
+  // segment_size: the minimum number of states of the input lattice in each
+  // piece, if num_threads > 1.
+  int segment_size;
   DeterminizeLatticePhonePrunedOptions(): delta(kDelta),
                                           max_mem(50000000),
                                           phone_determinize(true),
                                           word_determinize(true),
-                                          minimize(false) {}
+                                          minimize(false),
+                                          num_threads(1),
+                                          segment_size(10000) {}
   void Register (kaldi::OptionsItf *opts) {
     opts->Register("delta", &delta, "Tolerance used in determinization");
     opts->Register("max-mem", &max_mem, "Maximum approximate memory usage in "
@@ -172,6 +181,13 @@ struct DeterminizeLatticePhonePrunedOptions {
                    "--phone-determinize)");
     opts->Register("minimize", &minimize, "If true, push and minimize after "
                    "determinization.");
+    opts->Register("determinize-threads", &num_threads, "If > 1, long "
+                   "lattices are split at states that all paths pass through, "
+                   "and the pieces are determinized in parallel using this "
+                   "many threads (the output is equivalent).");
+    opts->Register("determinize-segment-size", &segment_size, "Minimum number "
+                   "of states of the raw lattice in each piece that is "
+                   "determinized separately, if --determinize-threads > 1.");
   }
 };
 
@@ -280,6 +296,18 @@ bool DeterminizeLatticePhonePruned(
     output side.
     This function can be used as the top-level interface to all the determinization
     code.
+
+    If opts.num_threads > 1, a long lattice is split into pieces of at least
+    opts.segment_size states at "cut" states that all paths pass through
+    (e.g. in long silences); the pieces are determinized in parallel and the
+    results are joined.  Since all paths pass through the cut states, this is
+    equivalent to determinizing the whole lattice: each piece is pruned with
+    'beam' relative to its own best path, so the joined lattice is pruned with
+    'beam' once more, which removes the paths that would not have survived
+    pruning of the whole lattice.  (If the determinized
+    piece before a cut could not be joined deterministically to the next one,
+    because a word sequence in it is a prefix of another one, the two pieces
+    are merged and determinized together).
 */
 bool DeterminizeLatticePhonePrunedWrapper(
     const kaldi::TransitionInformation &trans_model,
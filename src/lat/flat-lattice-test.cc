@@ -0,0 +1,121 @@
+// lat/flat-lattice-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "lat/flat-lattice.h"
+#include "lat/lattice-functions.h"
+
+namespace kaldi {
+
+// Creates a random state-level lattice with consistent times: there are
+// 'num_states_per_frame' states on each frame, with arcs between adjacent
+// frames and some epsilon arcs within frames.  The states are numbered in
+// topological order.
+static void RandTrellisLattice(Lattice *lat) {
+  int32 num_frames = RandInt(1, 8), num_states_per_frame = RandInt(1, 4);
+  lat->DeleteStates();
+  for (int32 i = 0; i < (num_frames + 1) * num_states_per_frame; i++)
+    lat->AddState();
+  lat->SetStart(0);
+  for (int32 t = 0; t <= num_frames; t++) {
+    for (int32 k = 0; k < num_states_per_frame; k++) {
+      int32 s = t * num_states_per_frame + k;
+      for (int32 k2 = 0; k2 < num_states_per_frame; k2++) {
+        LatticeWeight weight(RandUniform() * 5.0, RandGauss() * 10.0);
+        int32 word = (RandInt(0, 2) == 0 ? RandInt(1, 5) : 0);
+        if (t < num_frames && (k2 == 0 || RandInt(0, 2) != 0))
+          lat->AddArc(s, LatticeArc(RandInt(1, 10), word, weight,
+                                    (t + 1) * num_states_per_frame + k2));
+        else if (k2 > k && RandInt(0, 3) == 0)
+          lat->AddArc(s, LatticeArc(0, word, weight,
+                                    t * num_states_per_frame + k2));
+      }
+      if (t == num_frames && (k == 0 || RandInt(0, 1) == 0))
+        lat->SetFinal(s, LatticeWeight(RandUniform(), RandUniform()));
+    }
+  }
+}
+
+static bool LogProbsEqual(double a, double b) {
+  if (a == kLogZeroDouble || b == kLogZeroDouble)
+    return a == b;
+  return fabs(a - b) < 1.0e-04 * (1.0 + fabs(a));
+}
+
+static void AssertEqualLogProbs(const std::vector<double> &a,
+                                const std::vector<double> &b) {
+  KALDI_ASSERT(a.size() == b.size());
+  for (size_t i = 0; i < a.size(); i++)
+    KALDI_ASSERT(LogProbsEqual(a[i], b[i]));
+}
+
+void TestFlatLatticeForwardBackward() {
+  Lattice lat;
+  RandTrellisLattice(&lat);
+  FlatLattice flat_lat(lat);
+  KALDI_ASSERT(flat_lat.NumStates() == lat.NumStates() &&
+               flat_lat.NumArcs() == fst::NumArcs(lat) &&
+               !flat_lat.FromCompactLattice());
+
+  Posterior post, flat_post;
+  double ac_like, flat_ac_like;
+  BaseFloat like = LatticeForwardBackward(lat, &post, &ac_like),
+      flat_like = LatticeForwardBackward(flat_lat, &flat_post, &flat_ac_like);
+  KALDI_ASSERT(LogProbsEqual(like, flat_like));
+  KALDI_ASSERT(LogProbsEqual(ac_like, flat_ac_like));
+  KALDI_ASSERT(post.size() == flat_post.size());
+  for (size_t t = 0; t < post.size(); t++) {
+    KALDI_ASSERT(post[t].size() == flat_post[t].size());
+    for (size_t i = 0; i < post[t].size(); i++) {
+      KALDI_ASSERT(post[t][i].first == flat_post[t][i].first);
+      KALDI_ASSERT(fabs(post[t][i].second - flat_post[t][i].second) < 1.0e-04);
+    }
+  }
+
+  CompactLattice clat;
+  ConvertLattice(lat, &clat);
+  TopSortCompactLatticeIfNeeded(&clat);
+  FlatLattice flat_clat(clat);
+  KALDI_ASSERT(flat_clat.NumArcs() == fst::NumArcs(clat) &&
+               flat_clat.FromCompactLattice());
+  for (int32 viterbi = 0; viterbi <= 1; viterbi++) {
+    std::vector<double> alpha, beta, flat_alpha, flat_beta;
+    double tot = ComputeLatticeAlphasAndBetas(lat, viterbi != 0,
+                                              &alpha, &beta),
+        flat_tot = flat_lat.ComputeAlphasAndBetas(viterbi != 0,
+                                                  &flat_alpha, &flat_beta);
+    KALDI_ASSERT(LogProbsEqual(tot, flat_tot));
+    AssertEqualLogProbs(alpha, flat_alpha);
+    AssertEqualLogProbs(beta, flat_beta);
+
+    tot = ComputeLatticeAlphasAndBetas(clat, viterbi != 0, &alpha, &beta);
+    flat_tot = flat_clat.ComputeAlphasAndBetas(viterbi != 0,
+                                               &flat_alpha, &flat_beta);
+    KALDI_ASSERT(LogProbsEqual(tot, flat_tot));
+    AssertEqualLogProbs(alpha, flat_alpha);
+    AssertEqualLogProbs(beta, flat_beta);
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (int32 i = 0; i < 100; i++)
+    kaldi::TestFlatLatticeForwardBackward();
+  std::cout << "Test OK.\n";
+  return 0;
+}
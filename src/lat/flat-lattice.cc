@@ -0,0 +1,235 @@
+// lat/flat-lattice.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-math.h"
+#include "lat/flat-lattice.h"
+
+namespace kaldi {
+
+FlatLattice::FlatLattice(const Lattice &lat): from_compact_lattice_(false) {
+  num_frames_ = LatticeStateTimes(lat, &state_times_);  // checks it's sorted.
+  int32 num_states = lat.NumStates();
+  ReserveArcs(fst::NumArcs(lat));
+  arc_begin_.resize(num_states + 1);
+  final_likes_.resize(num_states);
+  final_acoustic_costs_.resize(num_states);
+  for (int32 s = 0; s < num_states; s++) {
+    arc_begin_[s] = nextstates_.size();
+    for (fst::ArcIterator<Lattice> aiter(lat, s); !aiter.Done();
+         aiter.Next()) {
+      const LatticeArc &arc = aiter.Value();
+      ilabels_.push_back(arc.ilabel);
+      olabels_.push_back(arc.olabel);
+      nextstates_.push_back(arc.nextstate);
+      sources_.push_back(s);
+      graph_costs_.push_back(arc.weight.Value1());
+      acoustic_costs_.push_back(arc.weight.Value2());
+      arc_likes_.push_back(-ConvertToCost(arc.weight));
+    }
+    LatticeWeight f = lat.Final(s);
+    final_likes_[s] = (f == LatticeWeight::Zero() ? kLogZeroDouble :
+                       -ConvertToCost(f));
+    final_acoustic_costs_[s] = f.Value2();
+  }
+  arc_begin_[num_states] = nextstates_.size();
+  SetUpIncomingArcs();
+}
+
+FlatLattice::FlatLattice(const CompactLattice &clat):
+    from_compact_lattice_(true) {
+  // this checks it's sorted.
+  num_frames_ = CompactLatticeStateTimes(clat, &state_times_);
+  int32 num_states = clat.NumStates();
+  ReserveArcs(fst::NumArcs(clat));
+  arc_begin_.resize(num_states + 1);
+  final_likes_.resize(num_states);
+  final_acoustic_costs_.resize(num_states);
+  for (int32 s = 0; s < num_states; s++) {
+    arc_begin_[s] = nextstates_.size();
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      ilabels_.push_back(arc.ilabel);
+      olabels_.push_back(arc.olabel);
+      nextstates_.push_back(arc.nextstate);
+      sources_.push_back(s);
+      graph_costs_.push_back(arc.weight.Weight().Value1());
+      acoustic_costs_.push_back(arc.weight.Weight().Value2());
+      arc_likes_.push_back(-ConvertToCost(arc.weight));
+    }
+    CompactLatticeWeight f = clat.Final(s);
+    final_likes_[s] = (f == CompactLatticeWeight::Zero() ? kLogZeroDouble :
+                       -ConvertToCost(f));
+    final_acoustic_costs_[s] = f.Weight().Value2();
+  }
+  arc_begin_[num_states] = nextstates_.size();
+  SetUpIncomingArcs();
+}
+
+void FlatLattice::ReserveArcs(int32 num_arcs) {
+  ilabels_.reserve(num_arcs);
+  olabels_.reserve(num_arcs);
+  nextstates_.reserve(num_arcs);
+  sources_.reserve(num_arcs);
+  graph_costs_.reserve(num_arcs);
+  acoustic_costs_.reserve(num_arcs);
+  arc_likes_.reserve(num_arcs);
+}
+
+void FlatLattice::SetUpIncomingArcs() {
+  int32 num_states = NumStates(), num_arcs = NumArcs();
+  // First count the arcs entering each state, then turn the counts into
+  // offsets.
+  in_arc_begin_.clear();
+  in_arc_begin_.resize(num_states + 1, 0);
+  for (int32 a = 0; a < num_arcs; a++)
+    in_arc_begin_[nextstates_[a] + 1]++;
+  max_degree_ = 1;
+  for (int32 s = 0; s < num_states; s++) {
+    max_degree_ = std::max(max_degree_, in_arc_begin_[s + 1]);
+    max_degree_ = std::max(max_degree_, arc_begin_[s + 1] - arc_begin_[s] + 1);
+    in_arc_begin_[s + 1] += in_arc_begin_[s];
+  }
+  in_arcs_.resize(num_arcs);
+  std::vector<int32> next_pos(in_arc_begin_.begin(), in_arc_begin_.end() - 1);
+  for (int32 a = 0; a < num_arcs; a++)
+    in_arcs_[next_pos[nextstates_[a]]++] = a;
+}
+
+// Returns log(sum_i exp(x[i])), or max_i x[i] if 'viterbi' is true, for the
+// 'n' elements of 'x'; returns kLogZeroDouble if n == 0.  Taking the max
+// first means we need only one exp() per element and one log() in total,
+// and the loops are simple enough for the compiler to vectorize.
+static inline double LogSumExpOrMax(bool viterbi, const double *x, int32 n) {
+  if (n == 0)
+    return kLogZeroDouble;
+  double max = x[0];
+  for (int32 i = 1; i < n; i++)
+    max = std::max(max, x[i]);
+  if (viterbi || max == kLogZeroDouble)
+    return max;
+  double sum = 0.0;
+  for (int32 i = 0; i < n; i++)
+    sum += Exp(x[i] - max);
+  return max + Log(sum);
+}
+
+double FlatLattice::ComputeAlphasAndBetas(bool viterbi,
+                                          std::vector<double> *alpha,
+                                          std::vector<double> *beta) const {
+  int32 num_states = NumStates();
+  KALDI_ASSERT(num_states > 0);
+  alpha->resize(num_states);
+  beta->resize(num_states);
+  std::vector<double> buffer(max_degree_);
+  double *buf = &(buffer[0]);
+  const int32 *sources = sources_.data(), *nextstates = nextstates_.data();
+  const double *arc_likes = arc_likes_.data();
+  double *a = &((*alpha)[0]), *b = &((*beta)[0]);
+
+  a[0] = 0.0;
+  for (int32 s = 1; s < num_states; s++) {
+    int32 begin = in_arc_begin_[s], end = in_arc_begin_[s + 1];
+    for (int32 i = begin; i < end; i++) {
+      int32 arc = in_arcs_[i];
+      buf[i - begin] = a[sources[arc]] + arc_likes[arc];
+    }
+    a[s] = LogSumExpOrMax(viterbi, buf, end - begin);
+  }
+  std::vector<double> final_buffer;
+  for (int32 s = 0; s < num_states; s++)
+    if (final_likes_[s] != kLogZeroDouble)
+      final_buffer.push_back(a[s] + final_likes_[s]);
+  double tot_forward_prob = LogSumExpOrMax(viterbi, final_buffer.data(),
+                                           final_buffer.size());
+
+  for (int32 s = num_states - 1; s >= 0; s--) {
+    int32 begin = arc_begin_[s], end = arc_begin_[s + 1];
+    for (int32 arc = begin; arc < end; arc++)
+      buf[arc - begin] = arc_likes[arc] + b[nextstates[arc]];
+    int32 n = end - begin;
+    if (final_likes_[s] != kLogZeroDouble)
+      buf[n++] = final_likes_[s];
+    b[s] = LogSumExpOrMax(viterbi, buf, n);
+  }
+  double tot_backward_prob = b[0];
+  if (!ApproxEqual(tot_forward_prob, tot_backward_prob, 1e-8)) {
+    KALDI_WARN << "Total forward probability over lattice = " << tot_forward_prob
+               << ", while total backward probability = " << tot_backward_prob;
+  }
+  // Split the difference when returning... they should be the same.
+  return 0.5 * (tot_backward_prob + tot_forward_prob);
+}
+
+void FlatLattice::ComputeArcPosteriors(const std::vector<double> &alpha,
+                                       const std::vector<double> &beta,
+                                       double tot_like,
+                                       std::vector<double> *arc_post) const {
+  int32 num_arcs = NumArcs();
+  KALDI_ASSERT(alpha.size() == state_times_.size() &&
+               beta.size() == state_times_.size());
+  arc_post->resize(num_arcs);
+  for (int32 arc = 0; arc < num_arcs; arc++)
+    (*arc_post)[arc] = Exp(alpha[sources_[arc]] + arc_likes_[arc] +
+                           beta[nextstates_[arc]] - tot_like);
+}
+
+
+BaseFloat LatticeForwardBackward(const FlatLattice &lat,
+                                 Posterior *post,
+                                 double *acoustic_like_sum) {
+  KALDI_ASSERT(!lat.FromCompactLattice() &&
+               "LatticeForwardBackward() needs a FlatLattice created from a "
+               "Lattice, not a CompactLattice.");
+  if (acoustic_like_sum) *acoustic_like_sum = 0.0;
+  int32 num_states = lat.NumStates(), max_time = lat.NumFrames();
+  std::vector<double> alpha, beta, arc_post;
+  lat.ComputeAlphasAndBetas(false, &alpha, &beta);
+  // We use the backward prob, like the version of LatticeForwardBackward()
+  // for Lattice.
+  double tot_prob = beta[0];
+  lat.ComputeArcPosteriors(alpha, beta, tot_prob, &arc_post);
+
+  post->clear();
+  post->resize(max_time);
+  int32 num_arcs = lat.NumArcs();
+  for (int32 arc = 0; arc < num_arcs; arc++) {
+    int32 transition_id = lat.ILabel(arc);
+    if (transition_id != 0)  // Arc has a transition-id on it [not epsilon]
+      (*post)[lat.StateTime(lat.SourceState(arc))].push_back(
+          std::make_pair(transition_id, static_cast<BaseFloat>(arc_post[arc])));
+    if (acoustic_like_sum != NULL)
+      *acoustic_like_sum -= arc_post[arc] * lat.AcousticCost(arc);
+  }
+  for (int32 s = 0; s < num_states; s++) {
+    if (lat.IsFinal(s)) {
+      KALDI_ASSERT(lat.StateTime(s) == max_time &&
+                   "Lattice is inconsistent (final-prob not at max_time)");
+      if (acoustic_like_sum != NULL) {
+        double posterior = Exp(alpha[s] + lat.FinalLike(s) - tot_prob);
+        *acoustic_like_sum -= posterior * lat.FinalAcousticCost(s);
+      }
+    }
+  }
+  // Now combine any posteriors with the same transition-id.
+  for (int32 t = 0; t < max_time; t++)
+    MergePairVectorSumming(&((*post)[t]));
+  return tot_prob;
+}
+
+}  // namespace kaldi
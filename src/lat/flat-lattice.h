@@ -0,0 +1,156 @@
+// lat/flat-lattice.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_LAT_FLAT_LATTICE_H_
+#define KALDI_LAT_FLAT_LATTICE_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+
+namespace kaldi {
+
+/**
+   FlatLattice is a read-only copy of a topologically sorted Lattice or
+   CompactLattice, stored in flat arrays (in the style of compressed sparse
+   row matrices): the arcs leaving each state are numbered contiguously, and
+   their labels, costs and destination states are stored in separate
+   arrays.  We also store, for each state, the list of arcs entering it.
+
+   It's intended for algorithms that make several passes over the same
+   lattice, such as forward-backward: building it takes about as long as one
+   pass over the lattice, but after that, the passes don't have to go through
+   the virtual functions of the fst::ArcIterator, and the forward and backward
+   recursions can compute each alpha and beta with one log-sum-exp over a
+   contiguous buffer instead of a chain of LogAdd() calls (which need an
+   exp() and a log() per arc).
+
+   For a CompactLattice, the input and output labels are both the word, the
+   alignments are not stored, and the state times are worked out from the
+   lengths of the strings.  FromCompactLattice() says which type the lattice
+   was created from, since the labels mean different things in the two cases.
+*/
+class FlatLattice {
+ public:
+  /// Constructor from a Lattice, which must be topologically sorted with
+  /// start state 0 (e.g. call TopSortLatticeIfNeeded() first).
+  explicit FlatLattice(const Lattice &lat);
+
+  /// Constructor from a CompactLattice, which must be topologically sorted
+  /// with start state 0.
+  explicit FlatLattice(const CompactLattice &clat);
+
+  int32 NumStates() const { return static_cast<int32>(state_times_.size()); }
+  int32 NumArcs() const { return static_cast<int32>(nextstates_.size()); }
+
+  /// Returns true if this was created from a CompactLattice (so the labels
+  /// are words), false if from a Lattice.
+  bool FromCompactLattice() const { return from_compact_lattice_; }
+
+  /// The arcs leaving state s are numbered from ArcBegin(s) to
+  /// ArcBegin(s + 1) - 1.
+  int32 ArcBegin(int32 s) const { return arc_begin_[s]; }
+
+  int32 ILabel(int32 arc) const { return ilabels_[arc]; }
+  int32 OLabel(int32 arc) const { return olabels_[arc]; }
+  int32 NextState(int32 arc) const { return nextstates_[arc]; }
+  int32 SourceState(int32 arc) const { return sources_[arc]; }
+  BaseFloat GraphCost(int32 arc) const { return graph_costs_[arc]; }
+  BaseFloat AcousticCost(int32 arc) const { return acoustic_costs_[arc]; }
+
+  /// Returns true if state s is final.
+  bool IsFinal(int32 s) const { return final_likes_[s] != kLogZeroDouble; }
+  /// Returns the negated total cost of the final-prob of state s
+  /// (kLogZeroDouble if s is not final).
+  double FinalLike(int32 s) const { return final_likes_[s]; }
+  BaseFloat FinalAcousticCost(int32 s) const { return final_acoustic_costs_[s]; }
+
+  /// Returns the time (frame index) of state s, as LatticeStateTimes() or
+  /// CompactLatticeStateTimes() would.
+  int32 StateTime(int32 s) const { return state_times_[s]; }
+  /// Returns the largest state time, i.e. the number of frames.
+  int32 NumFrames() const { return num_frames_; }
+
+  /// Computes (normal or Viterbi) alphas and betas, as negated costs; returns
+  /// the total log-prob (or best-path negated cost) of the lattice.  This
+  /// gives the same results as ComputeLatticeAlphasAndBetas() in
+  /// lattice-functions.h.
+  double ComputeAlphasAndBetas(bool viterbi,
+                               std::vector<double> *alpha,
+                               std::vector<double> *beta) const;
+
+  /// Computes the posterior probability of each arc, given the alphas and
+  /// betas and the total log-prob from ComputeAlphasAndBetas() (with
+  /// viterbi == false).  'arc_post' is indexed by arc.
+  void ComputeArcPosteriors(const std::vector<double> &alpha,
+                            const std::vector<double> &beta,
+                            double tot_like,
+                            std::vector<double> *arc_post) const;
+
+ private:
+  // Sets up in_arc_begin_, in_arcs_ and the max in/out degrees, after the
+  // arcs have been added.
+  void SetUpIncomingArcs();
+
+  // Reserves space in the arrays indexed by arc.
+  void ReserveArcs(int32 num_arcs);
+
+  bool from_compact_lattice_;
+  // arc_begin_ is of dimension NumStates() + 1.
+  std::vector<int32> arc_begin_;
+  // The following are indexed by arc.
+  std::vector<int32> ilabels_;
+  std::vector<int32> olabels_;
+  std::vector<int32> nextstates_;
+  std::vector<int32> sources_;
+  std::vector<BaseFloat> graph_costs_;
+  std::vector<BaseFloat> acoustic_costs_;
+  // arc_likes_ is the negated total cost of each arc.
+  std::vector<double> arc_likes_;
+
+  // in_arc_begin_ is of dimension NumStates() + 1; the arcs entering state s
+  // are in_arcs_[in_arc_begin_[s]] ... in_arcs_[in_arc_begin_[s+1] - 1].
+  std::vector<int32> in_arc_begin_;
+  std::vector<int32> in_arcs_;
+  // The largest number of arcs entering or leaving any state (plus one, for
+  // the final-prob); this is the size of buffer needed in the recursions.
+  int32 max_degree_;
+
+  // The following are indexed by state.
+  std::vector<double> final_likes_;
+  std::vector<BaseFloat> final_acoustic_costs_;
+  std::vector<int32> state_times_;
+  int32 num_frames_;
+};
+
+
+/// This is as LatticeForwardBackward() in lattice-functions.h, but it
+/// operates on a FlatLattice, which must have been created from a Lattice
+/// (not a CompactLattice, whose labels are words, not transition-ids).
+/// It gives the same results, and is faster if you already have the
+/// FlatLattice.
+BaseFloat LatticeForwardBackward(const FlatLattice &lat,
+                                 Posterior *arc_post,
+                                 double *acoustic_like_sum = NULL);
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_LAT_FLAT_LATTICE_H_
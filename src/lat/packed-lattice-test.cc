@@ -0,0 +1,93 @@
+// lat/packed-lattice-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "lat/packed-lattice.h"
+#include "fstext/rand-fst.h"
+
+namespace kaldi {
+
+void TestPackedCompactLatticeConversion() {
+  Lattice *lat = fst::RandPairFst<LatticeArc>();
+  CompactLattice clat;
+  ConvertLattice(*lat, &clat);
+  delete lat;
+
+  PackedCompactLattice packed(clat);
+  KALDI_ASSERT(packed.NumStates() == clat.NumStates() &&
+               packed.NumArcs() == fst::NumArcs(clat) &&
+               packed.Start() == clat.Start());
+  for (int32 s = 0; s < packed.NumStates(); s++) {
+    int32 arc = packed.ArcBegin(s);
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next(), arc++) {
+      const CompactLatticeArc &carc = aiter.Value();
+      KALDI_ASSERT(packed.NextState(arc) == carc.nextstate &&
+                   packed.ILabel(arc) == carc.ilabel &&
+                   packed.Weight(arc) == carc.weight.Weight());
+      std::vector<int32> str(packed.String(arc),
+                             packed.String(arc) + packed.StringLength(arc));
+      KALDI_ASSERT(str == carc.weight.String());
+    }
+    KALDI_ASSERT(arc == packed.ArcBegin(s + 1));
+    KALDI_ASSERT(packed.IsFinal(s) ==
+                 (clat.Final(s) != CompactLatticeWeight::Zero()));
+  }
+
+  CompactLattice clat2;
+  packed.CopyTo(&clat2);
+  KALDI_ASSERT(fst::Equal(clat, clat2));
+
+  PackedCompactLattice packed2;
+  packed2.Swap(&packed);
+  KALDI_ASSERT(packed.NumStates() == 0);
+  packed2.CopyTo(&clat2);
+  KALDI_ASSERT(fst::Equal(clat, clat2));
+}
+
+void TestPackedCompactLatticeTable(bool binary) {
+  int32 num_lats = 10;
+  std::vector<CompactLattice> clats(num_lats);
+  {
+    CompactLatticeWriter writer(binary ? "ark:tmpf" : "ark,t:tmpf");
+    for (int32 i = 0; i < num_lats; i++) {
+      Lattice *lat = fst::RandPairFst<LatticeArc>();
+      ConvertLattice(*lat, &(clats[i]));
+      delete lat;
+      writer.Write("key" + std::to_string(i), clats[i]);
+    }
+  }
+  RandomAccessPackedCompactLatticeReader reader("ark:tmpf");
+  for (int32 i = 0; i < num_lats; i++) {
+    CompactLattice clat;
+    reader.Value("key" + std::to_string(i)).CopyTo(&clat);
+    KALDI_ASSERT(fst::Equal(clat, clats[i]));
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 20; i++)
+    TestPackedCompactLatticeConversion();
+  TestPackedCompactLatticeTable(true);
+  TestPackedCompactLatticeTable(false);
+  unlink("tmpf");
+  std::cout << "Test OK.\n";
+  return 0;
+}
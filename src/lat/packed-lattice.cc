@@ -0,0 +1,147 @@
+// lat/packed-lattice.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "lat/packed-lattice.h"
+
+namespace kaldi {
+
+void PackedCompactLattice::CopyFrom(const CompactLattice &clat) {
+  int32 num_states = clat.NumStates();
+  // Work out the sizes first so that each array is allocated exactly once.
+  size_t num_arcs = 0, string_size = 0;
+  for (int32 s = 0; s < num_states; s++) {
+    num_arcs += clat.NumArcs(s);
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next())
+      string_size += aiter.Value().weight.String().size();
+    string_size += clat.Final(s).String().size();
+  }
+  start_ = clat.Start();
+  arc_begin_.clear();
+  arc_begin_.reserve(num_states + 1);
+  ilabels_.clear();
+  ilabels_.reserve(num_arcs);
+  olabels_.clear();
+  olabels_.reserve(num_arcs);
+  nextstates_.clear();
+  nextstates_.reserve(num_arcs);
+  weights_.clear();
+  weights_.reserve(num_arcs);
+  arc_string_begin_.clear();
+  arc_string_begin_.reserve(num_arcs + 1);
+  final_weights_.clear();
+  final_weights_.reserve(num_states);
+  final_string_begin_.clear();
+  final_string_begin_.reserve(num_states + 1);
+  strings_.clear();
+  strings_.reserve(string_size);
+
+  for (int32 s = 0; s < num_states; s++) {
+    arc_begin_.push_back(nextstates_.size());
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      ilabels_.push_back(arc.ilabel);
+      olabels_.push_back(arc.olabel);
+      nextstates_.push_back(arc.nextstate);
+      weights_.push_back(arc.weight.Weight());
+      arc_string_begin_.push_back(strings_.size());
+      const std::vector<int32> &str = arc.weight.String();
+      strings_.insert(strings_.end(), str.begin(), str.end());
+    }
+  }
+  arc_begin_.push_back(nextstates_.size());
+  arc_string_begin_.push_back(strings_.size());
+  for (int32 s = 0; s < num_states; s++) {
+    CompactLatticeWeight final_weight = clat.Final(s);
+    final_weights_.push_back(final_weight.Weight());
+    final_string_begin_.push_back(strings_.size());
+    const std::vector<int32> &str = final_weight.String();
+    strings_.insert(strings_.end(), str.begin(), str.end());
+  }
+  final_string_begin_.push_back(strings_.size());
+}
+
+void PackedCompactLattice::CopyTo(CompactLattice *clat) const {
+  clat->DeleteStates();
+  int32 num_states = NumStates();
+  clat->ReserveStates(num_states);
+  for (int32 s = 0; s < num_states; s++)
+    clat->AddState();
+  if (start_ != fst::kNoStateId)
+    clat->SetStart(start_);
+  std::vector<int32> str;
+  for (int32 s = 0; s < num_states; s++) {
+    int32 begin = arc_begin_[s], end = arc_begin_[s + 1];
+    clat->ReserveArcs(s, end - begin);
+    for (int32 arc = begin; arc < end; arc++) {
+      const int32 *arc_str = String(arc);
+      str.assign(arc_str, arc_str + StringLength(arc));
+      clat->AddArc(s, CompactLatticeArc(ilabels_[arc], olabels_[arc],
+                                        CompactLatticeWeight(weights_[arc],
+                                                             str),
+                                        nextstates_[arc]));
+    }
+    if (IsFinal(s)) {
+      const int32 *final_str = FinalString(s);
+      str.assign(final_str, final_str + FinalStringLength(s));
+      clat->SetFinal(s, CompactLatticeWeight(final_weights_[s], str));
+    }
+  }
+}
+
+size_t PackedCompactLattice::MemoryUsage() const {
+  return sizeof(*this) +
+      sizeof(int32) * (arc_begin_.capacity() + ilabels_.capacity() +
+                       olabels_.capacity() + nextstates_.capacity() +
+                       arc_string_begin_.capacity() +
+                       final_string_begin_.capacity() + strings_.capacity()) +
+      sizeof(LatticeWeight) * (weights_.capacity() + final_weights_.capacity());
+}
+
+void PackedCompactLattice::Swap(PackedCompactLattice *other) {
+  std::swap(start_, other->start_);
+  arc_begin_.swap(other->arc_begin_);
+  ilabels_.swap(other->ilabels_);
+  olabels_.swap(other->olabels_);
+  nextstates_.swap(other->nextstates_);
+  weights_.swap(other->weights_);
+  arc_string_begin_.swap(other->arc_string_begin_);
+  final_weights_.swap(other->final_weights_);
+  final_string_begin_.swap(other->final_string_begin_);
+  strings_.swap(other->strings_);
+}
+
+
+bool PackedCompactLatticeHolder::Write(std::ostream &os, bool binary,
+                                       const T &t) {
+  CompactLattice clat;
+  t.CopyTo(&clat);
+  return CompactLatticeHolder::Write(os, binary, clat);
+}
+
+bool PackedCompactLatticeHolder::Read(std::istream &is) {
+  Clear();
+  CompactLatticeHolder holder;
+  if (!holder.Read(is))
+    return false;
+  t_ = new PackedCompactLattice(holder.Value());
+  return true;
+}
+
+}  // namespace kaldi
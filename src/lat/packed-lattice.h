@@ -0,0 +1,167 @@
+// lat/packed-lattice.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_LAT_PACKED_LATTICE_H_
+#define KALDI_LAT_PACKED_LATTICE_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "lat/kaldi-lattice.h"
+
+namespace kaldi {
+
+/**
+   PackedCompactLattice is an immutable, compact in-memory copy of a
+   CompactLattice.  A CompactLattice is a VectorFst, which has a separately
+   allocated state object and arc vector for each state, and a separately
+   allocated std::vector<int32> of transition-ids in the weight of each arc
+   and final-prob.  That's a lot of small allocations, which matters for
+   programs that keep many lattices in memory at once (e.g. those that use a
+   RandomAccessTableReader on an archive that's not sorted).
+
+   Here the arcs are numbered contiguously in the order of their source states
+   and stored in flat arrays, and all the transition-id strings are stored in
+   one pooled array, so a lattice takes a fixed number of allocations
+   regardless of its size.  Converting to and from CompactLattice is cheap
+   (one pass over the lattice).  The states keep their numbering, so the
+   lattice doesn't have to be topologically sorted.
+*/
+class PackedCompactLattice {
+ public:
+  PackedCompactLattice(): start_(fst::kNoStateId) { }
+
+  explicit PackedCompactLattice(const CompactLattice &clat) { CopyFrom(clat); }
+
+  /// Makes this a copy of 'clat'.
+  void CopyFrom(const CompactLattice &clat);
+
+  /// Outputs the lattice as a CompactLattice.
+  void CopyTo(CompactLattice *clat) const;
+
+  int32 NumStates() const { return static_cast<int32>(final_weights_.size()); }
+  int32 NumArcs() const { return static_cast<int32>(nextstates_.size()); }
+  int32 Start() const { return start_; }
+
+  /// The arcs leaving state s are numbered from ArcBegin(s) to
+  /// ArcBegin(s + 1) - 1.
+  int32 ArcBegin(int32 s) const { return arc_begin_[s]; }
+
+  int32 ILabel(int32 arc) const { return ilabels_[arc]; }
+  int32 OLabel(int32 arc) const { return olabels_[arc]; }
+  int32 NextState(int32 arc) const { return nextstates_[arc]; }
+  const LatticeWeight &Weight(int32 arc) const { return weights_[arc]; }
+  /// Returns the number of transition-ids on the arc.
+  int32 StringLength(int32 arc) const {
+    return arc_string_begin_[arc + 1] - arc_string_begin_[arc];
+  }
+  /// Returns a pointer to the transition-ids on the arc (there are
+  /// StringLength(arc) of them).
+  const int32 *String(int32 arc) const {
+    return strings_.data() + arc_string_begin_[arc];
+  }
+
+  bool IsFinal(int32 s) const {
+    return final_weights_[s] != LatticeWeight::Zero();
+  }
+  /// Returns the weight part of the final-prob of state s (Zero() if it's not
+  /// final).
+  const LatticeWeight &FinalWeight(int32 s) const { return final_weights_[s]; }
+  int32 FinalStringLength(int32 s) const {
+    return final_string_begin_[s + 1] - final_string_begin_[s];
+  }
+  const int32 *FinalString(int32 s) const {
+    return strings_.data() + final_string_begin_[s];
+  }
+
+  /// Returns the approximate number of bytes of memory used.
+  size_t MemoryUsage() const;
+
+  void Swap(PackedCompactLattice *other);
+
+ private:
+  int32 start_;
+  // arc_begin_ is of dimension NumStates() + 1.
+  std::vector<int32> arc_begin_;
+  // The following are indexed by arc.
+  std::vector<int32> ilabels_;
+  std::vector<int32> olabels_;
+  std::vector<int32> nextstates_;
+  std::vector<LatticeWeight> weights_;
+  // arc_string_begin_ is of dimension NumArcs() + 1; the string of arc a is
+  // strings_[arc_string_begin_[a]] ... strings_[arc_string_begin_[a+1] - 1].
+  std::vector<int32> arc_string_begin_;
+  // The following are indexed by state.
+  std::vector<LatticeWeight> final_weights_;
+  // final_string_begin_ is of dimension NumStates() + 1, and works like
+  // arc_string_begin_; the final strings are stored after the arc strings.
+  std::vector<int32> final_string_begin_;
+  // The pool of transition-id strings.
+  std::vector<int32> strings_;
+};
+
+
+/// A holder for reading CompactLattices straight into the PackedCompactLattice
+/// format, for use in programs that only read lattices.  Reading is done as
+/// for CompactLatticeHolder, and the lattice is packed (and the temporary
+/// CompactLattice freed) before Read() returns.  Writing is supported, but is
+/// slower than for CompactLatticeHolder as it has to unpack the lattice.
+class PackedCompactLatticeHolder {
+ public:
+  typedef PackedCompactLattice T;
+
+  PackedCompactLatticeHolder() { t_ = NULL; }
+
+  static bool Write(std::ostream &os, bool binary, const T &t);
+
+  bool Read(std::istream &is);
+
+  static bool IsReadInBinary() { return true; }
+
+  T &Value() {
+    KALDI_ASSERT(t_ != NULL &&
+                 "Called Value() on empty PackedCompactLatticeHolder");
+    return *t_;
+  }
+
+  void Clear() { delete t_; t_ = NULL; }
+
+  void Swap(PackedCompactLatticeHolder *other) {
+    std::swap(t_, other->t_);
+  }
+
+  bool ExtractRange(const PackedCompactLatticeHolder &other,
+                    const std::string &range) {
+    KALDI_ERR << "ExtractRange is not defined for this type of holder.";
+    return false;
+  }
+
+  ~PackedCompactLatticeHolder() { Clear(); }
+ private:
+  T *t_;
+};
+
+typedef SequentialTableReader<PackedCompactLatticeHolder>
+    SequentialPackedCompactLatticeReader;
+typedef RandomAccessTableReader<PackedCompactLatticeHolder>
+    RandomAccessPackedCompactLatticeReader;
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_LAT_PACKED_LATTICE_H_
@@ -0,0 +1,177 @@
+// lat/sausages-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "lat/sausages.h"
+#include "lat/lattice-functions.h"
+
+namespace kaldi {
+
+// Creates a random CompactLattice that consists of 'num_pieces' pieces, each
+// between two "cut" states that all paths pass through.  Each path through
+// piece i has exactly one word, from a vocabulary used only in that piece, so
+// the MBR alignment of each piece does not depend on the other pieces.  Some
+// pieces also have a state in the middle (not a cut state, since other arcs
+// span it) that is reached by a word arc and left by an epsilon arc.  The
+// states are numbered in topological order; the cut states, starting with the
+// start state, are output to 'cut_states', and the last of them is final.
+static void RandPiecewiseLattice(int32 num_pieces, CompactLattice *clat,
+                                 std::vector<int32> *cut_states) {
+  clat->DeleteStates();
+  cut_states->clear();
+  int32 start = clat->AddState();
+  clat->SetStart(start);
+  cut_states->push_back(start);
+  for (int32 i = 0; i < num_pieces; i++) {
+    int32 length = RandInt(2, 6), num_arcs = RandInt(1, 4),
+        piece_start = cut_states->back(),
+        middle = (RandInt(0, 1) == 0 ? clat->AddState() : -1),
+        piece_end = clat->AddState();
+    for (int32 j = 0; j < num_arcs; j++) {
+      int32 word = 10 * (i + 1) + j;
+      CompactLatticeWeight weight(
+          LatticeWeight(RandUniform() * 2.0, RandUniform() * 5.0),
+          std::vector<int32>(length, 1));
+      clat->AddArc(piece_start,
+                   CompactLatticeArc(word, word, weight, piece_end));
+    }
+    if (middle != -1) {
+      int32 word = 10 * (i + 1) + num_arcs,
+          first_length = RandInt(1, length - 1);
+      CompactLatticeWeight weight1(
+          LatticeWeight(RandUniform() * 2.0, RandUniform() * 5.0),
+          std::vector<int32>(first_length, 1)),
+          weight2(LatticeWeight(0.0, RandUniform()),
+                  std::vector<int32>(length - first_length, 1));
+      clat->AddArc(piece_start, CompactLatticeArc(word, word, weight1, middle));
+      clat->AddArc(middle, CompactLatticeArc(0, 0, weight2, piece_end));
+    }
+    cut_states->push_back(piece_end);
+  }
+  clat->SetFinal(cut_states->back(),
+                 CompactLatticeWeight(LatticeWeight(RandUniform(), 0.0),
+                                      std::vector<int32>()));
+}
+
+// Outputs to 'prefix' the part of 'clat' up to the state 'end_state' (which
+// all arcs from earlier states end at or before), with 'end_state' final: this
+// is like the lattice that the incremental decoder would give us after the
+// first few pieces.
+static void GetLatticePrefix(const CompactLattice &clat, int32 end_state,
+                             CompactLattice *prefix) {
+  prefix->DeleteStates();
+  for (int32 s = 0; s <= end_state; s++)
+    prefix->AddState();
+  prefix->SetStart(0);
+  for (int32 s = 0; s < end_state; s++) {
+    for (fst::ArcIterator<CompactLattice> aiter(clat, s); !aiter.Done();
+         aiter.Next()) {
+      KALDI_ASSERT(aiter.Value().nextstate <= end_state);
+      prefix->AddArc(s, aiter.Value());
+    }
+  }
+  prefix->SetFinal(end_state, CompactLatticeWeight::One());
+}
+
+// Checks that the first a.size() elements of b are the same as a.
+template<class T>
+static void AssertIsPrefix(const std::vector<T> &a, const std::vector<T> &b) {
+  KALDI_ASSERT(a.size() <= b.size() &&
+               std::equal(a.begin(), a.end(), b.begin()));
+}
+
+// Feeds growing prefixes of a lattice to IncrementalMinimumBayesRisk, and
+// checks that the output it has finalized never changes, and that at the end
+// the words, times and confidences are the same as from MinimumBayesRisk on
+// the whole lattice.
+void TestIncrementalMinimumBayesRisk() {
+  int32 num_pieces = RandInt(1, 10);
+  CompactLattice clat;
+  std::vector<int32> cut_states;
+  RandPiecewiseLattice(num_pieces, &clat, &cut_states);
+  std::vector<int32> cut_times;
+  CompactLatticeStateTimes(clat, &cut_times);
+
+  MinimumBayesRiskOptions opts;
+  opts.decode_mbr = (RandInt(0, 1) == 0);
+  IncrementalMinimumBayesRisk incremental_mbr(opts);
+  std::vector<int32> one_best;
+  std::vector<std::pair<BaseFloat, BaseFloat> > one_best_times;
+  std::vector<BaseFloat> one_best_confidences;
+  for (int32 k = 1; k <= num_pieces; k++) {
+    bool is_final = (k == num_pieces);
+    // Sometimes we see the same lattice twice.
+    int32 num_calls = (!is_final && RandInt(0, 3) == 0 ? 2 : 1);
+    for (int32 n = 0; n < num_calls; n++) {
+      CompactLattice prefix;
+      if (is_final)
+        prefix = clat;
+      else
+        GetLatticePrefix(clat, cut_states[k], &prefix);
+      int32 num_words = incremental_mbr.AcceptLattice(prefix, is_final);
+      // The pieces before the last cut state that is before the final state
+      // are finalized, and each has one word in the output.
+      int32 num_pieces_finalized = (is_final ? k : k - 1);
+      KALDI_ASSERT(incremental_mbr.GetOneBest().size() ==
+                   num_pieces_finalized);
+      KALDI_ASSERT(num_words ==
+                   num_pieces_finalized - static_cast<int32>(one_best.size()));
+      if (!is_final)
+        KALDI_ASSERT(incremental_mbr.NumFramesFinalized() ==
+                     cut_times[cut_states[k - 1]]);
+
+      // The output finalized by the previous calls must not have changed.
+      AssertIsPrefix(one_best, incremental_mbr.GetOneBest());
+      AssertIsPrefix(one_best_times, incremental_mbr.GetOneBestTimes());
+      AssertIsPrefix(one_best_confidences,
+                     incremental_mbr.GetOneBestConfidences());
+      one_best = incremental_mbr.GetOneBest();
+      one_best_times = incremental_mbr.GetOneBestTimes();
+      one_best_confidences = incremental_mbr.GetOneBestConfidences();
+    }
+  }
+
+  MinimumBayesRisk mbr(clat, opts);
+  KALDI_ASSERT(mbr.GetOneBest() == one_best);
+  const std::vector<std::pair<BaseFloat, BaseFloat> > &ref_times =
+      mbr.GetOneBestTimes();
+  const std::vector<BaseFloat> &ref_confidences = mbr.GetOneBestConfidences();
+  KALDI_ASSERT(ref_times.size() == one_best_times.size() &&
+               ref_confidences.size() == one_best_confidences.size());
+  for (size_t i = 0; i < one_best.size(); i++) {
+    KALDI_ASSERT(ApproxEqual(ref_times[i].first, one_best_times[i].first) &&
+                 ApproxEqual(ref_times[i].second, one_best_times[i].second));
+    AssertEqual(ref_confidences[i], one_best_confidences[i], 0.001);
+  }
+
+  // After Reset() we can process another utterance.
+  incremental_mbr.Reset();
+  KALDI_ASSERT(incremental_mbr.GetOneBest().empty() &&
+               incremental_mbr.NumFramesFinalized() == 0);
+  incremental_mbr.AcceptLattice(clat, true);
+  KALDI_ASSERT(incremental_mbr.GetOneBest() == one_best);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 50; i++)
+    TestIncrementalMinimumBayesRisk();
+  KALDI_LOG << "Success.";
+  return 0;
+}
@@ -429,4 +429,221 @@ MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in,
 }
 
 
+IncrementalMinimumBayesRisk::IncrementalMinimumBayesRisk(
+    const MinimumBayesRiskOptions &opts,
+    BaseFloat acoustic_scale,
+    BaseFloat lm_scale): opts_(opts), acoustic_scale_(acoustic_scale),
+                         lm_scale_(lm_scale) {
+  Reset();
+}
+
+void IncrementalMinimumBayesRisk::Reset() {
+  frontier_state_ = fst::kNoStateId;
+  frontier_time_ = 0;
+  finalized_ = false;
+  one_best_.clear();
+  one_best_times_.clear();
+  one_best_confidences_.clear();
+  sausage_stats_.clear();
+  sausage_times_.clear();
+  bayes_risk_ = 0.0;
+}
+
+int32 IncrementalMinimumBayesRisk::AcceptLattice(const CompactLattice &clat,
+                                                 bool is_final) {
+  typedef CompactLattice::StateId StateId;
+  KALDI_ASSERT(!finalized_ &&
+               "You must call Reset() after processing the final lattice.");
+  if (clat.Start() == fst::kNoStateId) {
+    if (is_final) {
+      KALDI_WARN << "Empty lattice.";
+      finalized_ = true;
+    }
+    return 0;
+  }
+  if (frontier_state_ == fst::kNoStateId)
+    frontier_state_ = clat.Start();
+  KALDI_ASSERT(frontier_state_ < clat.NumStates());
+  size_t num_words_before = one_best_.size();
+
+  // Find the states reachable from the frontier state, with their times and
+  // the states preceding them.  Everything is indexed by the position in
+  // 'states'.
+  std::vector<StateId> states(1, frontier_state_);
+  std::vector<int32> times(1, frontier_time_);
+  std::vector<std::vector<int32> > preceding(1);
+  unordered_map<StateId, int32> state_index;
+  state_index[frontier_state_] = 0;
+  for (size_t i = 0; i < states.size(); i++) {
+    int32 t = times[i];
+    for (fst::ArcIterator<CompactLattice> aiter(clat, states[i]);
+         !aiter.Done(); aiter.Next()) {
+      const CompactLatticeArc &arc = aiter.Value();
+      std::pair<unordered_map<StateId, int32>::iterator, bool> ret =
+          state_index.insert(std::make_pair(arc.nextstate,
+                                            static_cast<int32>(states.size())));
+      if (ret.second) {
+        states.push_back(arc.nextstate);
+        times.push_back(t + arc.weight.String().size());
+        preceding.resize(states.size());
+      }
+      preceding[ret.first->second].push_back(i);
+    }
+  }
+
+  // Work out which of those states are coaccessible, and the earliest time of
+  // any final state: the lattice may change from there on.
+  int32 num_states = states.size(),
+      final_time = std::numeric_limits<int32>::max(),
+      max_time = frontier_time_;
+  std::vector<bool> coaccessible(num_states, false);
+  std::vector<int32> queue;
+  for (int32 i = 0; i < num_states; i++) {
+    if (clat.Final(states[i]) != CompactLatticeWeight::Zero()) {
+      coaccessible[i] = true;
+      queue.push_back(i);
+      final_time = std::min(final_time, times[i]);
+    }
+  }
+  if (queue.empty()) {
+    if (is_final) {
+      KALDI_WARN << "Lattice has no final states reachable from the last cut "
+                 << "state; output is incomplete.";
+      finalized_ = true;
+    }
+    return 0;
+  }
+  while (!queue.empty()) {
+    int32 i = queue.back();
+    queue.pop_back();
+    max_time = std::max(max_time, times[i]);
+    for (size_t j = 0; j < preceding[i].size(); j++) {
+      int32 p = preceding[i][j];
+      if (!coaccessible[p]) {
+        coaccessible[p] = true;
+        queue.push_back(p);
+      }
+    }
+  }
+
+  // Time t is the time of a cut state if only one coaccessible state has
+  // that time and no arc between coaccessible states spans it.  'crossing'
+  // stores differences of the number of arcs spanning each time.
+  int32 num_times = max_time - frontier_time_ + 1;
+  std::vector<int32> num_states_at(num_times, 0), state_at(num_times, -1),
+      crossing(num_times + 1, 0);
+  for (int32 i = 0; i < num_states; i++) {
+    if (!coaccessible[i]) continue;
+    int32 t = times[i] - frontier_time_;
+    num_states_at[t]++;
+    state_at[t] = i;
+    for (fst::ArcIterator<CompactLattice> aiter(clat, states[i]);
+         !aiter.Done(); aiter.Next()) {
+      int32 n = state_index[aiter.Value().nextstate];
+      if (coaccessible[n] && times[n] - frontier_time_ > t + 1) {
+        crossing[t + 1]++;
+        crossing[times[n] - frontier_time_]--;
+      }
+    }
+  }
+  std::vector<int32> cut_times;
+  int32 num_crossing = 0;
+  for (int32 t = 1; t < num_times && t + frontier_time_ < final_time; t++) {
+    num_crossing += crossing[t];
+    if (num_crossing == 0 && num_states_at[t] == 1)
+      cut_times.push_back(t);
+  }
+  if (cut_times.empty() && !is_final)
+    return 0;
+
+  // Sort the coaccessible states by time, so that each piece is a contiguous
+  // range.
+  std::vector<std::pair<int32, int32> > time_and_index;
+  for (int32 i = 0; i < num_states; i++)
+    if (coaccessible[i])
+      time_and_index.push_back(std::make_pair(times[i], i));
+  std::sort(time_and_index.begin(), time_and_index.end());
+  size_t pos = 0;
+  std::vector<StateId> piece_states;
+  for (size_t c = 0; c <= cut_times.size(); c++) {
+    bool is_last = (c == cut_times.size());
+    if (is_last && !is_final)
+      break;
+    piece_states.clear();
+    piece_states.push_back(frontier_state_);
+    int32 end_time = (is_last ? std::numeric_limits<int32>::max() :
+                      cut_times[c] + frontier_time_);
+    for (; pos < time_and_index.size() &&
+             time_and_index[pos].first < end_time; pos++) {
+      StateId s = states[time_and_index[pos].second];
+      if (s != frontier_state_)
+        piece_states.push_back(s);
+    }
+    if (!is_last) {
+      StateId cut_state = states[state_at[cut_times[c]]];
+      piece_states.push_back(cut_state);
+      ProcessPiece(clat, piece_states, false);
+      frontier_state_ = cut_state;
+      frontier_time_ = end_time;
+    } else {
+      ProcessPiece(clat, piece_states, true);
+      finalized_ = true;
+    }
+  }
+  return one_best_.size() - num_words_before;
+}
+
+void IncrementalMinimumBayesRisk::ProcessPiece(
+    const CompactLattice &clat,
+    const std::vector<CompactLattice::StateId> &piece_states,
+    bool is_last) {
+  typedef CompactLattice::StateId StateId;
+  unordered_map<StateId, StateId> state_map;
+  CompactLattice piece;
+  for (size_t i = 0; i < piece_states.size(); i++)
+    state_map[piece_states[i]] = piece.AddState();
+  piece.SetStart(0);
+  for (size_t i = 0; i < piece_states.size(); i++) {
+    if (!is_last && i + 1 == piece_states.size()) {
+      piece.SetFinal(i, CompactLatticeWeight::One());
+      break;
+    }
+    piece.SetFinal(i, clat.Final(piece_states[i]));
+    for (fst::ArcIterator<CompactLattice> aiter(clat, piece_states[i]);
+         !aiter.Done(); aiter.Next()) {
+      CompactLatticeArc arc = aiter.Value();
+      unordered_map<StateId, StateId>::const_iterator iter =
+          state_map.find(arc.nextstate);
+      if (iter == state_map.end())
+        continue;  // Not coaccessible.
+      arc.nextstate = iter->second;
+      piece.AddArc(i, arc);
+    }
+  }
+  if (acoustic_scale_ != 1.0 || lm_scale_ != 1.0)
+    fst::ScaleLattice(fst::LatticeScale(lm_scale_, acoustic_scale_), &piece);
+
+  MinimumBayesRisk mbr(piece, opts_);
+  BaseFloat offset = frontier_time_;
+  const std::vector<int32> &one_best = mbr.GetOneBest();
+  const std::vector<std::pair<BaseFloat, BaseFloat> > &one_best_times =
+      mbr.GetOneBestTimes();
+  one_best_.insert(one_best_.end(), one_best.begin(), one_best.end());
+  for (size_t i = 0; i < one_best_times.size(); i++)
+    one_best_times_.push_back(std::make_pair(one_best_times[i].first + offset,
+                                             one_best_times[i].second + offset));
+  const std::vector<BaseFloat> &confidences = mbr.GetOneBestConfidences();
+  one_best_confidences_.insert(one_best_confidences_.end(),
+                               confidences.begin(), confidences.end());
+  const std::vector<std::vector<std::pair<int32, BaseFloat> > > &stats =
+      mbr.GetSausageStats();
+  sausage_stats_.insert(sausage_stats_.end(), stats.begin(), stats.end());
+  std::vector<std::pair<BaseFloat, BaseFloat> > sausage_times =
+      mbr.GetSausageTimes();
+  for (size_t i = 0; i < sausage_times.size(); i++)
+    sausage_times_.push_back(std::make_pair(sausage_times[i].first + offset,
+                                            sausage_times[i].second + offset));
+  bayes_risk_ += mbr.GetBayesRisk();
+}
+
 }  // namespace kaldi
@@ -265,6 +265,100 @@ class MinimumBayesRisk {
   };
 };
 
+
+/// This class does the same computation as class MinimumBayesRisk, but
+/// incrementally on a lattice that is growing as decoding proceeds (e.g. the
+/// lattice from LatticeIncrementalDecoder::GetLattice()), so that the MBR
+/// output and confidences can be produced with bounded latency instead of at
+/// the end of the utterance.
+///
+/// Each time you call AcceptLattice() we look, in the part of the lattice that
+/// hasn't been finalized yet, for `cut` states: states that all paths pass
+/// through, and which are earlier than any final state in the lattice (so the
+/// part of the lattice before them can't change as more frames are decoded;
+/// in the incremental decoder only the states near the end of the lattice,
+/// which have final-probs, are redeterminized).  The part of the lattice
+/// between each pair of successive cut states is given to class
+/// MinimumBayesRisk, and the resulting words, confidences and sausage bins
+/// are appended to the output.  Because the posteriors of arcs before a cut
+/// state don't depend on the rest of the lattice, the confidences are the
+/// same as if we had processed the whole lattice, provided the edit-distance
+/// alignment of the whole lattice wouldn't align words across the cut (see
+/// sausages-test.cc); the MBR decoding itself is done separately for each
+/// piece, which makes little difference in practice.
+///
+/// The lattice must keep the same state numbering for the finalized part
+/// between calls, and the part of the lattice before the most recent cut
+/// state must not change, which is the case for the incremental decoder.
+class IncrementalMinimumBayesRisk {
+ public:
+  /// The lattices passed to AcceptLattice() are scaled with
+  /// LatticeScale(lm_scale, acoustic_scale) before the MBR computation.
+  IncrementalMinimumBayesRisk(const MinimumBayesRiskOptions &opts,
+                              BaseFloat acoustic_scale = 1.0,
+                              BaseFloat lm_scale = 1.0);
+
+  /// Processes the lattice decoded so far, finalizing the output up to the
+  /// last cut state that can no longer change.  If 'is_final' is true, this is
+  /// the complete lattice for the utterance, and the rest of the output is
+  /// finalized too; after this, you must call Reset() before processing
+  /// another utterance.  Returns the number of words (in GetOneBest())
+  /// finalized by this call.
+  int32 AcceptLattice(const CompactLattice &clat, bool is_final);
+
+  /// Resets the object for a new utterance.
+  void Reset();
+
+  /// Returns the number of frames of output that have been finalized.
+  int32 NumFramesFinalized() const { return frontier_time_; }
+
+  /// The following are as the same-named functions of class MinimumBayesRisk,
+  /// for the finalized part of the output, with the times as frame indexes
+  /// relative to the start of the utterance.
+  const std::vector<int32> &GetOneBest() const { return one_best_; }
+  const std::vector<std::pair<BaseFloat, BaseFloat> > &GetOneBestTimes() const {
+    return one_best_times_;
+  }
+  const std::vector<BaseFloat> &GetOneBestConfidences() const {
+    return one_best_confidences_;
+  }
+  const std::vector<std::vector<std::pair<int32, BaseFloat> > > &GetSausageStats() const {
+    return sausage_stats_;
+  }
+  const std::vector<std::pair<BaseFloat, BaseFloat> > &GetSausageTimes() const {
+    return sausage_times_;
+  }
+  /// Returns the sum of the expected word errors of the pieces processed
+  /// so far.
+  BaseFloat GetBayesRisk() const { return bayes_risk_; }
+
+ private:
+  // Gets the MBR output for the piece of 'clat' consisting of the states in
+  // 'piece_states', which starts at piece_states[0] (at time frontier_time_);
+  // and appends it to the output.  If is_last == false, the piece ends at the
+  // cut state piece_states.back(), otherwise it ends at the final states.
+  void ProcessPiece(const CompactLattice &clat,
+                    const std::vector<CompactLattice::StateId> &piece_states,
+                    bool is_last);
+
+  MinimumBayesRiskOptions opts_;
+  BaseFloat acoustic_scale_;
+  BaseFloat lm_scale_;
+
+  // The last cut state in the lattice up to which the output is finalized
+  // (or fst::kNoStateId if we haven't seen a lattice yet), and its time.
+  CompactLattice::StateId frontier_state_;
+  int32 frontier_time_;
+  bool finalized_;
+
+  std::vector<int32> one_best_;
+  std::vector<std::pair<BaseFloat, BaseFloat> > one_best_times_;
+  std::vector<BaseFloat> one_best_confidences_;
+  std::vector<std::vector<std::pair<int32, BaseFloat> > > sausage_stats_;
+  std::vector<std::pair<BaseFloat, BaseFloat> > sausage_times_;
+  BaseFloat bayes_risk_;
+};
+
 }  // namespace kaldi
 
 #endif  // KALDI_LAT_SAUSAGES_H_
@@ -24,6 +24,108 @@
 #include "lat/word-align-lattice-lexicon.h"
 #include "lat/lattice-functions.h"
 #include "lat/lattice-functions-transition-model.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// This class word-aligns one lattice; it is run by class TaskSequencer so
+// that lattices can be aligned in parallel.  The model and lexicon
+// information are shared (read-only) between the tasks.  The output is
+// written in the destructor, which TaskSequencer calls in the order the
+// lattices were read.
+class WordAlignLatticeLexiconTask {
+ public:
+  // Takes ownership of "clat".
+  WordAlignLatticeLexiconTask(const TransitionModel &tmodel,
+                              const WordAlignLatticeLexiconInfo &lexicon_info,
+                              const WordAlignLatticeLexiconOpts &opts,
+                              bool output_if_error,
+                              bool output_if_empty,
+                              bool test,
+                              bool allow_duplicate_paths,
+                              const std::string &key,
+                              CompactLattice *clat,
+                              CompactLatticeWriter *clat_writer,
+                              int32 *num_done,
+                              int32 *num_err):
+      tmodel_(tmodel), lexicon_info_(lexicon_info), opts_(opts),
+      output_if_error_(output_if_error), output_if_empty_(output_if_empty),
+      test_(test), allow_duplicate_paths_(allow_duplicate_paths), key_(key),
+      clat_(clat), ok_(false), clat_writer_(clat_writer),
+      num_done_(num_done), num_err_(num_err) { }
+
+  void operator () () {
+    ok_ = WordAlignLatticeLexicon(*clat_, tmodel_, lexicon_info_, opts_,
+                                  &aligned_clat_);
+
+    if (ok_ && test_) { // We only test if it succeeded.
+      if (!TestWordAlignedLattice(lexicon_info_, tmodel_, *clat_,
+                                  aligned_clat_, allow_duplicate_paths_)) {
+        KALDI_WARN << "Lattice failed test (activated because --test=true). "
+                   << "Probable code error, please contact Kaldi maintainers.";
+        ok_ = false;
+      }
+    }
+    if (aligned_clat_.Start() != fst::kNoStateId)
+      TopSortCompactLatticeIfNeeded(&aligned_clat_);
+    // We only need the input lattice after this if we may pass it through.
+    if (ok_ || !output_if_empty_ || aligned_clat_.NumStates() != 0) {
+      delete clat_;
+      clat_ = NULL;
+    }
+  }
+
+  ~WordAlignLatticeLexiconTask() {
+    if (!ok_) {
+      (*num_err_)++;
+      if (output_if_empty_ && aligned_clat_.NumStates() == 0 &&
+          clat_ != NULL && clat_->NumStates() != 0) {
+        KALDI_WARN << "Algorithm produced no output (due to --max-expand?), "
+                   << "so passing input through as output, for key " << key_;
+        clat_writer_->Write(key_, *clat_);
+      } else if (!output_if_error_) {
+        KALDI_WARN << "Lattice for " << key_ << " did not align correctly";
+      } else {
+        if (aligned_clat_.Start() != fst::kNoStateId) {
+          KALDI_WARN << "Outputting partial lattice for " << key_;
+          clat_writer_->Write(key_, aligned_clat_);
+        } else {
+          KALDI_WARN << "Empty aligned lattice for " << key_
+                     << ", producing no output.";
+        }
+      }
+    } else {
+      if (aligned_clat_.Start() == fst::kNoStateId) {
+        (*num_err_)++;
+        KALDI_WARN << "Lattice was empty for key " << key_;
+      } else {
+        (*num_done_)++;
+        KALDI_VLOG(2) << "Aligned lattice for " << key_;
+        clat_writer_->Write(key_, aligned_clat_);
+      }
+    }
+    delete clat_;
+  }
+
+ private:
+  const TransitionModel &tmodel_;
+  const WordAlignLatticeLexiconInfo &lexicon_info_;
+  const WordAlignLatticeLexiconOpts &opts_;
+  bool output_if_error_;
+  bool output_if_empty_;
+  bool test_;
+  bool allow_duplicate_paths_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice.  Owned locally.
+  bool ok_;
+  CompactLattice aligned_clat_;  // The output, which will be written to
+                                 // clat_writer_ in the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -43,7 +145,9 @@ int main(int argc, char *argv[]) {
         " e.g.: lattice-align-words-lexicon  --partial-word-label=4324 --max-expand 10.0 --test true \\\n"
         "   data/lang/phones/align_lexicon.int final.mdl ark:1.lats ark:aligned.lats\n"
         "See also: lattice-align-words, which is only applicable if your phones have word-position\n"
-        "markers, i.e. each phone comes in 5 versions like AA_B, AA_I, AA_W, AA_S, AA.\n";
+        "markers, i.e. each phone comes in 5 versions like AA_B, AA_I, AA_W, AA_S, AA.\n"
+        "With --num-threads > 1, lattices are aligned in parallel (the output\n"
+        "is still written in the input order).\n";
     
     ParseOptions po(usage);
     bool output_if_error = true;
@@ -65,6 +169,8 @@ int main(int argc, char *argv[]) {
     
     WordAlignLatticeLexiconOpts opts;
     opts.Register(&po);
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+    sequencer_config.Register(&po);
     
     po.Read(argc, argv);
 
@@ -101,58 +207,21 @@ int main(int argc, char *argv[]) {
     // No longer needed.
     
     int32 num_done = 0, num_err = 0;
-    
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      const CompactLattice &clat = clat_reader.Value();
-      
-      CompactLattice aligned_clat;
-      
-      bool ok = WordAlignLatticeLexicon(clat, tmodel, lexicon_info, opts,
-                                        &aligned_clat);
-
-      if (ok && test) { // We only test if it succeeded.
-        if (!TestWordAlignedLattice(lexicon_info, tmodel, clat, aligned_clat,
-                                    allow_duplicate_paths)) {
-          KALDI_WARN << "Lattice failed test (activated because --test=true). "
-                     << "Probable code error, please contact Kaldi maintainers.";
-          ok = false;
-        }
-      }
 
-      if (!ok) {
-        num_err++;
-        if (output_if_empty && aligned_clat.NumStates() == 0 &&
-            clat.NumStates() != 0) {
-          KALDI_WARN << "Algorithm produced no output (due to --max-expand?), "
-                     << "so passing input through as output, for key " << key;
-          TopSortCompactLatticeIfNeeded(&aligned_clat);
-          clat_writer.Write(key, clat);
-          continue;
-        }
-        if (!output_if_error)
-          KALDI_WARN << "Lattice for " << key << " did not align correctly";
-        else {
-          if (aligned_clat.Start() != fst::kNoStateId) {
-            KALDI_WARN << "Outputting partial lattice for " << key;
-            TopSortCompactLatticeIfNeeded(&aligned_clat);
-            clat_writer.Write(key, aligned_clat);
-          } else {
-            KALDI_WARN << "Empty aligned lattice for " << key
-                       << ", producing no output.";
-          }
-        }
-      } else {
-        if (aligned_clat.Start() == fst::kNoStateId) {
-          num_err++;
-          KALDI_WARN << "Lattice was empty for key " << key;
-        } else {
-          num_done++;
-          KALDI_VLOG(2) << "Aligned lattice for " << key;
-          TopSortCompactLatticeIfNeeded(&aligned_clat);
-          clat_writer.Write(key, aligned_clat);
-        }
+    {
+      TaskSequencer<WordAlignLatticeLexiconTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        // will give ownership to "task" below.
+        CompactLattice *clat = new CompactLattice(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        WordAlignLatticeLexiconTask *task = new WordAlignLatticeLexiconTask(
+            tmodel, lexicon_info, opts, output_if_error, output_if_empty,
+            test, allow_duplicate_paths, key, clat, &clat_writer,
+            &num_done, &num_err);
+        sequencer.Run(task);
       }
+      sequencer.Wait();
     }
     KALDI_LOG << "Successfully aligned " << num_done << " lattices; "
               << num_err << " had errors.";
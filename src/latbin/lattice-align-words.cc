@@ -24,6 +24,93 @@
 #include "lat/word-align-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/lattice-functions-transition-model.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// This class word-aligns one lattice; it is run by class TaskSequencer so
+// that lattices can be aligned in parallel.  The model and word-boundary
+// information are shared (read-only) between the tasks.  The output is
+// written in the destructor, which TaskSequencer calls in the order the
+// lattices were read.
+class WordAlignLatticeTask {
+ public:
+  // Takes ownership of "clat".
+  WordAlignLatticeTask(const TransitionModel &tmodel,
+                       const WordBoundaryInfo &info,
+                       BaseFloat max_expand,
+                       bool output_if_error,
+                       bool do_test,
+                       const std::string &key,
+                       CompactLattice *clat,
+                       CompactLatticeWriter *clat_writer,
+                       int32 *num_done,
+                       int32 *num_err):
+      tmodel_(tmodel), info_(info), max_expand_(max_expand),
+      output_if_error_(output_if_error), do_test_(do_test), key_(key),
+      clat_(clat), ok_(false), clat_writer_(clat_writer),
+      num_done_(num_done), num_err_(num_err) { }
+
+  void operator () () {
+    int32 max_states;
+    if (max_expand_ > 0) max_states = 1000 + max_expand_ * clat_->NumStates();
+    else max_states = 0;
+
+    ok_ = WordAlignLattice(*clat_, tmodel_, info_, max_states, &aligned_clat_);
+
+    if (do_test_ && ok_)
+      TestWordAlignedLattice(*clat_, tmodel_, info_, aligned_clat_);
+    delete clat_;  // This is no longer needed so we can delete it now.
+    clat_ = NULL;
+    if (aligned_clat_.Start() != fst::kNoStateId)
+      TopSortCompactLatticeIfNeeded(&aligned_clat_);
+  }
+
+  ~WordAlignLatticeTask() {
+    delete clat_;  // in case operator () was not called.
+    if (!ok_) {
+      (*num_err_)++;
+      if (!output_if_error_)
+        KALDI_WARN << "Lattice for " << key_
+                   << " did not align correctly, producing no output.";
+      else {
+        if (aligned_clat_.Start() != fst::kNoStateId) {
+          KALDI_WARN << "Outputting partial lattice for " << key_;
+          clat_writer_->Write(key_, aligned_clat_);
+        } else {
+          KALDI_WARN << "Empty aligned lattice for " << key_
+                     << ", producing no output.";
+        }
+      }
+    } else {
+      if (aligned_clat_.Start() == fst::kNoStateId) {
+        (*num_err_)++;
+        KALDI_WARN << "Lattice was empty for key " << key_;
+      } else {
+        (*num_done_)++;
+        KALDI_VLOG(2) << "Aligned lattice for " << key_;
+        clat_writer_->Write(key_, aligned_clat_);
+      }
+    }
+  }
+
+ private:
+  const TransitionModel &tmodel_;
+  const WordBoundaryInfo &info_;
+  BaseFloat max_expand_;
+  bool output_if_error_;
+  bool do_test_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice.  Owned locally.
+  bool ok_;
+  CompactLattice aligned_clat_;  // The output, which will be written to
+                                 // clat_writer_ in the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -41,7 +128,9 @@ int main(int argc, char *argv[]) {
         "Note: word-boundary file has format (on each line):\n"
         "<integer-phone-id> [begin|end|singleton|internal|nonword]\n"
         "See also: lattice-align-words-lexicon, for use in cases where phones\n"
-        "don't have word-position information.\n";
+        "don't have word-position information.\n"
+        "With --num-threads > 1, lattices are aligned in parallel (the output\n"
+        "is still written in the input order).\n";
     
     ParseOptions po(usage);
     BaseFloat max_expand = 0.0;
@@ -58,6 +147,8 @@ int main(int argc, char *argv[]) {
     
     WordBoundaryInfoNewOpts opts;
     opts.Register(&po);
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -81,47 +172,20 @@ int main(int argc, char *argv[]) {
     WordBoundaryInfo info(opts, word_boundary_rxfilename);
     
     int32 num_done = 0, num_err = 0;
-    
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      const CompactLattice &clat = clat_reader.Value();
-
-      CompactLattice aligned_clat;
-      int32 max_states;
-      if (max_expand > 0) max_states = 1000 + max_expand * clat.NumStates();
-      else max_states = 0;
-      
-      bool ok = WordAlignLattice(clat, tmodel, info, max_states, &aligned_clat);
-      
-      if (do_test && ok)
-        TestWordAlignedLattice(clat, tmodel, info, aligned_clat);
-
-      if (!ok) {
-        num_err++;
-        if (!output_if_error)
-          KALDI_WARN << "Lattice for " << key
-                     << " did not align correctly, producing no output.";
-        else {
-          if (aligned_clat.Start() != fst::kNoStateId) {
-            KALDI_WARN << "Outputting partial lattice for " << key;
-            TopSortCompactLatticeIfNeeded(&aligned_clat);
-            clat_writer.Write(key, aligned_clat);
-          } else {
-            KALDI_WARN << "Empty aligned lattice for " << key
-                       << ", producing no output.";
-          }
-        }
-      } else {
-        if (aligned_clat.Start() == fst::kNoStateId) {
-          num_err++;
-          KALDI_WARN << "Lattice was empty for key " << key;
-        } else {
-          num_done++;
-          KALDI_VLOG(2) << "Aligned lattice for " << key;
-          TopSortCompactLatticeIfNeeded(&aligned_clat);
-          clat_writer.Write(key, aligned_clat);
-        }
+
+    {
+      TaskSequencer<WordAlignLatticeTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        // will give ownership to "task" below.
+        CompactLattice *clat = new CompactLattice(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        WordAlignLatticeTask *task = new WordAlignLatticeTask(
+            tmodel, info, max_expand, output_if_error, do_test, key, clat,
+            &clat_writer, &num_done, &num_err);
+        sequencer.Run(task);
       }
+      sequencer.Wait();
     }
     KALDI_LOG << "Successfully aligned " << num_done << " lattices; "
               << num_err << " had errors.";
@@ -40,6 +40,7 @@ using std::vector;
 #include "util/common-utils.h"
 #include "lat/lattice-functions.h"
 #include "lat/kaldi-lattice.h"
+#include "lat/packed-lattice.h"
 #include "lat/sausages.h"
 
 namespace kaldi {
@@ -168,11 +169,15 @@ int main(int argc, char *argv[]) {
 
     // Input lattices
     SequentialCompactLatticeReader clat_reader1(lats_rspecifier1);
-    vector<RandomAccessCompactLatticeReader*> clat_reader_vec(
-        num_args-2, static_cast<RandomAccessCompactLatticeReader*>(NULL));
+    // The other systems' lattices are read into the packed format, because if
+    // the archives aren't sorted, the readers will keep all the lattices in
+    // memory.
+    vector<RandomAccessPackedCompactLatticeReader*> clat_reader_vec(
+        num_args-2, static_cast<RandomAccessPackedCompactLatticeReader*>(NULL));
     vector<string> clat_rspec_vec(num_args-2);
     for (int32 i = 2; i < num_args; ++i) {
-      clat_reader_vec[i-2] = new RandomAccessCompactLatticeReader(po.GetArg(i));
+      clat_reader_vec[i-2] =
+          new RandomAccessPackedCompactLatticeReader(po.GetArg(i));
       clat_rspec_vec[i-2] = po.GetArg(i);
     }
 
@@ -202,7 +207,8 @@ int main(int argc, char *argv[]) {
 
       for (int32 i = 0; i < num_args-2; ++i) {
         if (clat_reader_vec[i]->HasKey(key)) {
-          CompactLattice clat2 = clat_reader_vec[i]->Value(key);
+          CompactLattice clat2;
+          clat_reader_vec[i]->Value(key).CopyTo(&clat2);
           n_total_lats++;
           fst::ScaleLattice(lat_scale, &clat2);
           success = CompactLatticeNormalize(&clat2, lat_weights[i+1]);
@@ -22,6 +22,7 @@
 #include "util/common-utils.h"
 #include "fstext/fstext-lib.h"
 #include "lat/kaldi-lattice.h"
+#include "lat/packed-lattice.h"
 
 int main(int argc, char *argv[]) {
   try {
@@ -52,7 +53,10 @@ int main(int argc, char *argv[]) {
     std::string lats_wspecifier = po.GetArg(3);
 
     SequentialCompactLatticeReader compact_lattice_reader1(lats1_rspecifier);
-    RandomAccessCompactLatticeReader compact_lattice_reader2(lats2_rspecifier);
+    // The second archive is read into the packed format, because if it's not
+    // sorted, the reader will keep all the lattices in memory.
+    RandomAccessPackedCompactLatticeReader compact_lattice_reader2(
+        lats2_rspecifier);
     
     CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
 
@@ -62,7 +66,8 @@ int main(int argc, char *argv[]) {
       std::string key = compact_lattice_reader1.Key();
       const CompactLattice &clat1 =  compact_lattice_reader1.Value();
       if (compact_lattice_reader2.HasKey(key)) {
-        CompactLattice clat2 (compact_lattice_reader2.Value(key));
+        CompactLattice clat2;
+        compact_lattice_reader2.Value(key).CopyTo(&clat2);
         // "Difference" requires clat2 to be unweighted, deterministic and epsilon-free.
         // So we remove the weights, remove epsilons and determinize.
         RemoveWeights(&clat2);
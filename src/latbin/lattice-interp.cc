@@ -22,6 +22,7 @@
 #include "util/common-utils.h"
 #include "fstext/fstext-lib.h"
 #include "lat/kaldi-lattice.h"
+#include "lat/packed-lattice.h"
 
 int main(int argc, char *argv[]) {
   try {
@@ -60,7 +61,9 @@ int main(int argc, char *argv[]) {
         lats_wspecifier = po.GetArg(3);
 
     SequentialLatticeReader lattice_reader1(lats_rspecifier1);
-    RandomAccessCompactLatticeReader lattice_reader2(lats_rspecifier2);
+    // The second archive is read into the packed format, because if it's not
+    // sorted, the reader will keep all the lattices in memory.
+    RandomAccessPackedCompactLatticeReader lattice_reader2(lats_rspecifier2);
 
     CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
 
@@ -75,7 +78,8 @@ int main(int argc, char *argv[]) {
 
       if (lattice_reader2.HasKey(key)) {
         n_processed++;
-        CompactLattice clat2 = lattice_reader2.Value(key);
+        CompactLattice clat2;
+        lattice_reader2.Value(key).CopyTo(&clat2);
         RemoveAlignmentsFromCompactLattice(&clat2);
 
         Lattice lat2;
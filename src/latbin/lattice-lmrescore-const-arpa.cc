@@ -18,12 +18,141 @@
 // limitations under the License.
 
 
+#include <mutex>
+
 #include "base/kaldi-common.h"
 #include "fstext/fstext-lib.h"
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lm/const-arpa-lm.h"
 #include "util/common-utils.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// Keeps one ConstArpaLmCache per thread that is rescoring lattices, so that
+// the cached n-gram lookups persist from one lattice to the next (consecutive
+// lattices tend to query many of the same n-grams).  The caches are not
+// thread-safe, so a task takes a cache for the duration of its work and gives
+// it back afterwards.
+class ConstArpaLmCachePool {
+ public:
+  ConstArpaLmCachePool(const ConstArpaLm &lm, int32 cache_size):
+      lm_(lm), cache_size_(cache_size) { }
+
+  ConstArpaLmCache *Get() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_caches_.empty()) {
+      all_caches_.push_back(new ConstArpaLmCache(lm_, cache_size_));
+      return all_caches_.back();
+    }
+    ConstArpaLmCache *ans = free_caches_.back();
+    free_caches_.pop_back();
+    return ans;
+  }
+
+  void Release(ConstArpaLmCache *cache) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_caches_.push_back(cache);
+  }
+
+  // Prints the cache hit rate; should be called once all tasks are done.
+  void PrintStats() const {
+    int64 num_queries = 0, num_hits = 0;
+    for (size_t i = 0; i < all_caches_.size(); i++) {
+      num_queries += all_caches_[i]->NumQueries();
+      num_hits += all_caches_[i]->NumHits();
+    }
+    KALDI_LOG << "Used " << all_caches_.size() << " LM cache(s); "
+              << num_queries << " n-gram queries, hit rate was "
+              << (num_hits / std::max<double>(num_queries, 1.0));
+  }
+
+  ~ConstArpaLmCachePool() { DeletePointers(&all_caches_); }
+
+ private:
+  const ConstArpaLm &lm_;
+  int32 cache_size_;
+  std::mutex mutex_;
+  std::vector<ConstArpaLmCache*> all_caches_;
+  std::vector<ConstArpaLmCache*> free_caches_;
+};
+
+// This class rescores one lattice; it is run by class TaskSequencer so that
+// lattices can be rescored in parallel.  The output is written in the
+// destructor, which TaskSequencer calls in the order the lattices were read.
+class ConstArpaLmRescoreTask {
+ public:
+  // Takes ownership of "clat".
+  ConstArpaLmRescoreTask(ConstArpaLmCachePool *cache_pool,
+                         BaseFloat lm_scale,
+                         const std::string &key,
+                         CompactLattice *clat,
+                         CompactLatticeWriter *clat_writer,
+                         int32 *num_done,
+                         int32 *num_fail):
+      cache_pool_(cache_pool), lm_scale_(lm_scale), key_(key), clat_(clat),
+      clat_writer_(clat_writer), num_done_(num_done), num_fail_(num_fail) { }
+
+  void operator () () {
+    // Before composing with the LM FST, we scale the lattice weights
+    // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+    // We do it this way so we can determinize and it will give the
+    // right effect (taking the "best path" through the LM) regardless
+    // of the sign of lm_scale.
+    fst::ScaleLattice(fst::GraphLatticeScale(1.0/lm_scale_), clat_);
+    ArcSort(clat_, fst::OLabelCompare<CompactLatticeArc>());
+
+    // Wraps the ConstArpaLm format language model into FST. We re-create it
+    // for each lattice to prevent memory usage increasing with time; the
+    // n-gram lookups are cached across lattices by the cache.
+    ConstArpaLmCache *cache = cache_pool_->Get();
+    CompactLattice composed_clat;
+    {
+      ConstArpaLmDeterministicFst const_arpa_fst(cache);
+
+      // Composes lattice with language model.
+      ComposeCompactLatticeDeterministic(*clat_,
+                                         &const_arpa_fst, &composed_clat);
+    }
+    cache_pool_->Release(cache);
+    delete clat_;  // This is no longer needed so we can delete it now.
+    clat_ = NULL;
+
+    // Determinizes the composed lattice.
+    Lattice composed_lat;
+    ConvertLattice(composed_clat, &composed_lat);
+    composed_clat.DeleteStates();
+    Invert(&composed_lat);
+    DeterminizeLattice(composed_lat, &determinized_clat_);
+    fst::ScaleLattice(fst::GraphLatticeScale(lm_scale_), &determinized_clat_);
+  }
+
+  ~ConstArpaLmRescoreTask() {
+    delete clat_;  // in case operator () was not called.
+    if (determinized_clat_.Start() == fst::kNoStateId) {
+      KALDI_WARN << "Empty lattice for utterance " << key_
+                 << " (incompatible LM?)";
+      (*num_fail_)++;
+    } else {
+      clat_writer_->Write(key_, determinized_clat_);
+      (*num_done_)++;
+    }
+  }
+
+ private:
+  ConstArpaLmCachePool *cache_pool_;
+  BaseFloat lm_scale_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice.  Owned locally.
+  CompactLattice determinized_clat_;  // The output, which will be written to
+                                      // clat_writer_ in the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_fail_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -45,9 +174,15 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     BaseFloat lm_scale = 1.0;
+    int32 cache_size = 65536;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
                 "costs; frequently 1.0 or -1.0");
+    po.Register("cache-size", &cache_size, "Number of entries in the n-gram "
+                "lookup cache of each thread (rounded up to a power of two); "
+                "the cache is kept from one lattice to the next.");
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -68,51 +203,31 @@ int main(int argc, char *argv[]) {
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
     CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
 
+    ConstArpaLmCachePool cache_pool(const_arpa, cache_size);
+
     int32 n_done = 0, n_fail = 0;
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
-      compact_lattice_reader.FreeCurrent();
-
-      if (lm_scale != 0.0) {
-        // Before composing with the LM FST, we scale the lattice weights
-        // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-        // We do it this way so we can determinize and it will give the
-        // right effect (taking the "best path" through the LM) regardless
-        // of the sign of lm_scale.
-        fst::ScaleLattice(fst::GraphLatticeScale(1.0/lm_scale), &clat);
-        ArcSort(&clat, fst::OLabelCompare<CompactLatticeArc>());
-
-        // Wraps the ConstArpaLm format language model into FST. We re-create it
-        // for each lattice to prevent memory usage increasing with time.
-        ConstArpaLmDeterministicFst const_arpa_fst(const_arpa);
-
-        // Composes lattice with language model.
-        CompactLattice composed_clat;
-        ComposeCompactLatticeDeterministic(clat,
-                                           &const_arpa_fst, &composed_clat);
-
-        // Determinizes the composed lattice.
-        Lattice composed_lat;
-        ConvertLattice(composed_clat, &composed_lat);
-        Invert(&composed_lat);
-        CompactLattice determinized_clat;
-        DeterminizeLattice(composed_lat, &determinized_clat);
-        fst::ScaleLattice(fst::GraphLatticeScale(lm_scale), &determinized_clat);
-        if (determinized_clat.Start() == fst::kNoStateId) {
-          KALDI_WARN << "Empty lattice for utterance " << key
-              << " (incompatible LM?)";
-          n_fail++;
+    {
+      TaskSequencer<ConstArpaLmRescoreTask> sequencer(sequencer_config);
+      for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+        std::string key = compact_lattice_reader.Key();
+        if (lm_scale != 0.0) {
+          CompactLattice *clat =
+              new CompactLattice(compact_lattice_reader.Value());
+          compact_lattice_reader.FreeCurrent();
+          sequencer.Run(new ConstArpaLmRescoreTask(&cache_pool, lm_scale, key,
+                                                   clat,
+                                                   &compact_lattice_writer,
+                                                   &n_done, &n_fail));
         } else {
-          compact_lattice_writer.Write(key, determinized_clat);
+          // Zero scale so nothing to do.
           n_done++;
+          compact_lattice_writer.Write(key, compact_lattice_reader.Value());
         }
-      } else {
-        // Zero scale so nothing to do.
-        n_done++;
-        compact_lattice_writer.Write(key, clat);
       }
+      sequencer.Wait();
     }
+    if (lm_scale != 0.0)
+      cache_pool.PrintStats();
 
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
     return (n_done != 0 ? 0 : 1);
@@ -28,6 +28,108 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/compose-lattice-pruned.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// This class rescores one lattice; it is run by class TaskSequencer so that
+// lattices can be rescored in parallel.  The models are shared between the
+// tasks; each task has its own on-demand LM FSTs (and hence its own cache of
+// RNNLM states).  The output is written in the destructor, which
+// TaskSequencer calls in the order the lattices were read.
+class RnnlmRescoreLatticeTask {
+ public:
+  // Takes ownership of "clat".  Exactly one of "lm_to_subtract_fst" and
+  // "const_arpa" must be non-NULL; "cache" may be NULL.
+  RnnlmRescoreLatticeTask(const ComposeLatticePrunedOptions &compose_opts,
+                          const rnnlm::RnnlmComputeStateInfo &info,
+                          int32 max_ngram_order,
+                          BaseFloat lm_scale,
+                          BaseFloat acoustic_scale,
+                          const fst::VectorFst<fst::StdArc> *lm_to_subtract_fst,
+                          const ConstArpaLm *const_arpa,
+                          rnnlm::RnnlmComputeStateCache *cache,
+                          const std::string &key,
+                          CompactLattice *clat,
+                          CompactLatticeWriter *clat_writer,
+                          int32 *num_done,
+                          int32 *num_err):
+      compose_opts_(compose_opts), info_(info),
+      max_ngram_order_(max_ngram_order), lm_scale_(lm_scale),
+      acoustic_scale_(acoustic_scale), lm_to_subtract_fst_(lm_to_subtract_fst),
+      const_arpa_(const_arpa), cache_(cache), key_(key), clat_(clat),
+      clat_writer_(clat_writer), num_done_(num_done), num_err_(num_err) { }
+
+  void operator () () {
+    fst::DeterministicOnDemandFst<fst::StdArc> *lm_to_subtract_det;
+    if (const_arpa_ != NULL)
+      lm_to_subtract_det = new ConstArpaLmDeterministicFst(*const_arpa_);
+    else
+      lm_to_subtract_det =
+          new fst::BackoffDeterministicOnDemandFst<fst::StdArc>(
+              *lm_to_subtract_fst_);
+    fst::ScaleDeterministicOnDemandFst lm_to_subtract_det_scale(
+        -lm_scale_, lm_to_subtract_det);
+    rnnlm::KaldiRnnlmDeterministicFst lm_to_add_orig(max_ngram_order_, info_,
+                                                     cache_);
+    fst::ScaleDeterministicOnDemandFst lm_to_add(lm_scale_, &lm_to_add_orig);
+
+    // Before composing with the LM FST, we scale the lattice weights
+    // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+    // We do it this way so we can determinize and it will give the
+    // right effect (taking the "best path" through the LM) regardless
+    // of the sign of lm_scale.
+    if (acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale_), clat_);
+    }
+    TopSortCompactLatticeIfNeeded(clat_);
+
+    fst::ComposeDeterministicOnDemandFst<fst::StdArc> combined_lms(
+        &lm_to_subtract_det_scale, &lm_to_add);
+
+    // Composes lattice with language model.
+    ComposeCompactLatticePruned(compose_opts_, *clat_,
+                                &combined_lms, &composed_clat_);
+    delete clat_;  // This is no longer needed so we can delete it now.
+    clat_ = NULL;
+    delete lm_to_subtract_det;
+
+    if (composed_clat_.NumStates() != 0 && acoustic_scale_ != 1.0) {
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                        &composed_clat_);
+    }
+  }
+
+  ~RnnlmRescoreLatticeTask() {
+    delete clat_;  // in case operator () was not called.
+    if (composed_clat_.NumStates() == 0) {
+      // Something went wrong.  A warning will already have been printed.
+      (*num_err_)++;
+    } else {
+      clat_writer_->Write(key_, composed_clat_);
+      (*num_done_)++;
+    }
+  }
+
+ private:
+  const ComposeLatticePrunedOptions &compose_opts_;
+  const rnnlm::RnnlmComputeStateInfo &info_;
+  int32 max_ngram_order_;
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  const fst::VectorFst<fst::StdArc> *lm_to_subtract_fst_;
+  const ConstArpaLm *const_arpa_;
+  rnnlm::RnnlmComputeStateCache *cache_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice.  Owned locally.
+  CompactLattice composed_clat_;  // The output, which will be written to
+                                  // clat_writer_ in the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -55,13 +157,18 @@ int main(int argc, char *argv[]) {
         "       lattice-lmrescore-kaldi-rnnlm-pruned --lm-scale=-1.0 fst_words.txt \\\n"
         "              --bos-symbol=1 --eos-symbol=2 \\\n"
         "              data/lang_test_fg/G.carpa word_embedding.mat \\\n"
-        "              final.raw ark:in.lats ark:out.lats\n";
+        "              final.raw ark:in.lats ark:out.lats\n"
+        "\n"
+        "With --num-threads > 1, lattices are rescored in parallel (the output\n"
+        "is still written in the input order).\n";
 
     ParseOptions po(usage);
     rnnlm::RnnlmComputeStateComputationOptions opts;
     ComposeLatticePrunedOptions compose_opts;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     int32 max_ngram_order = 3;
+    int32 history_cache_size = 0;
     BaseFloat lm_scale = 0.5;
     BaseFloat acoustic_scale = 0.1;
     bool use_carpa = false;
@@ -75,11 +182,18 @@ int main(int argc, char *argv[]) {
         "If positive, allow RNNLM histories longer than this to be identified "
         "with each other for rescoring purposes (an approximation that "
         "saves time and reduces output lattice size).");
+    po.Register("history-cache-size", &history_cache_size, "If positive, "
+                "the number of RNNLM states (indexed by word history) to cache "
+                "across lattices, so that histories that recur in many "
+                "utterances are not recomputed.  Only complete histories "
+                "(those not truncated by --max-ngram-order) are cached, so the "
+                "output does not depend on the order of the lattices.");
     po.Register("use-const-arpa", &use_carpa, "If true, read the old-LM file "
                 "as a const-arpa file as opposed to an FST file");
 
     opts.Register(&po);
     compose_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -101,31 +215,21 @@ int main(int argc, char *argv[]) {
     lats_rspecifier = po.GetArg(4);
     lats_wspecifier = po.GetArg(5);
 
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
+
     // for G.fst
-    fst::ScaleDeterministicOnDemandFst *lm_to_subtract_det_scale = NULL;
-    fst::BackoffDeterministicOnDemandFst<StdArc> *lm_to_subtract_det_backoff = NULL;
     VectorFst<StdArc> *lm_to_subtract_fst = NULL;
-
     // for G.carpa
     ConstArpaLm* const_arpa = NULL;
-    fst::DeterministicOnDemandFst<StdArc> *carpa_lm_to_subtract_fst = NULL;
 
     KALDI_LOG << "Reading old LMs...";
     if (use_carpa) {
       const_arpa = new ConstArpaLm();
       ReadKaldiObject(lm_to_subtract_rxfilename, const_arpa);
-      carpa_lm_to_subtract_fst = new ConstArpaLmDeterministicFst(*const_arpa);
-      lm_to_subtract_det_scale
-        = new fst::ScaleDeterministicOnDemandFst(-lm_scale,
-                                                 carpa_lm_to_subtract_fst);
     } else {
       lm_to_subtract_fst = fst::ReadAndPrepareLmFst(
           lm_to_subtract_rxfilename);
-      lm_to_subtract_det_backoff =
-        new fst::BackoffDeterministicOnDemandFst<StdArc>(*lm_to_subtract_fst);
-      lm_to_subtract_det_scale =
-           new fst::ScaleDeterministicOnDemandFst(-lm_scale,
-                                                  lm_to_subtract_det_backoff);
     }
 
     kaldi::nnet3::Nnet rnnlm;
@@ -136,6 +240,8 @@ int main(int argc, char *argv[]) {
     CuMatrix<BaseFloat> word_embedding_mat;
     ReadKaldiObject(word_embedding_rxfilename, &word_embedding_mat);
 
+    // The models are read-only from here on, and are shared by all the
+    // threads.
     const rnnlm::RnnlmComputeStateInfo info(opts, rnnlm, word_embedding_mat);
 
     // Reads and writes as compact lattice.
@@ -144,60 +250,35 @@ int main(int argc, char *argv[]) {
 
     int32 num_done = 0, num_err = 0;
 
-    rnnlm::KaldiRnnlmDeterministicFst* lm_to_add_orig = 
-         new rnnlm::KaldiRnnlmDeterministicFst(max_ngram_order, info);
-
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      fst::DeterministicOnDemandFst<StdArc> *lm_to_add =
-         new fst::ScaleDeterministicOnDemandFst(lm_scale, lm_to_add_orig);
-
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
-      compact_lattice_reader.FreeCurrent();
-
-      // Before composing with the LM FST, we scale the lattice weights
-      // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-      // We do it this way so we can determinize and it will give the
-      // right effect (taking the "best path" through the LM) regardless
-      // of the sign of lm_scale.
-      if (acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &clat);
-      }
-      TopSortCompactLatticeIfNeeded(&clat);
-
-      fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
-          lm_to_subtract_det_scale, lm_to_add);
-
-      // Composes lattice with language model.
-      CompactLattice composed_clat;
-      ComposeCompactLatticePruned(compose_opts, clat,
-                                  &combined_lms, &composed_clat);
-
-      lm_to_add_orig->Clear();
-
-      if (composed_clat.NumStates() == 0) {
-        // Something went wrong.  A warning will already have been printed.
-        num_err++;
-      } else {
-        if (acoustic_scale != 1.0) {
-          if (acoustic_scale == 0.0)
-            KALDI_ERR << "Acoustic scale cannot be zero.";
-          fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
-                            &composed_clat);
-        }
-        compact_lattice_writer.Write(key, composed_clat);
-        num_done++;
+    // Shared by all the threads.
+    rnnlm::RnnlmComputeStateCache *cache = NULL;
+    if (history_cache_size > 0)
+      cache = new rnnlm::RnnlmComputeStateCache(history_cache_size);
+
+    {
+      TaskSequencer<RnnlmRescoreLatticeTask> sequencer(sequencer_config);
+      for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+        std::string key = compact_lattice_reader.Key();
+        // will give ownership to "task" below.
+        CompactLattice *clat = new CompactLattice(
+            compact_lattice_reader.Value());
+        compact_lattice_reader.FreeCurrent();
+
+        RnnlmRescoreLatticeTask *task = new RnnlmRescoreLatticeTask(
+            compose_opts, info, max_ngram_order, lm_scale, acoustic_scale,
+            lm_to_subtract_fst, const_arpa, cache, key, clat,
+            &compact_lattice_writer, &num_done, &num_err);
+        sequencer.Run(task);
       }
-      delete lm_to_add;
+      sequencer.Wait();
+    }
+    if (cache != NULL) {
+      cache->PrintStats();
+      delete cache;
     }
 
     delete lm_to_subtract_fst;
-    delete lm_to_add_orig;
-    delete lm_to_subtract_det_backoff;
-    delete lm_to_subtract_det_scale;
-
     delete const_arpa;
-    delete carpa_lm_to_subtract_fst;
 
     KALDI_LOG << "Overall, succeeded for " << num_done
               << " lattices, failed for " << num_err;
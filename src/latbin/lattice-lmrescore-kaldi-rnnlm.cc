@@ -51,6 +51,7 @@ int main(int argc, char *argv[]) {
     rnnlm::RnnlmComputeStateComputationOptions opts;
 
     int32 max_ngram_order = 3;
+    int32 history_cache_size = 0;
     BaseFloat lm_scale = 1.0;
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
@@ -59,6 +60,12 @@ int main(int argc, char *argv[]) {
         "If positive, allow RNNLM histories longer than this to be identified "
         "with each other for rescoring purposes (an approximation that "
         "saves time and reduces output lattice size).");
+    po.Register("history-cache-size", &history_cache_size, "If positive, "
+                "the number of RNNLM states (indexed by word history) to cache "
+                "across lattices, so that histories that recur in many "
+                "utterances are not recomputed.  Only complete histories "
+                "(those not truncated by --max-ngram-order) are cached, so the "
+                "output does not depend on the order of the lattices.");
     opts.Register(&po);
 
     po.Read(argc, argv);
@@ -93,7 +100,11 @@ int main(int argc, char *argv[]) {
 
     int32 n_done = 0, n_fail = 0;
 
-    rnnlm::KaldiRnnlmDeterministicFst rnnlm_fst(max_ngram_order, info);
+    rnnlm::RnnlmComputeStateCache *cache = NULL;
+    if (history_cache_size > 0)
+      cache = new rnnlm::RnnlmComputeStateCache(history_cache_size);
+
+    rnnlm::KaldiRnnlmDeterministicFst rnnlm_fst(max_ngram_order, info, cache);
 
     for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
       std::string key = compact_lattice_reader.Key();
@@ -138,6 +149,10 @@ int main(int argc, char *argv[]) {
       rnnlm_fst.Clear();
     }
 
+    if (cache != NULL) {
+      cache->PrintStats();
+      delete cache;
+    }
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
     return (n_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
@@ -20,9 +20,163 @@
 
 #include "util/common-utils.h"
 #include "util/kaldi-table.h"
+#include "util/kaldi-thread.h"
 #include "lat/sausages.h"
+#include "lat/word-align-lattice.h"
+#include "lat/word-align-lattice-lexicon.h"
+#include "lat/lattice-functions.h"
 #include <numeric>
 
+namespace kaldi {
+
+// This class does the work for one lattice: optionally word-aligning it, then
+// MBR decoding and working out the ctm lines.  It is run by class
+// TaskSequencer so that lattices can be processed in parallel; the ctm is
+// written in the destructor, which TaskSequencer calls in the order the
+// lattices were read.
+class LatticeToCtmConfTask {
+ public:
+  // Takes ownership of "clat".  At most one of "word_boundary_info" and
+  // "lexicon_info" may be non-NULL; if one is, the lattice is word-aligned
+  // first.  "one_best" and "times" are the initial hypothesis and the
+  // initial times of its bins, and are only used if "use_one_best" and
+  // "use_times" respectively are true.
+  LatticeToCtmConfTask(const MinimumBayesRiskOptions &mbr_opts,
+                       BaseFloat lm_scale, BaseFloat acoustic_scale,
+                       BaseFloat frame_shift,
+                       const TransitionModel *tmodel,
+                       const WordBoundaryInfo *word_boundary_info,
+                       const WordAlignLatticeLexiconInfo *lexicon_info,
+                       const WordAlignLatticeLexiconOpts &align_opts,
+                       const std::string &key,
+                       CompactLattice *clat,
+                       bool use_one_best,
+                       const std::vector<int32> &one_best,
+                       bool use_times,
+                       const std::vector<std::pair<BaseFloat, BaseFloat> > &times,
+                       std::ostream *ctm_stream,
+                       int32 *n_done, int32 *n_words, int32 *n_err,
+                       BaseFloat *tot_bayes_risk):
+      mbr_opts_(mbr_opts), lm_scale_(lm_scale), acoustic_scale_(acoustic_scale),
+      frame_shift_(frame_shift), tmodel_(tmodel),
+      word_boundary_info_(word_boundary_info), lexicon_info_(lexicon_info),
+      align_opts_(align_opts), key_(key), clat_(clat),
+      use_one_best_(use_one_best), one_best_(one_best), use_times_(use_times),
+      times_(times), ok_(false), num_words_(0), bayes_risk_(0.0),
+      avg_conf_(0.0), ctm_stream_(ctm_stream), n_done_(n_done),
+      n_words_(n_words), n_err_(n_err), tot_bayes_risk_(tot_bayes_risk) {
+    ctm_.copyfmt(*ctm_stream);
+  }
+
+  void operator () () {
+    if (word_boundary_info_ != NULL || lexicon_info_ != NULL) {
+      if (!WordAlign())
+        return;
+    }
+    fst::ScaleLattice(fst::LatticeScale(lm_scale_, acoustic_scale_), clat_);
+
+    MinimumBayesRisk *mbr = NULL;
+    if (!use_one_best_)
+      mbr = new MinimumBayesRisk(*clat_, mbr_opts_);
+    else if (!use_times_)
+      mbr = new MinimumBayesRisk(*clat_, one_best_, mbr_opts_); // no 'times',
+    else  // with initial 'times' of the bins,
+      mbr = new MinimumBayesRisk(*clat_, one_best_, times_, mbr_opts_);
+    delete clat_;  // This is no longer needed so we can delete it now.
+    clat_ = NULL;
+
+    const std::vector<BaseFloat> &conf = mbr->GetOneBestConfidences();
+    const std::vector<int32> &words = mbr->GetOneBest();
+    const std::vector<std::pair<BaseFloat, BaseFloat> > &times =
+        mbr->GetOneBestTimes();
+    KALDI_ASSERT(conf.size() == words.size() && words.size() == times.size());
+    for (size_t i = 0; i < words.size(); i++) {
+      KALDI_ASSERT(words[i] != 0 || mbr_opts_.print_silence); // Should not have epsilons.
+      ctm_ << key_ << " 1 " << (frame_shift_ * times[i].first) << ' '
+           << (frame_shift_ * (times[i].second-times[i].first)) << ' '
+           << words[i] << ' ' << conf[i] << '\n';
+    }
+    num_words_ = words.size();
+    bayes_risk_ = mbr->GetBayesRisk();
+    avg_conf_ = std::accumulate(conf.begin(), conf.end(), 0.0) / words.size();
+    ok_ = true;
+    delete mbr;
+  }
+
+  ~LatticeToCtmConfTask() {
+    delete clat_;  // in case it wasn't deleted.
+    if (!ok_) {
+      (*n_err_)++;
+      return;
+    }
+    *ctm_stream_ << ctm_.str();
+    KALDI_LOG << "For utterance " << key_ << ", Bayes Risk "
+              << bayes_risk_ << ", avg. confidence per-word "
+              << avg_conf_;
+    (*n_done_)++;
+    (*n_words_) += num_words_;
+    (*tot_bayes_risk_) += bayes_risk_;
+  }
+
+ private:
+  // Word-aligns *clat_ as lattice-align-words or lattice-align-words-lexicon
+  // would (with --output-error-lats=true).  Returns false if there was
+  // nothing to output.
+  bool WordAlign() {
+    CompactLattice aligned_clat;
+    bool ok;
+    if (word_boundary_info_ != NULL) {
+      int32 max_states = 0;
+      if (align_opts_.max_expand > 0)
+        max_states = 1000 + align_opts_.max_expand * clat_->NumStates();
+      ok = WordAlignLattice(*clat_, *tmodel_, *word_boundary_info_,
+                            max_states, &aligned_clat);
+    } else {
+      ok = WordAlignLatticeLexicon(*clat_, *tmodel_, *lexicon_info_,
+                                   align_opts_, &aligned_clat);
+    }
+    if (aligned_clat.Start() == fst::kNoStateId) {
+      KALDI_WARN << "Empty aligned lattice for " << key_
+                 << ", producing no output.";
+      return false;
+    }
+    if (!ok)
+      KALDI_WARN << "Lattice for " << key_ << " did not align correctly; "
+                 << "using partial lattice.";
+    TopSortCompactLatticeIfNeeded(&aligned_clat);
+    *clat_ = aligned_clat;
+    return true;
+  }
+
+  const MinimumBayesRiskOptions &mbr_opts_;
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  BaseFloat frame_shift_;
+  const TransitionModel *tmodel_;
+  const WordBoundaryInfo *word_boundary_info_;
+  const WordAlignLatticeLexiconInfo *lexicon_info_;
+  const WordAlignLatticeLexiconOpts &align_opts_;
+  std::string key_;
+  CompactLattice *clat_;  // The input lattice.  Owned locally.
+  bool use_one_best_;
+  std::vector<int32> one_best_;
+  bool use_times_;
+  std::vector<std::pair<BaseFloat, BaseFloat> > times_;
+  bool ok_;
+  // The output, which will be written to ctm_stream_ in the destructor.
+  std::ostringstream ctm_;
+  int32 num_words_;
+  BaseFloat bayes_risk_;
+  BaseFloat avg_conf_;
+  std::ostream *ctm_stream_;
+  int32 *n_done_;
+  int32 *n_words_;
+  int32 *n_err_;
+  BaseFloat *tot_bayes_risk_;
+};
+
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   try {
     using namespace kaldi;
@@ -43,7 +197,10 @@ int main(int argc, char *argv[]) {
         "program produces will be relative to the utterance-id; a standard\n"
         "ctm relative to the filename can be obtained using\n"
         "utils/convert_ctm.pl.  The times produced by this program will only\n"
-        "be meaningful if you do lattice-align-words on the input.  The\n"
+        "be meaningful if you do lattice-align-words on the input, or set\n"
+        "--word-boundary or --align-lexicon (plus --model), in which case this\n"
+        "program word-aligns the lattices itself, as lattice-align-words or\n"
+        "lattice-align-words-lexicon would, without writing them out.  The\n"
         "<1-best-rspecifier> could be the output of utils/int2sym.pl or\n"
         "nbest-to-linear.\n"
         "\n"
@@ -54,6 +211,9 @@ int main(int argc, char *argv[]) {
         " e.g.: lattice-to-ctm-conf --acoustic-scale=0.1 ark:1.lats 1.ctm\n"
         "   or: lattice-to-ctm-conf --acoustic-scale=0.1 --decode-mbr=false\\\n"
         "                                      ark:1.lats ark:1.1best 1.ctm\n"
+        "   or: lattice-to-ctm-conf --acoustic-scale=0.1 --num-threads=4 \\\n"
+        "          --word-boundary=data/lang/phones/word_boundary.int \\\n"
+        "          --model=final.mdl ark:1.lats 1.ctm\n"
         "See also: lattice-mbr-decode, nbest-to-ctm, lattice-arc-post,\n"
         " steps/get_ctm.sh, steps/get_train_ctm.sh and utils/convert_ctm.pl.\n";
 
@@ -72,6 +232,27 @@ int main(int argc, char *argv[]) {
     po.Register("frame-shift", &frame_shift, "Time in seconds between frames.");
     po.Register("confidence-digits", &confidence_digits, "Number of decimal digits for confidences in 'ctm'.");
 
+    std::string word_boundary_rxfilename, align_lexicon_rxfilename,
+        model_rxfilename;
+    int32 silence_label = 0;
+    po.Register("word-boundary", &word_boundary_rxfilename, "If set, "
+                "word-align the lattices using this word-boundary file "
+                "(as lattice-align-words) before MBR decoding.  Requires "
+                "--model.");
+    po.Register("align-lexicon", &align_lexicon_rxfilename, "If set, "
+                "word-align the lattices using this alignment lexicon "
+                "(as lattice-align-words-lexicon) before MBR decoding.  "
+                "Requires --model.");
+    po.Register("model", &model_rxfilename, "Transition model, used "
+                "with --word-boundary or --align-lexicon.");
+    po.Register("silence-label", &silence_label, "Numeric id of word symbol "
+                "that is to be used for silence arcs in the word-aligned "
+                "lattice (zero is OK); only used with --word-boundary.");
+    WordAlignLatticeLexiconOpts align_opts;
+    align_opts.Register(&po);
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+    sequencer_config.Register(&po);
+
 
     MinimumBayesRiskOptions mbr_opts;
     mbr_opts.Register(&po);
@@ -115,6 +296,35 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
+    if (!word_boundary_rxfilename.empty() && !align_lexicon_rxfilename.empty())
+      KALDI_ERR << "You cannot set both --word-boundary and --align-lexicon.";
+    TransitionModel tmodel;
+    WordBoundaryInfo *word_boundary_info = NULL;
+    WordAlignLatticeLexiconInfo *lexicon_info = NULL;
+    if (!word_boundary_rxfilename.empty() || !align_lexicon_rxfilename.empty()) {
+      if (model_rxfilename.empty())
+        KALDI_ERR << "--word-boundary and --align-lexicon require --model.";
+      ReadKaldiObject(model_rxfilename, &tmodel);
+    }
+    if (!word_boundary_rxfilename.empty()) {
+      WordBoundaryInfoNewOpts word_boundary_opts;
+      word_boundary_opts.silence_label = silence_label;
+      word_boundary_opts.partial_word_label = align_opts.partial_word_label;
+      word_boundary_opts.reorder = align_opts.reorder;
+      word_boundary_info = new WordBoundaryInfo(word_boundary_opts,
+                                                word_boundary_rxfilename);
+    } else if (!align_lexicon_rxfilename.empty()) {
+      std::vector<std::vector<int32> > lexicon;
+      bool binary_in;
+      Input ki(align_lexicon_rxfilename, &binary_in);
+      KALDI_ASSERT(!binary_in && "Not expecting binary file for lexicon");
+      if (!ReadLexiconForWordAlign(ki.Stream(), &lexicon)) {
+        KALDI_ERR << "Error reading alignment lexicon from "
+                  << align_lexicon_rxfilename;
+      }
+      lexicon_info = new WordAlignLatticeLexiconInfo(lexicon);
+    }
+
     // Read as compact lattice.
     SequentialCompactLatticeReader clat_reader(lats_rspecifier);
 
@@ -126,62 +336,48 @@ int main(int argc, char *argv[]) {
     // the #digits after the decimal point.
     ko.Stream().precision(confidence_digits);
 
-    int32 n_done = 0, n_words = 0;
+    int32 n_done = 0, n_words = 0, n_err = 0;
     BaseFloat tot_bayes_risk = 0.0;
 
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      CompactLattice clat = clat_reader.Value();
-      clat_reader.FreeCurrent();
-      fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &clat);
-
-      MinimumBayesRisk *mbr = NULL;
-
-      if (one_best_rspecifier == "") {
-        mbr = new MinimumBayesRisk(clat, mbr_opts);
-      } else {
-        // check,
-        if (!one_best_reader.HasKey(key)) {
-          KALDI_WARN << "No 1-best present for utterance " << key;
-          continue;
-        }
-        if (times_rspecifier != "" && !times_reader.HasKey(key)) {
-          KALDI_WARN << "No 'times' present for utterance " << key;
-          continue;
+    {
+      TaskSequencer<LatticeToCtmConfTask> sequencer(sequencer_config);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        std::vector<int32> one_best;
+        std::vector<std::pair<BaseFloat, BaseFloat> > times;
+        if (one_best_rspecifier != "") {
+          // check,
+          if (!one_best_reader.HasKey(key)) {
+            KALDI_WARN << "No 1-best present for utterance " << key;
+            continue;
+          }
+          if (times_rspecifier != "" && !times_reader.HasKey(key)) {
+            KALDI_WARN << "No 'times' present for utterance " << key;
+            continue;
+          }
+          one_best = one_best_reader.Value(key);
+          if (times_rspecifier != "")
+            times = times_reader.Value(key);
         }
-        // get the 'mbr' decoding object,
-        if (times_rspecifier == "") {
-          const std::vector<int32> &one_best = one_best_reader.Value(key);
-          mbr = new MinimumBayesRisk(clat, one_best, mbr_opts); // no 'times',
-        } else {
-          // with initial 'times' of the bins,
-          const std::vector<int32> &one_best = one_best_reader.Value(key);
-          const std::vector<std::pair<BaseFloat,BaseFloat> > &times = times_reader.Value(key);
-          mbr = new MinimumBayesRisk(clat, one_best, times, mbr_opts);
-        }
-      }
-
-      const std::vector<BaseFloat> &conf = mbr->GetOneBestConfidences();
-      const std::vector<int32> &words = mbr->GetOneBest();
-      const std::vector<std::pair<BaseFloat, BaseFloat> > &times =
-          mbr->GetOneBestTimes();
-      KALDI_ASSERT(conf.size() == words.size() && words.size() == times.size());
-      for (size_t i = 0; i < words.size(); i++) {
-        KALDI_ASSERT(words[i] != 0 || mbr_opts.print_silence); // Should not have epsilons.
-        ko.Stream() << key << " 1 " << (frame_shift * times[i].first) << ' '
-                    << (frame_shift * (times[i].second-times[i].first)) << ' '
-                    << words[i] << ' ' << conf[i] << '\n';
+        // will give ownership to "task" below.
+        CompactLattice *clat = new CompactLattice(clat_reader.Value());
+        clat_reader.FreeCurrent();
+        LatticeToCtmConfTask *task = new LatticeToCtmConfTask(
+            mbr_opts, lm_scale, acoustic_scale, frame_shift, &tmodel,
+            word_boundary_info, lexicon_info, align_opts, key, clat,
+            one_best_rspecifier != "", one_best, times_rspecifier != "",
+            times, &(ko.Stream()), &n_done, &n_words, &n_err,
+            &tot_bayes_risk);
+        sequencer.Run(task);
       }
-      KALDI_LOG << "For utterance " << key << ", Bayes Risk "
-                << mbr->GetBayesRisk() << ", avg. confidence per-word "
-                << std::accumulate(conf.begin(),conf.end(),0.0) / words.size();
-      n_done++;
-      n_words += mbr->GetOneBest().size();
-      tot_bayes_risk += mbr->GetBayesRisk();
-      delete mbr;
+      sequencer.Wait();
     }
+    delete word_boundary_info;
+    delete lexicon_info;
 
     KALDI_LOG << "Done " << n_done << " lattices.";
+    if (n_err != 0)
+      KALDI_WARN << n_err << " lattices could not be word-aligned.";
     KALDI_LOG << "Overall average Bayes Risk per sentence is "
               << (tot_bayes_risk / n_done) << " and per word, "
               << (tot_bayes_risk / n_words);
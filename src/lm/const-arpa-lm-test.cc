@@ -0,0 +1,152 @@
+// lm/const-arpa-lm-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <set>
+
+#include "base/kaldi-common.h"
+#include "lm/const-arpa-lm.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+
+// Writes a random ARPA language model with integer words to <arpa_filename>.
+// The words are 1 (<s>), 2 (</s>), 3 (<unk>) and 4 ... num_words - 1.  Each
+// n-gram of order > 1 extends one of the (n-1)-grams.
+static void GenerateArpa(int32 order, int32 num_words,
+                         const std::string &arpa_filename) {
+  std::vector<std::set<std::vector<int32> > > ngrams(order);
+  for (int32 w = 1; w < num_words; w++)
+    ngrams[0].insert(std::vector<int32>(1, w));
+  for (int32 n = 1; n < order; n++) {
+    int32 num_ngrams = RandInt(1, 4 * num_words);
+    for (int32 i = 0; i < num_ngrams; i++) {
+      std::set<std::vector<int32> >::const_iterator iter = ngrams[n-1].begin();
+      std::advance(iter, RandInt(0, ngrams[n-1].size() - 1));
+      std::vector<int32> ngram(*iter);
+      if (ngram.back() == 2) continue;  // nothing follows </s>.
+      ngram.push_back(RandInt(2, num_words - 1));  // not <s>.
+      ngrams[n].insert(ngram);
+    }
+  }
+  Output ko(arpa_filename, false);
+  std::ostream &os = ko.Stream();
+  os << "\n\\data\\\n";
+  for (int32 n = 0; n < order; n++)
+    os << "ngram " << (n + 1) << "=" << ngrams[n].size() << "\n";
+  for (int32 n = 0; n < order; n++) {
+    os << "\n\\" << (n + 1) << "-grams:\n";
+    for (std::set<std::vector<int32> >::const_iterator iter =
+             ngrams[n].begin(); iter != ngrams[n].end(); ++iter) {
+      const std::vector<int32> &ngram = *iter;
+      float logprob = (ngram.size() == 1 && ngram[0] == 1 ? -99.0 :
+                       -5.0 * RandUniform());
+      os << logprob;
+      for (size_t i = 0; i < ngram.size(); i++)
+        os << (i == 0 ? '\t' : ' ') << ngram[i];
+      if (n + 1 < order && ngram.back() != 2)
+        os << '\t' << (-2.0 * RandUniform());
+      os << "\n";
+    }
+  }
+  os << "\n\\end\\\n";
+}
+
+static std::vector<int32> RandWordSequence(int32 max_length, int32 num_words) {
+  std::vector<int32> ans(RandInt(0, max_length));
+  for (size_t i = 0; i < ans.size(); i++)
+    ans[i] = RandInt(1, num_words + 1);  // may be out of vocabulary.
+  return ans;
+}
+
+void TestConstArpaLmCache() {
+  int32 order = RandInt(1, 4), num_words = RandInt(5, 20);
+  GenerateArpa(order, num_words, "tmp.arpa");
+  ArpaParseOptions options;
+  options.bos_symbol = 1;
+  options.eos_symbol = 2;
+  options.unk_symbol = (RandInt(0, 1) == 0 ? 3 : -1);
+  BuildConstArpaLm(options, "tmp.arpa", "tmp.carpa");
+  ConstArpaLm lm;
+  ReadKaldiObject("tmp.carpa", &lm);
+
+  // A small cache, so that there are collisions.
+  ConstArpaLmCache cache(lm, RandInt(1, 64));
+  for (int32 i = 0; i < 1000; i++) {
+    std::vector<int32> hist = RandWordSequence(order + 1, num_words),
+        words = RandWordSequence(10, num_words);
+    // Single queries.
+    for (size_t j = 0; j < words.size(); j++) {
+      int32 next_hist_length;
+      float logprob = lm.GetNgramLogprob(words[j], hist),
+          cached_logprob = cache.GetNgramLogprob(words[j], hist,
+                                                 &next_hist_length);
+      KALDI_ASSERT(logprob == cached_logprob);
+      std::vector<int32> next_hist(hist);
+      next_hist.push_back(words[j]);
+      next_hist.erase(next_hist.begin(), next_hist.end() - next_hist_length);
+      KALDI_ASSERT(next_hist.size() < order && lm.HistoryStateExists(next_hist));
+      if (next_hist.size() + 1 < order && next_hist.size() <= hist.size()) {
+        // The next longer suffix, if it could be a history state, isn't one.
+        std::vector<int32> longer_hist(hist.end() - next_hist.size(),
+                                       hist.end());
+        longer_hist.push_back(words[j]);
+        KALDI_ASSERT(!lm.HistoryStateExists(longer_hist));
+      }
+    }
+    // Batched queries.
+    std::vector<float> logprobs, cached_logprobs;
+    lm.GetNgramLogprobs(words, hist, &logprobs);
+    cache.GetNgramLogprobs(words, hist, &cached_logprobs);
+    KALDI_ASSERT(logprobs.size() == words.size() &&
+                 cached_logprobs.size() == words.size());
+    for (size_t j = 0; j < words.size(); j++) {
+      KALDI_ASSERT(logprobs[j] == lm.GetNgramLogprob(words[j], hist));
+      KALDI_ASSERT(cached_logprobs[j] == logprobs[j]);
+    }
+  }
+  KALDI_LOG << "Cache hit rate was "
+            << (cache.NumHits() / static_cast<double>(cache.NumQueries()));
+
+  // Check that the FST gives the same arcs with and without the cache.
+  ConstArpaLmDeterministicFst fst(lm), cached_fst(&cache);
+  for (int32 i = 0; i < 100; i++) {
+    std::vector<int32> words = RandWordSequence(10, num_words);
+    fst::StdArc::StateId s = fst.Start(), cached_s = cached_fst.Start();
+    for (size_t j = 0; j < words.size(); j++) {
+      fst::StdArc arc, cached_arc;
+      bool ans = fst.GetArc(s, words[j], &arc),
+          cached_ans = cached_fst.GetArc(cached_s, words[j], &cached_arc);
+      KALDI_ASSERT(ans == cached_ans);
+      if (!ans) break;
+      KALDI_ASSERT(arc.weight.Value() == cached_arc.weight.Value());
+      s = arc.nextstate;
+      cached_s = cached_arc.nextstate;
+      KALDI_ASSERT(fst.Final(s).Value() == cached_fst.Final(cached_s).Value());
+    }
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (int32 i = 0; i < 20; i++)
+    kaldi::TestConstArpaLmCache();
+  unlink("tmp.arpa");
+  unlink("tmp.carpa");
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -780,6 +780,84 @@ float ConstArpaLm::GetNgramLogprob(const int32 word,
   return GetNgramLogprobRecurse(mapped_word, mapped_hist);
 }
 
+void ConstArpaLm::GetNgramLogprobs(const std::vector<int32>& words,
+                                   const std::vector<int32>& hist,
+                                   std::vector<float>* logprobs) const {
+  KALDI_ASSERT(initialized_);
+  int32 num_words = words.size();
+  logprobs->resize(num_words);
+
+  // Maps the history and words as in GetNgramLogprob().
+  std::vector<int32> mapped_hist(hist);
+  while (mapped_hist.size() >= ngram_order_) {
+    mapped_hist.erase(mapped_hist.begin(), mapped_hist.begin() + 1);
+  }
+  std::vector<int32> mapped_words(words);
+  if (unk_symbol_ != -1) {
+    for (int32 i = 0; i < num_words; ++i) {
+      KALDI_ASSERT(mapped_words[i] >= 0);
+      if (mapped_words[i] >= num_words_ ||
+          unigram_states_[mapped_words[i]] == NULL) {
+        mapped_words[i] = unk_symbol_;
+      }
+    }
+    for (int32 i = 0; i < mapped_hist.size(); ++i) {
+      KALDI_ASSERT(mapped_hist[i] >= 0);
+      if (mapped_hist[i] >= num_words_ ||
+          unigram_states_[mapped_hist[i]] == NULL) {
+        mapped_hist[i] = unk_symbol_;
+      }
+    }
+  }
+
+  // <pending> contains the indexes of the words we have not found yet, and
+  // <backoff_logprobs> the backoff log-probs of the history states we have
+  // backed off from. We add the backoff log-probs in the same order as
+  // GetNgramLogprobRecurse() does, so that the results are identical.
+  std::vector<int32> pending(num_words);
+  for (int32 i = 0; i < num_words; ++i) pending[i] = i;
+  std::vector<float> backoff_logprobs;
+  std::vector<int32> cur_hist(mapped_hist);
+  while (true) {
+    int32* state = (cur_hist.empty() ? NULL : GetLmState(cur_hist));
+    size_t num_pending = 0;
+    for (size_t j = 0; j < pending.size(); ++j) {
+      int32 i = pending[j], word = mapped_words[i];
+      float logprob;
+      if (cur_hist.empty()) {
+        // Unigram case.
+        if (word >= num_words_ || unigram_states_[word] == NULL) {
+          logprob = -std::numeric_limits<float>::infinity();
+        } else {
+          Int32AndFloat logprob_i(*unigram_states_[word]);
+          logprob = logprob_i.f;
+        }
+      } else {
+        int32 child_info;
+        int32* child_lm_state = NULL;
+        if (state == NULL || !GetChildInfo(word, state, &child_info)) {
+          pending[num_pending++] = i;
+          continue;
+        }
+        DecodeChildInfo(child_info, state, &child_lm_state, &logprob);
+      }
+      for (size_t k = backoff_logprobs.size(); k > 0; --k)
+        logprob = backoff_logprobs[k - 1] + logprob;
+      (*logprobs)[i] = logprob;
+    }
+    pending.resize(num_pending);
+    if (pending.empty()) break;
+    KALDI_ASSERT(!cur_hist.empty());
+    if (state != NULL) {
+      Int32AndFloat backoff_logprob_i(*(state + 1));
+      backoff_logprobs.push_back(backoff_logprob_i.f);
+    } else {
+      backoff_logprobs.push_back(0.0);
+    }
+    cur_hist.erase(cur_hist.begin(), cur_hist.begin() + 1);
+  }
+}
+
 float ConstArpaLm::GetNgramLogprobRecurse(
     const int32 word, const std::vector<int32>& hist) const {
   KALDI_ASSERT(initialized_);
@@ -1010,8 +1088,138 @@ void ConstArpaLm::WriteArpa(std::ostream &os) const {
   os << std::endl << "\\end\\" << std::endl;
 }
 
+ConstArpaLmCache::ConstArpaLmCache(const ConstArpaLm& lm, int32 cache_size)
+    : lm_(lm), max_hist_length_(lm.NgramOrder() - 1),
+      use_cache_(lm.NgramOrder() <= kMaxOrder),
+      num_queries_(0), num_hits_(0) {
+  KALDI_ASSERT(lm.Initialized() && cache_size > 0);
+  size_t size = 1;
+  while (size < static_cast<size_t>(cache_size)) size *= 2;
+  mask_ = size - 1;
+  Entry empty_entry;
+  empty_entry.hist_length = -1;
+  if (use_cache_)
+    entries_.resize(size, empty_entry);
+}
+
+ConstArpaLmCache::Entry* ConstArpaLmCache::Lookup(
+    const int32 word, const std::vector<int32>& hist, size_t hist_begin,
+    bool* found) {
+  size_t hist_length = hist.size() - hist_begin;
+  size_t hash = word;
+  for (size_t i = hist_begin; i < hist.size(); ++i)
+    hash = hash * 7853 + hist[i];
+  Entry* entry = &(entries_[(hash + hist_length) & mask_]);
+  *found = false;
+  if (entry->hist_length != static_cast<int32>(hist_length) ||
+      entry->ngram[hist_length] != word)
+    return entry;
+  for (size_t i = 0; i < hist_length; ++i)
+    if (entry->ngram[i] != hist[hist_begin + i])
+      return entry;
+  *found = true;
+  return entry;
+}
+
+void ConstArpaLmCache::Store(const int32 word, const std::vector<int32>& hist,
+                             size_t hist_begin, float logprob, Entry* entry) {
+  size_t hist_length = hist.size() - hist_begin;
+  entry->hist_length = hist_length;
+  for (size_t i = 0; i < hist_length; ++i)
+    entry->ngram[i] = hist[hist_begin + i];
+  entry->ngram[hist_length] = word;
+  entry->logprob = logprob;
+  entry->next_hist_length = -1;
+}
+
+int32 ConstArpaLmCache::NextHistoryLength(
+    const int32 word, const std::vector<int32>& hist) const {
+  // This is the same as in ConstArpaLmDeterministicFst::GetArc().
+  std::vector<int32> wseq(hist);
+  wseq.push_back(word);
+  while (wseq.size() >= lm_.NgramOrder()) {
+    wseq.erase(wseq.begin(), wseq.begin() + 1);
+  }
+  while (!lm_.HistoryStateExists(wseq)) {
+    KALDI_ASSERT(wseq.size() > 0);
+    wseq.erase(wseq.begin(), wseq.begin() + 1);
+  }
+  return wseq.size();
+}
+
+float ConstArpaLmCache::GetNgramLogprob(const int32 word,
+                                        const std::vector<int32>& hist,
+                                        int32* next_hist_length) {
+  num_queries_++;
+  if (!use_cache_) {
+    if (next_hist_length != NULL)
+      *next_hist_length = NextHistoryLength(word, hist);
+    return lm_.GetNgramLogprob(word, hist);
+  }
+  size_t hist_begin = (hist.size() > max_hist_length_ ?
+                       hist.size() - max_hist_length_ : 0);
+  bool found;
+  Entry* entry = Lookup(word, hist, hist_begin, &found);
+  if (found) {
+    num_hits_++;
+  } else {
+    Store(word, hist, hist_begin, lm_.GetNgramLogprob(word, hist), entry);
+  }
+  if (next_hist_length != NULL) {
+    if (entry->next_hist_length == -1)
+      entry->next_hist_length = NextHistoryLength(word, hist);
+    *next_hist_length = entry->next_hist_length;
+  }
+  return entry->logprob;
+}
+
+void ConstArpaLmCache::GetNgramLogprobs(const std::vector<int32>& words,
+                                        const std::vector<int32>& hist,
+                                        std::vector<float>* logprobs) {
+  num_queries_ += words.size();
+  if (!use_cache_) {
+    lm_.GetNgramLogprobs(words, hist, logprobs);
+    return;
+  }
+  size_t hist_begin = (hist.size() > max_hist_length_ ?
+                       hist.size() - max_hist_length_ : 0);
+  logprobs->resize(words.size());
+  std::vector<int32> missing_words;
+  std::vector<size_t> missing_indexes;
+  for (size_t i = 0; i < words.size(); ++i) {
+    bool found;
+    Entry* entry = Lookup(words[i], hist, hist_begin, &found);
+    if (found) {
+      num_hits_++;
+      (*logprobs)[i] = entry->logprob;
+    } else {
+      missing_words.push_back(words[i]);
+      missing_indexes.push_back(i);
+    }
+  }
+  if (missing_words.empty()) return;
+  std::vector<float> missing_logprobs;
+  lm_.GetNgramLogprobs(missing_words, hist, &missing_logprobs);
+  for (size_t j = 0; j < missing_words.size(); ++j) {
+    bool found;
+    Entry* entry = Lookup(missing_words[j], hist, hist_begin, &found);
+    if (!found)  // (it may be there if the word was repeated.)
+      Store(missing_words[j], hist, hist_begin, missing_logprobs[j], entry);
+    (*logprobs)[missing_indexes[j]] = missing_logprobs[j];
+  }
+}
+
+ConstArpaLmDeterministicFst::ConstArpaLmDeterministicFst(
+    const ConstArpaLm& lm) : lm_(lm), cache_(NULL) {
+  // Creates a history state for <s>.
+  std::vector<Label> bos_state(1, lm_.BosSymbol());
+  state_to_wseq_.push_back(bos_state);
+  wseq_to_state_[bos_state] = 0;
+  start_state_ = 0;
+}
+
 ConstArpaLmDeterministicFst::ConstArpaLmDeterministicFst(
-    const ConstArpaLm& lm) : lm_(lm) {
+    ConstArpaLmCache* cache) : lm_(cache->Lm()), cache_(cache) {
   // Creates a history state for <s>.
   std::vector<Label> bos_state(1, lm_.BosSymbol());
   state_to_wseq_.push_back(bos_state);
@@ -1023,7 +1231,9 @@ fst::StdArc::Weight ConstArpaLmDeterministicFst::Final(StateId s) {
   // At this point, we should have created the state.
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
   const std::vector<Label>& wseq = state_to_wseq_[s];
-  float logprob = lm_.GetNgramLogprob(lm_.EosSymbol(), wseq);
+  float logprob = (cache_ != NULL ?
+                   cache_->GetNgramLogprob(lm_.EosSymbol(), wseq) :
+                   lm_.GetNgramLogprob(lm_.EosSymbol(), wseq));
   return Weight(-logprob);
 }
 
@@ -1033,6 +1243,17 @@ bool ConstArpaLmDeterministicFst::GetArc(StateId s,
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
   std::vector<Label> wseq = state_to_wseq_[s];
 
+  if (cache_ != NULL) {
+    int32 next_hist_length;
+    float logprob = cache_->GetNgramLogprob(ilabel, wseq, &next_hist_length);
+    if (logprob == -std::numeric_limits<float>::infinity()) {
+      return false;
+    }
+    wseq.push_back(ilabel);
+    wseq.erase(wseq.begin(), wseq.end() - next_hist_length);
+    return GetArcForHistory(ilabel, logprob, wseq, oarc);
+  }
+
   float logprob = lm_.GetNgramLogprob(ilabel, wseq);
   if (logprob == -std::numeric_limits<float>::infinity()) {
     return false;
@@ -1049,7 +1270,12 @@ bool ConstArpaLmDeterministicFst::GetArc(StateId s,
     KALDI_ASSERT(wseq.size() > 0);
     wseq.erase(wseq.begin(), wseq.begin() + 1);
   }
+  return GetArcForHistory(ilabel, logprob, wseq, oarc);
+}
 
+bool ConstArpaLmDeterministicFst::GetArcForHistory(
+    Label ilabel, float logprob, const std::vector<Label>& wseq,
+    fst::StdArc* oarc) {
   std::pair<const std::vector<Label>, StateId> wseq_state_pair(
       wseq, static_cast<Label>(state_to_wseq_.size()));
 
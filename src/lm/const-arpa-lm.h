@@ -270,6 +270,14 @@ class ConstArpaLm {
   // words to <unk>, if <unk> is defined, and then calls GetNgramLogprobRecurse.
   float GetNgramLogprob(const int32 word, const std::vector<int32>& hist) const;
 
+  // As GetNgramLogprob(), but for several words following the same history:
+  // sets (*logprobs)[i] to the log-prob of words[i]. This is faster than
+  // calling GetNgramLogprob() for each word, since the history state (and each
+  // backed-off history state) is only looked up once for all the words.
+  void GetNgramLogprobs(const std::vector<int32>& words,
+                        const std::vector<int32>& hist,
+                        std::vector<float>* logprobs) const;
+
   // Returns true if the history word sequence <hist> has successor, which means
   // <hist> will be a state in the FST format language model.
   bool HistoryStateExists(const std::vector<int32>& hist) const;
@@ -386,9 +394,80 @@ class ConstArpaLm {
   int32* lm_states_;
 };
 
+/**
+ ConstArpaLmCache is a direct-mapped cache in front of a ConstArpaLm, for the
+ queries made in lattice rescoring, where the same (history, word) pairs are
+ looked up many times within a lattice and across lattices. Each entry holds the
+ n-gram, its log-probability and the length of the history state that follows
+ it, so a hit saves both the backoff recursion in GetNgramLogprob() and the
+ search for the next history state in ConstArpaLmDeterministicFst::GetArc(). On
+ a collision the old entry is overwritten.
+
+ The cache is not tied to the state numbering of any FST, so it can be kept
+ across lattices. It is not thread-safe: use one per thread.
+ */
+class ConstArpaLmCache {
+ public:
+  // <cache_size> is rounded up to a power of two. N-grams longer than
+  // kMaxOrder are not cached (but still work).
+  explicit ConstArpaLmCache(const ConstArpaLm& lm, int32 cache_size = 65536);
+
+  const ConstArpaLm& Lm() const { return lm_; }
+
+  // Returns the same as lm.GetNgramLogprob(word, hist). If <next_hist_length>
+  // is not NULL, it is set to the number of words in the history state that
+  // follows "hist word", i.e. the longest suffix of it with fewer than
+  // lm.NgramOrder() words for which lm.HistoryStateExists().
+  float GetNgramLogprob(const int32 word, const std::vector<int32>& hist,
+                        int32* next_hist_length = NULL);
+
+  // Returns the same as lm.GetNgramLogprobs(words, hist, logprobs). The words
+  // that are not in the cache are looked up together.
+  void GetNgramLogprobs(const std::vector<int32>& words,
+                        const std::vector<int32>& hist,
+                        std::vector<float>* logprobs);
+
+  int64 NumQueries() const { return num_queries_; }
+  int64 NumHits() const { return num_hits_; }
+
+ private:
+  static const int32 kMaxOrder = 6;
+
+  struct Entry {
+    int32 hist_length;  // -1 if the entry is unused.
+    int32 ngram[kMaxOrder];  // The history words, then the word.
+    float logprob;
+    int32 next_hist_length;  // -1 if not worked out yet.
+  };
+
+  // Returns the entry where the n-gram "hist[hist_begin...] word" would be
+  // stored, and sets <found> to true if it is there.
+  Entry* Lookup(const int32 word, const std::vector<int32>& hist,
+                size_t hist_begin, bool* found);
+
+  // Stores the n-gram in <entry>.
+  void Store(const int32 word, const std::vector<int32>& hist,
+             size_t hist_begin, float logprob, Entry* entry);
+
+  // Works out the length of the history state that follows "hist word".
+  int32 NextHistoryLength(const int32 word,
+                          const std::vector<int32>& hist) const;
+
+  const ConstArpaLm& lm_;
+  // lm_.NgramOrder() - 1; longer histories are truncated to this many words,
+  // as in GetNgramLogprob().
+  size_t max_hist_length_;
+  bool use_cache_;  // false if lm_.NgramOrder() > kMaxOrder.
+  size_t mask_;
+  std::vector<Entry> entries_;
+  int64 num_queries_;
+  int64 num_hits_;
+};
+
 /**
  This class wraps a ConstArpaLm format language model with the interface defined
- in DeterministicOnDemandFst.
+ in DeterministicOnDemandFst.  If it is given a ConstArpaLmCache, the LM queries
+ go through the cache.
  */
 class ConstArpaLmDeterministicFst
   : public fst::DeterministicOnDemandFst<fst::StdArc> {
@@ -399,6 +478,9 @@ class ConstArpaLmDeterministicFst
 
   explicit ConstArpaLmDeterministicFst(const ConstArpaLm& lm);
 
+  // This version uses (but does not own) <cache>, which must outlive it.
+  explicit ConstArpaLmDeterministicFst(ConstArpaLmCache* cache);
+
   // We cannot use "const" because the pure virtual function in the interface is
   // not const.
   virtual StateId Start() { return start_state_; }
@@ -410,12 +492,18 @@ class ConstArpaLmDeterministicFst
   virtual bool GetArc(StateId s, Label ilabel, fst::StdArc* oarc);
 
  private:
+  // Creates the arc for <ilabel>, with log-prob <logprob>, to the state for the
+  // history <wseq> (adding the state if it does not exist yet).
+  bool GetArcForHistory(Label ilabel, float logprob,
+                        const std::vector<Label>& wseq, fst::StdArc* oarc);
+
   typedef unordered_map<std::vector<Label>,
                         StateId, VectorHasher<Label> > MapType;
   StateId start_state_;
   MapType wseq_to_state_;
   std::vector<std::vector<Label> > state_to_wseq_;
   const ConstArpaLm& lm_;
+  ConstArpaLmCache* cache_;  // NULL if not using a cache.
 };
 
 // Reads in an Arpa format language model and converts it into ConstArpaLm
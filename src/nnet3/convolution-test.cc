@@ -401,6 +401,8 @@ void UnitTestTimeHeightConvolutionCompile() {
     GetRandomConvolutionIndexes(conv_model, &input_indexes, &output_indexes);
 
     ConvolutionComputationOptions opts;
+    // exercise the direct CPU implementation half the time.
+    opts.use_direct_cpu = (RandInt(0, 1) == 0);
     ConvolutionComputation computation;
     std::vector<Index> input_indexes_modified, output_indexes_modified;
     CompileConvolutionComputation(conv_model, input_indexes, output_indexes,
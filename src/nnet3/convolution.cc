@@ -308,6 +308,11 @@ void ConvolutionComputation::Write(std::ostream &os, bool binary) const {
     WriteToken(os, binary, "<HeightMap>");
     WriteIntegerVector(os, binary, step.height_map);
   }
+  if (use_direct_cpu) {
+    // we only write this if it's true, for back compatibility.
+    WriteToken(os, binary, "<UseDirectCpu>");
+    WriteBasicType(os, binary, use_direct_cpu);
+  }
   WriteToken(os, binary, "</ConvComputation>");
 }
 
@@ -340,7 +345,16 @@ void ConvolutionComputation::Read(std::istream &is, bool binary) {
     ExpectToken(is, binary, "<HeightMap>");
     ReadIntegerVector(is, binary, &step.height_map);
   }
-  ExpectToken(is, binary, "</ConvComputation>");
+  std::string token;
+  ReadToken(is, binary, &token);
+  if (token == "<UseDirectCpu>") {
+    ReadBasicType(is, binary, &use_direct_cpu);
+    ReadToken(is, binary, &token);
+  } else {
+    use_direct_cpu = false;
+  }
+  if (token != "</ConvComputation>")
+    KALDI_ERR << "Expected token </ConvComputation>, got " << token;
   ComputeDerived();
   Check();
 }
@@ -440,6 +454,211 @@ void ConvolutionComputation::Check() const {
 }
 
 
+/*
+   The functions below implement the 'direct' CPU version of the convolution,
+   which is used if cc.use_direct_cpu is true and we are not using a GPU.
+
+   The regular implementation copies (for each step) the input to a temporary
+   matrix with num-cols equal to step.height_map.size() * num_filters_in, and
+   then does one big matrix multiply with that temporary matrix reshaped to
+   have num_filters_in * (step.height_map.size() / height_out) columns.  On CPU,
+   the copy (which makes several copies of each input element) tends to
+   dominate.  Notice that for a particular output height h, the elements of
+   step.height_map that correspond to it are normally a contiguous run of input
+   heights (e.g. h-1, h, h+1 for a 3x3 kernel), which means that the
+   corresponding part of the temporary matrix is just a column-range of the
+   input matrix.  So instead of copying, we do one matrix multiply for each
+   such run, directly on (row-strided) sub-matrices of the input and output.
+   Runs are broken where height_map has -1's (zero-padding) or is not
+   contiguous.  We process the rows in blocks so that the part of the input
+   that we are working on stays in cache while we go over the output heights.
+*/
+
+// This struct represents a contiguous run of elements of
+// step.height_map that belong to the same output height.
+struct DirectConvolutionRun {
+  int32 height_out;  // the output height-index h, 0 <= h < cc.height_out.
+  int32 param_col;   // column offset of this run in the params, relative to
+                     // step.params_start_col.
+  int32 input_col;   // first input column that this run uses.
+  int32 num_cols;    // number of columns in this run (a multiple of
+                     // num_filters_in).
+};
+
+// Works out the contiguous runs for the direct CPU convolution, for
+// one step of the computation.
+static void GetDirectConvolutionRuns(
+    const ConvolutionComputation &cc,
+    const ConvolutionComputation::ConvolutionStep &step,
+    std::vector<DirectConvolutionRun> *runs) {
+  runs->clear();
+  int32 height_out = cc.height_out,
+      num_filters_in = cc.num_filters_in,
+      height_map_size = step.height_map.size();
+  KALDI_ASSERT(height_map_size % height_out == 0);
+  int32 blocks_per_height = height_map_size / height_out;
+  for (int32 h = 0; h < height_out; h++) {
+    const int32 *this_map = &(step.height_map[h * blocks_per_height]);
+    int32 b = 0;
+    while (b < blocks_per_height) {
+      if (this_map[b] == -1) {
+        b++;
+        continue;
+      }
+      int32 b_end = b + 1;
+      while (b_end < blocks_per_height &&
+             this_map[b_end] == this_map[b_end - 1] + 1)
+        b_end++;
+      DirectConvolutionRun run;
+      run.height_out = h;
+      run.param_col = b * num_filters_in;
+      run.input_col = this_map[b] * num_filters_in;
+      run.num_cols = (b_end - b) * num_filters_in;
+      runs->push_back(run);
+      b = b_end;
+    }
+  }
+}
+
+// Returns the number of rows that we process at a time in the direct
+// convolution; it's chosen so that the data we're working on (about
+// 256KB) stays in the cache.
+static int32 DirectConvolutionBlockRows(int32 input_cols,
+                                        int32 output_cols) {
+  const int32 kBlockFloats = 65536;
+  return std::max<int32>(1, kBlockFloats / (input_cols + output_cols));
+}
+
+// Returns true if we should use the direct CPU implementation.
+static bool UseDirectCpu(const ConvolutionComputation &cc) {
+  if (!cc.use_direct_cpu)
+    return false;
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    return false;
+#endif
+  return true;
+}
+
+// Direct version of ConvolveForward(); the input is assumed to have already
+// been reshaped, so input.NumRows() == cc.num_t_in * cc.num_images.
+static void ConvolveForwardDirect(
+    const ConvolutionComputation &cc,
+    const MatrixBase<BaseFloat> &input,
+    const MatrixBase<BaseFloat> &params,
+    MatrixBase<BaseFloat> *output) {
+  int32 output_rows = output->NumRows(),
+      num_filters_out = cc.num_filters_out,
+      block_rows = DirectConvolutionBlockRows(input.NumCols(),
+                                              output->NumCols());
+  int32 num_steps = cc.steps.size();
+  std::vector<DirectConvolutionRun> runs;
+  Matrix<BaseFloat> packed_params;
+  for (int32 s = 0; s < num_steps; s++) {
+    const ConvolutionComputation::ConvolutionStep &step = cc.steps[s];
+    GetDirectConvolutionRuns(cc, step, &runs);
+    int32 param_cols = step.height_map.size() / cc.height_out *
+        cc.num_filters_in;
+    // 'packed_params' is the transpose of the relevant part of the
+    // parameters, stored contiguously; each run uses a row-range of it.  It is
+    // reused for all output heights and all row-blocks.
+    packed_params.Resize(param_cols, num_filters_out, kUndefined);
+    packed_params.CopyFromMat(params.ColRange(step.params_start_col,
+                                              param_cols), kTrans);
+    SubMatrix<BaseFloat> input_part(input,
+                                    step.input_time_shift * cc.num_images,
+                                    output_rows, 0, input.NumCols());
+    for (int32 r = 0; r < output_rows; r += block_rows) {
+      int32 this_num_rows = std::min<int32>(block_rows, output_rows - r);
+      for (size_t i = 0; i < runs.size(); i++) {
+        const DirectConvolutionRun &run = runs[i];
+        SubMatrix<BaseFloat> input_block(input_part, r, this_num_rows,
+                                         run.input_col, run.num_cols),
+            output_block(*output, r, this_num_rows,
+                         run.height_out * num_filters_out, num_filters_out);
+        output_block.AddMatMat(1.0, input_block, kNoTrans,
+                               packed_params.RowRange(run.param_col,
+                                                      run.num_cols),
+                               kNoTrans, 1.0);
+      }
+    }
+  }
+}
+
+// Direct version of ConvolveBackwardData(); see ConvolveForwardDirect().
+static void ConvolveBackwardDataDirect(
+    const ConvolutionComputation &cc,
+    const MatrixBase<BaseFloat> &params,
+    const MatrixBase<BaseFloat> &output_deriv,
+    MatrixBase<BaseFloat> *input_deriv) {
+  int32 output_rows = output_deriv.NumRows(),
+      num_filters_out = cc.num_filters_out,
+      block_rows = DirectConvolutionBlockRows(input_deriv->NumCols(),
+                                              output_deriv.NumCols());
+  int32 num_steps = cc.steps.size();
+  std::vector<DirectConvolutionRun> runs;
+  for (int32 s = 0; s < num_steps; s++) {
+    const ConvolutionComputation::ConvolutionStep &step = cc.steps[s];
+    GetDirectConvolutionRuns(cc, step, &runs);
+    SubMatrix<BaseFloat> input_deriv_part(
+        *input_deriv, step.input_time_shift * cc.num_images,
+        output_rows, 0, input_deriv->NumCols());
+    for (int32 r = 0; r < output_rows; r += block_rows) {
+      int32 this_num_rows = std::min<int32>(block_rows, output_rows - r);
+      for (size_t i = 0; i < runs.size(); i++) {
+        const DirectConvolutionRun &run = runs[i];
+        SubMatrix<BaseFloat> input_deriv_block(input_deriv_part, r,
+                                               this_num_rows,
+                                               run.input_col, run.num_cols),
+            output_deriv_block(output_deriv, r, this_num_rows,
+                               run.height_out * num_filters_out,
+                               num_filters_out),
+            params_block(params, 0, params.NumRows(),
+                         step.params_start_col + run.param_col,
+                         run.num_cols);
+        input_deriv_block.AddMatMat(1.0, output_deriv_block, kNoTrans,
+                                    params_block, kNoTrans, 1.0);
+      }
+    }
+  }
+}
+
+// Direct version of ConvolveBackwardParams(); see ConvolveForwardDirect().
+// We don't split into row-blocks here, since each matrix multiply sums
+// over the rows.
+static void ConvolveBackwardParamsDirect(
+    const ConvolutionComputation &cc,
+    const MatrixBase<BaseFloat> &input,
+    const MatrixBase<BaseFloat> &output_deriv,
+    BaseFloat alpha,
+    MatrixBase<BaseFloat> *params_deriv) {
+  int32 output_rows = output_deriv.NumRows(),
+      num_filters_out = cc.num_filters_out;
+  int32 num_steps = cc.steps.size();
+  std::vector<DirectConvolutionRun> runs;
+  for (int32 s = 0; s < num_steps; s++) {
+    const ConvolutionComputation::ConvolutionStep &step = cc.steps[s];
+    GetDirectConvolutionRuns(cc, step, &runs);
+    SubMatrix<BaseFloat> input_part(input,
+                                    step.input_time_shift * cc.num_images,
+                                    output_rows, 0, input.NumCols());
+    for (size_t i = 0; i < runs.size(); i++) {
+      const DirectConvolutionRun &run = runs[i];
+      SubMatrix<BaseFloat> input_block(input_part, 0, output_rows,
+                                       run.input_col, run.num_cols),
+          output_deriv_block(output_deriv, 0, output_rows,
+                             run.height_out * num_filters_out,
+                             num_filters_out),
+          params_deriv_block(*params_deriv, 0, params_deriv->NumRows(),
+                             step.params_start_col + run.param_col,
+                             run.num_cols);
+      params_deriv_block.AddMatMat(alpha, output_deriv_block, kTrans,
+                                   input_block, kNoTrans, 1.0);
+    }
+  }
+}
+
+
 // Internal function called inside ConvolveForward.
 // Note: the number of time steps covered may be different
 // from that implied by cc.num_t_in and cc.num_t_out
@@ -555,6 +774,11 @@ void ConvolveForward(
     return;
   }
 
+  if (UseDirectCpu(cc)) {
+    ConvolveForwardDirect(cc, input.Mat(), params.Mat(), &(output->Mat()));
+    return;
+  }
+
   CuMatrix<BaseFloat> temp_mat(cc.temp_rows, cc.temp_cols,
                                kUndefined, kStrideEqualNumCols);
 
@@ -714,6 +938,12 @@ void ConvolveBackwardData(
     return;
   }
 
+  if (UseDirectCpu(cc)) {
+    ConvolveBackwardDataDirect(cc, params.Mat(), output_deriv.Mat(),
+                               &(input_deriv->Mat()));
+    return;
+  }
+
   CuMatrix<BaseFloat> temp_mat(cc.temp_rows, cc.temp_cols,
                                kSetZero, kStrideEqualNumCols);
 
@@ -873,6 +1103,12 @@ void ConvolveBackwardParams(
     return;
   }
 
+  if (UseDirectCpu(cc)) {
+    ConvolveBackwardParamsDirect(cc, input.Mat(), output_deriv.Mat(), alpha,
+                                 &(params_deriv->Mat()));
+    return;
+  }
+
   CuMatrix<BaseFloat> temp_mat(cc.temp_rows, cc.temp_cols,
                                kUndefined, kStrideEqualNumCols);
 
@@ -1577,6 +1813,7 @@ void MakeComputation(const ConvolutionModel &model,
   computation->num_t_in = io.num_t_in;
   computation->num_t_out = io.num_t_out;
   computation->num_images = io.num_images;
+  computation->use_direct_cpu = opts.use_direct_cpu;
   KALDI_ASSERT(io.reorder_t_in == 1);
   // first work out the steps of the computation, then
   // work out the dim of the temp matrix
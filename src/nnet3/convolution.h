@@ -342,6 +342,17 @@ struct ConvolutionComputation {
   };
   std::vector<ConvolutionStep> steps;
 
+  // If true, when running on CPU we use a direct implementation of the
+  // convolution (see ConvolveForwardDirect() in convolution.cc) that does not
+  // copy the input to the temporary matrix, but instead does one matrix
+  // multiply for each contiguous run of 'height_map' directly on row-strided
+  // views of the input and output.  This is set from the corresponding
+  // member of ConvolutionComputationOptions.  It is ignored when a GPU is
+  // being used.  The results are the same as the regular implementation, up
+  // to roundoff.
+  bool use_direct_cpu;
+
+  ConvolutionComputation(): use_direct_cpu(false) { }
 
   void Write(std::ostream &os, bool binary) const;
   void Read(std::istream &is, bool binary);
@@ -364,7 +375,12 @@ struct ConvolutionComputationOptions {
   // for the temporary matrix.  If it would exceed this amount, we do the
   // computation in batches.
   BaseFloat max_memory_mb;
-  ConvolutionComputationOptions(): max_memory_mb(200.0) { }
+  // use_direct_cpu, if true, selects the direct (im2col-free) implementation
+  // of the convolution when we are running on CPU; see the comment for
+  // ConvolutionComputation::use_direct_cpu.  It has no effect on GPU.
+  bool use_direct_cpu;
+  ConvolutionComputationOptions(): max_memory_mb(200.0),
+                                   use_direct_cpu(false) { }
 };
 
 
@@ -255,6 +255,32 @@ BaseFloat DecodableAmNnetLoopedOnline::LogLikelihood(int32 subsampled_frame,
       trans_model_.TransitionIdToPdfFast(index));
 }
 
+const BaseFloat *DecodableNnetLoopedOnline::LogLikelihoodRow(
+    int32 subsampled_frame) {
+  // The row is stored under the frame index after the offset, which stays
+  // valid if SetFrameOffset() is called.
+  subsampled_frame += frame_offset_;
+  const BaseFloat *row = row_.Get(subsampled_frame);
+  if (row != NULL) return row;
+  EnsureFrameIsComputed(subsampled_frame);
+  return row_.Set(subsampled_frame, info_.output_dim,
+                  current_log_post_.RowData(
+                      subsampled_frame - current_log_post_subsampled_offset_),
+                  1.0);
+}
+
+const BaseFloat *DecodableAmNnetLoopedOnline::LogLikelihoodRow(
+    int32 subsampled_frame) {
+  subsampled_frame += frame_offset_;
+  const BaseFloat *row = row_.Get(subsampled_frame);
+  if (row != NULL) return row;
+  EnsureFrameIsComputed(subsampled_frame);
+  return row_.Set(subsampled_frame, trans_model_.TransitionIdToPdfArray(),
+                  current_log_post_.RowData(
+                      subsampled_frame - current_log_post_subsampled_offset_),
+                  1.0);
+}
+
 
 } // namespace nnet3
 } // namespace kaldi
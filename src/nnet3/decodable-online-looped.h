@@ -167,7 +167,11 @@ class DecodableNnetLoopedOnline: public DecodableNnetLoopedOnlineBase {
   // represents the pdf-id (or other output of the network) PLUS ONE.
   virtual BaseFloat LogLikelihood(int32 subsampled_frame, int32 index);
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 subsampled_frame);
+
  private:
+  MappedLogLikelihoodRow row_;
+
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetLoopedOnline);
 
 };
@@ -199,8 +203,11 @@ class DecodableAmNnetLoopedOnline: public DecodableNnetLoopedOnlineBase {
   virtual BaseFloat LogLikelihood(int32 subsampled_frame,
                                   int32 transition_id);
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 subsampled_frame);
+
  private:
   const TransitionModel &trans_model_;
+  MappedLogLikelihoodRow row_;
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmNnetLoopedOnline);
 
@@ -258,6 +258,13 @@ BaseFloat DecodableAmNnetSimpleLooped::LogLikelihood(int32 frame,
   return decodable_nnet_.GetOutput(frame, pdf_id);
 }
 
+const BaseFloat *DecodableAmNnetSimpleLooped::LogLikelihoodRow(int32 frame) {
+  const BaseFloat *row = row_.Get(frame);
+  if (row != NULL) return row;
+  return row_.Set(frame, trans_model_.TransitionIdToPdfArray(),
+                  decodable_nnet_.GetOutputRow(frame), 1.0);
+}
+
 
 
 } // namespace nnet3
@@ -215,6 +215,20 @@ class DecodableNnetSimpleLooped {
                              current_log_post_subsampled_offset_,
                              pdf_id);
   }
+
+  // Returns a pointer to the output for a particular frame (OutputDim()
+  // elements); the same ordering requirements apply as for GetOutput().  The
+  // pointer is only valid until the next call to a non-const function of this
+  // object.
+  inline const BaseFloat *GetOutputRow(int32 subsampled_frame) {
+    KALDI_ASSERT(subsampled_frame >= current_log_post_subsampled_offset_ &&
+                 "Frames must be accessed in order.");
+    while (subsampled_frame >= current_log_post_subsampled_offset_ +
+                            current_log_post_.NumRows())
+      AdvanceChunk();
+    return current_log_post_.RowData(subsampled_frame -
+                                     current_log_post_subsampled_offset_);
+  }
  private:
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetSimpleLooped);
 
@@ -304,6 +318,8 @@ class DecodableAmNnetSimpleLooped: public DecodableInterface {
 
   virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame);
+
   virtual inline int32 NumFramesReady() const {
     return decodable_nnet_.NumFrames();
   }
@@ -319,6 +335,7 @@ class DecodableAmNnetSimpleLooped: public DecodableInterface {
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmNnetSimpleLooped);
   DecodableNnetSimpleLooped decodable_nnet_;
   const TransitionModel &trans_model_;
+  MappedLogLikelihoodRow row_;
 };
 
 
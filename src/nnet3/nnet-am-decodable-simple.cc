@@ -35,6 +35,7 @@ DecodableNnetSimple::DecodableNnetSimple(
     int32 online_ivector_period):
     opts_(opts),
     nnet_(nnet),
+    frames_per_tile_(0),
     output_dim_(nnet_.OutputDim("output")),
     log_priors_(priors),
     feats_(feats),
@@ -81,6 +82,14 @@ BaseFloat DecodableAmNnetSimple::LogLikelihood(int32 frame,
   return decodable_nnet_.GetOutput(frame, pdf_id);
 }
 
+const BaseFloat *DecodableAmNnetSimple::LogLikelihoodRow(int32 frame) {
+  const BaseFloat *row = row_.Get(frame);
+  if (row != NULL) return row;
+  // The acoustic scale has already been applied to the nnet output.
+  return row_.Set(frame, trans_model_.TransitionIdToPdfArray(),
+                  decodable_nnet_.GetOutputRow(frame), 1.0);
+}
+
 int32 DecodableNnetSimple::GetIvectorDim() const {
   if (ivector_ != NULL)
     return ivector_->Dim();
@@ -113,8 +122,12 @@ void DecodableNnetSimple::EnsureFrameIsComputed(int32 subsampled_frame) {
 
   // all subsampled frames pertain to the output of the network,
   // they are output frames divided by opts_.frame_subsampling_factor.
+  // if we are computing tiles, we do the computation for a whole tile at a
+  // time.
   int32 subsampling_factor = opts_.frame_subsampling_factor,
-      subsampled_frames_per_chunk = opts_.frames_per_chunk / subsampling_factor,
+      frames_per_chunk = (frames_per_tile_ > 0 ? frames_per_tile_ :
+                          opts_.frames_per_chunk),
+      subsampled_frames_per_chunk = frames_per_chunk / subsampling_factor,
       start_subsampled_frame = subsampled_frame,
       num_subsampled_frames = std::min<int32>(num_subsampled_frames_ -
                                               start_subsampled_frame,
@@ -133,6 +146,11 @@ void DecodableNnetSimple::EnsureFrameIsComputed(int32 subsampled_frame) {
   if (last_subsampled_frame == num_subsampled_frames_ - 1 &&
       opts_.extra_right_context_final >= 0)
     extra_right_context = opts_.extra_right_context_final;
+  if (frames_per_tile_ > 0) {
+    // the nnet is not recurrent, so extra context would make no difference.
+    extra_left_context = 0;
+    extra_right_context = 0;
+  }
   int32 left_context = nnet_left_context_ + extra_left_context,
       right_context = nnet_right_context_ + extra_right_context;
   int32 first_input_frame = first_output_frame - left_context,
@@ -307,6 +325,37 @@ void DecodableNnetSimple::CheckAndFixConfigs() {
     }
     opts_.frames_per_chunk = frames_per_chunk;
   }
+  SetFramesPerTile();
+}
+
+void DecodableNnetSimple::SetFramesPerTile() {
+  static bool warned_recurrent = false, warned_online_ivectors = false;
+  frames_per_tile_ = 0;
+  if (opts_.tile_frames <= 0)
+    return;
+  if (online_ivector_feats_ != NULL) {
+    // the iVector is chosen per chunk, so we can't merge chunks.
+    if (!warned_online_ivectors) {
+      warned_online_ivectors = true;
+      KALDI_WARN << "Ignoring --tile-frames option since online iVectors "
+                 << "are in use.";
+    }
+    return;
+  }
+  if (NnetIsRecurrent(nnet_)) {
+    // for recurrent nets, the output depends on where the chunks start.
+    if (!warned_recurrent) {
+      warned_recurrent = true;
+      KALDI_WARN << "Ignoring --tile-frames option since the neural net is "
+                 << "recurrent.";
+    }
+    return;
+  }
+  int32 frames_per_chunk = opts_.frames_per_chunk;
+  // round up to a multiple of frames_per_chunk, which is itself a multiple of
+  // the frame-subsampling factor and the nnet's modulus.
+  frames_per_tile_ = frames_per_chunk *
+      ((opts_.tile_frames + frames_per_chunk - 1) / frames_per_chunk);
 }
 
 
@@ -361,6 +410,14 @@ BaseFloat DecodableAmNnetSimpleParallel::LogLikelihood(int32 frame,
   return decodable_nnet_->GetOutput(frame, pdf_id);
 }
 
+const BaseFloat *DecodableAmNnetSimpleParallel::LogLikelihoodRow(
+    int32 frame) {
+  const BaseFloat *row = row_.Get(frame);
+  if (row != NULL) return row;
+  return row_.Set(frame, trans_model_.TransitionIdToPdfArray(),
+                  decodable_nnet_->GetOutputRow(frame), 1.0);
+}
+
 
 } // namespace nnet3
 } // namespace kaldi
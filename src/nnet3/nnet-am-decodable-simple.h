@@ -47,6 +47,7 @@ struct NnetSimpleComputationOptions {
   int32 extra_right_context_final;
   int32 frame_subsampling_factor;
   int32 frames_per_chunk;
+  int32 tile_frames;
   BaseFloat acoustic_scale;
   bool debug_computation;
   NnetOptimizeOptions optimize_config;
@@ -60,6 +61,7 @@ struct NnetSimpleComputationOptions {
       extra_right_context_final(-1),
       frame_subsampling_factor(1),
       frames_per_chunk(50),
+      tile_frames(0),
       acoustic_scale(0.1),
       debug_computation(false) {
     compiler_config.cache_capacity += frames_per_chunk;
@@ -92,6 +94,16 @@ struct NnetSimpleComputationOptions {
                    "by the neural net.  Measured before any subsampling, if the "
                    "--frame-subsampling-factor options is used (i.e. counts "
                    "input frames");
+    opts->Register("tile-frames", &tile_frames,
+                   "If >0 and the neural net is not recurrent (this is "
+                   "checked), the output is computed in tiles of this many "
+                   "frames (rounded up to a multiple of --frames-per-chunk), "
+                   "so the context shared between adjacent chunks is only "
+                   "computed once per tile.  --extra-left-context and "
+                   "related options are ignored in this case, since they "
+                   "make no difference for non-recurrent nets.  Not "
+                   "supported with online iVectors.  E.g. 1500 for TDNN "
+                   "models in whole-file decoding.");
     opts->Register("debug-computation", &debug_computation, "If true, turn on "
                    "debug for the actual computation (very verbose!)");
 
@@ -211,6 +223,18 @@ class DecodableNnetSimple {
                              current_log_post_subsampled_offset_,
                              pdf_id);
   }
+
+  // Returns a pointer to the output for a particular frame (OutputDim()
+  // elements), with 0 <= subsampled_frame < NumFrames().  The pointer is only
+  // valid until the next call to a non-const function of this object.
+  inline const BaseFloat *GetOutputRow(int32 subsampled_frame) {
+    if (subsampled_frame < current_log_post_subsampled_offset_ ||
+        subsampled_frame >= current_log_post_subsampled_offset_ +
+                            current_log_post_.NumRows())
+      EnsureFrameIsComputed(subsampled_frame);
+    return current_log_post_.RowData(subsampled_frame -
+                                     current_log_post_subsampled_offset_);
+  }
  private:
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetSimple);
 
@@ -240,6 +264,9 @@ class DecodableNnetSimple {
   // called from constructor
   void CheckAndFixConfigs();
 
+  // called from CheckAndFixConfigs(); sets frames_per_tile_.
+  void SetFramesPerTile();
+
   // returns dimension of the provided iVectors if supplied, or 0 otherwise.
   int32 GetIvectorDim() const;
 
@@ -247,6 +274,10 @@ class DecodableNnetSimple {
   const Nnet &nnet_;
   int32 nnet_left_context_;
   int32 nnet_right_context_;
+  // If we are computing the output in tiles (see the --tile-frames option),
+  // the number of frames per tile (a multiple of opts_.frames_per_chunk);
+  // otherwise zero.
+  int32 frames_per_tile_;
   int32 output_dim_;
   // the log priors (or the empty vector if the priors are not set in the model)
   CuVector<BaseFloat> log_priors_;
@@ -327,6 +358,8 @@ class DecodableAmNnetSimple: public DecodableInterface {
 
   virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame);
+
   virtual inline int32 NumFramesReady() const {
     return decodable_nnet_.NumFrames();
   }
@@ -345,6 +378,7 @@ class DecodableAmNnetSimple: public DecodableInterface {
   CachingOptimizingCompiler compiler_;
   DecodableNnetSimple decodable_nnet_;
   const TransitionModel &trans_model_;
+  MappedLogLikelihoodRow row_;
 };
 
 
@@ -398,6 +432,8 @@ class DecodableAmNnetSimpleParallel: public DecodableInterface {
 
   virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
 
+  virtual const BaseFloat *LogLikelihoodRow(int32 frame);
+
   virtual inline int32 NumFramesReady() const {
     return decodable_nnet_->NumFrames();
   }
@@ -422,6 +458,8 @@ class DecodableAmNnetSimpleParallel: public DecodableInterface {
   Matrix<BaseFloat> *online_ivectors_copy_;
 
   DecodableNnetSimple *decodable_nnet_;
+
+  MappedLogLikelihoodRow row_;
 };
 
 
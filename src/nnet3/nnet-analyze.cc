@@ -418,6 +418,101 @@ void ComputeCommandAttributes(
   }
 }
 
+void ComputeCommandDependencies(
+    const Nnet &nnet,
+    const NnetComputation &computation,
+    std::vector<std::vector<int32> > *dependencies) {
+  ComputationVariables variables;
+  variables.Init(computation);
+  std::vector<CommandAttributes> attributes;
+  ComputeCommandAttributes(nnet, computation, variables, &attributes);
+
+  int32 num_commands = computation.commands.size(),
+      num_variables = variables.NumVariables();
+  dependencies->clear();
+  dependencies->resize(num_commands);
+  // last_writer[v] is the most recent command that wrote variable v, or -1.
+  std::vector<int32> last_writer(num_variables, -1);
+  // readers[v] is the list of commands that read variable v since it was last
+  // written.
+  std::vector<std::vector<int32> > readers(num_variables);
+  // last_component_command[i] is the most recent Propagate or Backprop
+  // command for component i, or -1.
+  std::vector<int32> last_component_command(nnet.NumComponents(), -1);
+  // the most recent barrier command, or -1.
+  int32 last_barrier = -1;
+  std::vector<int32> matrix_variables;
+
+  for (int32 command = 0; command < num_commands; command++) {
+    const NnetComputation::Command &c = computation.commands[command];
+    std::vector<int32> &deps = (*dependencies)[command];
+    CommandAttributes &attr = attributes[command];
+    // Commands that change the matrix as a whole (rather than its contents)
+    // are treated as writing all of its variables.
+    matrix_variables.clear();
+    switch (c.command_type) {
+      case kSwapMatrix:
+        variables.AppendVariablesForMatrix(
+            computation.submatrices[c.arg2].matrix_index, &matrix_variables);
+        // fall through.
+      case kAllocMatrix: case kDeallocMatrix:
+      case kCompressMatrix: case kDecompressMatrix:
+        variables.AppendVariablesForMatrix(
+            computation.submatrices[c.arg1].matrix_index, &matrix_variables);
+        attr.variables_written.insert(attr.variables_written.end(),
+                                      matrix_variables.begin(),
+                                      matrix_variables.end());
+        SortAndUniq(&attr.variables_written);
+        break;
+      default:
+        break;
+    }
+
+    bool is_barrier = (c.command_type == kAcceptInput ||
+                       c.command_type == kProvideOutput ||
+                       c.command_type == kGotoLabel ||
+                       c.command_type == kNoOperationLabel);
+    if (is_barrier) {
+      for (int32 prev = std::max<int32>(last_barrier, 0);
+           prev < command; prev++)
+        deps.push_back(prev);
+      last_barrier = command;
+    } else if (last_barrier >= 0) {
+      deps.push_back(last_barrier);
+    }
+
+    std::vector<int32>::const_iterator iter = attr.variables_read.begin(),
+        end = attr.variables_read.end();
+    for (; iter != end; ++iter)
+      if (last_writer[*iter] >= 0)
+        deps.push_back(last_writer[*iter]);
+    for (iter = attr.variables_written.begin(),
+             end = attr.variables_written.end(); iter != end; ++iter) {
+      if (last_writer[*iter] >= 0)
+        deps.push_back(last_writer[*iter]);
+      deps.insert(deps.end(), readers[*iter].begin(), readers[*iter].end());
+    }
+    if (c.command_type == kPropagate || c.command_type == kBackprop ||
+        c.command_type == kBackpropNoModelUpdate) {
+      int32 &last_command = last_component_command[c.arg1];
+      if (last_command >= 0)
+        deps.push_back(last_command);
+      last_command = command;
+    }
+    SortAndUniq(&deps);
+    // the variables written by a command may also be read by it; we need
+    // to record the reads before the writes.
+    for (iter = attr.variables_read.begin(),
+             end = attr.variables_read.end(); iter != end; ++iter)
+      readers[*iter].push_back(command);
+    for (iter = attr.variables_written.begin(),
+             end = attr.variables_written.end(); iter != end; ++iter) {
+      last_writer[*iter] = command;
+      readers[*iter].clear();
+    }
+  }
+}
+
 void ComputeVariableAccesses(
     const ComputationVariables &variables,
     const std::vector<CommandAttributes> &command_attributes,
@@ -388,6 +388,33 @@ void ComputeCommandAttributes(
     std::vector<CommandAttributes> *attributes);
 
 
+/**
+   This function works out, for each command in the computation, which earlier
+   commands it has to wait for if commands are to be executed out of order
+   (e.g. in parallel, see NnetComputeOptions::num_threads).  Command c depends
+   on an earlier command c2 if they access a common variable (see class
+   ComputationVariables) and at least one of them writes it; if both are
+   Propagate or Backprop commands for the same component (so we never call
+   one component from two threads at once, and memos and stats are dealt
+   with in order); or if either of them is an I/O command (kAcceptInput,
+   kProvideOutput) or a kGotoLabel or kNoOperationLabel command, which we
+   treat as barriers.  Allocation, deallocation, swapping, compression and
+   decompression of a matrix are treated as writing all of its variables.
+
+     @param [in] nnet          The neural net that the computation is for
+     @param [in] computation   The computation
+     @param [out] dependencies  Will be resized to the number of commands;
+                       (*dependencies)[c] is a sorted, unique list of the
+                       commands c2 < c that command c depends on.  Only
+                       direct dependencies are guaranteed to be listed,
+                       not ones that are implied by transitivity.
+ */
+void ComputeCommandDependencies(
+    const Nnet &nnet,
+    const NnetComputation &computation,
+    std::vector<std::vector<int32> > *dependencies);
+
+
 struct CheckComputationOptions {
   // do the check_rewrite check only for a non-optimized computation, it may
   // legitimately fail after optimization.  see code for details.
@@ -23,6 +23,7 @@
 #include "nnet3/nnet-batch-compute.h"
 #include "nnet3/nnet-utils.h"
 #include "decoder/decodable-matrix.h"
+#include "decoder/lattice-faster-multistream-decoder.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -1192,14 +1193,15 @@ NnetBatchDecoder::NnetBatchDecoder(
     const fst::SymbolTable *word_syms,
     bool allow_partial,
     int32 num_threads,
-    NnetBatchComputer *computer):
+    NnetBatchComputer *computer,
+    int32 num_streams):
   fst_(fst), decoder_opts_(decoder_opts),
   trans_model_(trans_model), word_syms_(word_syms),
   allow_partial_(allow_partial),  computer_(computer),
-  is_finished_(false), tasks_finished_(false), priority_offset_(0.0),
+  num_streams_(num_streams), is_finished_(false), tasks_finished_(false), priority_offset_(0.0),
   tot_like_(0.0), frame_count_(0), num_success_(0), num_fail_(0),
   num_partial_(0) {
-  KALDI_ASSERT(num_threads > 0);
+  KALDI_ASSERT(num_threads > 0 && num_streams > 0);
   for (int32 i = 0; i < num_threads; i++)
     decode_threads_.push_back(new std::thread(DecodeFunc, this));
   compute_thread_ = std::thread(ComputeFunc, this);
@@ -1334,6 +1336,60 @@ void NnetBatchDecoder::Compute() {
   }
 }
 
+NnetBatchDecoder::UtteranceOutput* NnetBatchDecoder::AcceptUtterance(
+    std::vector<NnetInferenceTask> *tasks) {
+  // we can be confident that the last element of 'pending_utts_' is the one
+  // for this utterance, as we know exactly at what point in the code the main
+  // thread will be in AcceptInput().
+  UtteranceOutput *output_utterance = pending_utts_.back();
+  {
+    UtteranceInput input_utterance(input_utterance_);
+    bool output_to_cpu = true;
+    computer_->SplitUtteranceIntoTasks(output_to_cpu,
+                                       *(input_utterance.input),
+                                       input_utterance.ivector,
+                                       input_utterance.online_ivectors,
+                                       input_utterance.online_ivector_period,
+                                       tasks);
+    KALDI_ASSERT(output_utterance->utterance_id ==
+                 input_utterance.utterance_id);
+    input_consumed_semaphore_.Signal();
+    // Now let input_utterance go out of scope; it's no longer valid as it may
+    // be overwritten by something else.
+  }
+
+  SetPriorities(tasks);
+  for (size_t i = 0; i < tasks->size(); i++)
+    computer_->AcceptTask(&((*tasks)[i]));
+  tasks_ready_semaphore_.Signal();
+  return output_utterance;
+}
+
+bool NnetBatchDecoder::GetUtteranceLattice(const LatticeFasterDecoder &decoder,
+                                           UtteranceOutput *output) {
+  const std::string &utterance_id = output->utterance_id;
+  bool use_final_probs = true;
+  if (!decoder.ReachedFinal()) {
+    if (allow_partial_) {
+      KALDI_WARN << "Outputting partial output for utterance "
+                 << utterance_id << " since no final-state reached\n";
+      use_final_probs = false;
+      std::unique_lock<std::mutex> lock(stats_mutex_);
+      num_partial_++;
+    } else {
+      KALDI_WARN << "Not producing output for utterance " << utterance_id
+                 << " since no final-state reached and "
+                 << "--allow-partial=false.\n";
+      std::unique_lock<std::mutex> lock(stats_mutex_);
+      num_fail_++;
+      return false;
+    }
+  }
+  // if we reached this point, we are getting a lattice.
+  decoder.GetRawLattice(&output->lat, use_final_probs);
+  return true;
+}
+
 void NnetBatchDecoder::Decode() {
   while (true) {
     input_ready_semaphore_.Wait();
@@ -1341,31 +1397,7 @@ void NnetBatchDecoder::Decode() {
       return;
 
     std::vector<NnetInferenceTask> tasks;
-    std::string utterance_id;
-    // we can be confident that the last element of 'pending_utts_' is the one
-    // for this utterance, as we know exactly at what point in the code the main
-    // thread will be in AcceptInput().
-    UtteranceOutput *output_utterance = pending_utts_.back();
-    {
-      UtteranceInput input_utterance(input_utterance_);
-      utterance_id = input_utterance.utterance_id;
-      bool output_to_cpu = true;
-      computer_->SplitUtteranceIntoTasks(output_to_cpu,
-                                         *(input_utterance.input),
-                                         input_utterance.ivector,
-                                         input_utterance.online_ivectors,
-                                         input_utterance.online_ivector_period,
-                                         &tasks);
-      KALDI_ASSERT(output_utterance->utterance_id == utterance_id);
-      input_consumed_semaphore_.Signal();
-      // Now let input_utterance go out of scope; it's no longer valid as it may
-      // be overwritten by something else.
-    }
-
-    SetPriorities(&tasks);
-    for (size_t i = 0; i < tasks.size(); i++)
-      computer_->AcceptTask(&(tasks[i]));
-    tasks_ready_semaphore_.Signal();
+    UtteranceOutput *output_utterance = AcceptUtterance(&tasks);
 
     {
       int32 frame_offset = 0;
@@ -1388,25 +1420,8 @@ void NnetBatchDecoder::Decode() {
         task.output.Resize(0, 0);  // Free some memory.
       }
 
-      bool use_final_probs = true;
-      if (!decoder.ReachedFinal()) {
-        if (allow_partial_) {
-          KALDI_WARN << "Outputting partial output for utterance "
-                     << utterance_id << " since no final-state reached\n";
-          use_final_probs = false;
-          std::unique_lock<std::mutex> lock(stats_mutex_);
-          num_partial_++;
-        } else {
-          KALDI_WARN << "Not producing output for utterance " << utterance_id
-                     << " since no final-state reached and "
-                     << "--allow-partial=false.\n";
-          std::unique_lock<std::mutex> lock(stats_mutex_);
-          num_fail_++;
-          continue;
-        }
-      }
-      // if we reached this point, we are getting a lattice.
-      decoder.GetRawLattice(&output_utterance->lat, use_final_probs);
+      if (!GetUtteranceLattice(decoder, output_utterance))
+        continue;
       // Let the decoder and the decodable object go out of scope, to save
       // memory.
     }
@@ -1414,6 +1429,105 @@ void NnetBatchDecoder::Decode() {
   }
 }
 
+void NnetBatchDecoder::DecodeMultiStream() {
+  // An utterance that this thread is decoding.  These are allocated
+  // individually because computer_ holds pointers to the tasks.
+  struct Stream {
+    UtteranceOutput *output;
+    std::vector<NnetInferenceTask> tasks;
+    size_t next_task;  // The index of the next task to decode.
+    int32 frame_offset;  // The number of frames decoded so far.
+    int32 stream;  // The stream number in 'decoder'.
+  };
+  LatticeFasterMultiStreamDecoder decoder(fst_, decoder_opts_);
+  std::list<Stream*> streams;  // Oldest first.
+  bool input_finished = false;
+
+  while (true) {
+    // Take on new utterances while we're decoding fewer than num_streams_.
+    // We only block waiting for one if we have nothing else to do.
+    while (!input_finished &&
+           static_cast<int32>(streams.size()) < num_streams_) {
+      if (streams.empty())
+        input_ready_semaphore_.Wait();
+      else if (!input_ready_semaphore_.TryWait())
+        break;
+      if (is_finished_) {
+        input_finished = true;
+        break;
+      }
+      Stream *stream = new Stream;
+      stream->output = AcceptUtterance(&(stream->tasks));
+      stream->next_task = 0;
+      stream->frame_offset = 0;
+      stream->stream = decoder.AddStream();
+      streams.push_back(stream);
+    }
+    // Output the utterances whose tasks have all been decoded.
+    for (std::list<Stream*>::iterator iter = streams.begin();
+         iter != streams.end(); ) {
+      Stream *stream = *iter;
+      if (stream->next_task < stream->tasks.size()) {
+        ++iter;
+        continue;
+      }
+      UtteranceOutput *output_utterance = stream->output;
+      bool ok = GetUtteranceLattice(decoder.GetDecoder(stream->stream),
+                                    output_utterance);
+      decoder.RemoveStream(stream->stream);  // To save memory.
+      delete stream;
+      iter = streams.erase(iter);
+      if (ok)
+        ProcessOutputUtterance(output_utterance);
+    }
+    if (streams.empty()) {
+      if (input_finished)
+        return;
+      continue;
+    }
+
+    // Find the streams whose next task has been computed.  If there are none,
+    // wait for the oldest stream's next task.
+    std::vector<Stream*> ready;
+    for (std::list<Stream*>::iterator iter = streams.begin();
+         iter != streams.end(); ++iter) {
+      Stream *stream = *iter;
+      if (stream->next_task < stream->tasks.size() &&
+          stream->tasks[stream->next_task].semaphore.TryWait())
+        ready.push_back(stream);
+    }
+    if (ready.empty()) {
+      Stream *stream = streams.front();
+      stream->tasks[stream->next_task].semaphore.Wait();
+      ready.push_back(stream);
+    }
+
+    // Decode those tasks, interleaving the frames of the different streams.
+    std::vector<DecodableInterface*> decodables(decoder.NumSlots(), NULL);
+    std::vector<SubMatrix<BaseFloat>*> posts;
+    for (size_t i = 0; i < ready.size(); i++) {
+      Stream *stream = ready[i];
+      NnetInferenceTask &task = stream->tasks[stream->next_task];
+      UpdatePriorityOffset(task.priority);
+      SubMatrix<BaseFloat> *post = new SubMatrix<BaseFloat>(
+          task.output_cpu, task.num_initial_unused_output_frames,
+          task.num_used_output_frames, 0, task.output_cpu.NumCols());
+      posts.push_back(post);
+      decodables[stream->stream] =
+          new DecodableMatrixMapped(trans_model_, *post, stream->frame_offset);
+      stream->frame_offset += post->NumRows();
+    }
+    decoder.AdvanceDecoding(decodables);
+    DeletePointers(&decodables);
+    DeletePointers(&posts);
+    for (size_t i = 0; i < ready.size(); i++) {
+      Stream *stream = ready[i];
+      stream->tasks[stream->next_task].output.Resize(0, 0);  // Free some memory.
+      stream->next_task++;
+    }
+  }
+}
+
 
 void NnetBatchDecoder::UtteranceFailed() {
   std::unique_lock<std::mutex> lock(stats_mutex_);
@@ -632,6 +632,12 @@ class NnetBatchDecoder {
                           and a thread for possibly-GPU-based inference.
         @param [in] computer The NnetBatchComputer object, through which the
                            neural net will be evaluated.
+        @param [in] num_streams  The number of utterances each decoder thread
+                           decodes at once.  If >1, each thread uses a
+                           LatticeFasterMultiStreamDecoder and interleaves the
+                           frames of its utterances, so that fewer threads are
+                           needed to keep up with the neural net; the output
+                           is the same.
    */
   NnetBatchDecoder(const fst::Fst<fst::StdArc> &fst,
                    const LatticeFasterDecoderConfig &decoder_config,
@@ -639,7 +645,8 @@ class NnetBatchDecoder {
                    const fst::SymbolTable *word_syms,
                    bool allow_partial,
                    int32 num_threads,
-                   NnetBatchComputer *computer);
+                   NnetBatchComputer *computer,
+                   int32 num_streams = 1);
 
   /**
     The user should call this one by one for the utterances that
@@ -751,8 +758,29 @@ class NnetBatchDecoder {
   // background.  It will exit once the user calls Finished() and all
   // computation is completed.
   void Decode();
-  // static wrapper for Compute().
-  static void DecodeFunc(NnetBatchDecoder *object) { object->Decode(); }
+  // This is the version of Decode() used if num_streams_ > 1: each thread
+  // decodes up to num_streams_ utterances at once.
+  void DecodeMultiStream();
+  // static wrapper for Decode() and DecodeMultiStream().
+  static void DecodeFunc(NnetBatchDecoder *object) {
+    if (object->num_streams_ > 1)
+      object->DecodeMultiStream();
+    else
+      object->Decode();
+  }
+
+  // This is called in a decoder thread when it has waited on
+  // input_ready_semaphore_ and is_finished_ is false.  It takes the utterance
+  // provided by AcceptInput(), splits it into tasks which it gives to
+  // computer_, and returns the UtteranceOutput object for the utterance.
+  UtteranceOutput *AcceptUtterance(std::vector<NnetInferenceTask> *tasks);
+
+  // This is called when 'decoder' has decoded all the frames of the utterance
+  // for 'output'.  It sets output->lat from the decoder, taking account of
+  // allow_partial_, and returns true; or returns false if we're not producing
+  // any output for this utterance.
+  bool GetUtteranceLattice(const LatticeFasterDecoder &decoder,
+                           UtteranceOutput *output);
 
   // This is the computation thread; it handles the neural net inference.
   void Compute();
@@ -779,6 +807,7 @@ class NnetBatchDecoder {
   const fst::SymbolTable *word_syms_;  // May be NULL.  Owned here.
   bool allow_partial_;
   NnetBatchComputer *computer_;
+  int32 num_streams_;
   std::vector<std::thread*> decode_threads_;
   std::thread compute_thread_;  // Thread that calls computer_->Compute().
 
@@ -19,6 +19,7 @@
 
 #include "nnet3/nnet-nnet.h"
 #include "nnet3/nnet-simple-component.h"
+#include "nnet3/nnet-convolutional-component.h"
 #include "nnet3/nnet-test-utils.h"
 
 namespace kaldi {
@@ -487,6 +488,29 @@ bool TestSimpleComponentModelDerivative(const Component &c,
 }
 
 
+// <UseDirectCpu> is an optional token, so check specifically that a
+// TimeHeightConvolutionComponent with use-direct-cpu=true can be read back.
+void UnitTestTimeHeightConvolutionComponentIo() {
+  for (int32 i = 0; i < 2; i++) {
+    bool binary = (i == 0);
+    ConfigLine cfl;
+    KALDI_ASSERT(cfl.ParseLine(
+        "num-filters-in=3 num-filters-out=4 height-in=5 height-out=5 "
+        "height-offsets=-1,0,1 time-offsets=-1,0,1 use-direct-cpu=true"));
+    TimeHeightConvolutionComponent c;
+    c.InitFromConfig(&cfl);
+    std::ostringstream os1;
+    c.Write(os1, binary);
+    std::istringstream is(os1.str());
+    Component *c2 = Component::ReadNew(is, binary);
+    KALDI_ASSERT(c2->Info().find("use-direct-cpu=1") != std::string::npos);
+    std::ostringstream os2;
+    c2->Write(os2, binary);
+    KALDI_ASSERT(os1.str() == os2.str());
+    delete c2;
+  }
+}
+
 void UnitTestNnetComponent() {
   for (int32 n = 0; n < 200; n++)  {
     Component *c = GenerateRandomSimpleComponent();
@@ -533,6 +557,7 @@ int main() {
     else
       CuDevice::Instantiate().SelectGpuId("yes");
 #endif
+    UnitTestTimeHeightConvolutionComponentIo();
     UnitTestNnetComponent();
 #if HAVE_CUDA == 1
   } // No for loop if 'HAVE_CUDA != 1',
@@ -98,11 +98,13 @@ void TestNnetDecodable(Nnet *nnet) {
   }
 
   Matrix<BaseFloat> output1(num_frames, output_dim),
-      output2(num_frames, output_dim);
+      output2(num_frames, output_dim),
+      output3(num_frames, output_dim);
 
+  int32 frames_per_chunk = RandInt(5, 25);
   {
     NnetSimpleComputationOptions opts;
-    opts.frames_per_chunk = RandInt(5, 25);
+    opts.frames_per_chunk = frames_per_chunk;
     CachingOptimizingCompiler compiler(*nnet);
     DecodableNnetSimple decodable(opts, *nnet, priors, input, &compiler,
                                   (ivector_dim != 0 ? &ivector : NULL));
@@ -112,6 +114,22 @@ void TestNnetDecodable(Nnet *nnet) {
     }
   }
 
+  {
+    // test computing the output in tiles spanning several chunks (this is
+    // ignored for recurrent nnets).
+    NnetSimpleComputationOptions opts;
+    opts.frames_per_chunk = frames_per_chunk;
+    opts.tile_frames = RandInt(1, 60);
+    opts.extra_left_context = RandInt(0, 3);
+    CachingOptimizingCompiler compiler(*nnet);
+    DecodableNnetSimple decodable(opts, *nnet, priors, input, &compiler,
+                                  (ivector_dim != 0 ? &ivector : NULL));
+    for (int32 t = 0; t < num_frames; t++) {
+      SubVector<BaseFloat> row(output3, t);
+      decodable.GetOutputForFrame(t, &row);
+    }
+  }
+
   {
     NnetSimpleLoopedComputationOptions opts;
     // caution: this may modify nnet, by changing how it consumes iVectors.
@@ -138,8 +156,9 @@ void TestNnetDecodable(Nnet *nnet) {
     // might have 'optional' context if required-time-offsets != time-offsets.
     for (int32 t = 0; t < num_frames; t++) {
       SubVector<BaseFloat> row1(output1, t),
-          row2(output2, t);
+          row2(output2, t), row3(output3, t);
       KALDI_ASSERT(row1.ApproxEqual(row2));
+      KALDI_ASSERT(row1.ApproxEqual(row3));
     }
   }
 }
@@ -238,6 +257,36 @@ void UnitTestNnetCompute() {
 
     KALDI_LOG << "Output sum is " << output.Sum();
 
+    if (test_collapse_model) {
+      // dropout and batchnorm are in test mode so the computation is
+      // deterministic, and we can check that executing independent commands
+      // in parallel gives the same output.
+      NnetComputeOptions parallel_compute_opts;
+      parallel_compute_opts.num_threads = RandInt(2, 4);
+      NnetComputer computer_parallel(parallel_compute_opts,
+                                     computation,
+                                     nnet,
+                                     &nnet);
+      for (size_t i = 0; i < request.inputs.size(); i++) {
+        CuMatrix<BaseFloat> temp(inputs[i]);
+        computer_parallel.AcceptInput(request.inputs[i].name, &temp);
+      }
+      // A copy has its own worker threads.
+      NnetComputer computer_parallel_copy(computer_parallel);
+      computer_parallel.Run();
+      const CuMatrixBase<BaseFloat> &output_parallel(
+          computer_parallel.GetOutput("output"));
+      KALDI_LOG << "Output sum [parallel] is " << output_parallel.Sum();
+      if (!ApproxEqual(output, output_parallel)) {
+        KALDI_ERR << "Sequential and parallel computations' outputs differ";
+      }
+      computer_parallel_copy.Run();
+      if (!ApproxEqual(output,
+                       computer_parallel_copy.GetOutput("output"))) {
+        KALDI_ERR << "Sequential and parallel computations' outputs differ";
+      }
+    }
+
     if (test_collapse_model) {
       NnetComputer computer_collapsed(compute_opts,
                                       computation_collapsed,
@@ -20,19 +20,94 @@
 
 #include <iterator>
 #include <sstream>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
 #include "nnet3/nnet-compute.h"
 
 namespace kaldi {
 namespace nnet3 {
 
 
+// The threads that help the calling thread in RunParallel().  They wait for
+// a job (a ParallelRunState) from Start(), call ParallelWorker() on it and go
+// back to waiting; Wait() waits until they have all returned from it.
+class NnetComputer::WorkerPool {
+ public:
+  WorkerPool(NnetComputer *computer, int32 num_threads):
+      computer_(computer), state_(NULL), job_index_(0), num_busy_(0),
+      exit_(false) {
+    for (int32 t = 0; t < num_threads; t++)
+      threads_.push_back(std::thread(&WorkerPool::Loop, this));
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      exit_ = true;
+    }
+    job_cond_.notify_all();
+    for (size_t t = 0; t < threads_.size(); t++)
+      threads_[t].join();
+  }
+
+  void Start(ParallelRunState *state) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    KALDI_ASSERT(num_busy_ == 0);
+    state_ = state;
+    job_index_++;
+    num_busy_ = threads_.size();
+    job_cond_.notify_all();
+  }
+
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (num_busy_ > 0)
+      done_cond_.wait(lock);
+    state_ = NULL;
+  }
+
+ private:
+  void Loop() {
+    int64 last_job_index = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      while (!exit_ && job_index_ == last_job_index)
+        job_cond_.wait(lock);
+      if (exit_)
+        return;
+      last_job_index = job_index_;
+      ParallelRunState *state = state_;
+      lock.unlock();
+      computer_->ParallelWorker(state);
+      lock.lock();
+      if (--num_busy_ == 0)
+        done_cond_.notify_one();
+    }
+  }
+
+  NnetComputer *computer_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable job_cond_;
+  std::condition_variable done_cond_;
+  // The current job, and a counter that is incremented for each new job.
+  ParallelRunState *state_;
+  int64 job_index_;
+  // The number of threads that have not finished the current job.
+  int32 num_busy_;
+  bool exit_;
+};
+
+
 NnetComputer::NnetComputer(const NnetComputeOptions &options,
                            const NnetComputation &computation,
                            const Nnet &nnet,
                            Nnet *nnet_to_update):
     options_(options), computation_(computation), nnet_(nnet),
     program_counter_(0), nnet_to_store_stats_(nnet_to_update),
-    nnet_to_update_(nnet_to_update) {
+    nnet_to_update_(nnet_to_update), worker_pool_(NULL) {
   Init();
 }
 
@@ -40,10 +115,10 @@ NnetComputer::NnetComputer(const NnetComputeOptions &options,
                            const NnetComputation &computation,
                            const Nnet &nnet,
                            Nnet *nnet_to_update,
-                           NnetComputerSnapshot *snapshot):
+                           const NnetComputerSnapshot *snapshot):
     options_(options), computation_(computation), nnet_(nnet),
     program_counter_(0), nnet_to_store_stats_(nnet_to_update),
-    nnet_to_update_(nnet_to_update) {
+    nnet_to_update_(nnet_to_update), worker_pool_(NULL) {
   Init();
   
   if (snapshot) {
@@ -67,7 +142,7 @@ NnetComputer::NnetComputer(const NnetComputeOptions &options,
                            Nnet *nnet_to_update):
     options_(options), computation_(computation), nnet_(*nnet),
     program_counter_(0), nnet_to_store_stats_(nnet),
-    nnet_to_update_(nnet_to_update) {
+    nnet_to_update_(nnet_to_update), worker_pool_(NULL) {
   Init();
 }
 
@@ -88,6 +163,29 @@ void NnetComputer::Init() {
     KALDI_LOG << preamble;
     computation_.GetSubmatrixStrings(nnet_, &submatrix_strings_);
   }
+  bool parallel = (options_.num_threads > 1 && !debug_);
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    parallel = false;
+#endif
+  if (parallel) {
+    ComputeCommandDependencies(nnet_, computation_, &command_dependencies_);
+    int32 num_commands = computation_.commands.size(),
+        max_memo_index = 0;
+    command_successors_.resize(num_commands);
+    for (int32 c = 0; c < num_commands; c++) {
+      const std::vector<int32> &deps = command_dependencies_[c];
+      for (size_t i = 0; i < deps.size(); i++)
+        command_successors_[deps[i]].push_back(c);
+      const NnetComputation::Command &command = computation_.commands[c];
+      if (command.command_type == kPropagate)
+        max_memo_index = std::max(max_memo_index, command.arg5);
+    }
+    // SaveMemo() would resize memos_ as needed, but that's not thread safe.
+    if (static_cast<int32>(memos_.size()) <= max_memo_index)
+      memos_.resize(max_memo_index + 1, NULL);
+    worker_pool_ = new WorkerPool(this, options_.num_threads - 1);
+  }
 }
 
 //static
@@ -225,16 +323,24 @@ NnetComputer::NnetComputer(const NnetComputer &other):
     submatrix_strings_(other.submatrix_strings_),
     command_strings_(other.command_strings_),
     matrices_(other.matrices_),
-    memos_(other.memos_) {
+    memos_(other.memos_),
+    command_successors_(other.command_successors_),
+    command_dependencies_(other.command_dependencies_),
+    worker_pool_(NULL) {
   // Note: this is the same as the default copy constructor, except for the check below.
-  if (!memos_.empty()) {
+  // (in the parallel case memos_ is pre-sized, so we check for non-NULL
+  // memos).
+  if (std::count(memos_.begin(), memos_.end(),
+                 static_cast<void*>(NULL)) != memos_.size()) {
     KALDI_ERR << "You cannot use the copy constructor of NnetComputer if "
         "memos are used.";
   }
+  if (other.worker_pool_ != NULL)
+    worker_pool_ = new WorkerPool(this, options_.num_threads - 1);
 }
 
-void NnetComputer::ExecuteCommand() {
-  const NnetComputation::Command &c = computation_.commands[program_counter_];
+void NnetComputer::ExecuteCommand(int32 command) {
+  const NnetComputation::Command &c = computation_.commands[command];
   int32 m1, m2;
   try {
     switch (c.command_type) {
@@ -458,17 +564,20 @@ void NnetComputer::ExecuteCommand() {
         KALDI_ERR << "Invalid command in computation";
     }
   } catch (...) {
+    // we use a local copy of the command strings because when executing
+    // commands in parallel, more than one thread may get here.
+    std::vector<std::string> command_strings(command_strings_);
     if (!debug_) {
       std::string preamble;
-      computation_.GetCommandStrings(nnet_, &preamble, &command_strings_);
+      computation_.GetCommandStrings(nnet_, &preamble, &command_strings);
       KALDI_WARN << "Printing some background info since error was detected";
       KALDI_LOG << preamble;
-      for (int32 prev_c = 0; prev_c < program_counter_; prev_c++)
-        KALDI_LOG << command_strings_[prev_c];
+      for (int32 prev_c = 0; prev_c < command; prev_c++)
+        KALDI_LOG << command_strings[prev_c];
     }
     // the following will re-throw the error, but now we've printed more info
     // about what went wrong.
-    KALDI_ERR << "Error running command " << command_strings_[program_counter_];
+    KALDI_ERR << "Error running command " << command_strings[command];
   }
 }
 
@@ -558,6 +667,17 @@ void NnetComputer::Run() {
       // interaction, e.g. the end of the forward or backward phase.
       break;
     }
+    if (!command_successors_.empty() &&
+        c[program_counter_].command_type != kGotoLabel) {
+      int32 end_command = program_counter_ + 1;
+      while (end_command < num_commands &&
+             c[end_command].command_type != kAcceptInput &&
+             c[end_command].command_type != kProvideOutput &&
+             c[end_command].command_type != kGotoLabel)
+        end_command++;
+      RunParallel(end_command);
+      continue;
+    }
     if (debug_)
       DebugBeforeExecute(program_counter_, &info);
     ExecuteCommand();
@@ -570,6 +690,89 @@ void NnetComputer::Run() {
   }
 }
 
+struct NnetComputer::ParallelRunState {
+  std::mutex mutex;
+  std::condition_variable cond;
+  // The commands that are ready to be executed, i.e. all of whose dependencies
+  // have been executed.  We execute them lowest-numbered first, which keeps
+  // the order (and hence the memory use) close to that of sequential
+  // execution.
+  std::priority_queue<int32, std::vector<int32>,
+                      std::greater<int32> > ready;
+  // num_pending[c - begin_command] is the number of commands that command c
+  // is still waiting for.
+  std::vector<int32> num_pending;
+  int32 begin_command;
+  int32 end_command;
+  // The number of commands in the range that have not finished yet.
+  int32 num_remaining;
+  // Set if a command failed; the other threads then stop as soon as they can.
+  bool failed;
+  std::string error_message;
+};
+
+void NnetComputer::RunParallel(int32 end_command) {
+  ParallelRunState state;
+  state.begin_command = program_counter_;
+  state.end_command = end_command;
+  state.num_remaining = end_command - program_counter_;
+  state.failed = false;
+  state.num_pending.resize(state.num_remaining, 0);
+  for (int32 c = program_counter_; c < end_command; c++) {
+    // only dependencies within the range matter; earlier commands have been
+    // executed already.
+    const std::vector<int32> &deps = command_dependencies_[c];
+    int32 &num_pending = state.num_pending[c - program_counter_];
+    for (size_t i = 0; i < deps.size(); i++)
+      if (deps[i] >= program_counter_)
+        num_pending++;
+    if (num_pending == 0)
+      state.ready.push(c);
+  }
+  worker_pool_->Start(&state);
+  ParallelWorker(&state);
+  // 'state' is on our stack, so wait until the workers are done with it.
+  worker_pool_->Wait();
+  if (state.failed)
+    KALDI_ERR << "Error executing computation: " << state.error_message;
+  // as in the sequential loop in Run(), which will increment it.
+  program_counter_ = end_command - 1;
+}
+
+void NnetComputer::ParallelWorker(ParallelRunState *state) {
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while (true) {
+    while (state->ready.empty() && state->num_remaining > 0 && !state->failed)
+      state->cond.wait(lock);
+    if (state->num_remaining == 0 || state->failed)
+      return;
+    int32 command = state->ready.top();
+    state->ready.pop();
+    lock.unlock();
+    try {
+      ExecuteCommand(command);
+    } catch (const std::exception &e) {
+      lock.lock();
+      if (!state->failed) {
+        state->failed = true;
+        state->error_message = e.what();
+      }
+      state->cond.notify_all();
+      return;
+    }
+    lock.lock();
+    state->num_remaining--;
+    const std::vector<int32> &successors = command_successors_[command];
+    for (size_t i = 0; i < successors.size(); i++) {
+      int32 s = successors[i];
+      if (s < state->end_command &&
+          --(state->num_pending[s - state->begin_command]) == 0)
+        state->ready.push(s);
+    }
+    state->cond.notify_all();
+  }
+}
+
 void NnetComputer::AcceptInput(const std::string &node_name,
                                CuMatrix<BaseFloat> *input) {
   bool is_output = false;
@@ -706,6 +909,7 @@ void NnetComputer::AcceptInputs(const Nnet &nnet,
 }
 
 NnetComputer::~NnetComputer() {
+  delete worker_pool_;
   // Delete any pointers that are present in compressed_matrices_.  Actually
   // they should all already have been deallocated and set to NULL if the
   // compuation was run to completion; we do this in case someone ran
@@ -743,7 +947,7 @@ bool NnetComputer::Equal(const NnetComputer &other) {
 
 void NnetComputer::GetState(const std::vector<bool> &batch_first,
                             const int32 batch_size,
-                            std::vector< NnetComputeState* > *state) {
+                            std::vector< NnetComputeState* > *state) const {
   KALDI_ASSERT(state->size() <= batch_size);
   std::vector< const CuMatrix<BaseFloat>* > valid_matrices;
 
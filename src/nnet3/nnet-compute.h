@@ -39,11 +39,19 @@ namespace nnet3 {
 
 struct NnetComputeOptions {
   bool debug;
-  NnetComputeOptions(): debug(false) { }
+  int32 num_threads;
+  NnetComputeOptions(): debug(false), num_threads(1) { }
   void Register(OptionsItf *opts) {
     opts->Register("debug", &debug, "If true, turn on "
                    "debug for the neural net computation (very verbose!) "
                    "Will be turned on regardless if --verbose >= 5");
+    opts->Register("num-threads", &num_threads, "If >1, when running on "
+                   "CPU, commands of the computation that do not depend on "
+                   "each other (e.g. separate branches of the network) are "
+                   "executed in parallel using this many threads.  Only "
+                   "helpful for networks with independent branches; you may "
+                   "want to limit the number of BLAS threads.  Ignored when "
+                   "using GPU or in debug mode.");
   }
 
 };
@@ -105,7 +113,7 @@ class NnetComputer {
                const NnetComputation &computation,
                const Nnet &nnet,
                Nnet *nnet_to_update,
-               NnetComputerSnapshot *snapshot);
+               const NnetComputerSnapshot *snapshot);
 
   /// This version of the constructor accepts a pointer to 'nnet' instead
   /// of a const reference.  The difference is that this version will,
@@ -176,7 +184,7 @@ class NnetComputer {
   // The parameter named "state" stores state of streams.
   void GetState(const std::vector<bool> &batch_first,
                 const int32 batch_size,
-                std::vector< NnetComputeState* > *state);
+                std::vector< NnetComputeState* > *state) const;
   
   // Copy the state of stream from NnetComputeState to NnetComputer, 
   // filling matrices of NnetComputer with corresponding state of stream 
@@ -250,7 +258,43 @@ class NnetComputer {
 
 
   // executes the command in computation_.commands[program_counter_].
-  void ExecuteCommand();
+  void ExecuteCommand() { ExecuteCommand(program_counter_); }
+
+  // executes the command in computation_.commands[command].  If it is a
+  // kGotoLabel command, sets program_counter_.
+  void ExecuteCommand(int32 command);
+
+  // This is called from Run() if we are executing commands in parallel
+  // (i.e. if !command_successors_.empty()).  It executes the commands
+  // from program_counter_ up to but not including 'end_command', which
+  // must not include any I/O or kGotoLabel commands, respecting the
+  // dependencies between them, using options_.num_threads threads (including
+  // the calling thread).  At exit, program_counter_ equals end_command - 1,
+  // i.e. the last command executed, as in the sequential loop in Run().
+  void RunParallel(int32 end_command);
+
+  // State shared between the threads in RunParallel(); defined in
+  // nnet-compute.cc.
+  struct ParallelRunState;
+
+  // This function, called from RunParallel(), is executed by each of the
+  // threads.
+  void ParallelWorker(ParallelRunState *state);
+
+  // The following are set up in Init() only if we are to execute commands in
+  // parallel (options_.num_threads > 1, no GPU and not in debug mode).
+  // command_successors_[c] is the list of commands that directly depend on c
+  // (see ComputeCommandDependencies()); command_dependencies_[c] is the list
+  // of commands that c directly depends on.
+  std::vector<std::vector<int32> > command_successors_;
+  std::vector<std::vector<int32> > command_dependencies_;
+
+  // The options_.num_threads - 1 threads that help the calling thread in
+  // RunParallel().  Created in Init() (or the copy constructor) if we are to
+  // execute commands in parallel, and reused by every call to Run(); NULL
+  // otherwise.  Defined in nnet-compute.cc.
+  class WorkerPool;
+  WorkerPool *worker_pool_;
 
   // Returns the matrix index where the input (if is_output==false) or output
   // matrix index for "node_name" is stored.  This looks at the next command (at
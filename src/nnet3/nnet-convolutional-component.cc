@@ -29,7 +29,7 @@ namespace nnet3 {
 
 
 TimeHeightConvolutionComponent::TimeHeightConvolutionComponent():
-    use_natural_gradient_(true) { }
+    use_direct_cpu_(false), use_natural_gradient_(true) { }
 
 TimeHeightConvolutionComponent::TimeHeightConvolutionComponent(
     const TimeHeightConvolutionComponent &other):
@@ -40,6 +40,7 @@ TimeHeightConvolutionComponent::TimeHeightConvolutionComponent(
     linear_params_(other.linear_params_),
     bias_params_(other.bias_params_),
     max_memory_mb_(other.max_memory_mb_),
+    use_direct_cpu_(other.use_direct_cpu_),
     use_natural_gradient_(other.use_natural_gradient_),
     preconditioner_in_(other.preconditioner_in_),
     preconditioner_out_(other.preconditioner_out_) {
@@ -73,6 +74,7 @@ std::string TimeHeightConvolutionComponent::Info() const {
   PrintParameterStats(stream, "bias-params", bias_params_, true);
   stream << ", num-params=" << NumParameters()
          << ", max-memory-mb=" << max_memory_mb_
+         << ", use-direct-cpu=" << use_direct_cpu_
          << ", use-natural-gradient=" << use_natural_gradient_;
   if (use_natural_gradient_) {
     stream << ", num-minibatches-history="
@@ -118,6 +120,7 @@ void TimeHeightConvolutionComponent::InitFromConfig(ConfigLine *cfl) {
   // 2. convolution-related config values.
   model_.height_subsample_out = 1;  // default.
   max_memory_mb_ = 200.0;
+  use_direct_cpu_ = false;
   std::string height_offsets, time_offsets, required_time_offsets = "undef",
       offsets;
 
@@ -136,6 +139,7 @@ void TimeHeightConvolutionComponent::InitFromConfig(ConfigLine *cfl) {
   cfl->GetValue("height-subsample-out", &model_.height_subsample_out);
   cfl->GetValue("max-memory-mb", &max_memory_mb_);
   KALDI_ASSERT(max_memory_mb_ > 0.0);
+  cfl->GetValue("use-direct-cpu", &use_direct_cpu_);
 
   { // This block sets up model_.offsets.
     model_.offsets.clear();
@@ -411,6 +415,7 @@ void TimeHeightConvolutionComponent::ReorderIndexes(
   using namespace time_height_convolution;
   ConvolutionComputationOptions opts;
   opts.max_memory_mb = max_memory_mb_;
+  opts.use_direct_cpu = use_direct_cpu_;
   ConvolutionComputation computation_temp;
   std::vector<Index> input_indexes_modified,
       output_indexes_modified;
@@ -431,6 +436,11 @@ void TimeHeightConvolutionComponent::Write(std::ostream &os, bool binary) const
   bias_params_.Write(os, binary);
   WriteToken(os, binary, "<MaxMemoryMb>");
   WriteBasicType(os, binary, max_memory_mb_);
+  if (use_direct_cpu_) {
+    // only written if true, for back compatibility.
+    WriteToken(os, binary, "<UseDirectCpu>");
+    WriteBasicType(os, binary, use_direct_cpu_);
+  }
   WriteToken(os, binary, "<UseNaturalGradient>");
   WriteBasicType(os, binary, use_natural_gradient_);
   int32 rank_in = preconditioner_in_.GetRank(),
@@ -464,7 +474,18 @@ void TimeHeightConvolutionComponent::Read(std::istream &is, bool binary) {
   bias_params_.Read(is, binary);
   ExpectToken(is, binary, "<MaxMemoryMb>");
   ReadBasicType(is, binary, &max_memory_mb_);
-  ExpectToken(is, binary, "<UseNaturalGradient>");
+  // <UseDirectCpu> is only written if true.  We can't use PeekToken() to
+  // detect it, because <UseNaturalGradient> starts with the same letter.
+  std::string tok;
+  ReadToken(is, binary, &tok);
+  if (tok == "<UseDirectCpu>") {
+    ReadBasicType(is, binary, &use_direct_cpu_);
+    ReadToken(is, binary, &tok);
+  } else {
+    use_direct_cpu_ = false;
+  }
+  if (tok != "<UseNaturalGradient>")
+    KALDI_ERR << "Expected token <UseNaturalGradient>, got " << tok;
   ReadBasicType(is, binary, &use_natural_gradient_);
   int32 rank_in,  rank_out;
   BaseFloat alpha_in, alpha_out,
@@ -565,6 +586,7 @@ ComponentPrecomputedIndexes* TimeHeightConvolutionComponent::PrecomputeIndexes(
   using namespace time_height_convolution;
   ConvolutionComputationOptions opts;
   opts.max_memory_mb = max_memory_mb_;
+  opts.use_direct_cpu = use_direct_cpu_;
   PrecomputedIndexes *ans = new PrecomputedIndexes();
   std::vector<Index> input_indexes_modified,
       output_indexes_modified;
@@ -116,6 +116,11 @@ namespace nnet3 {
      max-memory-mb    Maximum amount of temporary memory, in megabytes, that may
                       be used as temporary matrices in the convolution computation.
                       default=200.0.
+     use-direct-cpu   If true, when running on CPU, use the direct implementation
+                      of the convolution that avoids copying the input to
+                      temporary matrices (faster on CPU for typical CNN setups;
+                      results are the same up to roundoff).  It has no effect
+                      on GPU.  default=false.
 
    Initialization parameters:
       param-stddev    Standard deviation of the linear parameters of the
@@ -355,6 +360,11 @@ class TimeHeightConvolutionComponent: public UpdatableComponent {
   // are).
   BaseFloat max_memory_mb_;
 
+  // If true, the computations we compile will use the direct (im2col-free)
+  // implementation of the convolution when running on CPU.  See
+  // ConvolutionComputationOptions::use_direct_cpu.
+  bool use_direct_cpu_;
+
   // Controls whether or not the natural-gradient is used.
   // Note: even if this is true, if is_gradient_ (from the
   // UpdatableComponent base class) is true, we'll do the 'simple'
@@ -552,10 +562,14 @@ class TdnnComponent: public UpdatableComponent {
   };
 
   CuMatrixBase<BaseFloat> &LinearParams() { return linear_params_; }
+  const CuMatrixBase<BaseFloat> &LinearParams() const { return linear_params_; }
 
   // This allows you to resize the vector in order to add a bias where
   // there previously was none-- obviously this should be done carefully.
   CuVector<BaseFloat> &BiasParams() { return bias_params_; }
+  const CuVector<BaseFloat> &BiasParams() const { return bias_params_; }
+
+  const std::vector<int32> &TimeOffsets() const { return time_offsets_; }
 
   BaseFloat OrthonormalConstraint() const { return orthonormal_constraint_; }
 
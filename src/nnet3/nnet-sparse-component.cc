@@ -0,0 +1,334 @@
+// nnet3/nnet-sparse-component.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iterator>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include "nnet3/nnet-sparse-component.h"
+#include "nnet3/nnet-parse.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+void BlockSparseAffineComponent::Check() const {
+  KALDI_ASSERT(block_dim_in_ > 0 && block_dim_out_ > 0 &&
+               input_dim_ % block_dim_in_ == 0 &&
+               output_dim_ % block_dim_out_ == 0);
+  int32 num_block_rows = output_dim_ / block_dim_out_,
+      num_block_cols = input_dim_ / block_dim_in_,
+      num_blocks = block_cols_.size();
+  KALDI_ASSERT(static_cast<int32>(row_offsets_.size()) == num_block_rows + 1 &&
+               row_offsets_[0] == 0 &&
+               row_offsets_[num_block_rows] == num_blocks);
+  for (int32 i = 0; i < num_block_rows; i++) {
+    KALDI_ASSERT(row_offsets_[i + 1] >= row_offsets_[i]);
+    for (int32 b = row_offsets_[i]; b < row_offsets_[i + 1]; b++) {
+      KALDI_ASSERT(block_cols_[b] >= 0 && block_cols_[b] < num_block_cols);
+      if (b > row_offsets_[i])
+        KALDI_ASSERT(block_cols_[b] > block_cols_[b - 1]);
+    }
+  }
+  KALDI_ASSERT(block_params_.NumRows() == num_blocks * block_dim_out_ &&
+               (num_blocks == 0 || block_params_.NumCols() == block_dim_in_) &&
+               bias_params_.Dim() == output_dim_);
+}
+
+BaseFloat BlockSparseAffineComponent::Density() const {
+  int32 num_block_rows = output_dim_ / block_dim_out_,
+      num_block_cols = input_dim_ / block_dim_in_;
+  return NumBlocks() / static_cast<BaseFloat>(num_block_rows *
+                                              num_block_cols);
+}
+
+std::string BlockSparseAffineComponent::Info() const {
+  std::ostringstream stream;
+  stream << Component::Info()
+         << ", block-dim-in=" << block_dim_in_
+         << ", block-dim-out=" << block_dim_out_
+         << ", num-blocks=" << NumBlocks()
+         << ", density=" << Density();
+  PrintParameterStats(stream, "block-params", block_params_);
+  PrintParameterStats(stream, "bias", bias_params_, true);
+  return stream.str();
+}
+
+void BlockSparseAffineComponent::Init(
+    const CuMatrixBase<BaseFloat> &linear_params_in,
+    const CuVectorBase<BaseFloat> &bias_params,
+    int32 block_dim_in, int32 block_dim_out,
+    BaseFloat sparsity,
+    BaseFloat *energy_retained) {
+  KALDI_ASSERT(sparsity >= 0.0 && sparsity <= 1.0);
+  input_dim_ = linear_params_in.NumCols();
+  output_dim_ = linear_params_in.NumRows();
+  block_dim_in_ = block_dim_in;
+  block_dim_out_ = block_dim_out;
+  KALDI_ASSERT(bias_params.Dim() == output_dim_ &&
+               block_dim_in > 0 && block_dim_out > 0);
+  if (input_dim_ % block_dim_in != 0 || output_dim_ % block_dim_out != 0)
+    KALDI_ERR << "Block dims " << block_dim_out << " x " << block_dim_in
+              << " do not divide the parameter dims " << output_dim_
+              << " x " << input_dim_;
+  // We do the rest of the initialization on CPU.
+  Matrix<BaseFloat> linear_params(linear_params_in);
+  int32 num_block_rows = output_dim_ / block_dim_out,
+      num_block_cols = input_dim_ / block_dim_in,
+      num_blocks_total = num_block_rows * num_block_cols;
+
+  // (squared norm, block index) for each block, where the block index
+  // is i * num_block_cols + j.
+  std::vector<std::pair<BaseFloat, int32> > block_norms;
+  block_norms.reserve(num_blocks_total);
+  double tot_energy = 0.0;
+  for (int32 i = 0; i < num_block_rows; i++) {
+    for (int32 j = 0; j < num_block_cols; j++) {
+      SubMatrix<BaseFloat> block(linear_params, i * block_dim_out,
+                                 block_dim_out, j * block_dim_in,
+                                 block_dim_in);
+      BaseFloat sumsq = TraceMatMat(block, block, kTrans);
+      tot_energy += sumsq;
+      if (sumsq != 0.0)
+        block_norms.push_back(std::pair<BaseFloat, int32>(
+            sumsq, i * num_block_cols + j));
+    }
+  }
+  // num_keep is the number of blocks we keep.
+  int32 num_keep = std::min<int32>(
+      block_norms.size(),
+      static_cast<int32>((1.0 - sparsity) * num_blocks_total + 0.5));
+  std::sort(block_norms.begin(), block_norms.end(),
+            std::greater<std::pair<BaseFloat, int32> >());
+  std::vector<int32> kept_blocks(num_keep);
+  double kept_energy = 0.0;
+  for (int32 k = 0; k < num_keep; k++) {
+    kept_blocks[k] = block_norms[k].second;
+    kept_energy += block_norms[k].first;
+  }
+  // sorting the block indexes puts them in the order we need for the
+  // compressed-sparse-row format.
+  std::sort(kept_blocks.begin(), kept_blocks.end());
+
+  row_offsets_.clear();
+  row_offsets_.resize(num_block_rows + 1, 0);
+  block_cols_.resize(num_keep);
+  // (note: a matrix with zero rows must have zero columns.)
+  Matrix<BaseFloat> block_params(num_keep * block_dim_out,
+                                 num_keep > 0 ? block_dim_in : 0,
+                                 kUndefined);
+  for (int32 k = 0; k < num_keep; k++) {
+    int32 i = kept_blocks[k] / num_block_cols,
+        j = kept_blocks[k] % num_block_cols;
+    row_offsets_[i + 1]++;
+    block_cols_[k] = j;
+    block_params.RowRange(k * block_dim_out, block_dim_out).CopyFromMat(
+        linear_params.Range(i * block_dim_out, block_dim_out,
+                            j * block_dim_in, block_dim_in));
+  }
+  for (int32 i = 0; i < num_block_rows; i++)
+    row_offsets_[i + 1] += row_offsets_[i];
+  block_params_.Swap(&block_params);
+  bias_params_ = bias_params;
+  if (energy_retained != NULL)
+    *energy_retained = (tot_energy == 0.0 ? 1.0 : kept_energy / tot_energy);
+  Check();
+}
+
+void BlockSparseAffineComponent::InitFromConfig(ConfigLine *cfl) {
+  int32 input_dim = -1, output_dim = -1, block_dim_in = -1,
+      block_dim_out = -1;
+  bool ok = cfl->GetValue("input-dim", &input_dim) &&
+      cfl->GetValue("output-dim", &output_dim) &&
+      cfl->GetValue("block-dim-in", &block_dim_in) &&
+      cfl->GetValue("block-dim-out", &block_dim_out);
+  if (!ok || input_dim <= 0 || output_dim <= 0)
+    KALDI_ERR << "Bad initializer " << cfl->WholeLine();
+  BaseFloat density = 0.5,
+      param_stddev = 1.0 / std::sqrt(input_dim),
+      bias_stddev = 1.0;
+  cfl->GetValue("density", &density);
+  cfl->GetValue("param-stddev", &param_stddev);
+  cfl->GetValue("bias-stddev", &bias_stddev);
+  if (cfl->HasUnusedValues())
+    KALDI_ERR << "Could not process these elements in initializer: "
+              << cfl->UnusedValues();
+  KALDI_ASSERT(density >= 0.0 && density <= 1.0);
+  CuMatrix<BaseFloat> linear_params(output_dim, input_dim);
+  CuVector<BaseFloat> bias_params(output_dim);
+  linear_params.SetRandn();
+  linear_params.Scale(param_stddev);
+  bias_params.SetRandn();
+  bias_params.Scale(bias_stddev);
+  // Since the parameters are random, pruning by magnitude gives a random
+  // sparsity pattern.
+  Init(linear_params, bias_params, block_dim_in, block_dim_out,
+       1.0 - density);
+}
+
+int32 BlockSparseAffineComponent::RowBlockSize(int32 num_rows) const {
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    return num_rows;
+#endif
+  // Process enough rows at a time that the input and output chunks take up
+  // about 256KB.
+  const int32 kBlockFloats = 65536;
+  return std::max<int32>(1, kBlockFloats / (input_dim_ + output_dim_));
+}
+
+void* BlockSparseAffineComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+  out->CopyRowsFromVec(bias_params_);
+  int32 num_rows = in.NumRows(),
+      num_block_rows = output_dim_ / block_dim_out_,
+      row_block_size = RowBlockSize(num_rows);
+  for (int32 r = 0; r < num_rows; r += row_block_size) {
+    int32 this_num_rows = std::min<int32>(row_block_size, num_rows - r);
+    CuSubMatrix<BaseFloat> in_part(in, r, this_num_rows, 0, input_dim_),
+        out_part(*out, r, this_num_rows, 0, output_dim_);
+    for (int32 i = 0; i < num_block_rows; i++) {
+      CuSubMatrix<BaseFloat> out_block(out_part.ColRange(i * block_dim_out_,
+                                                         block_dim_out_));
+      for (int32 b = row_offsets_[i]; b < row_offsets_[i + 1]; b++) {
+        out_block.AddMatMat(1.0, in_part.ColRange(block_cols_[b] *
+                                                  block_dim_in_,
+                                                  block_dim_in_),
+                            kNoTrans,
+                            block_params_.RowRange(b * block_dim_out_,
+                                                   block_dim_out_),
+                            kTrans, 1.0);
+      }
+    }
+  }
+  return NULL;
+}
+
+void BlockSparseAffineComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &, // in_value
+    const CuMatrixBase<BaseFloat> &, // out_value
+    const CuMatrixBase<BaseFloat> &out_deriv,
+    void *memo,
+    Component *, // to_update
+    CuMatrixBase<BaseFloat> *in_deriv) const {
+  NVTX_RANGE("BlockSparseAffineComponent::Backprop");
+  // kBackpropAdds is true. It's the user's responsibility to zero out
+  // <in_deriv> if they need it to be so.
+  if (in_deriv == NULL)
+    return;
+  int32 num_rows = out_deriv.NumRows(),
+      num_block_rows = output_dim_ / block_dim_out_,
+      row_block_size = RowBlockSize(num_rows);
+  for (int32 r = 0; r < num_rows; r += row_block_size) {
+    int32 this_num_rows = std::min<int32>(row_block_size, num_rows - r);
+    CuSubMatrix<BaseFloat> out_deriv_part(out_deriv, r, this_num_rows,
+                                          0, output_dim_),
+        in_deriv_part(*in_deriv, r, this_num_rows, 0, input_dim_);
+    for (int32 i = 0; i < num_block_rows; i++) {
+      CuSubMatrix<BaseFloat> out_deriv_block(
+          out_deriv_part.ColRange(i * block_dim_out_, block_dim_out_));
+      for (int32 b = row_offsets_[i]; b < row_offsets_[i + 1]; b++) {
+        CuSubMatrix<BaseFloat> in_deriv_block(
+            in_deriv_part.ColRange(block_cols_[b] * block_dim_in_,
+                                   block_dim_in_));
+        in_deriv_block.AddMatMat(1.0, out_deriv_block, kNoTrans,
+                                 block_params_.RowRange(b * block_dim_out_,
+                                                        block_dim_out_),
+                                 kNoTrans, 1.0);
+      }
+    }
+  }
+}
+
+void BlockSparseAffineComponent::GetLinearParams(
+    CuMatrix<BaseFloat> *linear_params) const {
+  linear_params->Resize(output_dim_, input_dim_);
+  int32 num_block_rows = output_dim_ / block_dim_out_;
+  for (int32 i = 0; i < num_block_rows; i++) {
+    for (int32 b = row_offsets_[i]; b < row_offsets_[i + 1]; b++) {
+      linear_params->Range(i * block_dim_out_, block_dim_out_,
+                           block_cols_[b] * block_dim_in_,
+                           block_dim_in_).CopyFromMat(
+                               block_params_.RowRange(b * block_dim_out_,
+                                                      block_dim_out_));
+    }
+  }
+}
+
+Component* BlockSparseAffineComponent::Copy() const {
+  BlockSparseAffineComponent *ans = new BlockSparseAffineComponent();
+  ans->input_dim_ = input_dim_;
+  ans->output_dim_ = output_dim_;
+  ans->block_dim_in_ = block_dim_in_;
+  ans->block_dim_out_ = block_dim_out_;
+  ans->row_offsets_ = row_offsets_;
+  ans->block_cols_ = block_cols_;
+  ans->block_params_ = block_params_;
+  ans->bias_params_ = bias_params_;
+  return ans;
+}
+
+void BlockSparseAffineComponent::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<BlockSparseAffineComponent>");
+  WriteToken(os, binary, "<InputDim>");
+  WriteBasicType(os, binary, input_dim_);
+  WriteToken(os, binary, "<OutputDim>");
+  WriteBasicType(os, binary, output_dim_);
+  WriteToken(os, binary, "<BlockDimIn>");
+  WriteBasicType(os, binary, block_dim_in_);
+  WriteToken(os, binary, "<BlockDimOut>");
+  WriteBasicType(os, binary, block_dim_out_);
+  WriteToken(os, binary, "<RowOffsets>");
+  WriteIntegerVector(os, binary, row_offsets_);
+  WriteToken(os, binary, "<BlockCols>");
+  WriteIntegerVector(os, binary, block_cols_);
+  WriteToken(os, binary, "<BlockParams>");
+  block_params_.Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "</BlockSparseAffineComponent>");
+}
+
+void BlockSparseAffineComponent::Read(std::istream &is, bool binary) {
+  ExpectOneOrTwoTokens(is, binary, "<BlockSparseAffineComponent>",
+                       "<InputDim>");
+  ReadBasicType(is, binary, &input_dim_);
+  ExpectToken(is, binary, "<OutputDim>");
+  ReadBasicType(is, binary, &output_dim_);
+  ExpectToken(is, binary, "<BlockDimIn>");
+  ReadBasicType(is, binary, &block_dim_in_);
+  ExpectToken(is, binary, "<BlockDimOut>");
+  ReadBasicType(is, binary, &block_dim_out_);
+  ExpectToken(is, binary, "<RowOffsets>");
+  ReadIntegerVector(is, binary, &row_offsets_);
+  ExpectToken(is, binary, "<BlockCols>");
+  ReadIntegerVector(is, binary, &block_cols_);
+  ExpectToken(is, binary, "<BlockParams>");
+  block_params_.Read(is, binary);
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "</BlockSparseAffineComponent>");
+  Check();
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
@@ -0,0 +1,159 @@
+// nnet3/nnet-sparse-component.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_SPARSE_COMPONENT_H_
+#define KALDI_NNET3_NNET_SPARSE_COMPONENT_H_
+
+#include "nnet3/nnet-common.h"
+#include "nnet3/nnet-component-itf.h"
+#include <iostream>
+
+namespace kaldi {
+namespace nnet3 {
+
+/// @file  nnet-sparse-component.h
+///
+///   This file contains declarations of components whose parameters are
+///   stored in a sparse form, for faster inference with pruned models.
+///   Currently it contains just BlockSparseAffineComponent.
+
+
+/**
+   BlockSparseAffineComponent is a non-updatable affine component (like
+   FixedAffineComponent) whose linear parameters are block-sparse: the
+   (output-dim by input-dim) parameter matrix is divided into blocks of size
+   block-dim-out by block-dim-in, and only the nonzero blocks are stored.  It
+   is intended for test-time use of models whose AffineComponents or
+   LinearComponents have been pruned; it's normally created from such
+   components by the program nnet3-prune (see PruneToBlockSparse() in
+   nnet-utils.h), but for testing purposes it can also be initialized
+   from a config line, with a random sparsity pattern.
+
+   The nonzero blocks are stored in a compressed-sparse-row format over
+   block-rows.  The propagation does one matrix multiply per nonzero block,
+   directly on column-ranges of the input and output (no copying), and on CPU
+   it processes the rows in cache-sized pieces.  This is faster than the
+   dense multiply when the proportion of nonzero blocks is small enough; the
+   block dimension should be large enough (e.g. 16 or 32) for the individual
+   matrix multiplies to be efficient.
+
+   Parameters accepted on the config line, with default if applicable:
+
+     input-dim        The input dimension of the component
+     output-dim       The output dimension of the component
+     block-dim-in     Block size on the input side; must divide input-dim.
+     block-dim-out    Block size on the output side; must divide output-dim.
+     density=0.5      Proportion of blocks that are nonzero (chosen at random).
+     param-stddev=1/sqrt(input-dim)  The standard deviation of the elements of
+                      the linear parameters.
+     bias-stddev=1.0  The standard deviation of the bias parameters.
+*/
+class BlockSparseAffineComponent: public Component {
+ public:
+  BlockSparseAffineComponent(): input_dim_(0), output_dim_(0),
+                                block_dim_in_(0), block_dim_out_(0) { }
+  virtual std::string Type() const { return "BlockSparseAffineComponent"; }
+  virtual std::string Info() const;
+
+  virtual void InitFromConfig(ConfigLine *cfl);
+
+  /**
+     Initializes from dense parameters.
+       @param [in] linear_params  The linear parameters, of dimension
+                           output-dim by input-dim.
+       @param [in] bias_params  The bias, of dimension output-dim.
+       @param [in] block_dim_in  The block size on the input side; must
+                           divide input-dim.
+       @param [in] block_dim_out  The block size on the output side; must
+                           divide output-dim.
+       @param [in] sparsity  The proportion of blocks to prune, 0 <= sparsity
+                           <= 1.  We keep the (1 - sparsity) proportion of
+                           blocks with the largest Frobenius norm; blocks that
+                           are exactly zero are never kept.
+       @param [out] energy_retained  If non-NULL, the proportion of the
+                           squared Frobenius norm of 'linear_params' that is
+                           in the kept blocks will be written to here.
+  */
+  void Init(const CuMatrixBase<BaseFloat> &linear_params,
+            const CuVectorBase<BaseFloat> &bias_params,
+            int32 block_dim_in, int32 block_dim_out,
+            BaseFloat sparsity,
+            BaseFloat *energy_retained = NULL);
+
+  virtual int32 Properties() const { return kSimpleComponent|kBackpropAdds; }
+  virtual int32 InputDim() const { return input_dim_; }
+  virtual int32 OutputDim() const { return output_dim_; }
+
+  virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
+                         const CuMatrixBase<BaseFloat> &in,
+                         CuMatrixBase<BaseFloat> *out) const;
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &in_value,
+                        const CuMatrixBase<BaseFloat> &, // out_value
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        void *memo,
+                        Component *to_update,
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+
+  virtual Component* Copy() const;
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+
+  /// Returns the number of nonzero blocks.
+  int32 NumBlocks() const { return block_cols_.size(); }
+  /// Returns the proportion of blocks that are nonzero.
+  BaseFloat Density() const;
+  /// Outputs the linear parameters as a dense matrix of dimension
+  /// output-dim by input-dim.
+  void GetLinearParams(CuMatrix<BaseFloat> *linear_params) const;
+  const CuVector<BaseFloat> &BiasParams() const { return bias_params_; }
+
+ private:
+  void Check() const;
+
+  // Returns the number of rows of the input and output that we process at a
+  // time in Propagate() and Backprop(); on CPU this is chosen so that the
+  // parts of the matrices we're working on stay in cache.
+  int32 RowBlockSize(int32 num_rows) const;
+
+  int32 input_dim_;
+  int32 output_dim_;
+  int32 block_dim_in_;
+  int32 block_dim_out_;
+  // row_offsets_ is of dimension output_dim_ / block_dim_out_ + 1; the
+  // nonzero blocks in block-row i are numbered row_offsets_[i] through
+  // row_offsets_[i+1] - 1.
+  std::vector<int32> row_offsets_;
+  // block_cols_[b] is the block-column index (0 <= block_cols_[b] <
+  // input_dim_ / block_dim_in_) of the b'th nonzero block.
+  std::vector<int32> block_cols_;
+  // The parameters of the nonzero blocks; it is of dimension
+  // (NumBlocks() * block_dim_out_) by block_dim_in_, and the b'th block is
+  // the row-range starting at b * block_dim_out_.
+  CuMatrix<BaseFloat> block_params_;
+  CuVector<BaseFloat> bias_params_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(BlockSparseAffineComponent);
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+
+#endif
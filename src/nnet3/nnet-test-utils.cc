@@ -1063,6 +1063,8 @@ void GenerateConfigSequenceCnnNew(
       // it breaks up the temporary matrix into pieces
       ss << " max-memory-mb=1.0e-04";
     }
+    if (RandInt(0, 1) == 0)
+      ss << " use-direct-cpu=true";
 
     if (height_subsampling_factor != 1 || RandInt(0, 1) == 0)
       ss << " height-subsample-out=" << height_subsampling_factor;
@@ -1400,7 +1402,7 @@ void ComputeExampleComputationRequestSimple(
 static void GenerateRandomComponentConfig(std::string *component_type,
                                           std::string *config) {
 
-  int32 n = RandInt(0, 37);
+  int32 n = RandInt(0, 38);
   BaseFloat learning_rate = 0.001 * RandInt(1, 100);
 
   std::ostringstream os;
@@ -1773,6 +1775,16 @@ static void GenerateRandomComponentConfig(std::string *component_type,
 
       break;
     }
+    case 38: {
+      *component_type = "BlockSparseAffineComponent";
+      int32 block_dim_in = RandInt(1, 8), block_dim_out = RandInt(1, 8);
+      os << "input-dim=" << (block_dim_in * RandInt(1, 6))
+         << " output-dim=" << (block_dim_out * RandInt(1, 6))
+         << " block-dim-in=" << block_dim_in
+         << " block-dim-out=" << block_dim_out
+         << " density=" << (0.1 * RandInt(0, 10));
+      break;
+    }
     default:
       KALDI_ERR << "Error generating random component";
   }
@@ -25,6 +25,7 @@
 #include "nnet3/nnet-normalize-component.h"
 #include "nnet3/nnet-general-component.h"
 #include "nnet3/nnet-convolutional-component.h"
+#include "nnet3/nnet-sparse-component.h"
 #include "nnet3/nnet-parse.h"
 #include "nnet3/nnet-computation-graph.h"
 #include "nnet3/nnet-diagnostics.h"
@@ -659,7 +660,8 @@ void FindOrphanNodes(const Nnet &nnet, std::vector<int32> *nodes) {
 //        the SVD process is aborted for that particular Affine weights layer.
 //
 
-// this class implements the internals of the edit directive 'apply-svd'.
+// this class implements the internals of the edit directive 'apply-svd', and
+// of FactorizeComponents().
 class SvdApplier {
  public:
   SvdApplier(const std::string component_name_pattern,
@@ -670,13 +672,27 @@ class SvdApplier {
                           bottleneck_dim_(bottleneck_dim),
         		  energy_threshold_(energy_threshold),
           		  shrinkage_threshold_(shrinkage_threshold),
-                          component_name_pattern_(component_name_pattern) { }
-  void ApplySvd() {
+                          component_name_pattern_(component_name_pattern),
+                          tot_flops_before_(0.0), tot_flops_after_(0.0) { }
+  // Returns the number of components that were decomposed.
+  int32 ApplySvd() {
     DecomposeComponents();
     if (!modified_component_info_.empty())
       ModifyTopology();
-    KALDI_LOG << "Decomposed " << modified_component_info_.size()
-              << " components with SVD dimension " << bottleneck_dim_;
+    if (energy_threshold_ > 0) {
+      KALDI_LOG << "Decomposed " << modified_component_info_.size()
+                << " components with SVD, energy threshold "
+                << energy_threshold_;
+    } else {
+      KALDI_LOG << "Decomposed " << modified_component_info_.size()
+                << " components with SVD dimension " << bottleneck_dim_;
+    }
+    if (tot_flops_before_ > 0.0)
+      KALDI_LOG << "Multiply-adds per frame in the components considered "
+                << "went from " << tot_flops_before_ << " to "
+                << tot_flops_after_ << " (ratio "
+                << (tot_flops_after_ / tot_flops_before_) << ")";
+    return modified_component_info_.size();
   }
 
  private:
@@ -692,13 +708,20 @@ class SvdApplier {
       if (NameMatchesPattern(component_name.c_str(),
                              component_name_pattern_.c_str())) {
         AffineComponent *affine =  dynamic_cast<AffineComponent*>(component);
-        if (affine == NULL) {
-          KALDI_WARN << "Not decomposing component " << component_name
-                     << " as it is not an AffineComponent.";
+        TdnnComponent *tdnn = dynamic_cast<TdnnComponent*>(component);
+        if (affine == NULL && tdnn == NULL) {
+          // only warn for updatable components, so that patterns like '*'
+          // don't produce a warning for every nonlinearity.
+          if (component->Properties() & kUpdatableComponent)
+            KALDI_WARN << "Not decomposing component " << component_name
+                       << " as it is not an AffineComponent or TdnnComponent.";
           continue;
         }
-        int32 input_dim = affine->InputDim(),
-            output_dim = affine->OutputDim();
+        // for TdnnComponent, 'input_dim' is the dimension after splicing,
+        // i.e. the num-cols of the parameter matrix.
+        int32 input_dim = (affine != NULL ? affine->InputDim() :
+                           tdnn->LinearParams().NumCols()),
+            output_dim = component->OutputDim();
         if (input_dim <= bottleneck_dim_ || output_dim <= bottleneck_dim_) {
           KALDI_WARN << "Not decomposing component " << component_name
                      << " with SVD to rank " << bottleneck_dim_
@@ -707,7 +730,12 @@ class SvdApplier {
           continue;
         }
         Component *component_a = NULL, *component_b = NULL;
-	if (DecomposeComponent(component_name, *affine, &component_a, &component_b)) {
+        bool decomposed = (affine != NULL ?
+                           DecomposeComponent(component_name, *affine,
+                                              &component_a, &component_b) :
+                           DecomposeComponent(component_name, *tdnn,
+                                              &component_a, &component_b));
+	if (decomposed) {
 	  size_t n = modified_component_info_.size();
 	  modification_index_[c] = n;
 	  modified_component_info_.resize(n + 1);
@@ -729,8 +757,6 @@ class SvdApplier {
 	}
       }
     }
-    KALDI_LOG << "Converted " << modified_component_info_.size()
-              << " components to FixedAffineComponent.";
   }
 
   // This function finds the minimum index of
@@ -766,9 +792,80 @@ class SvdApplier {
                           const AffineComponent &affine,
                           Component **component_a_out,
                           Component **component_b_out) {
-    int32 input_dim = affine.InputDim(), output_dim = affine.OutputDim();
-    Matrix<BaseFloat> linear_params(affine.LinearParams());
-    Vector<BaseFloat> bias_params(affine.BiasParams());
+    Matrix<BaseFloat> A, B;
+    if (!ComputeFactors(component_name, Matrix<BaseFloat>(affine.LinearParams()),
+                        &A, &B))
+      return false;
+    CuMatrix<BaseFloat> A_cuda(A), B_cuda(B);
+    CuVector<BaseFloat> bias_params_cuda(affine.BiasParams());
+
+    LinearComponent *component_a = new LinearComponent(A_cuda);
+    NaturalGradientAffineComponent *component_b =
+        new NaturalGradientAffineComponent(B_cuda, bias_params_cuda);
+    // set the learning rates, max-change, and so on.
+    component_a->SetUpdatableConfigs(affine);
+    component_b->SetUpdatableConfigs(affine);
+    *component_a_out = component_a;
+    *component_b_out = component_b;
+    return true;
+  }
+
+  // This version of DecomposeComponent() is for TdnnComponent.  The first
+  // part is a TdnnComponent without bias, with the same time-offsets as the
+  // original and with output dimension equal to the bottleneck dim (the
+  // splicing has to stay in the first part); the second part is a
+  // NaturalGradientAffineComponent, or a LinearComponent if the original had
+  // no bias.
+  bool DecomposeComponent(const std::string &component_name,
+                          const TdnnComponent &tdnn,
+                          Component **component_a_out,
+                          Component **component_b_out) {
+    Matrix<BaseFloat> A, B;
+    if (!ComputeFactors(component_name, Matrix<BaseFloat>(tdnn.LinearParams()),
+                        &A, &B))
+      return false;
+
+    const std::vector<int32> &time_offsets = tdnn.TimeOffsets();
+    std::ostringstream config_os;
+    config_os << "input-dim=" << tdnn.InputDim()
+              << " output-dim=" << A.NumRows() << " time-offsets=";
+    for (size_t i = 0; i < time_offsets.size(); i++)
+      config_os << (i == 0 ? "" : ",") << time_offsets[i];
+    config_os << " use-bias=false";
+    ConfigLine config_line;
+    if (!config_line.ParseLine(config_os.str()))
+      KALDI_ERR << "Error parsing config line " << config_os.str();
+    TdnnComponent *component_a = new TdnnComponent();
+    component_a->InitFromConfig(&config_line);
+    component_a->LinearParams().CopyFromMat(A);
+    component_a->SetUpdatableConfigs(tdnn);
+
+    CuMatrix<BaseFloat> B_cuda(B);
+    UpdatableComponent *component_b;
+    if (tdnn.BiasParams().Dim() != 0) {
+      CuVector<BaseFloat> bias_params_cuda(tdnn.BiasParams());
+      component_b = new NaturalGradientAffineComponent(B_cuda,
+                                                       bias_params_cuda);
+    } else {
+      component_b = new LinearComponent(B_cuda);
+    }
+    component_b->SetUpdatableConfigs(tdnn);
+    *component_a_out = component_a;
+    *component_b_out = component_b;
+    return true;
+  }
+
+  // This function does the SVD of 'linear_params' (of dimension output_dim by
+  // input_dim) and works out the reduced dimension r (from bottleneck_dim_ or
+  // energy_threshold_).  If the shrinkage ratio is acceptable it outputs 'A'
+  // (r by input_dim) and 'B' (output_dim by r) with B A approximating
+  // linear_params, and returns true; otherwise it returns false.
+  bool ComputeFactors(const std::string &component_name,
+                      const Matrix<BaseFloat> &linear_params,
+                      Matrix<BaseFloat> *A_out,
+                      Matrix<BaseFloat> *B_out) {
+    int32 input_dim = linear_params.NumCols(),
+        output_dim = linear_params.NumRows();
     int32 middle_dim = std::min<int32>(input_dim, output_dim);
 
     // note: 'linear_params' is of dimension output_dim by input_dim.
@@ -782,26 +879,37 @@ class SvdApplier {
     s2.AddVec2(1.0, s);
     BaseFloat s2_sum_orig = s2.Sum();
     KALDI_ASSERT(energy_threshold_ < 1);
-    KALDI_ASSERT(shrinkage_threshold_ < 1);
+    KALDI_ASSERT(shrinkage_threshold_ <= 1);
+    // note: we don't modify bottleneck_dim_ here, because it would then
+    // affect subsequent components.
+    int32 bottleneck_dim = bottleneck_dim_;
     if (energy_threshold_ > 0) {
       BaseFloat min_singular_sum = energy_threshold_ * s2_sum_orig;
-      bottleneck_dim_ = GetReducedDimension(s2, 0, s2.Dim()-1, min_singular_sum);
+      bottleneck_dim = GetReducedDimension(s2, 0, s2.Dim()-1, min_singular_sum);
     }
-    SubVector<BaseFloat> this_part(s2, 0, bottleneck_dim_);
+    SubVector<BaseFloat> this_part(s2, 0, bottleneck_dim);
     BaseFloat s2_sum_reduced = this_part.Sum();
-    BaseFloat shrinkage_ratio =
-      static_cast<BaseFloat>(bottleneck_dim_ * (input_dim+output_dim))
-      / static_cast<BaseFloat>(input_dim * output_dim);
+    // the number of multiply-adds per frame is the same as the number of
+    // parameters (ignoring the bias), so the shrinkage ratio is also the
+    // ratio of flops after vs. before.
+    double flops_before = static_cast<double>(input_dim) * output_dim,
+        flops_after = static_cast<double>(bottleneck_dim) *
+                      (input_dim + output_dim);
+    BaseFloat shrinkage_ratio = flops_after / flops_before;
+    tot_flops_before_ += flops_before;
     if (shrinkage_ratio > shrinkage_threshold_) {
-      KALDI_LOG << "Shrinkage ratio " << shrinkage_ratio
+      KALDI_LOG << "For component " << component_name
+                << ", shrinkage ratio " << shrinkage_ratio
 		<< " greater than threshold : " << shrinkage_threshold_
 		<< " Skipping SVD for this layer.";
+      tot_flops_after_ += flops_before;
       return false;
     }
+    tot_flops_after_ += flops_after;
 
-    s.Resize(bottleneck_dim_, kCopyData);
-    A.Resize(bottleneck_dim_, input_dim, kCopyData);
-    B.Resize(output_dim, bottleneck_dim_, kCopyData);
+    s.Resize(bottleneck_dim, kCopyData);
+    A.Resize(bottleneck_dim, input_dim, kCopyData);
+    B.Resize(output_dim, bottleneck_dim, kCopyData);
     KALDI_LOG << "For component " << component_name
               << " singular value squared sum changed by "
               << (s2_sum_orig - s2_sum_reduced)
@@ -809,27 +917,20 @@ class SvdApplier {
     KALDI_LOG << "For component " << component_name
 	      << " dimension reduced from "
               << " (" << input_dim << "," << output_dim << ")"
-	      << " to [(" << input_dim << "," << bottleneck_dim_
-	      << "), (" << bottleneck_dim_ << "," << output_dim <<")]";
-    KALDI_LOG << "shrinkage ratio : " << shrinkage_ratio;
+	      << " to [(" << input_dim << "," << bottleneck_dim
+	      << "), (" << bottleneck_dim << "," << output_dim <<")]";
+    KALDI_LOG << "For component " << component_name
+              << " multiply-adds per frame reduced from " << flops_before
+              << " to " << flops_after << "; shrinkage ratio : "
+              << shrinkage_ratio;
 
     // we'll divide the singular values equally between the two
     // parameter matrices.
     s.ApplyPow(0.5);
     A.MulRowsVec(s);
     B.MulColsVec(s);
-
-    CuMatrix<BaseFloat> A_cuda(A), B_cuda(B);
-    CuVector<BaseFloat> bias_params_cuda(bias_params);
-
-    LinearComponent *component_a = new LinearComponent(A_cuda);
-    NaturalGradientAffineComponent *component_b =
-        new NaturalGradientAffineComponent(B_cuda, bias_params_cuda);
-    // set the learning rates, max-change, and so on.
-    component_a->SetUpdatableConfigs(affine);
-    component_b->SetUpdatableConfigs(affine);
-    *component_a_out = component_a;
-    *component_b_out = component_b;
+    A_out->Swap(&A);
+    B_out->Swap(&B);
     return true;
   }
 
@@ -968,8 +1069,25 @@ class SvdApplier {
   BaseFloat energy_threshold_;
   BaseFloat shrinkage_threshold_;
   std::string component_name_pattern_;
+  // The total number of multiply-adds per frame in the components we
+  // considered, before and after decomposition.
+  double tot_flops_before_;
+  double tot_flops_after_;
 };
 
+int32 FactorizeComponents(const SvdFactorizeConfig &config,
+                          Nnet *nnet) {
+  if (config.bottleneck_dim <= 0 && config.energy_threshold <= 0)
+    KALDI_ERR << "Either bottleneck-dim or energy-threshold must be set.";
+  if (config.energy_threshold >= 1.0 || config.shrinkage_threshold > 1.0)
+    KALDI_ERR << "Invalid energy-threshold " << config.energy_threshold
+              << " or shrinkage-threshold " << config.shrinkage_threshold;
+  SvdApplier applier(config.component_names, config.bottleneck_dim,
+                     config.energy_threshold, config.shrinkage_threshold,
+                     nnet);
+  return applier.ApplySvd();
+}
+
 /*
   Does an update that moves M closer to being a (matrix with orthonormal rows)
   times 'scale'.  Note: this will diverge if we start off with singular values
@@ -1245,6 +1363,83 @@ void ReduceRankOfComponents(const std::string component_name_pattern,
 }
 
 
+int32 PruneToBlockSparse(const BlockSparsePruneConfig &config,
+                         Nnet *nnet) {
+  KALDI_ASSERT(config.block_dim_in > 0 && config.block_dim_out > 0 &&
+               config.sparsity >= 0.0 && config.sparsity <= 1.0);
+  int32 num_converted = 0;
+  // The following are summed over all components considered, and are
+  // the number of multiply-adds per frame before and after.
+  double tot_flops_before = 0.0, tot_flops_after = 0.0;
+  std::ostringstream report;
+  report << "Block-sparse pruning report (block size "
+         << config.block_dim_out << " x " << config.block_dim_in
+         << ", sparsity=" << config.sparsity
+         << ", max-density=" << config.max_density << "):";
+  for (int32 c = 0; c < nnet->NumComponents(); c++) {
+    Component *component = nnet->GetComponent(c);
+    const std::string &component_name = nnet->GetComponentName(c);
+    if (!NameMatchesPattern(component_name.c_str(),
+                            config.component_names.c_str()))
+      continue;
+    AffineComponent *affine = dynamic_cast<AffineComponent*>(component);
+    LinearComponent *linear = dynamic_cast<LinearComponent*>(component);
+    if (affine == NULL && linear == NULL)
+      continue;
+    const CuMatrixBase<BaseFloat> &linear_params =
+        (affine != NULL ? affine->LinearParams() : linear->Params());
+    int32 input_dim = linear_params.NumCols(),
+        output_dim = linear_params.NumRows();
+    double flops = static_cast<double>(input_dim) * output_dim;
+    tot_flops_before += flops;
+    report << "\n  " << component_name << " (" << component->Type()
+           << ", " << input_dim << " -> " << output_dim << "): ";
+    if (input_dim % config.block_dim_in != 0 ||
+        output_dim % config.block_dim_out != 0) {
+      report << "not converted (dims not divisible by block size).";
+      tot_flops_after += flops;
+      continue;
+    }
+    CuVector<BaseFloat> bias_params(output_dim);
+    if (affine != NULL)
+      bias_params.CopyFromVec(affine->BiasParams());
+    BlockSparseAffineComponent *sparse = new BlockSparseAffineComponent();
+    BaseFloat energy_retained;
+    sparse->Init(linear_params, bias_params,
+                 config.block_dim_in, config.block_dim_out,
+                 config.sparsity, &energy_retained);
+    BaseFloat density = sparse->Density();
+    // note: the density is also the ratio of multiply-adds after vs.
+    // before conversion.
+    report << "density=" << density
+           << ", energy-retained=" << energy_retained << ": ";
+    if (density <= config.max_density) {
+      report << "converted.";
+      nnet->SetComponent(c, sparse);  // takes ownership, deletes old one.
+      tot_flops_after += flops * density;
+      num_converted++;
+    } else {
+      report << "not converted (density too high).";
+      tot_flops_after += flops;
+      delete sparse;
+    }
+  }
+  KALDI_LOG << report.str();
+  if (tot_flops_before > 0.0) {
+    KALDI_LOG << "Converted " << num_converted << " components to "
+              << "block-sparse form; multiply-adds per frame in the "
+              << "components considered went from " << tot_flops_before
+              << " to " << tot_flops_after << " (ratio "
+              << (tot_flops_after / tot_flops_before) << ")";
+  } else {
+    KALDI_WARN << "No components matched the pattern '"
+               << config.component_names << "' and were of a type that "
+               << "we can prune.";
+  }
+  return num_converted;
+}
+
+
 
 
 void ReadEditConfig(std::istream &edit_config_is, Nnet *nnet) {
@@ -1426,11 +1621,12 @@ void ReadEditConfig(std::istream &edit_config_is, Nnet *nnet) {
         KALDI_ERR << "Either Bottleneck-dim or energy-threshold "
 	  "must be set in apply-svd command. "
 	  "Range of possible values is (0 1]";
-      SvdApplier applier(name_pattern, bottleneck_dim,
-			 energy_threshold,
-			 shrinkage_threshold,
-			 nnet);
-      applier.ApplySvd();
+      SvdFactorizeConfig factorize_config;
+      factorize_config.component_names = name_pattern;
+      factorize_config.bottleneck_dim = bottleneck_dim;
+      factorize_config.energy_threshold = energy_threshold;
+      factorize_config.shrinkage_threshold = shrinkage_threshold;
+      FactorizeComponents(factorize_config, nnet);
     } else if (directive == "reduce-rank") {
       std::string name_pattern;
       int32 rank = -1;
@@ -258,6 +258,106 @@ struct CollapseModelConfig {
 void CollapseModel(const CollapseModelConfig &config,
                    Nnet *nnet);
 
+
+/**
+   Configuration for PruneToBlockSparse(), which is used in the program
+   nnet3-prune.
+ */
+struct BlockSparsePruneConfig {
+  int32 block_dim_in;
+  int32 block_dim_out;
+  BaseFloat sparsity;
+  BaseFloat max_density;
+  std::string component_names;
+  BlockSparsePruneConfig(): block_dim_in(16), block_dim_out(16),
+                            sparsity(0.0), max_density(0.5),
+                            component_names("*") { }
+  void Register(OptionsItf *opts) {
+    opts->Register("block-dim-in", &block_dim_in, "Block size on the input "
+                   "side of the parameter matrices.");
+    opts->Register("block-dim-out", &block_dim_out, "Block size on the "
+                   "output side of the parameter matrices.");
+    opts->Register("sparsity", &sparsity, "Proportion of blocks to prune, "
+                   "by magnitude (Frobenius norm), in addition to blocks that "
+                   "are already zero.  If zero, we only remove blocks that "
+                   "were already zero (e.g. from magnitude pruning during "
+                   "training).");
+    opts->Register("max-density", &max_density, "A component is only "
+                   "converted to block-sparse form if the proportion of "
+                   "nonzero blocks after pruning is <= this value; denser "
+                   "components are faster with the dense multiply.");
+    opts->Register("component-names", &component_names, "Pattern (like "
+                   "UNIX globbing, where '*' is the only metacharacter) that "
+                   "determines which components are considered for pruning.");
+  }
+};
+
+/**
+   This function converts AffineComponents (including their child classes
+   such as NaturalGradientAffineComponent) and LinearComponents whose names
+   match config.component_names into BlockSparseAffineComponents (see
+   nnet-sparse-component.h), pruning blocks by magnitude as specified by
+   config.sparsity.  Components for which the resulting density would be
+   greater than config.max_density are left unchanged, as are components
+   whose dimensions are not divisible by the block dimensions.  It prints
+   a report saying, for each component considered, the density, the
+   proportion of parameter energy retained and the estimated reduction in
+   floating-point operations, and whether it was converted.  Returns the
+   number of components that were converted.
+ */
+int32 PruneToBlockSparse(const BlockSparsePruneConfig &config,
+                         Nnet *nnet);
+
+/**
+   Configuration for FactorizeComponents(), which is used in the program
+   nnet3-factorize.
+ */
+struct SvdFactorizeConfig {
+  int32 bottleneck_dim;
+  BaseFloat energy_threshold;
+  BaseFloat shrinkage_threshold;
+  std::string component_names;
+  SvdFactorizeConfig(): bottleneck_dim(-1), energy_threshold(-1.0),
+                        shrinkage_threshold(1.0), component_names("*") { }
+  void Register(OptionsItf *opts) {
+    opts->Register("bottleneck-dim", &bottleneck_dim, "If >0, the fixed "
+                   "dimension to which we reduce the rank of each component "
+                   "(i.e. the number of singular values we retain).");
+    opts->Register("energy-threshold", &energy_threshold, "If >0 (and <1), "
+                   "for each component we retain the smallest number of "
+                   "singular values whose squares sum to at least this "
+                   "proportion of the total; overrides --bottleneck-dim.");
+    opts->Register("shrinkage-threshold", &shrinkage_threshold, "A "
+                   "component is left undecomposed if the ratio of the "
+                   "number of parameters (and multiply-adds) after vs. before "
+                   "decomposition would be greater than this value.");
+    opts->Register("component-names", &component_names, "Pattern (like "
+                   "UNIX globbing, where '*' is the only metacharacter) that "
+                   "determines which components are considered for "
+                   "factorization.");
+  }
+};
+
+/**
+   This function replaces AffineComponents (including child classes such as
+   NaturalGradientAffineComponent) and TdnnComponents whose names match
+   config.component_names with low-rank factorizations obtained by SVD,
+   keeping either config.bottleneck_dim singular values or as many as
+   are required to retain config.energy_threshold of the energy.  A
+   component "foo" is replaced by two components "foo_a" and "foo_b", and
+   its component-node "bar" by two nodes "bar_a" and "bar_b".  "foo_a" is a
+   LinearComponent (for TdnnComponent, a TdnnComponent without bias and with
+   the same time-offsets); "foo_b" is a NaturalGradientAffineComponent
+   (or a LinearComponent, if the original had no bias).  Both parts are
+   updatable and inherit the learning-rate and max-change settings of the
+   original, so the resulting model can be fine-tuned as usual.  The
+   reduction in multiply-adds is printed for each component and in total.
+   This is the same as the edit directive 'apply-svd'; see ReadEditConfig().
+   Returns the number of components that were factorized.
+ */
+int32 FactorizeComponents(const SvdFactorizeConfig &config,
+                          Nnet *nnet);
+
 /**
    ReadEditConfig() reads a file with a similar-looking format to the config file
    read by Nnet::ReadConfig(), but this consists of a sequence of operations to
@@ -310,7 +410,7 @@ void CollapseModel(const CollapseModelConfig &config,
 
     apply-svd name=<name-pattern> bottleneck-dim=<dim> energy-threshold=<threshold> shrinkage-threshold=<s>
        Locates all components with names matching <name-pattern>, which are
-       type AffineComponent or child classes thereof.  If <dim> is
+       type AffineComponent or child classes thereof, or TdnnComponent.  If <dim> is
        less than the minimum of the (input or output) dimension of the component,
        it does SVD on the components' parameters, retaining only the largest
        <dim> singular values, replacing these components with sequences of two
@@ -320,7 +420,7 @@ void CollapseModel(const CollapseModelConfig &config,
        the original singular values. A particular SVD factored component is left unshrinked,
        if the shrinkage ratio of the total no. of its parameters,
        after the SVD based refactoring, is greater than shrinkage threshold.
-       See also 'reduce-rank'.
+       See also FactorizeComponents() and 'reduce-rank'.
 
     reduce-rank name=<name-pattern> rank=<dim>
        Locates all components with names matching <name-pattern>, which are
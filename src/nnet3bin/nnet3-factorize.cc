@@ -0,0 +1,76 @@
+// nnet3bin/nnet3-factorize.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "nnet3/nnet-nnet.h"
+#include "nnet3/nnet-utils.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Factorize the AffineComponents (including NaturalGradientAffineComponents)\n"
+        "and TdnnComponents of a 'raw' nnet3 neural network into pairs of\n"
+        "low-rank components using SVD, for faster computation.  The rank is\n"
+        "either fixed (--bottleneck-dim) or chosen per component to retain a\n"
+        "given proportion of the energy of the singular values\n"
+        "(--energy-threshold).  The reduction in multiply-adds per frame is\n"
+        "printed for each component.  The resulting components are updatable,\n"
+        "so the model can be fine-tuned afterwards, e.g. with nnet3-chain-train.\n"
+        "This is equivalent to the 'apply-svd' directive of the --edits option\n"
+        "of nnet3-copy.\n"
+        "\n"
+        "Usage:  nnet3-factorize [options] <nnet-in> <nnet-out>\n"
+        "e.g.:\n"
+        " nnet3-am-copy --raw=true final.mdl - | \\\n"
+        "   nnet3-factorize --energy-threshold=0.8 --shrinkage-threshold=0.7 - factorized.raw\n"
+        " nnet3-am-copy --set-raw-nnet=factorized.raw final.mdl 0.mdl\n";
+
+    bool binary_write = true;
+    SvdFactorizeConfig factorize_config;
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    factorize_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string raw_nnet_rxfilename = po.GetArg(1),
+        raw_nnet_wxfilename = po.GetArg(2);
+
+    Nnet nnet;
+    ReadKaldiObject(raw_nnet_rxfilename, &nnet);
+
+    FactorizeComponents(factorize_config, &nnet);
+
+    WriteKaldiObject(nnet, raw_nnet_wxfilename, binary_write);
+    KALDI_LOG << "Wrote factorized neural net to " << raw_nnet_wxfilename;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -86,7 +86,7 @@ int main(int argc, char *argv[]) {
     std::string ivector_rspecifier,
         online_ivector_rspecifier,
         utt2spk_rspecifier;
-    int32 online_ivector_period = 0, num_threads = 1;
+    int32 online_ivector_period = 0, num_threads = 1, num_streams = 1;
     decoder_opts.Register(&po);
     compute_opts.Register(&po);
     po.Register("word-symbol-table", &word_syms_filename,
@@ -105,6 +105,10 @@ int main(int argc, char *argv[]) {
     po.Register("num-threads", &num_threads, "Number of decoder (i.e. "
                 "graph-search) threads.  The number of model-evaluation threads "
                 "is always 1; this is optimized for use with the GPU.");
+    po.Register("num-streams", &num_streams, "Number of utterances each "
+                "decoder thread decodes at once, interleaving their frames.  "
+                "Values >1 let fewer decoder threads keep up with the GPU, and "
+                "share token storage between utterances.");
     po.Register("use-gpu", &use_gpu,
                 "yes|no|optional|wait, only has effect if compiled with CUDA");
 
@@ -171,7 +175,7 @@ int main(int argc, char *argv[]) {
                                  am_nnet.Priors());
       NnetBatchDecoder decoder(*decode_fst, decoder_opts,
                                trans_model, word_syms, allow_partial,
-                               num_threads, &computer);
+                               num_threads, &computer, num_streams);
 
       for (; !feature_reader.Done(); feature_reader.Next()) {
         std::string utt = feature_reader.Key();
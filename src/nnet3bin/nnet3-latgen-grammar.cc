@@ -28,6 +28,7 @@
 #include "nnet3/nnet-utils.h"
 #include "decoder/grammar-fst.h"
 #include "base/timer.h"
+#include "util/kaldi-thread.h"
 
 
 int main(int argc, char *argv[]) {
@@ -44,7 +45,9 @@ int main(int argc, char *argv[]) {
 
     const char *usage =
         "Generate lattices using nnet3 neural net model, and GrammarFst-based graph\n"
-        "see kaldi-asr.org/doc/grammar.html for more context.\n"
+        "see kaldi-asr.org/doc/grammar.html for more context.  With --num-threads > 1,\n"
+        "utterances are decoded in parallel, sharing the GrammarFst (and its\n"
+        "expanded states) between threads.\n"
         "\n"
         "Usage: nnet3-latgen-grammar [options] <nnet-in> <grammar-fst-in> <features-rspecifier>"
         " <lattice-wspecifier> [ <words-wspecifier> [<alignments-wspecifier>] ]\n";
@@ -54,6 +57,7 @@ int main(int argc, char *argv[]) {
     bool allow_partial = false;
     LatticeFasterDecoderConfig config;
     NnetSimpleComputationOptions decodable_opts;
+    TaskSequencerConfig sequencer_config; // has --num-threads option
 
     std::string word_syms_filename;
     std::string ivector_rspecifier,
@@ -62,6 +66,7 @@ int main(int argc, char *argv[]) {
     int32 online_ivector_period = 0;
     config.Register(&po);
     decodable_opts.Register(&po);
+    sequencer_config.Register(&po);
     po.Register("word-symbol-table", &word_syms_filename,
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
@@ -142,6 +147,9 @@ int main(int argc, char *argv[]) {
 
     {
       LatticeFasterDecoderTpl<fst::ConstGrammarFst > decoder(fst, config);
+      // Only used if --num-threads > 1.  All the tasks share 'fst'.
+      TaskSequencer<DecodeUtteranceLatticeFasterClassTpl<fst::ConstGrammarFst> >
+          sequencer(sequencer_config);
 
       for (; !feature_reader.Done(); feature_reader.Next()) {
         std::string utt = feature_reader.Key();
@@ -172,6 +180,26 @@ int main(int argc, char *argv[]) {
           }
         }
 
+        if (sequencer_config.num_threads > 1) {
+          LatticeFasterDecoderTpl<fst::ConstGrammarFst> *thread_decoder =
+              new LatticeFasterDecoderTpl<fst::ConstGrammarFst>(fst, config);
+          DecodableInterface *thread_decodable = new
+              DecodableAmNnetSimpleParallel(
+                  decodable_opts, trans_model, am_nnet,
+                  features, ivector, online_ivectors,
+                  online_ivector_period);
+          DecodeUtteranceLatticeFasterClassTpl<fst::ConstGrammarFst> *task =
+              new DecodeUtteranceLatticeFasterClassTpl<fst::ConstGrammarFst>(
+                  thread_decoder, thread_decodable, // takes ownership of these.
+                  trans_model, word_syms, utt, decodable_opts.acoustic_scale,
+                  determinize, allow_partial, &alignment_writer, &words_writer,
+                  &compact_lattice_writer, &lattice_writer,
+                  &tot_like, &frame_count, &num_success, &num_fail, NULL);
+          sequencer.Run(task); // takes ownership of "task",
+                               // and will delete it when done.
+          continue;
+        }
+
         DecodableAmNnetSimple nnet_decodable(
             decodable_opts, trans_model, am_nnet,
             features, ivector, online_ivectors,
@@ -189,7 +217,9 @@ int main(int argc, char *argv[]) {
           num_success++;
         } else num_fail++;
       }
+      sequencer.Wait(); // Waits for all tasks to be done.
     }
+    fst.PrintStats();
 
     kaldi::int64 input_frame_count =
         frame_count * decodable_opts.frame_subsampling_factor;
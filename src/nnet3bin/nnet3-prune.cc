@@ -0,0 +1,74 @@
+// nnet3bin/nnet3-prune.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "nnet3/nnet-nnet.h"
+#include "nnet3/nnet-utils.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Convert the AffineComponents and LinearComponents of a 'raw' nnet3\n"
+        "neural network to block-sparse form (BlockSparseAffineComponent),\n"
+        "for faster test-time computation of pruned models.  Blocks that are\n"
+        "zero are removed, and further blocks may be pruned by magnitude\n"
+        "(--sparsity option).  Components are only converted if the result\n"
+        "is sparse enough to be faster (--max-density option); a report is\n"
+        "printed saying which components benefit.  The output is for test\n"
+        "time only; the converted components are not trainable.\n"
+        "\n"
+        "Usage:  nnet3-prune [options] <nnet-in> <nnet-out>\n"
+        "e.g.:\n"
+        " nnet3-am-copy --raw=true final.mdl - | \\\n"
+        "   nnet3-prune --sparsity=0.7 - pruned.raw\n"
+        " nnet3-am-copy --set-raw-nnet=pruned.raw final.mdl final_pruned.mdl\n";
+
+    bool binary_write = true;
+    BlockSparsePruneConfig prune_config;
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    prune_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string raw_nnet_rxfilename = po.GetArg(1),
+        raw_nnet_wxfilename = po.GetArg(2);
+
+    Nnet nnet;
+    ReadKaldiObject(raw_nnet_rxfilename, &nnet);
+
+    PruneToBlockSparse(prune_config, &nnet);
+
+    WriteKaldiObject(nnet, raw_nnet_wxfilename, binary_write);
+    KALDI_LOG << "Wrote pruned neural net to " << raw_nnet_wxfilename;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
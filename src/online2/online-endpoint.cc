@@ -152,6 +152,22 @@ bool EndpointDetected<LatticeFasterOnlineDecoderTpl<fst::VectorGrammarFst > >(
     const LatticeFasterOnlineDecoderTpl<fst::VectorGrammarFst > &decoder);
 
 
+template
+bool EndpointDetected<LatticeFasterOnlineDecoderTpl<fst::SharedLookaheadFst > >(
+    const OnlineEndpointConfig &config,
+    const TransitionInformation &tmodel,
+    BaseFloat frame_shift_in_seconds,
+    const LatticeFasterOnlineDecoderTpl<fst::SharedLookaheadFst > &decoder);
+
+
+template
+bool EndpointDetected<LatticeFasterOnlineDecoderTpl<fst::BiglmFst > >(
+    const OnlineEndpointConfig &config,
+    const TransitionInformation &tmodel,
+    BaseFloat frame_shift_in_seconds,
+    const LatticeFasterOnlineDecoderTpl<fst::BiglmFst > &decoder);
+
+
 template
 bool EndpointDetected<LatticeIncrementalOnlineDecoderTpl<fst::Fst<fst::StdArc> > >(
     const OnlineEndpointConfig &config,
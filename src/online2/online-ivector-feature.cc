@@ -592,6 +592,14 @@ template
 void OnlineSilenceWeighting::ComputeCurrentTraceback<fst::VectorGrammarFst >(
     const LatticeFasterOnlineDecoderTpl<fst::VectorGrammarFst > &decoder,
     bool use_final_probs);
+template
+void OnlineSilenceWeighting::ComputeCurrentTraceback<fst::SharedLookaheadFst >(
+    const LatticeFasterOnlineDecoderTpl<fst::SharedLookaheadFst > &decoder,
+    bool use_final_probs);
+template
+void OnlineSilenceWeighting::ComputeCurrentTraceback<fst::BiglmFst >(
+    const LatticeFasterOnlineDecoderTpl<fst::BiglmFst > &decoder,
+    bool use_final_probs);
 
 template
 void OnlineSilenceWeighting::ComputeCurrentTraceback<fst::Fst<fst::StdArc> >(
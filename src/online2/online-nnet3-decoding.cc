@@ -84,6 +84,12 @@ void SingleUtteranceNnet3DecoderTpl<FST>::GetBestPath(bool end_of_utterance,
   decoder_.GetBestPath(best_path, end_of_utterance);
 }
 
+template <typename FST>
+void SingleUtteranceNnet3DecoderTpl<FST>::GetPartialBestPath(
+    bool end_of_utterance, Lattice *best_path, int32 *num_stable_frames) {
+  decoder_.GetPartialBestPath(best_path, num_stable_frames, end_of_utterance);
+}
+
 template <typename FST>
 bool SingleUtteranceNnet3DecoderTpl<FST>::EndpointDetected(
     const OnlineEndpointConfig &config) {
@@ -99,5 +105,7 @@ bool SingleUtteranceNnet3DecoderTpl<FST>::EndpointDetected(
 template class SingleUtteranceNnet3DecoderTpl<fst::Fst<fst::StdArc> >;
 template class SingleUtteranceNnet3DecoderTpl<fst::ConstGrammarFst >;
 template class SingleUtteranceNnet3DecoderTpl<fst::VectorGrammarFst >;
+template class SingleUtteranceNnet3DecoderTpl<fst::SharedLookaheadFst >;
+template class SingleUtteranceNnet3DecoderTpl<fst::BiglmFst >;
 
 }  // namespace kaldi
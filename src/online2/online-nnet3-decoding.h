@@ -91,6 +91,16 @@ class SingleUtteranceNnet3DecoderTpl {
   void GetBestPath(bool end_of_utterance,
                    Lattice *best_path) const;
 
+  /// This is as GetBestPath(), but more efficient if you call it repeatedly
+  /// while decoding (e.g. to show partial results): it only traces back the
+  /// part of the best path that may still change.  If num_stable_frames is
+  /// non-NULL, it outputs the number of frames at the start of the best path
+  /// that won't change any more.  See
+  /// LatticeFasterOnlineDecoderTpl::GetPartialBestPath().
+  void GetPartialBestPath(bool end_of_utterance,
+                          Lattice *best_path,
+                          int32 *num_stable_frames = NULL);
+
 
   /// This function calls EndpointDetected from online-endpoint.h,
   /// with the required arguments.
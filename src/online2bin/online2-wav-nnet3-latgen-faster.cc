@@ -189,6 +189,7 @@ int main(int argc, char *argv[]) {
     int32 num_done = 0, num_err = 0;
     double tot_like = 0.0;
     int64 num_frames = 0;
+    int64 num_degraded_frames = 0;  // see --rtf-target.
 
     SequentialTokenVectorReader spk2utt_reader(spk2utt_rspecifier);
     RandomAccessTableReader<WaveHolder> wav_reader(wav_rspecifier);
@@ -272,6 +273,7 @@ int main(int argc, char *argv[]) {
           }
         }
         decoder.FinalizeDecoding();
+        num_degraded_frames += decoder.Decoder().NumDegradedFrames();
 
         CompactLattice clat;
         bool end_of_utterance = true;
@@ -303,6 +305,10 @@ int main(int argc, char *argv[]) {
               << num_err << " with errors.";
     KALDI_LOG << "Overall likelihood per frame was " << (tot_like / num_frames)
               << " per frame over " << num_frames << " frames.";
+    if (num_degraded_frames > 0)
+      KALDI_LOG << "Speed control (--rtf-target) reduced the beam or "
+                << "max-active on " << num_degraded_frames << " out of "
+                << num_frames << " frames.";
     delete decode_fst;
     delete word_syms; // will delete if non-NULL.
     return (num_done != 0 ? 0 : 1);
@@ -94,7 +94,9 @@ int main(int argc, char *argv[]) {
         "Usage: online2-wav-nnet3-latgen-grammar [options] <nnet3-in> <fst-in> "
         "<spk2utt-rspecifier> <wav-rspecifier> <lattice-wspecifier>\n"
         "The spk2utt-rspecifier can just be <utterance-id> <utterance-id> if\n"
-        "you want to decode utterance by utterance.\n";
+        "you want to decode utterance by utterance.\n"
+        "With --speaker-grammars, one nonterminal of the grammar (e.g.\n"
+        "#nonterm:contact_list) can be bound to a different FST per speaker.\n";
 
     ParseOptions po(usage);
 
@@ -110,6 +112,9 @@ int main(int argc, char *argv[]) {
     BaseFloat chunk_length_secs = 0.18;
     bool do_endpointing = false;
     bool online = true;
+    std::string speaker_grammar_rspecifier;
+    int32 speaker_grammar_nonterminal = -1;
+    int32 speaker_grammar_cache_size = 10;
 
     po.Register("chunk-length", &chunk_length_secs,
                 "Length of chunk size in seconds, that we process.  Set to <= 0 "
@@ -129,6 +134,19 @@ int main(int argc, char *argv[]) {
                 "--chunk-length=-1.");
     po.Register("num-threads-startup", &g_num_threads,
                 "Number of threads used when initializing iVector extractor.");
+    po.Register("speaker-grammars", &speaker_grammar_rspecifier,
+                "Rspecifier for per-speaker FSTs (e.g. each speaker's contact "
+                "list), indexed by speaker and prepared as for the FSTs in "
+                "the grammar (see make-grammar-fst).  A speaker's FST is used "
+                "for the nonterminal given by --speaker-grammar-nonterminal, "
+                "replacing the grammar's FST for it, if any.");
+    po.Register("speaker-grammar-nonterminal", &speaker_grammar_nonterminal,
+                "Integer id in phones.txt of the nonterminal symbol (e.g. "
+                "#nonterm:contact_list) that the FSTs given by "
+                "--speaker-grammars are for.");
+    po.Register("speaker-grammar-cache-size", &speaker_grammar_cache_size,
+                "Number of speakers' FSTs from --speaker-grammars to keep in "
+                "memory, so that they are not read again if a speaker recurs.");
 
     feature_opts.Register(&po);
     decodable_opts.Register(&po);
@@ -182,6 +200,19 @@ int main(int argc, char *argv[]) {
     fst::ConstGrammarFst fst;
     ReadKaldiObject(fst_rxfilename, &fst);
 
+    typedef fst::GrammarFstOverrideCache<const fst::ConstFst<fst::StdArc> >
+        OverrideCache;
+    RandomAccessTableReader<fst::VectorFstHolder> speaker_grammar_reader;
+    OverrideCache override_cache(speaker_grammar_cache_size);
+    if (!speaker_grammar_rspecifier.empty()) {
+      if (speaker_grammar_nonterminal <= 0)
+        KALDI_ERR << "The --speaker-grammar-nonterminal option must be "
+            "supplied if --speaker-grammars is.";
+      if (!speaker_grammar_reader.Open(speaker_grammar_rspecifier))
+        KALDI_ERR << "Could not open speaker grammars: "
+                  << speaker_grammar_rspecifier;
+    }
+
     fst::SymbolTable *word_syms = NULL;
     if (word_syms_rxfilename != "")
       if (!(word_syms = fst::SymbolTable::ReadText(word_syms_rxfilename)))
@@ -191,6 +222,7 @@ int main(int argc, char *argv[]) {
     int32 num_done = 0, num_err = 0;
     double tot_like = 0.0;
     int64 num_frames = 0;
+    int64 num_degraded_frames = 0;  // see --rtf-target.
 
     SequentialTokenVectorReader spk2utt_reader(spk2utt_rspecifier);
     RandomAccessTableReader<WaveHolder> wav_reader(wav_rspecifier);
@@ -206,6 +238,31 @@ int main(int argc, char *argv[]) {
           feature_info.ivector_extractor_info);
       OnlineCmvnState cmvn_state(global_cmvn_stats);
 
+      // 'speaker_fst' shares everything with 'fst', except for the FST of the
+      // nonterminal bound to this speaker's grammar.
+      std::unique_ptr<fst::ConstGrammarFst> speaker_fst;
+      if (!speaker_grammar_rspecifier.empty()) {
+        std::shared_ptr<const OverrideCache::OverrideList> overrides =
+            override_cache.Find(spk);
+        if (overrides == NULL && speaker_grammar_reader.HasKey(spk)) {
+          OverrideCache::OverrideList *override_list =
+              new OverrideCache::OverrideList;
+          std::shared_ptr<const fst::ConstFst<fst::StdArc> > speaker_grammar(
+              new fst::ConstFst<fst::StdArc>(speaker_grammar_reader.Value(spk)));
+          override_list->push_back(std::make_pair(speaker_grammar_nonterminal,
+                                                  speaker_grammar));
+          overrides.reset(override_list);
+          override_cache.Insert(spk, overrides);
+        }
+        if (overrides != NULL)
+          speaker_fst.reset(new fst::ConstGrammarFst(fst, *overrides));
+        else
+          KALDI_WARN << "No grammar for speaker " << spk
+                     << ", using the default grammar.";
+      }
+      const fst::ConstGrammarFst &decode_fst =
+          (speaker_fst != NULL ? *speaker_fst : fst);
+
       for (size_t i = 0; i < uttlist.size(); i++) {
         std::string utt = uttlist[i];
         if (!wav_reader.HasKey(utt)) {
@@ -229,7 +286,7 @@ int main(int argc, char *argv[]) {
 
         SingleUtteranceNnet3DecoderTpl<fst::ConstGrammarFst > decoder(
             decoder_opts, trans_model,
-            decodable_info, fst, &feature_pipeline);
+            decodable_info, decode_fst, &feature_pipeline);
 
         OnlineTimer decoding_timer(utt);
 
@@ -275,6 +332,7 @@ int main(int argc, char *argv[]) {
           }
         }
         decoder.FinalizeDecoding();
+        num_degraded_frames += decoder.Decoder().NumDegradedFrames();
 
         CompactLattice clat;
         bool end_of_utterance = true;
@@ -301,11 +359,18 @@ int main(int argc, char *argv[]) {
       }
     }
     timing_stats.Print(online);
+    fst.PrintStats();
+    if (!speaker_grammar_rspecifier.empty())
+      override_cache.PrintStats();
 
     KALDI_LOG << "Decoded " << num_done << " utterances, "
               << num_err << " with errors.";
     KALDI_LOG << "Overall likelihood per frame was " << (tot_like / num_frames)
               << " per frame over " << num_frames << " frames.";
+    if (num_degraded_frames > 0)
+      KALDI_LOG << "Speed control (--rtf-target) reduced the beam or "
+                << "max-active on " << num_degraded_frames << " out of "
+                << num_frames << " frames.";
     delete word_syms; // will delete if non-NULL.
     return (num_done != 0 ? 0 : 1);
   } catch(const std::exception& e) {
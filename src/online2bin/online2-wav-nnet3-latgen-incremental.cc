@@ -25,6 +25,7 @@
 #include "online2/online-endpoint.h"
 #include "fstext/fstext-lib.h"
 #include "lat/lattice-functions.h"
+#include "lat/sausages.h"
 #include "util/kaldi-thread.h"
 #include "nnet3/nnet-utils.h"
 
@@ -72,6 +73,21 @@ void GetDiagnosticsAndPrintOutput(const std::string &utt,
   }
 }
 
+// Prints the median, 90th and 99th percentiles and maximum of 'times' (in
+// seconds), which are latencies of some decoding step; sorts 'times'.
+void PrintLatencyPercentiles(const std::string &name,
+                             std::vector<double> *times) {
+  if (times->empty())
+    return;
+  std::sort(times->begin(), times->end());
+  size_t n = times->size();
+  KALDI_LOG << "Latency of " << name << " over " << n << " calls (ms): "
+            << "p50 = " << 1000.0 * (*times)[n / 2]
+            << ", p90 = " << 1000.0 * (*times)[(n * 9) / 10]
+            << ", p99 = " << 1000.0 * (*times)[(n * 99) / 100]
+            << ", max = " << 1000.0 * times->back();
+}
+
 }
 
 int main(int argc, char *argv[]) {
@@ -97,7 +113,7 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
 
-    std::string word_syms_rxfilename;
+    std::string word_syms_rxfilename, ctm_wxfilename;
 
     // feature_opts includes configuration for the iVector adaptation,
     // as well as the basic features.
@@ -105,6 +121,7 @@ int main(int argc, char *argv[]) {
     nnet3::NnetSimpleLoopedComputationOptions decodable_opts;
     LatticeIncrementalDecoderConfig decoder_opts;
     OnlineEndpointConfig endpoint_opts;
+    MinimumBayesRiskOptions mbr_opts;
 
     BaseFloat chunk_length_secs = 0.18;
     bool do_endpointing = false;
@@ -126,6 +143,10 @@ int main(int argc, char *argv[]) {
                 "--use-most-recent-ivector=true and --greedy-ivector-extractor=true "
                 "in the file given to --ivector-extraction-config, and "
                 "--chunk-length=-1.");
+    po.Register("ctm-conf", &ctm_wxfilename,
+                "If set, write a ctm with MBR word confidences to this file.  "
+                "The words are finalized incrementally as decoding proceeds "
+                "(see --verbose=2 output for the latency).");
     po.Register("num-threads-startup", &g_num_threads,
                 "Number of threads used when initializing iVector extractor.");
 
@@ -133,6 +154,7 @@ int main(int argc, char *argv[]) {
     decodable_opts.Register(&po);
     decoder_opts.Register(&po);
     endpoint_opts.Register(&po);
+    mbr_opts.Register(&po);
 
 
     po.Read(argc, argv);
@@ -190,8 +212,21 @@ int main(int argc, char *argv[]) {
     SequentialTokenVectorReader spk2utt_reader(spk2utt_rspecifier);
     RandomAccessTableReader<WaveHolder> wav_reader(wav_rspecifier);
     CompactLatticeWriter clat_writer(clat_wspecifier);
+    Output *ctm_output = NULL;
+    if (!ctm_wxfilename.empty()) {
+      ctm_output = new Output(ctm_wxfilename, false);
+      ctm_output->Stream() << std::fixed;
+      ctm_output->Stream().precision(2);
+    }
+    BaseFloat frame_shift = feature_info.FrameShiftInSeconds() *
+        decodable_opts.frame_subsampling_factor;
+    // The lattices from the decoder already have the acoustic scale applied.
+    IncrementalMinimumBayesRisk incremental_mbr(mbr_opts);
 
     OnlineTimingStats timing_stats;
+    // Wall-clock times of each call to AdvanceDecoding(), and of the work done
+    // at the end of each utterance to get its lattice.
+    std::vector<double> advance_times, final_times;
 
     for (; !spk2utt_reader.Done(); spk2utt_reader.Next()) {
       std::string spk = spk2utt_reader.Key();
@@ -234,6 +269,7 @@ int main(int argc, char *argv[]) {
 
         int32 samp_offset = 0;
         std::vector<std::pair<int32, BaseFloat> > delta_weights;
+        incremental_mbr.Reset();
 
         while (samp_offset < data.Dim()) {
           int32 samp_remaining = data.Dim() - samp_offset;
@@ -258,17 +294,48 @@ int main(int argc, char *argv[]) {
             feature_pipeline.IvectorFeature()->UpdateFrameWeights(delta_weights);
           }
 
+          Timer advance_timer;
           decoder.AdvanceDecoding();
+          advance_times.push_back(advance_timer.Elapsed());
+
+          int32 num_frames_in_lattice = decoder.Decoder().NumFramesInLattice();
+          if (ctm_output != NULL && num_frames_in_lattice > 0) {
+            int32 num_words = incremental_mbr.AcceptLattice(
+                decoder.GetLattice(num_frames_in_lattice, false), false);
+            if (num_words > 0)
+              KALDI_VLOG(2) << "Finalized " << num_words << " words of "
+                            << utt << " up to frame "
+                            << incremental_mbr.NumFramesFinalized()
+                            << ", having decoded "
+                            << decoder.NumFramesDecoded() << " frames.";
+          }
 
           if (do_endpointing && decoder.EndpointDetected(endpoint_opts)) {
             break;
           }
         }
+        Timer final_timer;
         decoder.FinalizeDecoding();
 
         bool use_final_probs = true;
         CompactLattice clat = decoder.GetLattice(decoder.NumFramesDecoded(),
                                                  use_final_probs);
+        final_times.push_back(final_timer.Elapsed());
+
+        if (ctm_output != NULL) {
+          // This must be done before Connect(), which renumbers the states.
+          incremental_mbr.AcceptLattice(clat, true);
+          const std::vector<int32> &words = incremental_mbr.GetOneBest();
+          const std::vector<BaseFloat> &conf =
+              incremental_mbr.GetOneBestConfidences();
+          const std::vector<std::pair<BaseFloat, BaseFloat> > &times =
+              incremental_mbr.GetOneBestTimes();
+          for (size_t i = 0; i < words.size(); i++)
+            ctm_output->Stream() << utt << " 1 " << (frame_shift * times[i].first)
+                                 << ' ' << (frame_shift * (times[i].second -
+                                                           times[i].first))
+                                 << ' ' << words[i] << ' ' << conf[i] << '\n';
+        }
 
         Connect(&clat);
         GetDiagnosticsAndPrintOutput(utt, word_syms, clat,
@@ -291,6 +358,8 @@ int main(int argc, char *argv[]) {
       }
     }
     timing_stats.Print(online);
+    PrintLatencyPercentiles("AdvanceDecoding()", &advance_times);
+    PrintLatencyPercentiles("end-of-utterance lattice", &final_times);
 
     KALDI_LOG << "Decoded " << num_done << " utterances, "
               << num_err << " with errors.";
@@ -298,6 +367,7 @@ int main(int argc, char *argv[]) {
               << " per frame over " << num_frames << " frames.";
     delete decode_fst;
     delete word_syms; // will delete if non-NULL.
+    delete ctm_output;
     return (num_done != 0 ? 0 : 1);
   } catch(const std::exception& e) {
     std::cerr << e.what();
@@ -0,0 +1,141 @@
+// rnnlm/rnnlm-compute-state-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rnnlm/rnnlm-compute-state.h"
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "cudamatrix/cu-device.h"
+
+namespace kaldi {
+namespace rnnlm {
+
+// Creates a small recurrent RNNLM (an affine layer whose input includes its
+// own output from the previous word, and possibly the word before that,
+// followed by an affine layer that predicts the embedding of the next word).
+static void GenerateRnnlm(int32 embedding_dim, nnet3::Nnet *rnnlm) {
+  int32 hidden_dim = RandInt(5, 20);
+  bool two_words = (RandInt(0, 1) == 0);
+  std::ostringstream os;
+  os << "input-node name=input dim=" << embedding_dim << "\n"
+     << "component name=affine1 type=NaturalGradientAffineComponent "
+     << "input-dim=" << (embedding_dim + hidden_dim * (two_words ? 2 : 1))
+     << " output-dim=" << hidden_dim << "\n"
+     << "component name=tanh1 type=TanhComponent dim=" << hidden_dim << "\n"
+     << "component name=affine2 type=NaturalGradientAffineComponent "
+     << "input-dim=" << hidden_dim << " output-dim=" << embedding_dim << "\n"
+     << "component-node name=affine1 component=affine1 "
+     << "input=Append(input, IfDefined(Offset(tanh1, -1))"
+     << (two_words ? ", IfDefined(Offset(tanh1, -2))" : "") << ")\n"
+     << "component-node name=tanh1 component=tanh1 input=affine1\n"
+     << "component-node name=affine2 component=affine2 input=tanh1\n"
+     << "output-node name=output input=affine2\n";
+  std::istringstream is(os.str());
+  rnnlm->ReadConfig(is);
+}
+
+// Checks that GetSuccessorStates() gives the same results as
+// GetSuccessorState(), by expanding a random tree of histories both ways.
+void TestRnnlmComputeStateBatched() {
+  int32 embedding_dim = RandInt(4, 10), num_words = RandInt(5, 40);
+  nnet3::Nnet rnnlm;
+  GenerateRnnlm(embedding_dim, &rnnlm);
+  CuMatrix<BaseFloat> word_embedding_mat(num_words, embedding_dim);
+  word_embedding_mat.SetRandn();
+  word_embedding_mat.Scale(0.5);
+
+  RnnlmComputeStateComputationOptions opts;
+  opts.bos_index = 1;
+  opts.eos_index = 2;
+  opts.normalize_probs = (RandInt(0, 1) == 0);
+  opts.batch_size = RandInt(2, 9);
+  RnnlmComputeStateInfo info(opts, rnnlm, word_embedding_mat);
+  KALDI_ASSERT(!info.batch_sizes.empty() &&
+               info.batch_sizes.back() == opts.batch_size);
+
+  std::vector<const RnnlmComputeState*> states(
+      1, new RnnlmComputeState(info, opts.bos_index)),
+      ref_states(1, new RnnlmComputeState(info, opts.bos_index));
+  int32 num_levels = RandInt(3, 6);
+  size_t level_start = 0;
+  for (int32 level = 0; level < num_levels; level++) {
+    std::vector<const RnnlmComputeState*> prev_states;
+    std::vector<size_t> prev_indexes;
+    std::vector<int32> words;
+    size_t level_end = states.size();
+    for (size_t i = level_start; i < level_end; i++) {
+      int32 num_successors = (states.size() > 200 ? 1 : RandInt(1, 3));
+      for (int32 j = 0; j < num_successors; j++) {
+        prev_states.push_back(states[i]);
+        prev_indexes.push_back(i);
+        words.push_back(RandInt(1, num_words - 1));
+      }
+    }
+    std::vector<RnnlmComputeState*> successors;
+    RnnlmComputeState::GetSuccessorStates(prev_states, words, &successors);
+    for (size_t i = 0; i < successors.size(); i++) {
+      states.push_back(successors[i]);
+      ref_states.push_back(
+          ref_states[prev_indexes[i]]->GetSuccessorState(words[i]));
+    }
+    level_start = level_end;
+  }
+
+  int32 num_states = states.size();
+  CuMatrix<BaseFloat> log_probs(num_states, num_words);
+  RnnlmComputeState::GetLogProbOfWords(states, &log_probs);
+  for (int32 i = 0; i < num_states; i++) {
+    CuMatrix<BaseFloat> ref_log_probs(1, num_words);
+    ref_states[i]->GetLogProbOfWords(&ref_log_probs);
+    AssertEqual(log_probs.RowRange(i, 1), ref_log_probs, 0.001);
+    for (int32 w = 1; w < num_words; w++)
+      AssertEqual(states[i]->LogProbOfWord(w),
+                  ref_states[i]->LogProbOfWord(w), 0.001);
+  }
+  KALDI_LOG << "Compared " << num_states << " RNNLM states.";
+  for (int32 i = 0; i < num_states; i++) {
+    delete states[i];
+    delete ref_states[i];
+  }
+}
+
+
+}  // namespace rnnlm
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  int32 loop = 0;
+#if HAVE_CUDA == 1
+  for (loop = 0; loop < 2; loop++) {
+    CuDevice::Instantiate().SetDebugStrideMode(true);
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    for (int32 i = 0; i < 5; i++)
+      kaldi::rnnlm::TestRnnlmComputeStateBatched();
+    if (loop == 0)
+      KALDI_LOG << "Tests without GPU use succeeded.";
+    else
+      KALDI_LOG << "Tests with GPU use (if available) succeeded.";
+#if HAVE_CUDA == 1
+  }
+  CuDevice::Instantiate().PrintProfile();
+#endif
+  return 0;
+}
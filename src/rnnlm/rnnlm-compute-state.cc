@@ -68,6 +68,148 @@ RnnlmComputeStateInfo::RnnlmComputeStateInfo(
     KALDI_VLOG(3) << "Computation is:";
     computation.Print(std::cerr, rnnlm);
   }
+  if (opts.batch_size > 1)
+    SetUpBatchComputations();
+}
+
+// Works out from the cindexes of a matrix of a looped computation for
+// 'num_sequences' sequences (i.e. with 'n' indexes 0 ... num_sequences - 1)
+// whether the rows of each sequence are contiguous ('batch first', i.e. 'n'
+// has the largest stride) or interleaved ('n' has stride one).  Returns false
+// if the rows are arranged in neither of these ways.
+static bool GetBatchFirst(const std::vector<nnet3::Cindex> &cindexes,
+                          int32 num_sequences, bool *batch_first) {
+  int32 num_rows = cindexes.size();
+  if (num_rows % num_sequences != 0)
+    return false;
+  int32 rows_per_sequence = num_rows / num_sequences;
+  bool interleaved_ok = true, contiguous_ok = true;
+  for (int32 r = 0; r < num_rows; r++) {
+    int32 n = cindexes[r].second.n;
+    if (n != r / rows_per_sequence)
+      contiguous_ok = false;
+    if (n != r % num_sequences)
+      interleaved_ok = false;
+  }
+  // If both are consistent (i.e. if there is only one row per sequence), it
+  // doesn't matter which we choose.
+  *batch_first = contiguous_ok;
+  return contiguous_ok || interleaved_ok;
+}
+
+void RnnlmComputeStateInfo::SetUpBatchComputations() {
+  if (!GetStableSnapshot(computation, 1, &stable_snapshot, NULL)) {
+    KALDI_WARN << "The RNNLM computation did not become stable; "
+               << "disabling batched computation.";
+    return;
+  }
+  // The per-sequence sizes of the non-empty matrices of the stable
+  // single-sequence computation.
+  std::vector<std::pair<int32, int32> > stable_sizes;
+  for (size_t i = 0; i < stable_snapshot.num_rows_of_matrices.size(); i++) {
+    int32 num_rows = stable_snapshot.num_rows_of_matrices[i],
+        num_cols = stable_snapshot.num_cols_of_matrices[i];
+    if (num_rows > 0 && num_cols > 0)
+      stable_sizes.push_back(std::pair<int32, int32>(num_rows, num_cols));
+  }
+
+  for (int32 batch_size = 2; ; batch_size *= 2) {
+    batch_size = std::min(batch_size, opts.batch_size);
+    nnet3::ComputationRequest request1, request2, request3;
+    CreateLoopedComputationRequestSimple(rnnlm,
+                                         1, // num_frames
+                                         1, // frame_subsampling_factor
+                                         1, // ivector_period
+                                         0, // extra_left_context_initial
+                                         0, // extra_right_context
+                                         batch_size, // num_sequences
+                                         &request1, &request2, &request3);
+    batch_sizes.push_back(batch_size);
+    batch_computations.resize(batch_computations.size() + 1);
+    nnet3::NnetComputation &this_computation = batch_computations.back();
+    CompileLooped(rnnlm, opts.optimize_config, request1, request2,
+                  request3, &this_computation);
+    this_computation.ComputeCudaIndexes();
+
+    batch_snapshots.resize(batch_snapshots.size() + 1);
+    nnet3::NnetComputerSnapshot &snapshot = batch_snapshots.back();
+    std::vector<bool> this_batch_first;
+    bool ok = GetStableSnapshot(this_computation, batch_size, &snapshot,
+                                &this_batch_first) &&
+        (batch_first.empty() || batch_first == this_batch_first);
+    // Check that the stored matrices correspond one to one with those of the
+    // single-sequence computation, so we can move the state between them.
+    std::vector<std::pair<int32, int32> > sizes;
+    for (size_t i = 0; ok && i < snapshot.num_rows_of_matrices.size(); i++) {
+      int32 num_rows = snapshot.num_rows_of_matrices[i],
+          num_cols = snapshot.num_cols_of_matrices[i];
+      if (num_rows > 0 && num_cols > 0)
+        sizes.push_back(std::pair<int32, int32>(num_rows / batch_size,
+                                                num_cols));
+    }
+    if (!ok || sizes != stable_sizes) {
+      KALDI_WARN << "Could not set up the batched RNNLM computation for "
+                 << "batch-size=" << batch_size
+                 << "; disabling batched computation.";
+      batch_sizes.clear();
+      batch_computations.clear();
+      batch_snapshots.clear();
+      batch_first.clear();
+      return;
+    }
+    batch_first = this_batch_first;
+    if (batch_size == opts.batch_size)
+      break;
+  }
+  KALDI_VLOG(2) << "Set up batched RNNLM computations for batch sizes up to "
+                << opts.batch_size;
+}
+
+bool RnnlmComputeStateInfo::GetStableSnapshot(
+    const nnet3::NnetComputation &computation,
+    int32 num_sequences,
+    nnet3::NnetComputerSnapshot *snapshot,
+    std::vector<bool> *batch_first) const {
+  nnet3::NnetComputer computer(opts.compute_config, computation, rnnlm, NULL);
+  // It normally becomes stable after 2 or 3 words.
+  const int32 max_words = 10;
+  for (int32 n = 0; n < max_words; n++) {
+    nnet3::NnetComputer temp(computer);
+    CuMatrix<BaseFloat> input_embeddings(num_sequences,
+                                         word_embedding_mat.NumCols());
+    input_embeddings.SetRandn();
+    computer.AcceptInput("input", &input_embeddings);
+    computer.Run();
+    computer.GetOutput("output");
+    if (!computer.Equal(temp))
+      continue;
+
+    if (num_sequences > 1) {
+      // We take the layout of the matrices that hold the state from the
+      // cindexes in the computation's debug info.
+      if (computation.matrix_debug_info.size() != computation.matrices.size())
+        return false;
+      batch_first->clear();
+      const std::vector<CuMatrix<BaseFloat> > &matrices =
+          computer.GetMatrices();
+      for (size_t i = 0; i < matrices.size(); i++) {
+        const CuMatrix<BaseFloat> &matrix = matrices[i];
+        if (matrix.NumRows() == 0 || matrix.NumCols() == 0)
+          continue;
+        const std::vector<nnet3::Cindex> &cindexes =
+            computation.matrix_debug_info[i].cindexes;
+        if (static_cast<int32>(cindexes.size()) != matrix.NumRows())
+          return false;
+        bool this_batch_first;
+        if (!GetBatchFirst(cindexes, num_sequences, &this_batch_first))
+          return false;
+        batch_first->push_back(this_batch_first);
+      }
+    }
+    computer.GetSnapshot(snapshot);
+    return true;
+  }
+  return false;
 }
 
 RnnlmComputeState::RnnlmComputeState(const RnnlmComputeStateInfo &info,
@@ -83,15 +225,162 @@ RnnlmComputeState::RnnlmComputeState(const RnnlmComputeStateInfo &info,
 RnnlmComputeState::RnnlmComputeState(const RnnlmComputeState &other):
   info_(other.info_), computer_(other.computer_),
   previous_word_(other.previous_word_),
-  normalization_factor_(other.normalization_factor_)
+  normalization_factor_(other.normalization_factor_),
+  predicted_word_embedding_(other.predicted_word_embedding_)
 {}
 
+RnnlmComputeState::RnnlmComputeState(
+    const RnnlmComputeStateInfo &info,
+    const nnet3::NnetComputerSnapshot &snapshot):
+    info_(info),
+    computer_(info_.opts.compute_config, info_.computation,
+              info_.rnnlm, NULL, &snapshot),
+    previous_word_(-1),
+    normalization_factor_(0.0) { }
+
 RnnlmComputeState* RnnlmComputeState::GetSuccessorState(int32 next_word) const {
   RnnlmComputeState *ans = new RnnlmComputeState(*this);
   ans->AddWord(next_word);
   return ans;
 }
 
+bool RnnlmComputeState::IsStable() const {
+  if (info_.batch_sizes.empty())
+    return false;
+  const nnet3::NnetComputerSnapshot &stable = info_.stable_snapshot;
+  nnet3::NnetComputerSnapshot snapshot;
+  computer_.GetSnapshot(&snapshot);
+  return snapshot.program_counter == stable.program_counter &&
+      snapshot.pending_commands == stable.pending_commands &&
+      snapshot.num_rows_of_matrices == stable.num_rows_of_matrices &&
+      snapshot.num_cols_of_matrices == stable.num_cols_of_matrices;
+}
+
+void RnnlmComputeState::GetSuccessorStates(
+    const std::vector<const RnnlmComputeState*> &states,
+    const std::vector<int32> &next_words,
+    std::vector<RnnlmComputeState*> *successors) {
+  KALDI_ASSERT(states.size() == next_words.size());
+  successors->resize(states.size());
+  if (states.empty())
+    return;
+  const RnnlmComputeStateInfo &info = states[0]->info_;
+
+  // 'stable' is the indexes of the states that we can batch.
+  std::vector<int32> stable;
+  for (size_t i = 0; i < states.size(); i++) {
+    KALDI_ASSERT(&(states[i]->info_) == &info);
+    if (states[i]->IsStable())
+      stable.push_back(i);
+    else
+      (*successors)[i] = states[i]->GetSuccessorState(next_words[i]);
+  }
+  if (stable.empty())
+    return;
+
+  int32 max_batch_size = info.batch_sizes.back(),
+      num_stable = stable.size();
+  std::vector<const RnnlmComputeState*> batch_states;
+  std::vector<int32> batch_words;
+  std::vector<RnnlmComputeState*> batch_successors;
+  for (int32 start = 0; start < num_stable; start += max_batch_size) {
+    int32 end = std::min(start + max_batch_size, num_stable);
+    if (end - start == 1) {
+      // There is nothing to gain from batching.
+      int32 i = stable[start];
+      (*successors)[i] = states[i]->GetSuccessorState(next_words[i]);
+      continue;
+    }
+    batch_states.clear();
+    batch_words.clear();
+    for (int32 j = start; j < end; j++) {
+      batch_states.push_back(states[stable[j]]);
+      batch_words.push_back(next_words[stable[j]]);
+    }
+    AdvanceBatch(info, batch_states, batch_words, &batch_successors);
+    for (int32 j = start; j < end; j++)
+      (*successors)[stable[j]] = batch_successors[j - start];
+  }
+}
+
+void RnnlmComputeState::AdvanceBatch(
+    const RnnlmComputeStateInfo &info,
+    const std::vector<const RnnlmComputeState*> &states,
+    const std::vector<int32> &next_words,
+    std::vector<RnnlmComputeState*> *successors) {
+  int32 num_states = states.size();
+  size_t b = 0;
+  while (info.batch_sizes[b] < num_states) {
+    b++;
+    KALDI_ASSERT(b < info.batch_sizes.size());
+  }
+  int32 batch_size = info.batch_sizes[b];
+
+  // Get the state of each sequence from its own computer.
+  std::vector<nnet3::NnetComputeState> stream_states(num_states);
+  std::vector<nnet3::NnetComputeState*> stream_state_ptrs(num_states);
+  for (int32 i = 0; i < num_states; i++) {
+    stream_state_ptrs[i] = &(stream_states[i]);
+    std::vector<nnet3::NnetComputeState*> this_state(1, stream_state_ptrs[i]);
+    states[i]->computer_.GetState(info.batch_first, 1, &this_state);
+  }
+
+  // If there are fewer states than the batch size, we pad with copies of the
+  // last one.
+  std::vector<nnet3::NnetComputeState*> padded_state_ptrs(stream_state_ptrs);
+  padded_state_ptrs.resize(batch_size, stream_state_ptrs.back());
+  std::vector<int32> padded_words(next_words);
+  padded_words.resize(batch_size, next_words.back());
+  for (int32 i = 0; i < num_states; i++)
+    KALDI_ASSERT(next_words[i] > 0 &&
+                 next_words[i] < info.word_embedding_mat.NumRows());
+
+  nnet3::NnetComputer computer(info.opts.compute_config,
+                               info.batch_computations[b], info.rnnlm, NULL,
+                               &(info.batch_snapshots[b]));
+  computer.SetState(info.batch_first, batch_size, padded_state_ptrs);
+
+  CuMatrix<BaseFloat> input_embeddings(batch_size,
+                                       info.word_embedding_mat.NumCols(),
+                                       kUndefined);
+  input_embeddings.CopyRows(info.word_embedding_mat,
+                            CuArray<int32>(padded_words));
+  computer.AcceptInput("input", &input_embeddings);
+  computer.Run();
+  // See the comment in AdvanceChunk() about why we don't use
+  // GetOutputDestructive().
+  const CuMatrixBase<BaseFloat> &output = computer.GetOutput("output");
+  KALDI_ASSERT(output.NumRows() == batch_size);
+  CuSubMatrix<BaseFloat> predicted_embeddings(output.RowRange(0, num_states));
+  computer.GetState(info.batch_first, batch_size, &stream_state_ptrs);
+
+  Vector<BaseFloat> normalization_factors(num_states);
+  if (info.opts.normalize_probs) {
+    // Compute the normalizers of all the states with one matrix multiply.
+    int32 num_words = info.word_embedding_mat.NumRows();
+    CuMatrix<BaseFloat> probs(num_states, num_words, kUndefined);
+    probs.AddMatMat(1.0, predicted_embeddings, kNoTrans,
+                    info.word_embedding_mat, kTrans, 0.0);
+    probs.ApplyExp();
+    CuVector<BaseFloat> sums(num_states);
+    // We exclude the <eps> symbol, as in AddWord().
+    sums.AddColSumMat(1.0, probs.ColRange(1, num_words - 1), 0.0);
+    sums.ApplyLog();
+    sums.CopyToVec(&normalization_factors);
+  }
+
+  successors->resize(num_states);
+  for (int32 i = 0; i < num_states; i++) {
+    RnnlmComputeState *ans = new RnnlmComputeState(info, info.stable_snapshot);
+    std::vector<nnet3::NnetComputeState*> this_state(1, stream_state_ptrs[i]);
+    ans->computer_.SetState(info.batch_first, 1, this_state);
+    ans->previous_word_ = next_words[i];
+    ans->normalization_factor_ = normalization_factors(i);
+    ans->predicted_word_embedding_ = predicted_embeddings.Row(i);
+    (*successors)[i] = ans;
+  }
+}
+
 void RnnlmComputeState::AddWord(int32 word_index) {
   KALDI_ASSERT(word_index > 0 && word_index < info_.word_embedding_mat.NumRows());
   previous_word_ = word_index;
@@ -102,7 +391,7 @@ void RnnlmComputeState::AddWord(int32 word_index) {
     CuVector<BaseFloat> log_probs(info_.word_embedding_mat.NumRows());
 
     log_probs.AddMatVec(1.0, word_embedding_mat, kNoTrans,
-                        predicted_word_embedding_->Row(0), 0.0);
+                        predicted_word_embedding_, 0.0);
     log_probs.ApplyExp();
 
     // We excluding the <eps> symbol which is always 0.
@@ -113,7 +402,7 @@ void RnnlmComputeState::AddWord(int32 word_index) {
 BaseFloat RnnlmComputeState::LogProbOfWord(int32 word_index) const {
   const CuMatrix<BaseFloat> &word_embedding_mat = info_.word_embedding_mat;
 
-  BaseFloat log_prob = VecVec(predicted_word_embedding_->Row(0),
+  BaseFloat log_prob = VecVec(predicted_word_embedding_,
                               word_embedding_mat.Row(word_index));
 
   // Even without explicit normalization, the log-probs will be close to
@@ -128,9 +417,9 @@ void RnnlmComputeState::GetLogProbOfWords(CuMatrixBase<BaseFloat> *output) const
   const CuMatrix<BaseFloat> &word_embedding_mat = info_.word_embedding_mat;
 
   KALDI_ASSERT(output->NumRows() == 1
-                && output->NumCols() == word_embedding_mat.NumCols());
+                && output->NumCols() == word_embedding_mat.NumRows());
   output->Row(0).AddMatVec(1.0, word_embedding_mat, kNoTrans,
-                   predicted_word_embedding_->Row(0), 0.0);
+                   predicted_word_embedding_, 0.0);
 
   // Even without explicit normalization, the log-probs will be close to
   // correctly normalized due to the way the model was trained.
@@ -142,6 +431,36 @@ void RnnlmComputeState::GetLogProbOfWords(CuMatrixBase<BaseFloat> *output) const
   output->ColRange(0, 1).Set(-99.0);
 }
 
+void RnnlmComputeState::GetLogProbOfWords(
+    const std::vector<const RnnlmComputeState*> &states,
+    CuMatrixBase<BaseFloat> *output) {
+  int32 num_states = states.size();
+  KALDI_ASSERT(output->NumRows() == num_states);
+  if (num_states == 0)
+    return;
+  const RnnlmComputeStateInfo &info = states[0]->info_;
+  const CuMatrix<BaseFloat> &word_embedding_mat = info.word_embedding_mat;
+  KALDI_ASSERT(output->NumCols() == word_embedding_mat.NumRows());
+
+  CuMatrix<BaseFloat> predicted_embeddings(num_states,
+                                           word_embedding_mat.NumCols(),
+                                           kUndefined);
+  Vector<BaseFloat> normalization_factors(num_states);
+  for (int32 i = 0; i < num_states; i++) {
+    KALDI_ASSERT(&(states[i]->info_) == &info);
+    predicted_embeddings.Row(i).CopyFromVec(
+        states[i]->predicted_word_embedding_);
+    normalization_factors(i) = states[i]->normalization_factor_;
+  }
+  output->AddMatMat(1.0, predicted_embeddings, kNoTrans,
+                    word_embedding_mat, kTrans, 0.0);
+  if (info.opts.normalize_probs)
+    output->AddVecToCols(-1.0, CuVector<BaseFloat>(normalization_factors));
+
+  // making sure <eps> has almost 0 prob
+  output->ColRange(0, 1).Set(-99.0);
+}
+
 void RnnlmComputeState::AdvanceChunk() {
   CuMatrix<BaseFloat> input_embeddings(1, info_.word_embedding_mat.NumCols());
   input_embeddings.Row(0).AddVec(1.0,
@@ -153,7 +472,7 @@ void RnnlmComputeState::AdvanceChunk() {
     // here we have recurrence that goes directly from the output, and the call
     // to GetOutputDestructive() would cause a crash on the next chunk.
     const CuMatrixBase<BaseFloat> &output(computer_.GetOutput("output"));
-    predicted_word_embedding_ = &output;
+    predicted_word_embedding_ = output.Row(0);
   }
 }
 
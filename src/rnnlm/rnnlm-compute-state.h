@@ -41,6 +41,9 @@ struct RnnlmComputeStateComputationOptions {
   int32 eos_index;
   // This is not needed for computation; included only for ease of scripting.
   int32 brk_index;
+  // The maximum number of RNNLM states that are advanced together in
+  // RnnlmComputeState::GetSuccessorStates().
+  int32 batch_size;
   nnet3::NnetOptimizeOptions optimize_config;
   nnet3::NnetComputeOptions compute_config;
   RnnlmComputeStateComputationOptions():
@@ -48,7 +51,8 @@ struct RnnlmComputeStateComputationOptions {
       normalize_probs(false),
       bos_index(-1),
       eos_index(-1),
-      brk_index(-1)
+      brk_index(-1),
+      batch_size(16)
       { }
 
   void Register(OptionsItf *opts) {
@@ -64,6 +68,10 @@ struct RnnlmComputeStateComputationOptions {
     opts->Register("brk-symbol", &brk_index, "Index in wordlist representing "
                    "the break symbol. It is not needed in the computation "
                    "and we are including it for ease of scripting");
+    opts->Register("batch-size", &batch_size, "Maximum number of RNNLM "
+                   "states that are advanced together in a single computation "
+                   "(e.g. when rescoring lattices); if <= 1, states are "
+                   "advanced one at a time.");
 
     // Register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
@@ -93,6 +101,40 @@ class RnnlmComputeStateInfo  {
 
   // The compiled, 'looped' computation.
   nnet3::NnetComputation computation;
+
+  // The following are used by RnnlmComputeState::GetSuccessorStates() to
+  // advance many states at once.  They are only set up if opts.batch_size > 1;
+  // if batch_sizes is empty, batching is disabled.
+  //
+  // batch_sizes is 2, 4, 8, ... up to opts.batch_size, and
+  // batch_computations[i] is the looped computation for batch_sizes[i]
+  // sequences.
+  std::vector<int32> batch_sizes;
+  std::vector<nnet3::NnetComputation> batch_computations;
+  // batch_snapshots[i] is the snapshot of an NnetComputer for
+  // batch_computations[i] once it has become stable, i.e. once it returns to
+  // the same point in the computation after each word; stable_snapshot is
+  // the same thing for 'computation'.
+  std::vector<nnet3::NnetComputerSnapshot> batch_snapshots;
+  nnet3::NnetComputerSnapshot stable_snapshot;
+  // batch_first[i] is true if the i'th non-empty matrix of the stable
+  // computations stores the rows of each sequence contiguously (see
+  // NnetComputer::GetState()).
+  std::vector<bool> batch_first;
+
+ private:
+  // Compiles batch_computations and works out the snapshots; called from the
+  // constructor if opts.batch_size > 1.
+  void SetUpBatchComputations();
+
+  // Runs the looped computation 'computation' for 'num_sequences' sequences
+  // until it becomes stable, and outputs its snapshot; if num_sequences > 1
+  // it also works out 'batch_first'.  Returns false if it did not become
+  // stable, or the layout of the state could not be worked out.
+  bool GetStableSnapshot(const nnet3::NnetComputation &computation,
+                         int32 num_sequences,
+                         nnet3::NnetComputerSnapshot *snapshot,
+                         std::vector<bool> *batch_first) const;
 };
 
 /*
@@ -113,6 +155,18 @@ class RnnlmComputeState {
   /// The pointer is owned by the caller.
   RnnlmComputeState* GetSuccessorState(int32 next_word) const;
 
+  /// This is equivalent to setting (*successors)[i] to
+  /// states[i]->GetSuccessorState(next_words[i]) for each i, but the states
+  /// are advanced together in batches of up to opts.batch_size, which is much
+  /// faster than advancing them one by one.  (States that are within the
+  /// first few words of the sentence, where the looped computation is not yet
+  /// stable, are still advanced one by one).  All the states must share the
+  /// same RnnlmComputeStateInfo.  The pointers are owned by the caller.
+  static void GetSuccessorStates(
+      const std::vector<const RnnlmComputeState*> &states,
+      const std::vector<int32> &next_words,
+      std::vector<RnnlmComputeState*> *successors);
+
   /// Return the log-prob that the model predicts for the provided word-index,
   /// given the previous history determined by the sequence of calls to AddWord()
   /// (implicitly starting with the BOS symbol).
@@ -123,12 +177,39 @@ class RnnlmComputeState {
   // used in any computation by the caller. To avoid causing unexpected issues,
   // we here set it to a very small number
   void GetLogProbOfWords(CuMatrixBase<BaseFloat>* output) const;
+
+  /// This is a batched version of GetLogProbOfWords() which does a single
+  /// matrix multiplication: row i of 'output' is set to the log-probs of all
+  /// words given states[i].  'output' must have states.size() rows and as
+  /// many columns as there are words.
+  static void GetLogProbOfWords(
+      const std::vector<const RnnlmComputeState*> &states,
+      CuMatrixBase<BaseFloat> *output);
+
   /// Advance the state of the RNNLM by appending this word to the word sequence.
   void AddWord(int32 word_index);
  private:
+  /// This constructor is used in GetSuccessorStates(); it creates a state
+  /// whose computer is restored from 'snapshot', and the caller sets up the
+  /// rest.
+  RnnlmComputeState(const RnnlmComputeStateInfo &info,
+                    const nnet3::NnetComputerSnapshot &snapshot);
+
   /// This function does the computation for the next chunk.
   void AdvanceChunk();
 
+  /// Returns true if this state can be advanced by the batched computation in
+  /// GetSuccessorStates(), i.e. if batching is enabled and computer_ has
+  /// reached info_.stable_snapshot.
+  bool IsStable() const;
+
+  /// Advances 'states' (which must all be stable, and of which there must be
+  /// no more than the largest batch size) together in one computation.
+  static void AdvanceBatch(const RnnlmComputeStateInfo &info,
+                           const std::vector<const RnnlmComputeState*> &states,
+                           const std::vector<int32> &next_words,
+                           std::vector<RnnlmComputeState*> *successors);
+
   const RnnlmComputeStateInfo &info_;
   nnet3::NnetComputer computer_;
   int32 previous_word_;
@@ -137,9 +218,10 @@ class RnnlmComputeState {
   // Only used if config_.normalize_probs is set to be true.
   BaseFloat normalization_factor_;
 
-  // This points to the matrix returned by GetOutput() on the Nnet object.
-  // This pointer is not owned by this class.
-  const CuMatrixBase<BaseFloat> *predicted_word_embedding_;
+  // This is a copy of the output of the nnet for the most recent word.  (It is
+  // copied rather than pointing into computer_, because states created by
+  // GetSuccessorStates() get it from the batched computation).
+  CuVector<BaseFloat> predicted_word_embedding_;
 };
 
 
@@ -28,31 +28,74 @@
 namespace kaldi {
 namespace rnnlm {
 
+RnnlmComputeStateCache::RnnlmComputeStateCache(int32 cache_capacity):
+    cache_capacity_(cache_capacity), num_lookups_(0), num_hits_(0) {
+  KALDI_ASSERT(cache_capacity > 0);
+}
+
+std::shared_ptr<const RnnlmComputeState> RnnlmComputeStateCache::Find(
+    const std::vector<int32> &history) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  num_lookups_++;
+  CacheType::iterator iter = state_cache_.find(history);
+  if (iter == state_cache_.end())
+    return NULL;
+  num_hits_++;
+  // Move it to the end of the access queue, since it is now the most recently
+  // used.
+  access_queue_.splice(access_queue_.end(), access_queue_,
+                       iter->second.second);
+  return iter->second.first;
+}
+
+void RnnlmComputeStateCache::Insert(
+    const std::vector<int32> &history,
+    const std::shared_ptr<const RnnlmComputeState> &state) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (state_cache_.count(history) != 0)
+    return;  // Another thread may have computed it too.
+  if (static_cast<int32>(state_cache_.size()) >= cache_capacity_) {
+    // The cache is full; remove the least-recently-used state.
+    CacheType::iterator iter = state_cache_.find(*access_queue_.front());
+    KALDI_ASSERT(iter != state_cache_.end());
+    access_queue_.pop_front();
+    state_cache_.erase(iter);
+  }
+  std::pair<CacheType::iterator, bool> p = state_cache_.insert(
+      std::make_pair(history, std::make_pair(state, AqType::iterator())));
+  p.first->second.second = access_queue_.insert(access_queue_.end(),
+                                                &(p.first->first));
+}
+
+void RnnlmComputeStateCache::PrintStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  KALDI_LOG << "RNNLM history cache: " << num_lookups_ << " lookups, "
+            << num_hits_ << " hits (hit rate "
+            << (num_lookups_ == 0 ? 0.0 :
+                100.0 * num_hits_ / num_lookups_)
+            << "%), " << state_cache_.size() << " states cached.";
+}
+
 KaldiRnnlmDeterministicFst::~KaldiRnnlmDeterministicFst() {
-  int32 size = state_to_rnnlm_state_.size();
-  for (int32 i = 0; i < size; i++)
-    delete state_to_rnnlm_state_[i];
-  
   state_to_rnnlm_state_.resize(0);
   state_to_wseq_.resize(0);
   wseq_to_state_.clear();
+  pending_states_.clear();
 }
 
 void KaldiRnnlmDeterministicFst::Clear() {
   // This function is similar to the destructor but we retain the 0-th entries
   // in each map which corresponds to the <bos> state.
-  int32 size = state_to_rnnlm_state_.size();
-  for (int32 i = 1; i < size; i++)
-    delete state_to_rnnlm_state_[i];
-  
   state_to_rnnlm_state_.resize(1);
   state_to_wseq_.resize(1);
   wseq_to_state_.clear();
   wseq_to_state_[state_to_wseq_[0]] = 0;
+  pending_states_.clear();
 }
 
 KaldiRnnlmDeterministicFst::KaldiRnnlmDeterministicFst(int32 max_ngram_order,
-    const RnnlmComputeStateInfo &info) {
+    const RnnlmComputeStateInfo &info, RnnlmComputeStateCache *cache):
+    cache_(cache) {
   max_ngram_order_ = max_ngram_order;
   bos_index_ = info.opts.bos_index;
   eos_index_ = info.opts.eos_index;
@@ -60,7 +103,14 @@ KaldiRnnlmDeterministicFst::KaldiRnnlmDeterministicFst(int32 max_ngram_order,
   std::vector<Label> bos_seq;
   bos_seq.push_back(bos_index_);
   state_to_wseq_.push_back(bos_seq);
-  RnnlmComputeState *decodable_rnnlm = new RnnlmComputeState(info, bos_index_);
+  std::shared_ptr<const RnnlmComputeState> decodable_rnnlm;
+  if (IsCacheable(bos_seq))
+    decodable_rnnlm = cache_->Find(bos_seq);
+  if (decodable_rnnlm == NULL) {
+    decodable_rnnlm.reset(new RnnlmComputeState(info, bos_index_));
+    if (IsCacheable(bos_seq))
+      cache_->Insert(bos_seq, decodable_rnnlm);
+  }
   wseq_to_state_[bos_seq] = 0;
   start_state_ = 0;
 
@@ -71,7 +121,7 @@ fst::StdArc::Weight KaldiRnnlmDeterministicFst::Final(StateId s) {
   /// At this point, we have created the state.
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
 
-  RnnlmComputeState* rnn = state_to_rnnlm_state_[s];
+  const RnnlmComputeState* rnn = GetRnnlmState(s);
   return Weight(-rnn->LogProbOfWord(eos_index_));
 }
 
@@ -81,7 +131,7 @@ bool KaldiRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
   KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
 
   std::vector<Label> word_seq = state_to_wseq_[s];
-  const RnnlmComputeState* rnnlm = state_to_rnnlm_state_[s];
+  const RnnlmComputeState* rnnlm = GetRnnlmState(s);
 
   BaseFloat logprob = rnnlm->LogProbOfWord(ilabel);
 
@@ -102,8 +152,19 @@ bool KaldiRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
   std::pair<IterType, bool> result = wseq_to_state_.insert(wseq_state_pair);
 
   // If the pair was just inserted, then also add it to state_to_* structures.
+  // Its RNNLM state is taken from the cache if it's there (only possible for
+  // complete histories), or else computed later, in ComputePendingStates().
   if (result.second == true) {
-    RnnlmComputeState *rnnlm2 = rnnlm->GetSuccessorState(ilabel);
+    std::shared_ptr<const RnnlmComputeState> rnnlm2;
+    if (IsCacheable(word_seq))
+      rnnlm2 = cache_->Find(word_seq);
+    if (rnnlm2 == NULL) {
+      PendingState pending;
+      pending.state = result.first->second;
+      pending.prev_state = s;
+      pending.word = ilabel;
+      pending_states_.push_back(pending);
+    }
     state_to_wseq_.push_back(word_seq);
     state_to_rnnlm_state_.push_back(rnnlm2);
   }
@@ -116,5 +177,34 @@ bool KaldiRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
   return true;
 }
 
+const RnnlmComputeState *KaldiRnnlmDeterministicFst::GetRnnlmState(
+    StateId s) {
+  if (state_to_rnnlm_state_[s] == NULL)
+    ComputePendingStates();
+  KALDI_ASSERT(state_to_rnnlm_state_[s] != NULL);
+  return state_to_rnnlm_state_[s].get();
+}
+
+void KaldiRnnlmDeterministicFst::ComputePendingStates() {
+  int32 num_pending = pending_states_.size();
+  std::vector<const RnnlmComputeState*> prev_states(num_pending);
+  std::vector<int32> words(num_pending);
+  for (int32 i = 0; i < num_pending; i++) {
+    prev_states[i] =
+        state_to_rnnlm_state_[pending_states_[i].prev_state].get();
+    KALDI_ASSERT(prev_states[i] != NULL);
+    words[i] = pending_states_[i].word;
+  }
+  std::vector<RnnlmComputeState*> states;
+  RnnlmComputeState::GetSuccessorStates(prev_states, words, &states);
+  for (int32 i = 0; i < num_pending; i++) {
+    StateId state = pending_states_[i].state;
+    state_to_rnnlm_state_[state].reset(states[i]);
+    if (IsCacheable(state_to_wseq_[state]))
+      cache_->Insert(state_to_wseq_[state], state_to_rnnlm_state_[state]);
+  }
+  pending_states_.clear();
+}
+
 }  // namespace rnnlm
 }  // namespace kaldi
@@ -22,6 +22,9 @@
 #ifndef KALDI_RNNLM_RNNLM_LATTICE_RESCORING_H_
 #define KALDI_RNNLM_RNNLM_LATTICE_RESCORING_H_
 
+#include <list>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -33,6 +36,64 @@
 namespace kaldi {
 namespace rnnlm {
 
+/**
+   Class RnnlmComputeStateCache is a bounded cache of RNNLM states (the
+   hidden state of the RNNLM plus its output, from which the log-probs are
+   computed), indexed by word history.  It is used by
+   KaldiRnnlmDeterministicFst to avoid recomputing the states of histories
+   that occur in many lattices (e.g. "<s> yeah"); it is kept across
+   utterances, and may be shared between threads.  When it is full, the
+   least-recently-used state is removed.
+
+   KaldiRnnlmDeterministicFst only shares the states of complete histories
+   (those starting with the BOS symbol, i.e. not truncated to
+   max-ngram-order - 1 words), because the state of a truncated history
+   depends on which full history it was first reached by; so the results
+   do not depend on the order in which lattices are processed.
+
+   It's OK to call Find() and Insert() from multiple threads without
+   additional synchronization.
+*/
+class RnnlmComputeStateCache {
+ public:
+  explicit RnnlmComputeStateCache(int32 cache_capacity);
+
+  // Returns the state for this word history if cached, or NULL (as
+  // std::shared_ptr) if not.  (We use shared_ptr so that if the state is
+  // ejected from the cache by another thread, it won't be deleted while
+  // still in use).  This function also marks the state as most recently used,
+  // which is why it's not const.
+  std::shared_ptr<const RnnlmComputeState> Find(
+      const std::vector<int32> &history);
+
+  // Inserts the state for this word history into the cache (if there is
+  // already a state for this history, it is left unchanged).
+  void Insert(const std::vector<int32> &history,
+              const std::shared_ptr<const RnnlmComputeState> &state);
+
+  // Prints the number of lookups and the hit rate.
+  void PrintStats();
+
+ private:
+  std::mutex mutex_;
+
+  int32 cache_capacity_;
+
+  // The access queue, with the most recently used history at the end.  The
+  // pointers point to the keys of state_cache_.
+  typedef std::list<const std::vector<int32>*> AqType;
+  AqType access_queue_;
+
+  typedef unordered_map<std::vector<int32>,
+                        std::pair<std::shared_ptr<const RnnlmComputeState>,
+                                  AqType::iterator>,
+                        VectorHasher<int32> > CacheType;
+  CacheType state_cache_;
+
+  int64 num_lookups_;
+  int64 num_hits_;
+};
+
 class KaldiRnnlmDeterministicFst
     : public fst::DeterministicOnDemandFst<fst::StdArc> {
  public:
@@ -40,9 +101,12 @@ class KaldiRnnlmDeterministicFst
   typedef fst::StdArc::StateId StateId;
   typedef fst::StdArc::Label Label;
 
-  // Does not take ownership.
+  // Does not take ownership.  If 'cache' is non-NULL, the RNNLM states of
+  // complete (non-truncated) histories are looked up in it before being
+  // computed, and computed states of such histories are added to it.
   KaldiRnnlmDeterministicFst(int32 max_ngram_order,
-      const RnnlmComputeStateInfo &info);
+      const RnnlmComputeStateInfo &info,
+      RnnlmComputeStateCache *cache = NULL);
   ~KaldiRnnlmDeterministicFst();
 
   void Clear();
@@ -58,6 +122,22 @@ class KaldiRnnlmDeterministicFst
   virtual bool GetArc(StateId s, Label ilabel, fst::StdArc* oarc);
 
  private:
+  // Returns the RNNLM state for state s; if it has not been computed yet,
+  // computes it along with all the other pending states.
+  const RnnlmComputeState *GetRnnlmState(StateId s);
+
+  // Computes the RNNLM states of all the states in pending_states_, using
+  // the batched computation.
+  void ComputePendingStates();
+
+  // Returns true if the RNNLM state for this history may be shared via
+  // cache_, i.e. if it was not truncated to max_ngram_order_ - 1 words (so
+  // it starts with the BOS symbol) and the state is thus fully determined by
+  // the history.
+  bool IsCacheable(const std::vector<Label> &wseq) const {
+    return cache_ != NULL && !wseq.empty() && wseq[0] == bos_index_;
+  }
+
   typedef unordered_map
       <std::vector<Label>, StateId, VectorHasher<Label> > MapType;
   StateId start_state_;
@@ -70,9 +150,27 @@ class KaldiRnnlmDeterministicFst
   // Mapping from state-id to history sequence>
   std::vector<std::vector<Label> > state_to_wseq_;
 
-  // Mapping from state-id to RNNLM states.
-  // The pointers are owned in this class
-  std::vector<RnnlmComputeState*> state_to_rnnlm_state_;
+  // Mapping from state-id to RNNLM states.  They are NULL for states in
+  // pending_states_.  (They are shared pointers because they may be shared
+  // with cache_).
+  std::vector<std::shared_ptr<const RnnlmComputeState> > state_to_rnnlm_state_;
+
+  // A state whose RNNLM state has not been computed yet: it is the successor
+  // of 'prev_state' (whose RNNLM state has been computed) with word 'word'.
+  struct PendingState {
+    StateId state;
+    StateId prev_state;
+    Label word;
+  };
+  // The states created by GetArc() whose RNNLM states have not been computed
+  // yet.  We compute them lazily, when one of them is needed, so that they
+  // can all be computed in one batch; the states that the composition
+  // creates between accesses (e.g. from all the arcs leaving a lattice
+  // state) form the batch.
+  std::vector<PendingState> pending_states_;
+
+  // Not owned; may be NULL.
+  RnnlmComputeStateCache *cache_;
 
 };
 